@@ -2,6 +2,7 @@
 
 #include <base/Error.hpp>
 #include <base/File.hpp>
+#include <base/hash/Fnv.hpp>
 
 class BinaryFileView {
   std::span<const uint8_t> data;
@@ -32,6 +33,55 @@ class BinaryFileView {
   const uint8_t* raw() const { return data.data(); }
 };
 
+static uint64_t content_hash(std::span<const uint8_t> binary) {
+  base::Fnv1a hash;
+  hash.feed(binary.data(), binary.size());
+  return hash.hash();
+}
+
+static std::vector<uint64_t> function_addresses(BinaryFileView elf) {
+  const auto sh_offset = elf.read64(0x28);
+  const auto she_size = elf.read16(0x3a);
+  const auto she_count = elf.read16(0x3c);
+
+  std::vector<uint64_t> addresses;
+
+  if (sh_offset == 0) {
+    return addresses;
+  }
+
+  verify(she_size == 0x40, "unexpected image section header entry size");
+
+  for (uint32_t i = 0; i < she_count; ++i) {
+    const auto sh = elf.slice(sh_offset + i * she_size, she_size);
+
+    // Skip everything except SHT_SYMTAB.
+    const auto type = sh.read32(0x04);
+    if (type != 2) {
+      continue;
+    }
+
+    const auto symbols_offset = sh.read64(0x18);
+    const auto symbols_size = sh.read64(0x20);
+    const auto symbol_size = sh.read64(0x38);
+
+    verify(symbol_size == 0x18, "unexpected image symbol size");
+
+    const auto symbols = elf.slice(symbols_offset, symbols_size);
+    for (uint64_t offset = 0; offset + symbol_size <= symbols_size; offset += symbol_size) {
+      // Only defined STT_FUNC symbols.
+      const auto info = symbols.read8(offset + 0x04);
+      const auto section_index = symbols.read16(offset + 0x06);
+      const auto value = symbols.read64(offset + 0x08);
+      if ((info & 0xf) == 2 && section_index != 0 && value != 0) {
+        addresses.push_back(value);
+      }
+    }
+  }
+
+  return addresses;
+}
+
 ElfLoader::Image ElfLoader::load(const std::string& file_path, vm::Memory& memory) {
   const auto file = base::File::read_binary_file(file_path);
   return load(file, memory);
@@ -116,5 +166,7 @@ ElfLoader::Image ElfLoader::load(std::span<const uint8_t> binary, vm::Memory& me
     .base = base_address,
     .size = aligned_size,
     .entrypoint = entrypoint,
+    .content_hash = content_hash(binary),
+    .function_addresses = function_addresses(elf),
   };
 }
@@ -1,6 +1,7 @@
 #pragma once
 #include <span>
 #include <string>
+#include <vector>
 
 #include <vm/Memory.hpp>
 
@@ -10,6 +11,12 @@ class ElfLoader {
     uint64_t base{};
     uint64_t size{};
     uint64_t entrypoint{};
+
+    // Hash of the whole ELF file.
+    uint64_t content_hash{};
+
+    // Addresses of function symbols from the symbol table (empty for stripped images).
+    std::vector<uint64_t> function_addresses;
   };
 
   static Image load(const std::string& file_path, vm::Memory& memory);
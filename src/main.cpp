@@ -3,22 +3,59 @@
 #include <base/Error.hpp>
 #include <base/Initialization.hpp>
 #include <base/Log.hpp>
+#include <base/Parsing.hpp>
 #include <base/Print.hpp>
+#include <base/concurrency/CoreCount.hpp>
 #include <base/time/Stopwatch.hpp>
 
 #include <vm/Cpu.hpp>
 #include <vm/Vm.hpp>
 
+#include <string>
+#include <string_view>
+#include <vector>
+
 int main(int argc, const char* argv[]) {
   base::initialize();
 
-  if (argc != 2) {
-    log_info("usage: riscv64_emulator [elf image path]");
+  if (argc < 2) {
+    log_info(
+      "usage: riscv64_emulator [elf image path] [hart count] [--pretranslate] "
+      "[--translation-cache path]");
     return 1;
   }
 
   const auto elf_path = argv[1];
 
+  int next_argument = 2;
+
+  size_t hart_count = 1;
+  if (next_argument < argc && argv[next_argument][0] != '-') {
+    if (!base::parse_integer(argv[next_argument], hart_count) || hart_count == 0) {
+      log_error("invalid hart count: {}", argv[next_argument]);
+      return 1;
+    }
+    next_argument++;
+  }
+
+  bool pretranslate = false;
+
+  // Cached code gets executed so the cache is only used when asked for.
+  std::string translation_cache_path;
+
+  for (; next_argument < argc; ++next_argument) {
+    const std::string_view option = argv[next_argument];
+
+    if (option == "--pretranslate") {
+      pretranslate = true;
+    } else if (option == "--translation-cache" && next_argument + 1 < argc) {
+      translation_cache_path = argv[++next_argument];
+    } else {
+      log_error("unknown option: {}", option);
+      return 1;
+    }
+  }
+
   vm::Vm vm{32 * 1024 * 1024};
 
   log_info("loading {}...", elf_path);
@@ -30,29 +67,79 @@ int main(int argc, const char* argv[]) {
   {
     const auto max_executable_address = image.base + image.size;
 
-    auto code_buffer = std::make_shared<vm::jit::CodeBuffer>(
-      vm::jit::CodeBuffer::Flags::None, 16 * 1024 * 1024, max_executable_address);
+    const auto code_buffer_flags = hart_count > 1 ? vm::jit::CodeBuffer::Flags::Multithreaded
+                                                  : vm::jit::CodeBuffer::Flags::None;
+
+    // Memory is committed as code gets generated, blocks are flushed once the limit is reached.
+    constexpr size_t max_code_size = 128 * 1024 * 1024;
+
+    auto code_buffer = std::make_shared<vm::jit::CodeBuffer>(code_buffer_flags, max_code_size,
+                                                             max_executable_address);
     code_buffer->dump_code_to_file("jit_dump.bin");
 
     vm.use_jit(std::move(code_buffer));
   }
 
-  vm::Cpu cpu;
-  cpu.set_reg(vm::Register::Sp, image.base - 8);
-  cpu.set_reg(vm::Register::Pc, image.entrypoint);
+  // Blocks compiled by previous runs of the same image are reused.
+  if (!translation_cache_path.empty()) {
+    const auto cached_blocks =
+      vm.load_translation_cache(translation_cache_path, image.content_hash);
+    log_info("loaded {} blocks from the translation cache", cached_blocks);
+  }
+
+  if (pretranslate) {
+    std::vector<uint64_t> entry_points = image.function_addresses;
+    entry_points.push_back(image.entrypoint);
+
+    base::Stopwatch pretranslation_stopwatch;
+    const auto pretranslated_blocks = vm.pretranslate(entry_points, base::core_count());
+    log_info("pretranslated {} blocks in {}", pretranslated_blocks,
+             pretranslation_stopwatch.elapsed());
+  }
+
+  // Every hart gets its own stack below the image and its ID in a0.
+  constexpr uint64_t hart_stack_size = 1024 * 1024;
+
+  if (image.base < 8 || hart_count > (image.base - 8) / hart_stack_size) {
+    log_error("{} hart stacks don't fit below the image at {:x}", hart_count, image.base);
+    return 1;
+  }
+
+  const auto stacks_size = hart_count * hart_stack_size + 8;
+  vm.memory().set_permissions(image.base - stacks_size, stacks_size,
+                              vm::MemoryFlags::Read | vm::MemoryFlags::Write);
+
+  std::vector<vm::Cpu> cpus(hart_count);
+  for (size_t hart_id = 0; hart_id < hart_count; ++hart_id) {
+    auto& cpu = cpus[hart_id];
+    cpu.set_reg(vm::Register::Sp, image.base - 8 - hart_id * hart_stack_size);
+    cpu.set_reg(vm::Register::Pc, image.entrypoint);
+    cpu.set_reg(vm::Register::A0, hart_id);
+  }
 
   base::Stopwatch stopwatch;
 
-  const auto exit = vm.run(cpu);
+  const auto exits = vm.run_harts(cpus);
   const auto execution_time = stopwatch.elapsed();
 
-  log_info("exited the VM in {} with reason: {}", execution_time, exit.reason);
-  log_info("pc: {:#x}", cpu.pc());
-  if (exit.reason == vm::Exit::Reason::MemoryReadFault ||
-      exit.reason == vm::Exit::Reason::MemoryWriteFault) {
-    log_info("faulty address: {:#x}", exit.faulty_address);
-    if (exit.reason == vm::Exit::Reason::MemoryWriteFault) {
-      log_info("written value: {}", cpu.reg(exit.target_register));
+  log_info("exited the VM in {}", execution_time);
+
+  if (!translation_cache_path.empty()) {
+    vm.save_translation_cache(translation_cache_path, image.content_hash);
+  }
+
+  for (size_t hart_id = 0; hart_id < hart_count; ++hart_id) {
+    const auto& cpu = cpus[hart_id];
+    const auto& exit = exits[hart_id];
+
+    log_info("hart {} exit reason: {}", hart_id, exit.reason);
+    log_info("pc: {:#x}", cpu.pc());
+    if (exit.reason == vm::Exit::Reason::MemoryReadFault ||
+        exit.reason == vm::Exit::Reason::MemoryWriteFault) {
+      log_info("faulty address: {:#x}", exit.faulty_address);
+      if (exit.reason == vm::Exit::Reason::MemoryWriteFault) {
+        log_info("written value: {}", cpu.reg(exit.target_register));
+      }
     }
   }
 }
@@ -10,6 +10,9 @@ class Cpu {
   uint64_t reg(Register reg) const { return registers.get(reg); }
   void set_reg(Register reg, uint64_t value) { return registers.set(reg, value); }
 
+  uint64_t reg(FloatRegister reg) const { return registers.get(reg); }
+  void set_reg(FloatRegister reg, uint64_t value) { return registers.set(reg, value); }
+
   uint64_t pc() const { return reg(Register::Pc); }
 
   RegisterState& register_state() { return registers; }
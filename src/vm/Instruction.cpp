@@ -1,4 +1,5 @@
 #include "Instruction.hpp"
+#include "Memory.hpp"
 #include "private/InstructionDisplay.hpp"
 
 #include <base/Error.hpp>
@@ -9,6 +10,11 @@ static uint32_t sign32(uint32_t value) {
   return uint32_t(int32_t(value & 0x8000'0000) >> 31);
 }
 
+static uint32_t sign_extend(uint32_t value, uint32_t bits) {
+  const auto shift = 32 - bits;
+  return uint32_t(int32_t(value << shift) >> shift);
+}
+
 namespace vm {
 struct InstructionDecoder {
   uint32_t instruction;
@@ -51,16 +57,61 @@ struct InstructionDecoder {
             // clang-format on
 
           case 0b001: {
-            if (shtype == 0b00'0000) {
-              return decoded(InstructionType::Slli, shamt);
+            switch (shtype) {
+                // clang-format off
+              case 0b00'0000: return decoded(InstructionType::Slli, shamt);
+              case 0b00'1010: return decoded(InstructionType::Bseti, shamt);
+              case 0b01'0010: return decoded(InstructionType::Bclri, shamt);
+              case 0b01'1010: return decoded(InstructionType::Binvi, shamt);
+                // clang-format on
+
+              case 0b01'1000: {
+                switch (shamt) {
+                    // clang-format off
+                  case 0b00'0000: return decoded(InstructionType::Clz, 0);
+                  case 0b00'0001: return decoded(InstructionType::Ctz, 0);
+                  case 0b00'0010: return decoded(InstructionType::Cpop, 0);
+                  case 0b00'0100: return decoded(InstructionType::SextB, 0);
+                  case 0b00'0101: return decoded(InstructionType::SextH, 0);
+                    // clang-format on
+
+                  default:
+                    break;
+                }
+                break;
+              }
+
+              default:
+                break;
             }
             break;
           }
 
           case 0b101: {
-            if (shtype == 0b00'0000 || shtype == 0b01'0000) {
-              return decoded(shtype == 0b00'0000 ? InstructionType::Srli : InstructionType::Srai,
-                             shamt);
+            switch (shtype) {
+                // clang-format off
+              case 0b00'0000: return decoded(InstructionType::Srli, shamt);
+              case 0b01'0000: return decoded(InstructionType::Srai, shamt);
+              case 0b01'1000: return decoded(InstructionType::Rori, shamt);
+              case 0b01'0010: return decoded(InstructionType::Bexti, shamt);
+                // clang-format on
+
+              case 0b00'1010: {
+                if (shamt == 0b00'0111) {
+                  return decoded(InstructionType::OrcB, 0);
+                }
+                break;
+              }
+
+              case 0b01'1010: {
+                if (shamt == 0b11'1000) {
+                  return decoded(InstructionType::Rev8, 0);
+                }
+                break;
+              }
+
+              default:
+                break;
             }
             break;
           }
@@ -68,6 +119,8 @@ struct InstructionDecoder {
           default:
             break;
         }
+
+        break;
       }
 
       case 0b000'0011: {
@@ -101,15 +154,33 @@ struct InstructionDecoder {
             if (shtype32 == 0b000'0000) {
               return set_decoded(InstructionType::Slliw, rd, rs1, 0, shamt32);
             }
+            if (shtype == 0b00'0010) {
+              return set_decoded(InstructionType::SlliUw, rd, rs1, 0, shamt);
+            }
+            if (shtype32 == 0b011'0000) {
+              switch (shamt32) {
+                  // clang-format off
+                case 0b0'0000: return set_decoded(InstructionType::Clzw, rd, rs1, 0, 0);
+                case 0b0'0001: return set_decoded(InstructionType::Ctzw, rd, rs1, 0, 0);
+                case 0b0'0010: return set_decoded(InstructionType::Cpopw, rd, rs1, 0, 0);
+                  // clang-format on
+
+                default:
+                  break;
+              }
+            }
             break;
           }
 
           case 0b101: {
-            if (shtype32 == 0b000'0000 || shtype == 0b010'0000) {
+            if (shtype32 == 0b000'0000 || shtype32 == 0b010'0000) {
               return set_decoded(
                 shtype32 == 0b000'0000 ? InstructionType::Srliw : InstructionType::Sraiw, rd, rs1,
                 0, shamt32);
             }
+            if (shtype32 == 0b011'0000) {
+              return set_decoded(InstructionType::Roriw, rd, rs1, 0, shamt32);
+            }
             break;
           }
 
@@ -127,6 +198,35 @@ struct InstructionDecoder {
                                0);
           }
         }
+
+        const auto csr = imm & 0xfff;
+
+        switch (funct3) {
+            // clang-format off
+          case 0b001: return set_decoded(InstructionType::Csrrw, rd, rs1, 0, csr);
+          case 0b010: return set_decoded(InstructionType::Csrrs, rd, rs1, 0, csr);
+          case 0b011: return set_decoded(InstructionType::Csrrc, rd, rs1, 0, csr);
+          case 0b101: return set_decoded(InstructionType::Csrrwi, rd, rs1, 0, csr);
+          case 0b110: return set_decoded(InstructionType::Csrrsi, rd, rs1, 0, csr);
+          case 0b111: return set_decoded(InstructionType::Csrrci, rd, rs1, 0, csr);
+            // clang-format on
+
+          default:
+            break;
+        }
+        break;
+      }
+
+      case 0b000'0111: {
+        switch (funct3) {
+            // clang-format off
+          case 0b010: return set_decoded(InstructionType::Flw, rd, rs1, 0, imm);
+          case 0b011: return set_decoded(InstructionType::Fld, rd, rs1, 0, imm);
+            // clang-format on
+
+          default:
+            break;
+        }
         break;
       }
 
@@ -134,6 +234,9 @@ struct InstructionDecoder {
         if (funct3 == 0) {
           return set_decoded(InstructionType::Fence, rd, rs1, 0, imm);
         }
+        if (funct3 == 0b001) {
+          return set_decoded(InstructionType::FenceI, rd, rs1, 0, imm);
+        }
         break;
       }
 
@@ -204,6 +307,9 @@ struct InstructionDecoder {
                 // clang-format off
               case 0b000: return decoded(InstructionType::Sub);
               case 0b101: return decoded(InstructionType::Sra);
+              case 0b100: return decoded(InstructionType::Xnor);
+              case 0b110: return decoded(InstructionType::Orn);
+              case 0b111: return decoded(InstructionType::Andn);
                 // clang-format on
               default:
                 break;
@@ -211,6 +317,71 @@ struct InstructionDecoder {
             break;
           }
 
+          case 0b001'0000: {
+            switch (funct3) {
+                // clang-format off
+              case 0b010: return decoded(InstructionType::Sh1add);
+              case 0b100: return decoded(InstructionType::Sh2add);
+              case 0b110: return decoded(InstructionType::Sh3add);
+                // clang-format on
+              default:
+                break;
+            }
+            break;
+          }
+
+          case 0b000'0101: {
+            switch (funct3) {
+                // clang-format off
+              case 0b100: return decoded(InstructionType::Min);
+              case 0b101: return decoded(InstructionType::Minu);
+              case 0b110: return decoded(InstructionType::Max);
+              case 0b111: return decoded(InstructionType::Maxu);
+                // clang-format on
+              default:
+                break;
+            }
+            break;
+          }
+
+          case 0b011'0000: {
+            switch (funct3) {
+                // clang-format off
+              case 0b001: return decoded(InstructionType::Rol);
+              case 0b101: return decoded(InstructionType::Ror);
+                // clang-format on
+              default:
+                break;
+            }
+            break;
+          }
+
+          case 0b010'0100: {
+            switch (funct3) {
+                // clang-format off
+              case 0b001: return decoded(InstructionType::Bclr);
+              case 0b101: return decoded(InstructionType::Bext);
+                // clang-format on
+              default:
+                break;
+            }
+            break;
+          }
+
+          case 0b011'0100: {
+            if (funct3 == 0b001) {
+              return decoded(InstructionType::Binv);
+            }
+            break;
+          }
+
+          case 0b001'0100: {
+            if (funct3 == 0b001) {
+              return decoded(InstructionType::Bset);
+            }
+            break;
+          }
+
           case 0b000'0001: {
             switch (funct3) {
                 // clang-format off
@@ -263,6 +434,41 @@ struct InstructionDecoder {
             break;
           }
 
+          case 0b000'0100: {
+            if (funct3 == 0b000) {
+              return decoded(InstructionType::AddUw);
+            }
+            if (funct3 == 0b100 && rs2 == 0) {
+              return set_decoded(InstructionType::ZextH, rd, rs1, 0, 0);
+            }
+            break;
+          }
+
+          case 0b001'0000: {
+            switch (funct3) {
+                // clang-format off
+              case 0b010: return decoded(InstructionType::Sh1addUw);
+              case 0b100: return decoded(InstructionType::Sh2addUw);
+              case 0b110: return decoded(InstructionType::Sh3addUw);
+                // clang-format on
+              default:
+                break;
+            }
+            break;
+          }
+
+          case 0b011'0000: {
+            switch (funct3) {
+                // clang-format off
+              case 0b001: return decoded(InstructionType::Rolw);
+              case 0b101: return decoded(InstructionType::Rorw);
+                // clang-format on
+              default:
+                break;
+            }
+            break;
+          }
+
           case 0b000'0001: {
             switch (funct3) {
                 // clang-format off
@@ -288,6 +494,50 @@ struct InstructionDecoder {
     }
   }
 
+  void decode_atype(uint32_t opcode) {
+    const auto rd = (instruction >> 7) & 0b11111;
+    const auto rs1 = (instruction >> 15) & 0b11111;
+    const auto rs2 = (instruction >> 20) & 0b11111;
+
+    const auto funct3 = (instruction >> 12) & 0b111;
+    const auto funct5 = (instruction >> 27) & 0b11111;
+
+    if (opcode != 0b010'1111 || (funct3 != 0b010 && funct3 != 0b011)) {
+      return;
+    }
+
+    // Ordering bits (aq and rl) are ignored, all atomics are executed as sequentially consistent.
+    const auto decoded = [this, rd, rs1, rs2, funct3](InstructionType type32,
+                                                      InstructionType type64) {
+      return set_decoded(funct3 == 0b010 ? type32 : type64, rd, rs1, rs2, 0);
+    };
+
+    switch (funct5) {
+        // clang-format off
+      case 0b00011: return decoded(InstructionType::ScW, InstructionType::ScD);
+      case 0b00001: return decoded(InstructionType::AmoswapW, InstructionType::AmoswapD);
+      case 0b00000: return decoded(InstructionType::AmoaddW, InstructionType::AmoaddD);
+      case 0b00100: return decoded(InstructionType::AmoxorW, InstructionType::AmoxorD);
+      case 0b01100: return decoded(InstructionType::AmoandW, InstructionType::AmoandD);
+      case 0b01000: return decoded(InstructionType::AmoorW, InstructionType::AmoorD);
+      case 0b10000: return decoded(InstructionType::AmominW, InstructionType::AmominD);
+      case 0b10100: return decoded(InstructionType::AmomaxW, InstructionType::AmomaxD);
+      case 0b11000: return decoded(InstructionType::AmominuW, InstructionType::AmominuD);
+      case 0b11100: return decoded(InstructionType::AmomaxuW, InstructionType::AmomaxuD);
+        // clang-format on
+
+      case 0b00010: {
+        if (rs2 == 0) {
+          return decoded(InstructionType::LrW, InstructionType::LrD);
+        }
+        break;
+      }
+
+      default:
+        break;
+    }
+  }
+
   void decode_stype(uint32_t opcode) {
     const auto imm0_4 = (instruction >> 7) & 0b11111;
     const auto imm5_10 = (instruction >> 25) & 0b11'1111;
@@ -316,6 +566,262 @@ struct InstructionDecoder {
           break;
       }
     }
+
+    if (opcode == 0b010'0111) {
+      switch (funct3) {
+          // clang-format off
+        case 0b010: return set_decoded(InstructionType::Fsw, 0, rs1, rs2, imm);
+        case 0b011: return set_decoded(InstructionType::Fsd, 0, rs1, rs2, imm);
+          // clang-format on
+
+        default:
+          break;
+      }
+    }
+  }
+
+  // Vector instructions store their whole encoding in `b`. Only the instruction class (which
+  // determines scalar register operands) is decoded here, unsupported operations are rejected
+  // during execution.
+  void decode_vector(uint32_t opcode) {
+    using IT = InstructionType;
+
+    const auto rd = (instruction >> 7) & 0b11111;
+    const auto rs1 = (instruction >> 15) & 0b11111;
+    const auto rs2 = (instruction >> 20) & 0b11111;
+
+    const auto funct3 = (instruction >> 12) & 0b111;
+    const auto funct6 = instruction >> 26;
+
+    const auto decoded = [&](InstructionType type) {
+      return set_decoded(type, rd, rs1, rs2, instruction);
+    };
+
+    if (opcode == 0b000'0111 || opcode == 0b010'0111) {
+      const auto load = opcode == 0b000'0111;
+
+      const auto mop = (instruction >> 26) & 0b11;
+      const auto mew = (instruction >> 28) & 0b1;
+      const auto nf = instruction >> 29;
+
+      if (mew != 0) {
+        return;
+      }
+
+      // Unit-stride (`rs2` selects the variant) and strided accesses. Indexed accesses and
+      // segment accesses are not supported.
+      if (mop == 0b00) {
+        const auto whole_register = rs2 == 0b01000 && (nf == 0 || nf == 1 || nf == 3 || nf == 7);
+        const auto mask = rs2 == 0b01011 && nf == 0 && funct3 == 0b000;
+        const auto fault_only_first = load && rs2 == 0b10000 && nf == 0;
+
+        if ((rs2 == 0 && nf == 0) || whole_register || mask || fault_only_first) {
+          return decoded(load ? IT::VectorLoad : IT::VectorStore);
+        }
+      } else if (mop == 0b10 && nf == 0) {
+        return decoded(load ? IT::VectorLoadStrided : IT::VectorStoreStrided);
+      }
+
+      return;
+    }
+
+    switch (funct3) {
+      case 0b111: {
+        if ((instruction >> 31) == 0) {
+          return decoded(IT::Vsetvli);
+        }
+        if ((instruction >> 30) == 0b11) {
+          return decoded(IT::Vsetivli);
+        }
+        if ((instruction >> 25) == 0b100'0000) {
+          return decoded(IT::Vsetvl);
+        }
+        return;
+      }
+
+      // OPIVX and OPMVX.
+      case 0b100:
+      case 0b110:
+        return decoded(IT::VectorOperationScalar);
+
+      // OPMVV `vmv.x.s`, `vcpop.m` and `vfirst.m`.
+      case 0b010: {
+        if (funct6 == 0b01'0000) {
+          return decoded(IT::VectorMoveToScalar);
+        }
+        return decoded(IT::VectorOperation);
+      }
+
+      default:
+        return decoded(IT::VectorOperation);
+    }
+  }
+
+  void decode_float(uint32_t opcode) {
+    using IT = InstructionType;
+
+    const auto rd = (instruction >> 7) & 0b11111;
+    const auto rs1 = (instruction >> 15) & 0b11111;
+    const auto rs2 = (instruction >> 20) & 0b11111;
+    const auto rs3 = (instruction >> 27) & 0b11111;
+
+    const auto funct3 = (instruction >> 12) & 0b111;
+    const auto funct7 = (instruction >> 25) & 0b111'1111;
+    const auto format = funct7 & 0b11;
+
+    // Rounding modes 5 and 6 are reserved.
+    const auto rm = funct3;
+    const auto valid_rm = rm <= 0b100 || rm == 0b111;
+
+    if (format != 0b00 && format != 0b01) {
+      return;
+    }
+
+    const auto single = format == 0b00;
+
+    // Instructions with the rounding mode.
+    const auto rounded = [&](InstructionType type32, InstructionType type64) {
+      if (valid_rm) {
+        set_decoded(single ? type32 : type64, rd, rs1, rs2, rm | (rs3 << 3));
+      }
+    };
+    // Instructions which use the rounding mode field to select the operation.
+    const auto decoded = [&](InstructionType type32, InstructionType type64) {
+      set_decoded(single ? type32 : type64, rd, rs1, rs2, 0);
+    };
+
+    switch (opcode) {
+        // clang-format off
+      case 0b100'0011: return rounded(IT::FmaddS, IT::FmaddD);
+      case 0b100'0111: return rounded(IT::FmsubS, IT::FmsubD);
+      case 0b100'1011: return rounded(IT::FnmsubS, IT::FnmsubD);
+      case 0b100'1111: return rounded(IT::FnmaddS, IT::FnmaddD);
+        // clang-format on
+
+      default:
+        break;
+    }
+
+    if (opcode != 0b101'0011) {
+      return;
+    }
+
+    switch (funct7 >> 2) {
+        // clang-format off
+      case 0b00000: return rounded(IT::FaddS, IT::FaddD);
+      case 0b00001: return rounded(IT::FsubS, IT::FsubD);
+      case 0b00010: return rounded(IT::FmulS, IT::FmulD);
+      case 0b00011: return rounded(IT::FdivS, IT::FdivD);
+        // clang-format on
+
+      case 0b01011: {
+        if (rs2 == 0) {
+          return rounded(IT::FsqrtS, IT::FsqrtD);
+        }
+        break;
+      }
+
+      case 0b00100: {
+        switch (funct3) {
+            // clang-format off
+          case 0b000: return decoded(IT::FsgnjS, IT::FsgnjD);
+          case 0b001: return decoded(IT::FsgnjnS, IT::FsgnjnD);
+          case 0b010: return decoded(IT::FsgnjxS, IT::FsgnjxD);
+            // clang-format on
+          default:
+            break;
+        }
+        break;
+      }
+
+      case 0b00101: {
+        switch (funct3) {
+            // clang-format off
+          case 0b000: return decoded(IT::FminS, IT::FminD);
+          case 0b001: return decoded(IT::FmaxS, IT::FmaxD);
+            // clang-format on
+          default:
+            break;
+        }
+        break;
+      }
+
+      case 0b01000: {
+        // fcvt.s.d and fcvt.d.s, source format is in the rs2 field.
+        if (single && rs2 == 0b00001) {
+          return rounded(IT::FcvtSD, IT::FcvtSD);
+        }
+        if (!single && rs2 == 0b00000) {
+          return rounded(IT::FcvtDS, IT::FcvtDS);
+        }
+        break;
+      }
+
+      case 0b11000: {
+        switch (rs2) {
+            // clang-format off
+          case 0b00000: return rounded(IT::FcvtWS, IT::FcvtWD);
+          case 0b00001: return rounded(IT::FcvtWuS, IT::FcvtWuD);
+          case 0b00010: return rounded(IT::FcvtLS, IT::FcvtLD);
+          case 0b00011: return rounded(IT::FcvtLuS, IT::FcvtLuD);
+            // clang-format on
+          default:
+            break;
+        }
+        break;
+      }
+
+      case 0b11010: {
+        switch (rs2) {
+            // clang-format off
+          case 0b00000: return rounded(IT::FcvtSW, IT::FcvtDW);
+          case 0b00001: return rounded(IT::FcvtSWu, IT::FcvtDWu);
+          case 0b00010: return rounded(IT::FcvtSL, IT::FcvtDL);
+          case 0b00011: return rounded(IT::FcvtSLu, IT::FcvtDLu);
+            // clang-format on
+          default:
+            break;
+        }
+        break;
+      }
+
+      case 0b11100: {
+        if (rs2 == 0) {
+          switch (funct3) {
+              // clang-format off
+            case 0b000: return decoded(IT::FmvXW, IT::FmvXD);
+            case 0b001: return decoded(IT::FclassS, IT::FclassD);
+              // clang-format on
+            default:
+              break;
+          }
+        }
+        break;
+      }
+
+      case 0b11110: {
+        if (rs2 == 0 && funct3 == 0b000) {
+          return decoded(IT::FmvWX, IT::FmvDX);
+        }
+        break;
+      }
+
+      case 0b10100: {
+        switch (funct3) {
+            // clang-format off
+          case 0b010: return decoded(IT::FeqS, IT::FeqD);
+          case 0b001: return decoded(IT::FltS, IT::FltD);
+          case 0b000: return decoded(IT::FleS, IT::FleD);
+            // clang-format on
+          default:
+            break;
+        }
+        break;
+      }
+
+      default:
+        break;
+    }
   }
 
   void decode_btype(uint32_t opcode) {
@@ -365,6 +871,253 @@ struct InstructionDecoder {
     }
   }
 
+  void decode_compressed_instruction() {
+    using IT = InstructionType;
+
+    const auto field = [this](uint32_t first_bit, uint32_t bit_count) {
+      return (instruction >> first_bit) & ((uint32_t(1) << bit_count) - 1);
+    };
+
+    constexpr uint32_t zero = 0;
+    constexpr uint32_t ra = 1;
+    constexpr uint32_t sp = 2;
+
+    const auto quadrant = field(0, 2);
+    const auto funct3 = field(13, 3);
+
+    // Full register fields (CR and CI formats) and 3 bit register fields which encode x8-x15.
+    const auto rd = field(7, 5);
+    const auto rs2 = field(2, 5);
+    const auto rs1_prime = field(7, 3) + 8;
+    const auto rs2_prime = field(2, 3) + 8;
+
+    const auto imm6 = sign_extend(field(2, 5) | (field(12, 1) << 5), 6);
+    const auto shamt = field(2, 5) | (field(12, 1) << 5);
+
+    switch (quadrant) {
+      case 0b00: {
+        const auto offset_w = (field(6, 1) << 2) | (field(10, 3) << 3) | (field(5, 1) << 6);
+        const auto offset_d = (field(10, 3) << 3) | (field(5, 2) << 6);
+
+        switch (funct3) {
+            // clang-format off
+          case 0b001: return set_decoded(IT::Fld, rs2_prime, rs1_prime, 0, offset_d);
+          case 0b010: return set_decoded(IT::Lw, rs2_prime, rs1_prime, 0, offset_w);
+          case 0b011: return set_decoded(IT::Ld, rs2_prime, rs1_prime, 0, offset_d);
+          case 0b101: return set_decoded(IT::Fsd, 0, rs1_prime, rs2_prime, offset_d);
+          case 0b110: return set_decoded(IT::Sw, 0, rs1_prime, rs2_prime, offset_w);
+          case 0b111: return set_decoded(IT::Sd, 0, rs1_prime, rs2_prime, offset_d);
+            // clang-format on
+
+          case 0b000: {
+            // c.addi4spn
+            const auto imm = (field(6, 1) << 2) | (field(5, 1) << 3) | (field(11, 2) << 4) |
+                             (field(7, 4) << 6);
+            if (imm != 0) {
+              return set_decoded(IT::Addi, rs2_prime, sp, 0, imm);
+            }
+            break;
+          }
+
+          default:
+            break;
+        }
+
+        break;
+      }
+
+      case 0b01: {
+        switch (funct3) {
+          case 0b000: {
+            // c.addi (c.nop if rd is zero)
+            return set_decoded(IT::Addi, rd, rd, 0, imm6);
+          }
+
+          case 0b001: {
+            // c.addiw
+            if (rd != zero) {
+              return set_decoded(IT::Addiw, rd, rd, 0, imm6);
+            }
+            break;
+          }
+
+          case 0b010: {
+            // c.li
+            return set_decoded(IT::Addi, rd, zero, 0, imm6);
+          }
+
+          case 0b011: {
+            if (rd == sp) {
+              // c.addi16sp
+              const auto imm = sign_extend((field(6, 1) << 4) | (field(2, 1) << 5) |
+                                             (field(5, 1) << 6) | (field(3, 2) << 7) |
+                                             (field(12, 1) << 9),
+                                           10);
+              if (imm != 0) {
+                return set_decoded(IT::Addi, sp, sp, 0, imm);
+              }
+            } else if (imm6 != 0) {
+              // c.lui
+              return set_decoded(IT::Lui, rd, 0, 0, imm6 << 12);
+            }
+            break;
+          }
+
+          case 0b100: {
+            switch (field(10, 2)) {
+                // clang-format off
+              case 0b00: return set_decoded(IT::Srli, rs1_prime, rs1_prime, 0, shamt);
+              case 0b01: return set_decoded(IT::Srai, rs1_prime, rs1_prime, 0, shamt);
+              case 0b10: return set_decoded(IT::Andi, rs1_prime, rs1_prime, 0, imm6);
+                // clang-format on
+
+              case 0b11: {
+                const auto decoded = [this, rs1_prime, rs2_prime](InstructionType type) {
+                  return set_decoded(type, rs1_prime, rs1_prime, rs2_prime, 0);
+                };
+
+                switch (field(5, 2) | (field(12, 1) << 2)) {
+                    // clang-format off
+                  case 0b000: return decoded(IT::Sub);
+                  case 0b001: return decoded(IT::Xor);
+                  case 0b010: return decoded(IT::Or);
+                  case 0b011: return decoded(IT::And);
+                  case 0b100: return decoded(IT::Subw);
+                  case 0b101: return decoded(IT::Addw);
+                    // clang-format on
+
+                  default:
+                    break;
+                }
+                break;
+              }
+
+              default:
+                break;
+            }
+            break;
+          }
+
+          case 0b101: {
+            // c.j
+            const auto imm = sign_extend((field(3, 3) << 1) | (field(11, 1) << 4) |
+                                           (field(2, 1) << 5) | (field(7, 1) << 6) |
+                                           (field(6, 1) << 7) | (field(9, 2) << 8) |
+                                           (field(8, 1) << 10) | (field(12, 1) << 11),
+                                         12);
+            return set_decoded(IT::Jal, zero, 0, 0, imm);
+          }
+
+          case 0b110:
+          case 0b111: {
+            // c.beqz and c.bnez
+            const auto imm = sign_extend((field(3, 2) << 1) | (field(10, 2) << 3) |
+                                           (field(2, 1) << 5) | (field(5, 2) << 6) |
+                                           (field(12, 1) << 8),
+                                         9);
+            return set_decoded(funct3 == 0b110 ? IT::Beq : IT::Bne, 0, rs1_prime, zero, imm);
+          }
+
+          default:
+            break;
+        }
+
+        break;
+      }
+
+      case 0b10: {
+        switch (funct3) {
+          case 0b000: {
+            // c.slli
+            return set_decoded(IT::Slli, rd, rd, 0, shamt);
+          }
+
+          case 0b001: {
+            // c.fldsp
+            const auto imm = (field(5, 2) << 3) | (field(12, 1) << 5) | (field(2, 3) << 6);
+            return set_decoded(IT::Fld, rd, sp, 0, imm);
+          }
+
+          case 0b010: {
+            // c.lwsp
+            const auto imm = (field(4, 3) << 2) | (field(12, 1) << 5) | (field(2, 2) << 6);
+            if (rd != zero) {
+              return set_decoded(IT::Lw, rd, sp, 0, imm);
+            }
+            break;
+          }
+
+          case 0b011: {
+            // c.ldsp
+            const auto imm = (field(5, 2) << 3) | (field(12, 1) << 5) | (field(2, 3) << 6);
+            if (rd != zero) {
+              return set_decoded(IT::Ld, rd, sp, 0, imm);
+            }
+            break;
+          }
+
+          case 0b100: {
+            if (field(12, 1) == 0) {
+              if (rs2 == zero) {
+                // c.jr
+                if (rd != zero) {
+                  return set_decoded(IT::Jalr, zero, rd, 0, 0);
+                }
+                break;
+              }
+
+              // c.mv, decoded as `addi` so it's recognized as a register move.
+              return set_decoded(IT::Addi, rd, rs2, 0, 0);
+            }
+
+            if (rs2 == zero) {
+              // c.ebreak and c.jalr
+              return rd == zero ? set_decoded(IT::Ebreak, 0, 0, 0, 0)
+                                : set_decoded(IT::Jalr, ra, rd, 0, 0);
+            }
+
+            // c.add
+            return set_decoded(IT::Add, rd, rd, rs2, 0);
+          }
+
+          case 0b101: {
+            // c.fsdsp
+            const auto imm = (field(10, 3) << 3) | (field(7, 3) << 6);
+            return set_decoded(IT::Fsd, 0, sp, rs2, imm);
+          }
+
+          case 0b110: {
+            // c.swsp
+            const auto imm = (field(9, 4) << 2) | (field(7, 2) << 6);
+            return set_decoded(IT::Sw, 0, sp, rs2, imm);
+          }
+
+          case 0b111: {
+            // c.sdsp
+            const auto imm = (field(10, 3) << 3) | (field(7, 3) << 6);
+            return set_decoded(IT::Sd, 0, sp, rs2, imm);
+          }
+
+          default:
+            break;
+        }
+
+        break;
+      }
+
+      default:
+        break;
+    }
+  }
+
+  // Compressed instructions are expanded to the equivalent 32 bit instructions.
+  void decode_compressed() {
+    set_decoded(InstructionType::Undefined, 0, 0, 0, 0);
+    decode_compressed_instruction();
+
+    decoded_instruction.a |= Instruction::compressed_flag;
+  }
+
   void decode() {
     set_decoded(InstructionType::Undefined, 0, 0, 0, 0);
 
@@ -387,9 +1140,33 @@ struct InstructionDecoder {
       case 0b0111011:
         return decode_rtype(opcode);
 
+      case 0b0101111:
+        return decode_atype(opcode);
+
       case 0b0100011:
         return decode_stype(opcode);
 
+      case 0b0000111:
+      case 0b0100111: {
+        // Scalar floating point accesses use only some of the widths, the rest are vector
+        // accesses.
+        const auto width = (instruction >> 12) & 0b111;
+        if (width == 0b010 || width == 0b011) {
+          return opcode == 0b0000111 ? decode_itype(opcode) : decode_stype(opcode);
+        }
+        return decode_vector(opcode);
+      }
+
+      case 0b1010111:
+        return decode_vector(opcode);
+
+      case 0b1000011:
+      case 0b1000111:
+      case 0b1001011:
+      case 0b1001111:
+      case 0b1010011:
+        return decode_float(opcode);
+
       case 0b1100011:
         return decode_btype(opcode);
 
@@ -404,7 +1181,44 @@ struct InstructionDecoder {
 }  // namespace vm
 
 Instruction::Instruction(uint32_t encoded_instruction) {
-  InstructionDecoder{encoded_instruction, *this}.decode();
+  InstructionDecoder decoder{encoded_instruction, *this};
+  if (is_compressed(encoded_instruction)) {
+    decoder.decode_compressed();
+  } else {
+    decoder.decode();
+  }
+}
+
+Instruction Instruction::from_raw(uint64_t raw) {
+  Instruction instruction;
+  instruction.a = uint32_t(raw);
+  instruction.b = uint32_t(raw >> 32);
+  return instruction;
+}
+
+Instruction Instruction::from_fields(InstructionType type,
+                                     uint32_t rd,
+                                     uint32_t rs1,
+                                     uint32_t rs2,
+                                     uint32_t b) {
+  Instruction instruction;
+  InstructionDecoder{0, instruction}.set_decoded(type, rd, rs1, rs2, b);
+  return instruction;
+}
+
+bool Instruction::fetch(const Memory& memory, uint64_t pc, uint32_t& encoded_instruction) {
+  uint16_t low_half;
+  if (!memory.read(pc, MemoryFlags::Execute, low_half)) {
+    return false;
+  }
+
+  uint16_t high_half = 0;
+  if (!is_compressed(low_half) && !memory.read(pc + 2, MemoryFlags::Execute, high_half)) {
+    return false;
+  }
+
+  encoded_instruction = uint32_t(low_half) | (uint32_t(high_half) << 16);
+  return true;
 }
 
 std::string_view detail::instruction_name(InstructionType type) {
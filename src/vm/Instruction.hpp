@@ -7,6 +7,8 @@
 
 namespace vm {
 
+class Memory;
+
 enum class InstructionType {
   Undefined = 0,
 
@@ -72,6 +74,7 @@ enum class InstructionType {
   Ecall,
 
   Fence,
+  FenceI,
 
   Mul,
   Mulw,
@@ -89,25 +92,244 @@ enum class InstructionType {
   Remu,
   Remw,
   Remuw,
+
+  LrW,
+  LrD,
+  ScW,
+  ScD,
+
+  AmoswapW,
+  AmoaddW,
+  AmoxorW,
+  AmoandW,
+  AmoorW,
+  AmominW,
+  AmomaxW,
+  AmominuW,
+  AmomaxuW,
+
+  AmoswapD,
+  AmoaddD,
+  AmoxorD,
+  AmoandD,
+  AmoorD,
+  AmominD,
+  AmomaxD,
+  AmominuD,
+  AmomaxuD,
+
+  Csrrw,
+  Csrrs,
+  Csrrc,
+  Csrrwi,
+  Csrrsi,
+  Csrrci,
+
+  Flw,
+  Fsw,
+  Fld,
+  Fsd,
+
+  FmaddS,
+  FmsubS,
+  FnmsubS,
+  FnmaddS,
+
+  FaddS,
+  FsubS,
+  FmulS,
+  FdivS,
+  FsqrtS,
+
+  FsgnjS,
+  FsgnjnS,
+  FsgnjxS,
+  FminS,
+  FmaxS,
+
+  FcvtWS,
+  FcvtWuS,
+  FcvtLS,
+  FcvtLuS,
+  FcvtSW,
+  FcvtSWu,
+  FcvtSL,
+  FcvtSLu,
+
+  FmvXW,
+  FmvWX,
+
+  FeqS,
+  FltS,
+  FleS,
+  FclassS,
+
+  FmaddD,
+  FmsubD,
+  FnmsubD,
+  FnmaddD,
+
+  FaddD,
+  FsubD,
+  FmulD,
+  FdivD,
+  FsqrtD,
+
+  FsgnjD,
+  FsgnjnD,
+  FsgnjxD,
+  FminD,
+  FmaxD,
+
+  FcvtWD,
+  FcvtWuD,
+  FcvtLD,
+  FcvtLuD,
+  FcvtDW,
+  FcvtDWu,
+  FcvtDL,
+  FcvtDLu,
+
+  FmvXD,
+  FmvDX,
+
+  FeqD,
+  FltD,
+  FleD,
+  FclassD,
+
+  FcvtSD,
+  FcvtDS,
+
+  Vsetvli,
+  Vsetivli,
+  Vsetvl,
+
+  VectorLoad,
+  VectorStore,
+  VectorLoadStrided,
+  VectorStoreStrided,
+
+  VectorOperation,
+  VectorOperationScalar,
+  VectorMoveToScalar,
+
+  Sh1add,
+  Sh2add,
+  Sh3add,
+  AddUw,
+  Sh1addUw,
+  Sh2addUw,
+  Sh3addUw,
+  Andn,
+  Orn,
+  Xnor,
+  Min,
+  Minu,
+  Max,
+  Maxu,
+  Rol,
+  Ror,
+  Rolw,
+  Rorw,
+  Bclr,
+  Bext,
+  Binv,
+  Bset,
+
+  SlliUw,
+  Rori,
+  Roriw,
+  Bclri,
+  Bexti,
+  Binvi,
+  Bseti,
+
+  Clz,
+  Clzw,
+  Ctz,
+  Ctzw,
+  Cpop,
+  Cpopw,
+  SextB,
+  SextH,
+  ZextH,
+  OrcB,
+  Rev8,
 };
 
 class Instruction {
   friend struct InstructionDecoder;
 
+  // Set in `a` for instructions decoded from their 16 bit compressed form.
+  constexpr static uint32_t compressed_flag = uint32_t(1) << 31;
+
   uint32_t a{};
   uint32_t b{};
 
+  Instruction() = default;
+
  public:
   explicit Instruction(uint32_t encoded_instruction);
 
+  // Floating point rounding modes. `Dynamic` uses the rounding mode from `fcsr`.
+  enum class RoundingMode {
+    NearestEven = 0,
+    TowardZero = 1,
+    Down = 2,
+    Up = 3,
+    NearestMaxMagnitude = 4,
+    Dynamic = 7,
+  };
+
+  // Instructions which don't have both lowest bits set are 16 bit long (RVC extension).
+  static bool is_compressed(uint32_t encoded_instruction) {
+    return (encoded_instruction & 0b11) != 0b11;
+  }
+
+  // Reads the instruction at `pc` from executable memory. Upper half of a compressed instruction
+  // is not fetched and is set to zero. Returns false if the instruction cannot be fetched.
+  static bool fetch(const Memory& memory, uint64_t pc, uint32_t& encoded_instruction);
+
   InstructionType type() const { return InstructionType(a & 0xffff); }
 
+  bool compressed() const { return (a & compressed_flag) != 0; }
+  uint32_t length() const { return compressed() ? 2 : 4; }
+
   Register rd() const { return Register((a >> 16) & 0b11111); }
   Register rs1() const { return Register((a >> 21) & 0b11111); }
   Register rs2() const { return Register((a >> 26) & 0b11111); }
 
   int64_t imm() const { return int32_t(b); }
   uint32_t shamt() const { return b; }
+
+  // Floating point operands. Loads and stores use `rs1()` for the address and `imm()` for the
+  // offset. Arithmetic instructions encode the rounding mode and the third source in `b`.
+  FloatRegister frd() const { return FloatRegister((a >> 16) & 0b11111); }
+  FloatRegister frs1() const { return FloatRegister((a >> 21) & 0b11111); }
+  FloatRegister frs2() const { return FloatRegister((a >> 26) & 0b11111); }
+  FloatRegister frs3() const { return FloatRegister((b >> 3) & 0b11111); }
+  RoundingMode rounding_mode() const { return RoundingMode(b & 0b111); }
+
+  // CSR instructions. Immediate forms store the 5 bit immediate in the `rs1` field.
+  uint32_t csr() const { return b; }
+  uint32_t csr_imm() const { return (a >> 21) & 0b11111; }
+
+  // Vector instructions keep their whole encoding which is decoded during execution. `rd()`,
+  // `rs1()` and `rs2()` hold the fields at the standard positions (`vd`, `vs1` and `vs2`).
+  uint32_t vector_encoding() const { return b; }
+
+  // Decoded instruction packed into 64 bits so it can be passed to the code called by the JIT.
+  uint64_t raw() const { return uint64_t(a) | (uint64_t(b) << 32); }
+  static Instruction from_raw(uint64_t raw);
+
+  // Builds a decoded instruction from its fields (`b` holds the immediate or the packed floating
+  // point operands).
+  static Instruction from_fields(InstructionType type,
+                                 uint32_t rd,
+                                 uint32_t rs1,
+                                 uint32_t rs2,
+                                 uint32_t b);
 };
 
 namespace detail {
@@ -1,32 +1,159 @@
 #include "Interpreter.hpp"
 #include "Instruction.hpp"
 
+#include "private/Arithmetic.hpp"
+#include "private/ExecutionLog.hpp"
+#include "private/FloatArithmetic.hpp"
+#include "private/VectorArithmetic.hpp"
+
 #include <base/Error.hpp>
 
+#include <atomic>
+#include <type_traits>
+
 using namespace vm;
 
 static uint64_t signextend32(uint64_t value) {
   return uint64_t(int64_t(int32_t(value)));
 }
 
-bool Interpreter::step(Memory& memory, Cpu& cpu, Exit& exit) {
+template <typename T, typename Fn>
+static T atomic_fetch_update(std::atomic_ref<T> value, Fn&& update) {
+  auto current = value.load();
+  while (!value.compare_exchange_weak(current, update(current))) {
+  }
+  return current;
+}
+
+static bool read_csr(const RegisterState& state, uint32_t csr, uint64_t& value) {
+  return FloatArithmetic::read_csr(state, csr, value) ||
+         VectorArithmetic::read_csr(state, csr, value);
+}
+
+static bool write_csr(RegisterState& state, uint32_t csr, uint64_t value) {
+  return FloatArithmetic::write_csr(state, csr, value) ||
+         VectorArithmetic::write_csr(state, csr, value);
+}
+
+// Atomics must be naturally aligned, misaligned accesses are reported as access faults (which
+// is allowed by the specification).
+template <typename T>
+static bool execute_atomic_instruction(Memory& memory,
+                                       Cpu& cpu,
+                                       Exit& exit,
+                                       const Instruction& instruction) {
+  using IT = InstructionType;
+  using S = std::make_signed_t<T>;
+
+  const auto instruction_type = instruction.type();
+  const auto address = cpu.reg(instruction.rs1());
+  const auto operand = T(cpu.reg(instruction.rs2()));
+
+  const auto is_lr = instruction_type == IT::LrW || instruction_type == IT::LrD;
+  const auto is_sc = instruction_type == IT::ScW || instruction_type == IT::ScD;
+
+  auto required_flags = MemoryFlags::Read | MemoryFlags::Write;
+  if (is_lr) {
+    required_flags = MemoryFlags::Read;
+  } else if (is_sc) {
+    required_flags = MemoryFlags::Write;
+  }
+
+  const auto pointer = memory.aligned_pointer<T>(address, required_flags);
+  if (!pointer) {
+    exit.reason = is_lr ? Exit::Reason::MemoryReadFault : Exit::Reason::MemoryWriteFault;
+    exit.faulty_address = address;
+    exit.target_register = is_lr ? instruction.rd() : instruction.rs2();
+
+    return false;
+  }
+
+  auto& registers = cpu.register_state();
+  const std::atomic_ref<T> value(*pointer);
+
+  if (is_sc) {
+    auto expected = T(registers.reservation_value());
+    const auto success = registers.reservation_address() == address &&
+                         value.compare_exchange_strong(expected, operand);
+
+    registers.clear_reservation();
+    cpu.set_reg(instruction.rd(), success ? 0 : 1);
+
+    return true;
+  }
+
+  T result{};
+
+  switch (instruction_type) {
+      // clang-format off
+    case IT::LrW:      case IT::LrD:      result = value.load(); break;
+    case IT::AmoswapW: case IT::AmoswapD: result = value.exchange(operand); break;
+    case IT::AmoaddW:  case IT::AmoaddD:  result = value.fetch_add(operand); break;
+    case IT::AmoxorW:  case IT::AmoxorD:  result = value.fetch_xor(operand); break;
+    case IT::AmoandW:  case IT::AmoandD:  result = value.fetch_and(operand); break;
+    case IT::AmoorW:   case IT::AmoorD:   result = value.fetch_or(operand); break;
+      // clang-format on
+
+    case IT::AmominW:
+    case IT::AmominD: {
+      result = atomic_fetch_update(value, [&](T v) { return S(v) < S(operand) ? v : operand; });
+      break;
+    }
+    case IT::AmomaxW:
+    case IT::AmomaxD: {
+      result = atomic_fetch_update(value, [&](T v) { return S(v) > S(operand) ? v : operand; });
+      break;
+    }
+    case IT::AmominuW:
+    case IT::AmominuD: {
+      result = atomic_fetch_update(value, [&](T v) { return v < operand ? v : operand; });
+      break;
+    }
+    case IT::AmomaxuW:
+    case IT::AmomaxuD: {
+      result = atomic_fetch_update(value, [&](T v) { return v > operand ? v : operand; });
+      break;
+    }
+
+    default:
+      unreachable();
+  }
+
+  const auto extended_result = uint64_t(int64_t(S(result)));
+  if (is_lr) {
+    registers.set_reservation(address, extended_result);
+  }
+
+  cpu.set_reg(instruction.rd(), extended_result);
+
+  return true;
+}
+
+static bool execute_instruction(Memory& memory,
+                                Cpu& cpu,
+                                Exit& exit,
+                                InstructionType& executed_instruction_type,
+                                uint32_t& executed_instruction_length) {
   const auto current_pc = cpu.pc();
-  if ((current_pc & 3) != 0) {
+  if ((current_pc & 1) != 0) {
     exit.reason = Exit::Reason::UnalignedPc;
     return false;
   }
 
   uint32_t encoded_instruction;
-  if (!memory.read<uint32_t>(current_pc, MemoryFlags::Execute, encoded_instruction)) {
+  if (!Instruction::fetch(memory, current_pc, encoded_instruction)) {
     exit.reason = Exit::Reason::InstructionFetchFault;
     return false;
   }
 
-  uint64_t next_pc = current_pc + 4;
-
   const Instruction instruction(encoded_instruction);
   const auto instruction_type = instruction.type();
 
+  uint64_t next_pc = current_pc + instruction.length();
+
+  executed_instruction_type = instruction_type;
+  executed_instruction_length = instruction.length();
+
   using IT = InstructionType;
 
   switch (instruction_type) {
@@ -220,7 +347,7 @@ bool Interpreter::step(Memory& memory, Cpu& cpu, Exit& exit) {
           // clang-format off
         case IT::Slli:  result = a << shamt; break;
         case IT::Srli:  result = a >> shamt; break;
-        case IT::Srai:  result = uint64_t(int64_t(a) << shamt); break;
+        case IT::Srai:  result = uint64_t(int64_t(a) >> shamt); break;
         case IT::Slliw: result = signextend32(uint32_t(a) << shamt); break;
         case IT::Srliw: result = signextend32(uint32_t(a) >> shamt); break;
         case IT::Sraiw: result = signextend32(int32_t(a) >> shamt); break;
@@ -287,7 +414,7 @@ bool Interpreter::step(Memory& memory, Cpu& cpu, Exit& exit) {
         case IT::And: result = a & b; break;
         case IT::Sll: result = a << shamt64; break;
         case IT::Srl: result = a >> shamt64; break;
-        case IT::Sra: result = uint64_t(int64_t(a) << shamt64); break;
+        case IT::Sra: result = uint64_t(int64_t(a) >> shamt64); break;
         case IT::Addw: result = signextend32(uint32_t(a) + uint32_t(b)); break;
         case IT::Subw: result = signextend32(uint32_t(a) - uint32_t(b)); break;
         case IT::Sllw: result = signextend32(uint32_t(a) << shamt32); break;
@@ -306,6 +433,9 @@ bool Interpreter::step(Memory& memory, Cpu& cpu, Exit& exit) {
 
     case IT::Mul:
     case IT::Mulw:
+    case IT::Mulh:
+    case IT::Mulhu:
+    case IT::Mulhsu:
     case IT::Div:
     case IT::Divw:
     case IT::Divu:
@@ -321,16 +451,19 @@ bool Interpreter::step(Memory& memory, Cpu& cpu, Exit& exit) {
 
       switch (instruction_type) {
           // clang-format off
-        case IT::Mul:   result = a * b; break;
-        case IT::Mulw:  result = signextend32(uint32_t(a) / uint32_t(b)); break;
-        case IT::Div:   result = int64_t(a) / int64_t(b); break;
-        case IT::Divw:  result = signextend32(int32_t(a) / int32_t(b)); break;
-        case IT::Divu:  result = uint64_t(a) / uint64_t(b); break;
-        case IT::Divuw: result = signextend32(uint32_t(a) / uint32_t(b)); break;
-        case IT::Rem:   result = int64_t(a) % int64_t(b); break;
-        case IT::Remu:  result = uint64_t(a) % uint64_t(b); break;
-        case IT::Remw:  result = signextend32(int32_t(a) % int32_t(b)); break;
-        case IT::Remuw: result = signextend32(uint32_t(a) % uint32_t(b)); break;
+        case IT::Mul:    result = a * b; break;
+        case IT::Mulw:   result = signextend32(uint32_t(a) * uint32_t(b)); break;
+        case IT::Mulh:   result = Arithmetic::mulh(a, b); break;
+        case IT::Mulhu:  result = Arithmetic::mulhu(a, b); break;
+        case IT::Mulhsu: result = Arithmetic::mulhsu(a, b); break;
+        case IT::Div:    result = Arithmetic::div(a, b); break;
+        case IT::Divw:   result = Arithmetic::divw(a, b); break;
+        case IT::Divu:   result = Arithmetic::divu(a, b); break;
+        case IT::Divuw:  result = Arithmetic::divuw(a, b); break;
+        case IT::Rem:    result = Arithmetic::rem(a, b); break;
+        case IT::Remu:   result = Arithmetic::remu(a, b); break;
+        case IT::Remw:   result = Arithmetic::remw(a, b); break;
+        case IT::Remuw:  result = Arithmetic::remuw(a, b); break;
           // clang-format on
 
         default:
@@ -342,10 +475,38 @@ bool Interpreter::step(Memory& memory, Cpu& cpu, Exit& exit) {
       break;
     }
 
-    case IT::Mulh:
-    case IT::Mulhu:
-    case IT::Mulhsu: {
-      fatal_error("multiply high instructions are not supported");
+    case IT::LrW:
+    case IT::ScW:
+    case IT::AmoswapW:
+    case IT::AmoaddW:
+    case IT::AmoxorW:
+    case IT::AmoandW:
+    case IT::AmoorW:
+    case IT::AmominW:
+    case IT::AmomaxW:
+    case IT::AmominuW:
+    case IT::AmomaxuW: {
+      if (!execute_atomic_instruction<uint32_t>(memory, cpu, exit, instruction)) {
+        return false;
+      }
+      break;
+    }
+
+    case IT::LrD:
+    case IT::ScD:
+    case IT::AmoswapD:
+    case IT::AmoaddD:
+    case IT::AmoxorD:
+    case IT::AmoandD:
+    case IT::AmoorD:
+    case IT::AmominD:
+    case IT::AmomaxD:
+    case IT::AmominuD:
+    case IT::AmomaxuD: {
+      if (!execute_atomic_instruction<uint64_t>(memory, cpu, exit, instruction)) {
+        return false;
+      }
+      break;
     }
 
     case IT::Ecall: {
@@ -364,14 +525,230 @@ bool Interpreter::step(Memory& memory, Cpu& cpu, Exit& exit) {
     }
 
     case IT::Fence: {
+      // Other harts may observe guest memory concurrently.
+      std::atomic_thread_fence(std::memory_order::seq_cst);
       break;
     }
 
-    default:
-      unreachable();
+    case IT::FenceI: {
+      // Modified code is invalidated as soon as it's written, stale blocks are never executed.
+      std::atomic_thread_fence(std::memory_order::seq_cst);
+      break;
+    }
+
+    case IT::Flw:
+    case IT::Fld: {
+      const auto address = cpu.reg(instruction.rs1()) + instruction.imm();
+
+      bool success = false;
+      uint64_t result = 0;
+
+      if (instruction_type == IT::Flw) {
+        uint32_t v{};
+        success = memory.read<uint32_t>(address, MemoryFlags::Read, v);
+        result = FloatArithmetic::box(v);
+      } else {
+        success = memory.read<uint64_t>(address, MemoryFlags::Read, result);
+      }
+
+      if (!success) {
+        exit.reason = Exit::Reason::MemoryReadFault;
+        exit.faulty_address = address;
+
+        return false;
+      }
+
+      cpu.set_reg(instruction.frd(), result);
+
+      break;
+    }
+
+    case IT::Fsw:
+    case IT::Fsd: {
+      const auto address = cpu.reg(instruction.rs1()) + instruction.imm();
+      const auto value = cpu.reg(instruction.frs2());
+
+      const auto success = instruction_type == IT::Fsw
+                             ? memory.write<uint32_t>(address, MemoryFlags::Write, value)
+                             : memory.write<uint64_t>(address, MemoryFlags::Write, value);
+      if (!success) {
+        exit.reason = Exit::Reason::MemoryWriteFault;
+        exit.faulty_address = address;
+
+        return false;
+      }
+
+      break;
+    }
+
+    case IT::Csrrw:
+    case IT::Csrrs:
+    case IT::Csrrc:
+    case IT::Csrrwi:
+    case IT::Csrrsi:
+    case IT::Csrrci: {
+      auto& registers = cpu.register_state();
+
+      uint64_t value = 0;
+      if (!read_csr(registers, instruction.csr(), value)) {
+        exit.reason = Exit::Reason::UndefinedInstruction;
+        return false;
+      }
+
+      const auto immediate = instruction_type == IT::Csrrwi || instruction_type == IT::Csrrsi ||
+                             instruction_type == IT::Csrrci;
+      const auto source = immediate ? uint64_t(instruction.csr_imm()) : cpu.reg(instruction.rs1());
+
+      uint64_t new_value = 0;
+
+      switch (instruction_type) {
+          // clang-format off
+        case IT::Csrrw: case IT::Csrrwi: new_value = source; break;
+        case IT::Csrrs: case IT::Csrrsi: new_value = value | source; break;
+        case IT::Csrrc: case IT::Csrrci: new_value = value & ~source; break;
+          // clang-format on
+
+        default:
+          unreachable();
+      }
+
+      // Set and clear instructions don't write the CSR if the source is zero (`rs1` field is used
+      // by both register and immediate forms), which allows reading the read-only ones.
+      const auto writes = instruction_type == IT::Csrrw || instruction_type == IT::Csrrwi ||
+                          instruction.rs1() != Register::Zero;
+      if (writes && !write_csr(registers, instruction.csr(), new_value)) {
+        exit.reason = Exit::Reason::UndefinedInstruction;
+        return false;
+      }
+
+      cpu.set_reg(instruction.rd(), value);
+
+      break;
+    }
+
+    case IT::Vsetvli:
+    case IT::Vsetivli:
+    case IT::Vsetvl:
+    case IT::VectorLoad:
+    case IT::VectorStore:
+    case IT::VectorLoadStrided:
+    case IT::VectorStoreStrided:
+    case IT::VectorOperation:
+    case IT::VectorOperationScalar:
+    case IT::VectorMoveToScalar: {
+      using Status = VectorArithmetic::Status;
+
+      uint64_t faulty_address = 0;
+      const auto status =
+        VectorArithmetic::execute(cpu.register_state(), memory, instruction, faulty_address);
+
+      switch (status) {
+        case Status::Completed:
+          break;
+
+        case Status::UndefinedInstruction: {
+          exit.reason = Exit::Reason::UndefinedInstruction;
+          return false;
+        }
+
+        case Status::MemoryReadFault:
+        case Status::MemoryWriteFault: {
+          exit.reason = status == Status::MemoryReadFault ? Exit::Reason::MemoryReadFault
+                                                          : Exit::Reason::MemoryWriteFault;
+          exit.faulty_address = faulty_address;
+          return false;
+        }
+      }
+
+      break;
+    }
+
+    default: {
+      if (Arithmetic::is_bit_manipulation(instruction_type)) {
+        const auto b = Arithmetic::reads_second_register(instruction_type)
+                         ? cpu.reg(instruction.rs2())
+                         : uint64_t(instruction.shamt());
+
+        cpu.set_reg(instruction.rd(),
+                    Arithmetic::bit_manipulation(instruction_type, cpu.reg(instruction.rs1()), b));
+
+        break;
+      }
+
+      if (!FloatArithmetic::is_float_operation(instruction_type)) {
+        unreachable();
+      }
+
+      auto& registers = cpu.register_state();
+      if (!FloatArithmetic::has_valid_rounding_mode(registers, instruction)) {
+        exit.reason = Exit::Reason::UndefinedInstruction;
+        return false;
+      }
+
+      const auto result =
+        FloatArithmetic::execute(registers, instruction, cpu.reg(instruction.rs1()));
+      if (FloatArithmetic::writes_integer_register(instruction_type)) {
+        cpu.set_reg(instruction.rd(), result);
+      }
+
+      break;
+    }
   }
 
   cpu.set_reg(Register::Pc, next_pc);
 
   return true;
 }
+
+bool Interpreter::step(Memory& memory, Cpu& cpu, Exit& exit) {
+  InstructionType instruction_type{};
+  uint32_t instruction_length{};
+  return execute_instruction(memory, cpu, exit, instruction_type, instruction_length);
+}
+
+bool Interpreter::run_block(Memory& memory, Cpu& cpu, Exit& exit, jit::Profile& profile) {
+  using IT = InstructionType;
+
+  while (true) {
+    const auto current_pc = cpu.pc();
+
+#ifdef PRINT_EXECUTION_LOG
+    const auto previous_register_state = cpu.register_state();
+#endif
+
+    InstructionType instruction_type{};
+    uint32_t instruction_length{};
+    if (!execute_instruction(memory, cpu, exit, instruction_type, instruction_length)) {
+      return false;
+    }
+
+#ifdef PRINT_EXECUTION_LOG
+    ExecutionLog::print_execution_step(previous_register_state, cpu.register_state());
+#endif
+
+    const auto jumped = cpu.pc() != current_pc + instruction_length;
+
+    switch (instruction_type) {
+      case IT::Beq:
+      case IT::Bne:
+      case IT::Blt:
+      case IT::Bge:
+      case IT::Bltu:
+      case IT::Bgeu: {
+        profile.record_branch(current_pc, jumped);
+        if (jumped) {
+          return true;
+        }
+        break;
+      }
+
+      case IT::Jal:
+      case IT::Jalr: {
+        return true;
+      }
+
+      default:
+        break;
+    }
+  }
+}
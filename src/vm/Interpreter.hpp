@@ -3,11 +3,17 @@
 #include "Exit.hpp"
 #include "Memory.hpp"
 
+#include "jit/Profile.hpp"
+
 namespace vm {
 
 class Interpreter {
  public:
   static bool step(Memory& memory, Cpu& cpu, Exit& exit);
+
+  // Executes instructions until the end of the current basic block. Outcomes of conditional
+  // branches are recorded in `profile`.
+  static bool run_block(Memory& memory, Cpu& cpu, Exit& exit, jit::Profile& profile);
 };
 
 }  // namespace vm
\ No newline at end of file
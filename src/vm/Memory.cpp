@@ -1,13 +1,310 @@
 #include "Memory.hpp"
 
+#include <base/Error.hpp>
+#include <base/Platform.hpp>
+
+#include <algorithm>
+#include <atomic>
 #include <cstring>
+#include <string>
 
 using namespace vm;
 
-Memory::Memory(size_t size) : size_(size) {
-  const auto block_count = (size + sizeof(uint64_t) - 1) / sizeof(uint64_t);
-  contents_ = std::make_unique<uint64_t[]>(block_count * 2);
-  permissions_ = contents_.get() + block_count;
+#if defined(PLATFORM_LINUX) || defined(PLATFORM_MAC)
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static size_t host_page_size() {
+  return size_t(sysconf(_SC_PAGESIZE));
+}
+
+static int create_shared_memory_file(size_t size) {
+#ifdef PLATFORM_LINUX
+  const auto fd = memfd_create("guest_memory", MFD_CLOEXEC);
+#else
+  static std::atomic_uint32_t counter = 0;
+
+  // Shared memory object is only needed to create the mappings so it's unlinked immediately.
+  const auto name = "/riscv64_emulator." + std::to_string(getpid()) + "." +
+                    std::to_string(counter.fetch_add(1));
+  const auto fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd >= 0) {
+    shm_unlink(name.c_str());
+  }
+#endif
+
+  verify(fd >= 0, "failed to create shared memory for the guest memory");
+  verify(ftruncate(fd, off_t(size)) == 0, "failed to resize shared memory to {} bytes", size);
+
+  return fd;
+}
+
+// Maps the same memory twice: read-write view for the emulator and inaccessible view (followed by
+// the inaccessible guard region) for the JIT code.
+static void map_guarded_memory(size_t size,
+                               size_t guard_size,
+                               uint8_t*& contents,
+                               uint8_t*& guarded_contents) {
+  const auto fd = create_shared_memory_file(size);
+
+  const auto host_view = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  verify(host_view != MAP_FAILED, "failed to map guest memory");
+
+  const auto reservation =
+    mmap(nullptr, size + guard_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  verify(reservation != MAP_FAILED, "failed to reserve guarded guest memory");
+
+  const auto guarded_view = mmap(reservation, size, PROT_NONE, MAP_SHARED | MAP_FIXED, fd, 0);
+  verify(guarded_view == reservation, "failed to map guarded guest memory");
+
+  close(fd);
+
+  contents = reinterpret_cast<uint8_t*>(host_view);
+  guarded_contents = reinterpret_cast<uint8_t*>(guarded_view);
+}
+
+static void unmap_guarded_memory(size_t size,
+                                 size_t guard_size,
+                                 uint8_t* contents,
+                                 uint8_t* guarded_contents) {
+  munmap(contents, size);
+  munmap(guarded_contents, size + guard_size);
+}
+
+static void protect_guarded_memory(uint8_t* address, size_t size, MemoryFlags flags) {
+  int protection = PROT_NONE;
+  if ((flags & MemoryFlags::Read) != MemoryFlags::None) {
+    protection |= PROT_READ;
+    if ((flags & MemoryFlags::Write) != MemoryFlags::None) {
+      protection |= PROT_WRITE;
+    }
+  }
+
+  verify(mprotect(address, size, protection) == 0, "failed to protect guarded guest memory");
+}
+
+#else
+
+static size_t host_page_size() {
+  return 4096;
+}
+
+static void map_guarded_memory(size_t size,
+                               size_t guard_size,
+                               uint8_t*& contents,
+                               uint8_t*& guarded_contents) {
+  fatal_error("guard pages are not supported on this platform");
+}
+
+static void unmap_guarded_memory(size_t size,
+                                 size_t guard_size,
+                                 uint8_t* contents,
+                                 uint8_t* guarded_contents) {}
+
+static void protect_guarded_memory(uint8_t* address, size_t size, MemoryFlags flags) {}
+
+#endif
+
+// JIT code checks that accessed address is below the memory size so the guard region only needs
+// to cover accesses that cross the end of the memory.
+constexpr size_t guard_region_size = 1024 * 1024;
+
+Memory::Memory(size_t size, Flags flags) : size_(size) {
+  if ((flags & Flags::GuardPages) != Flags::None) {
+    const auto page_size = host_page_size();
+    verify(page_size % permission_page_size == 0,
+           "host page size must be a multiple of the permission page size");
+
+    mapping_size_ = (size + page_size - 1) / page_size * page_size;
+    map_guarded_memory(mapping_size_, guard_region_size, contents_, guarded_contents_);
+  } else {
+    storage_ = std::make_unique<uint64_t[]>((size + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+    contents_ = reinterpret_cast<uint8_t*>(storage_.get());
+  }
+
+  byte_permissions_ = (flags & Flags::BytePermissions) != Flags::None;
+
+  const auto permission_count =
+    byte_permissions_ ? size : (size + permission_page_size - 1) >> permission_page_shift;
+  permissions_ = std::make_unique<MemoryFlags[]>(permission_count);
+
+  const auto page_count = (size + permission_page_size - 1) >> permission_page_shift;
+  page_watched_ = std::make_unique<std::atomic_bool[]>(page_count);
+  write_watch_generations_ = std::make_unique<std::atomic_uint64_t[]>(page_count);
+}
+
+Memory::~Memory() {
+  if (guarded_contents_) {
+    unmap_guarded_memory(mapping_size_, guard_region_size, contents_, guarded_contents_);
+  }
+}
+
+MemoryFlags Memory::page_permissions(uint64_t page) const {
+  if (!byte_permissions_) {
+    return permissions_[page];
+  }
+
+  const auto begin = page << permission_page_shift;
+  const auto end = std::min(begin + permission_page_size, uint64_t(size_));
+
+  auto result = MemoryFlags::Read | MemoryFlags::Write | MemoryFlags::Execute;
+  for (uint64_t i = begin; i < end; ++i) {
+    result = result & permissions_[i];
+  }
+
+  return result;
+}
+
+void Memory::set_page_permissions(uint64_t address, size_t size, MemoryFlags flags) {
+  const auto end = address + size;
+
+  for (uint64_t page = address >> permission_page_shift;
+       (page << permission_page_shift) < end; ++page) {
+    // Last page may extend past the end of the memory, bytes out of bounds are ignored.
+    const auto page_begin = page << permission_page_shift;
+    const auto page_end = std::min(page_begin + permission_page_size, uint64_t(size_));
+    const auto page_size = page_end - page_begin;
+
+    const auto begin_in_page = std::max(address, page_begin) - page_begin;
+    const auto end_in_page = std::min(end, page_end) - page_begin;
+
+    auto it = partial_pages_.find(page);
+
+    if (begin_in_page == 0 && end_in_page == page_size) {
+      if (it != partial_pages_.end()) {
+        partial_pages_.erase(it);
+      }
+      permissions_[page] = flags;
+      continue;
+    }
+
+    if (it == partial_pages_.end()) {
+      if (permissions_[page] == flags) {
+        continue;
+      }
+
+      auto bytes = std::make_unique<MemoryFlags[]>(permission_page_size);
+      std::fill_n(bytes.get(), permission_page_size, permissions_[page]);
+      it = partial_pages_.emplace(page, std::move(bytes)).first;
+    }
+
+    const auto bytes = it->second.get();
+    std::fill(bytes + begin_in_page, bytes + end_in_page, flags);
+
+    // Page entry is used directly by the fast paths so it must allow only accesses which are
+    // allowed for every byte of the page.
+    auto common_flags = bytes[0];
+    bool uniform = true;
+    for (size_t i = 1; i < page_size; ++i) {
+      common_flags = common_flags & bytes[i];
+      uniform = uniform && bytes[i] == bytes[0];
+    }
+
+    permissions_[page] = common_flags;
+    if (uniform) {
+      partial_pages_.erase(it);
+    }
+  }
+}
+
+void Memory::update_page_protection(uint64_t address, size_t size) {
+  const auto page_size = host_page_size();
+  const auto pages_per_host_page = page_size >> permission_page_shift;
+
+  // Host page is accessible only if all guest bytes in it are. Pages which are partially
+  // accessible fault and get handled by the interpreter.
+  const auto host_page_flags = [&](uint64_t host_page) {
+    const auto first_page = host_page >> permission_page_shift;
+    const auto page_count = (uint64_t(size_) + permission_page_size - 1) >> permission_page_shift;
+
+    auto result = MemoryFlags::Read | MemoryFlags::Write;
+    for (uint64_t page = first_page; page < first_page + pages_per_host_page; ++page) {
+      result = result & (page < page_count ? page_permissions(page) : MemoryFlags::None);
+    }
+
+    return result;
+  };
+
+  const auto begin = address / page_size * page_size;
+  const auto end = std::min(address + size, uint64_t(mapping_size_));
+
+  // Protect runs of pages with the same flags at once.
+  uint64_t run_begin = begin;
+  MemoryFlags run_flags = host_page_flags(begin);
+
+  for (uint64_t page = begin + page_size;; page += page_size) {
+    const auto flags = page < end ? host_page_flags(page) : MemoryFlags::None;
+    if (page >= end || flags != run_flags) {
+      protect_guarded_memory(guarded_contents_ + run_begin, page - run_begin, run_flags);
+      if (page >= end) {
+        break;
+      }
+
+      run_begin = page;
+      run_flags = flags;
+    }
+  }
+}
+
+bool Memory::is_watched(uint64_t address, size_t size) const {
+  const auto end = address + size;
+
+  for (uint64_t page = address >> permission_page_shift;
+       (page << permission_page_shift) < end; ++page) {
+    if (page_watched_[page].load(std::memory_order::relaxed)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+std::vector<uint64_t> Memory::unwatch_for_write(uint64_t address, size_t size) {
+  std::vector<uint64_t> unwatched_pages;
+
+  if (size == 0 || !is_watched(address, size)) {
+    return unwatched_pages;
+  }
+
+  std::lock_guard lock(watch_mutex_);
+
+  const auto end = address + size;
+
+  for (uint64_t page = address >> permission_page_shift;
+       (page << permission_page_shift) < end; ++page) {
+    const auto it = watched_pages_.find(page);
+    if (it == watched_pages_.end()) {
+      continue;
+    }
+
+    const auto& original_entries = it->second;
+    std::copy(original_entries.begin(), original_entries.end(),
+              permissions_.get() + (byte_permissions_ ? page << permission_page_shift : page));
+
+    watched_pages_.erase(it);
+    page_watched_[page].store(false, std::memory_order::relaxed);
+
+    if (guarded_contents_) {
+      update_page_protection(page << permission_page_shift, permission_page_size);
+    }
+
+    unwatched_pages.push_back(page);
+  }
+
+  return unwatched_pages;
+}
+
+void Memory::finish_watched_write(const std::vector<uint64_t>& unwatched_pages) {
+  // Neighbouring pages touched by the same write weren't watched so their code is still valid.
+  for (const auto page : unwatched_pages) {
+    write_watch_generations_[page].fetch_add(1);
+
+    if (write_watch_handler_) {
+      write_watch_handler_(page << permission_page_shift);
+    }
+  }
 }
 
 bool Memory::read(uint64_t address, void* data, size_t size) const {
@@ -22,7 +319,11 @@ bool Memory::write(uint64_t address, const void* data, size_t size) {
   if (address > size_ || address + size > size_) {
     return false;
   }
+
+  const auto unwatched_pages = unwatch_for_write(address, size);
   std::memcpy(contents() + address, data, size);
+  finish_watched_write(unwatched_pages);
+
   return true;
 }
 
@@ -42,11 +343,15 @@ bool Memory::write(uint64_t address, MemoryFlags required_flags, const void* dat
   if (address > size_ || address + size > size_) {
     return false;
   }
+  const auto unwatched_pages = unwatch_for_write(address, size);
   if (!verify_permissions(address, size, required_flags)) {
+    finish_watched_write(unwatched_pages);
     return false;
   }
 
   std::memcpy(contents() + address, data, size);
+  finish_watched_write(unwatched_pages);
+
   return true;
 }
 
@@ -55,23 +360,130 @@ bool Memory::verify_permissions(uint64_t address, size_t size, MemoryFlags requi
     return false;
   }
 
-  const auto p = permissions() + address;
-  for (size_t i = 0; i < size; ++i) {
-    if ((p[i] & required_flags) != required_flags) {
+  if (size == 0) {
+    return true;
+  }
+
+  if (byte_permissions_) {
+    const auto p = permissions() + address;
+    for (size_t i = 0; i < size; ++i) {
+      if ((p[i] & required_flags) != required_flags) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  const auto end = address + size;
+
+  for (uint64_t page = address >> permission_page_shift;
+       (page << permission_page_shift) < end; ++page) {
+    if ((permissions_[page] & required_flags) == required_flags) {
+      continue;
+    }
+
+    // Page entry doesn't allow the access but some bytes of the page still may.
+    const auto it = partial_pages_.find(page);
+    if (it == partial_pages_.end()) {
       return false;
     }
+
+    const auto page_begin = page << permission_page_shift;
+    const auto begin_in_page = std::max(address, page_begin) - page_begin;
+    const auto end_in_page = std::min(end, page_begin + permission_page_size) - page_begin;
+
+    const auto bytes = it->second.get();
+    for (uint64_t i = begin_in_page; i < end_in_page; ++i) {
+      if ((bytes[i] & required_flags) != required_flags) {
+        return false;
+      }
+    }
   }
 
   return true;
 }
 
+void* Memory::aligned_pointer(uint64_t address, size_t size, MemoryFlags required_flags) {
+  if ((address & (size - 1)) != 0) {
+    return nullptr;
+  }
+
+  // The access happens after returning so the write is reported before it's done. Code which
+  // gets translated in the meantime can go stale, this is only possible when atomics modify
+  // code concurrently.
+  if ((required_flags & MemoryFlags::Write) != MemoryFlags::None && address + size <= size_) {
+    finish_watched_write(unwatch_for_write(address, size));
+  }
+
+  if (!verify_permissions(address, size, required_flags)) {
+    return nullptr;
+  }
+
+  return contents() + address;
+}
+
 bool Memory::set_permissions(uint64_t address, size_t size, MemoryFlags flags) {
   if (address > size_ || address + size > size_) {
     return false;
   }
 
-  const auto p = const_cast<MemoryFlags*>(permissions()) + address;
-  std::memset(p, uint8_t(flags), size);
+  if (size == 0) {
+    return true;
+  }
+
+  // Code on pages which become writable can be modified without going through the slow paths.
+  const auto unwatched_pages = unwatch_for_write(address, size);
+
+  if (byte_permissions_) {
+    std::fill_n(permissions_.get() + address, size, flags);
+  } else {
+    set_page_permissions(address, size, flags);
+  }
+
+  if (guarded_contents_) {
+    update_page_protection(address, size);
+  }
+
+  finish_watched_write(unwatched_pages);
 
   return true;
 }
+
+void Memory::watch_writes(uint64_t address, size_t size) {
+  if (size == 0 || address > size_ || address + size > size_) {
+    return;
+  }
+
+  std::lock_guard lock(watch_mutex_);
+
+  const auto end = address + size;
+
+  for (uint64_t page = address >> permission_page_shift;
+       (page << permission_page_shift) < end; ++page) {
+    if (page_watched_[page].load(std::memory_order::relaxed)) {
+      continue;
+    }
+
+    // Last page may extend past the end of the memory.
+    const auto page_begin = page << permission_page_shift;
+    const auto entry_count =
+      byte_permissions_ ? std::min(permission_page_size, uint64_t(size_) - page_begin) : 1;
+    const auto entries = permissions_.get() + (byte_permissions_ ? page_begin : page);
+
+    watched_pages_.emplace(page, std::vector<MemoryFlags>(entries, entries + entry_count));
+    for (size_t i = 0; i < entry_count; ++i) {
+      entries[i] = entries[i] & ~MemoryFlags::Write;
+    }
+
+    page_watched_[page].store(true, std::memory_order::relaxed);
+
+    if (guarded_contents_) {
+      update_page_protection(page << permission_page_shift, permission_page_size);
+    }
+  }
+}
+
+void Memory::set_write_watch_handler(WriteWatchHandler handler) {
+  write_watch_handler_ = std::move(handler);
+}
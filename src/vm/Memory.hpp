@@ -1,6 +1,11 @@
 #pragma once
+#include <atomic>
 #include <cstdint>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
 #include <base/EnumBitOperations.hpp>
 
@@ -14,19 +19,84 @@ enum class MemoryFlags : uint8_t {
 };
 
 class Memory {
+ public:
+  enum class Flags {
+    None = 0,
+
+    // Memory gets a second view for the JIT code which is followed by an inaccessible guard
+    // region and whose pages are accessible only if the guest has the required permissions for
+    // the whole page. Generated code doesn't need to check permissions then, faults are recovered
+    // by `jit::fault_handler`.
+    GuardPages = (1 << 0),
+
+    // Debug mode which tracks permissions for every byte and makes generated code check them
+    // with byte precision instead of using the page permission table.
+    BytePermissions = (1 << 1),
+  };
+
+  constexpr static uint64_t permission_page_shift = 12;
+  constexpr static uint64_t permission_page_size = uint64_t(1) << permission_page_shift;
+
+  // Called after the guest (or the host) has written to a watched page, the page is not watched
+  // anymore.
+  using WriteWatchHandler = std::function<void(uint64_t page_address)>;
+
+ private:
   size_t size_;
-  std::unique_ptr<uint64_t[]> contents_;
-  uint64_t* permissions_;
+
+  std::unique_ptr<uint64_t[]> storage_;
+  uint8_t* contents_{};
+
+  // One entry per byte with `Flags::BytePermissions`, one entry per permission page otherwise.
+  // Entry of a page is an intersection of permissions of all its bytes.
+  std::unique_ptr<MemoryFlags[]> permissions_;
+
+  // Byte permissions of pages whose bytes don't all have the same permissions.
+  std::unordered_map<uint64_t, std::unique_ptr<MemoryFlags[]>> partial_pages_;
+
+  bool byte_permissions_ = false;
+
+  // Only used with `Flags::GuardPages`.
+  uint8_t* guarded_contents_{};
+  size_t mapping_size_{};
+
+  // Write permission is removed from `permissions_` entries of watched pages so the JIT code
+  // doesn't write to them directly and their writes go through the slow paths. Original entries
+  // are kept in `watched_pages_`.
+  std::unique_ptr<std::atomic_bool[]> page_watched_;
+  std::unordered_map<uint64_t, std::vector<MemoryFlags>> watched_pages_;
+  std::mutex watch_mutex_;
+
+  WriteWatchHandler write_watch_handler_;
+  std::unique_ptr<std::atomic_uint64_t[]> write_watch_generations_;
+
+  MemoryFlags page_permissions(uint64_t page) const;
+  void set_page_permissions(uint64_t address, size_t size, MemoryFlags flags);
+
+  void update_page_protection(uint64_t address, size_t size);
+
+  bool is_watched(uint64_t address, size_t size) const;
+
+  // Stops watching pages in the range before they are written. Returns indices of pages which
+  // were watched, `finish_watched_write` must be called with them once the write is done.
+  std::vector<uint64_t> unwatch_for_write(uint64_t address, size_t size);
+  void finish_watched_write(const std::vector<uint64_t>& unwatched_pages);
 
  public:
-  explicit Memory(size_t size);
+  explicit Memory(size_t size, Flags flags = Flags::None);
+  ~Memory();
+
+  Memory(const Memory&) = delete;
+  Memory& operator=(const Memory&) = delete;
 
   size_t size() const { return size_; }
-  uint8_t* contents() { return reinterpret_cast<uint8_t*>(contents_.get()); }
-  const uint8_t* contents() const { return reinterpret_cast<const uint8_t*>(contents_.get()); }
-  const MemoryFlags* permissions() const {
-    return reinterpret_cast<const MemoryFlags*>(permissions_);
-  }
+  uint8_t* contents() { return contents_; }
+  const uint8_t* contents() const { return contents_; }
+  const MemoryFlags* permissions() const { return permissions_.get(); }
+
+  bool uses_byte_permissions() const { return byte_permissions_; }
+  bool uses_guard_pages() const { return guarded_contents_ != nullptr; }
+  uint8_t* guarded_contents() const { return guarded_contents_; }
 
   bool read(uint64_t address, void* data, size_t size) const;
   bool write(uint64_t address, const void* data, size_t size);
@@ -35,6 +105,20 @@ class Memory {
   bool write(uint64_t address, MemoryFlags required_flags, const void* data, size_t size);
 
   bool verify_permissions(uint64_t address, size_t size, MemoryFlags required_flags) const;
+
+  // Reports writes to pages in the range to the write watch handler (once per page, until the
+  // page is watched again). Used to detect modifications of code translated by the JIT.
+  void watch_writes(uint64_t address, size_t size);
+  void set_write_watch_handler(WriteWatchHandler handler);
+
+  // Incremented after every write to the watched page at `page_address`.
+  uint64_t write_watch_generation(uint64_t page_address) const {
+    return write_watch_generations_[page_address >> permission_page_shift].load();
+  }
+
+  // Returns host pointer to the naturally aligned guest value if the guest has `required_flags`
+  // for it. Atomic operations access memory through it directly.
+  void* aligned_pointer(uint64_t address, size_t size, MemoryFlags required_flags);
   bool set_permissions(uint64_t address, size_t size, MemoryFlags flags);
 
   template <typename T>
@@ -47,6 +131,11 @@ class Memory {
     return write(address, &value, sizeof(T));
   }
 
+  template <typename T>
+  T* aligned_pointer(uint64_t address, MemoryFlags required_flags) {
+    return static_cast<T*>(aligned_pointer(address, sizeof(T), required_flags));
+  }
+
   template <typename T>
   bool read(uint64_t address, MemoryFlags required_flags, T& value) const {
     return read(address, required_flags, &value, sizeof(T));
@@ -60,4 +149,5 @@ class Memory {
 
 }  // namespace vm
 
-IMPLEMENT_ENUM_BIT_OPERATIONS(vm::MemoryFlags)
\ No newline at end of file
+IMPLEMENT_ENUM_BIT_OPERATIONS(vm::MemoryFlags)
+IMPLEMENT_ENUM_BIT_OPERATIONS(vm::Memory::Flags)
\ No newline at end of file
@@ -4,3 +4,7 @@
 std::string_view vm::detail::register_name(Register reg) {
   return InstructionDisplay::register_name(reg);
 }
+
+std::string_view vm::detail::register_name(FloatRegister reg) {
+  return InstructionDisplay::register_name(reg);
+}
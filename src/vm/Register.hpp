@@ -39,9 +39,45 @@ enum class Register {
   Pc = 32,
 };
 
+enum class FloatRegister {
+  Ft0 = 0,
+  Ft1,
+  Ft2,
+  Ft3,
+  Ft4,
+  Ft5,
+  Ft6,
+  Ft7,
+  Fs0,
+  Fs1,
+  Fa0,
+  Fa1,
+  Fa2,
+  Fa3,
+  Fa4,
+  Fa5,
+  Fa6,
+  Fa7,
+  Fs2,
+  Fs3,
+  Fs4,
+  Fs5,
+  Fs6,
+  Fs7,
+  Fs8,
+  Fs9,
+  Fs10,
+  Fs11,
+  Ft8,
+  Ft9,
+  Ft10,
+  Ft11 = 31,
+};
+
 namespace detail {
 
 std::string_view register_name(Register reg);
+std::string_view register_name(FloatRegister reg);
 
 }
 
@@ -52,4 +88,11 @@ struct fmt::formatter<vm::Register> : formatter<std::string_view> {
   auto format(vm::Register reg, format_context& ctx) const {
     return formatter<string_view>::format(vm::detail::register_name(reg), ctx);
   }
+};
+
+template <>
+struct fmt::formatter<vm::FloatRegister> : formatter<std::string_view> {
+  auto format(vm::FloatRegister reg, format_context& ctx) const {
+    return formatter<string_view>::format(vm::detail::register_name(reg), ctx);
+  }
 };
\ No newline at end of file
@@ -7,9 +7,45 @@
 namespace vm {
 
 class RegisterState {
+ public:
+  constexpr static uint64_t no_reservation = ~uint64_t(0);
+
+  // VLEN is 128 bits.
+  constexpr static size_t vector_register_size = 16;
+
+  // `vill` bit of `vtype`, set after reset and for unsupported configurations.
+  constexpr static uint64_t vtype_illegal = uint64_t(1) << 63;
+
+ private:
   uint64_t registers[33]{};
 
+  // Reservation made by `lr`. `sc` succeeds only if the reserved location still holds the loaded
+  // value so it can be done with a single compare-exchange, even if multiple harts share memory.
+  uint64_t reservation_address_ = no_reservation;
+  uint64_t reservation_value_{};
+
+  // Single precision values are stored NaN-boxed (upper 32 bits set).
+  uint64_t float_registers[32]{};
+
+  // Only accrued exception flags (bits 0-4) and rounding mode (bits 5-7) are stored.
+  uint32_t fcsr_{};
+
+  uint64_t vl_{};
+  uint64_t vtype_ = vtype_illegal;
+
+  // Register groups (LMUL > 1) are contiguous so they can be accessed as one array.
+  alignas(16) uint8_t vector_registers[32 * vector_register_size]{};
+
  public:
+  // Offsets from `raw_table()` used by the generated code.
+  constexpr static size_t reservation_address_offset = sizeof(registers);
+  constexpr static size_t reservation_value_offset = sizeof(registers) + sizeof(uint64_t);
+  constexpr static size_t float_registers_offset = sizeof(registers) + 2 * sizeof(uint64_t);
+  constexpr static size_t fcsr_offset = float_registers_offset + sizeof(float_registers);
+  constexpr static size_t vl_offset = fcsr_offset + sizeof(uint64_t);  // `fcsr_` is padded.
+  constexpr static size_t vtype_offset = vl_offset + sizeof(uint64_t);
+  constexpr static size_t vector_registers_offset = vtype_offset + sizeof(uint64_t);
+
   RegisterState() = default;
 
   uint64_t get(Register reg) const { return registers[size_t(reg)]; }
@@ -22,6 +58,34 @@ class RegisterState {
 
   uint64_t pc() const { return get(Register::Pc); }
 
+  uint64_t get(FloatRegister reg) const { return float_registers[size_t(reg)]; }
+  void set(FloatRegister reg, uint64_t value) { float_registers[size_t(reg)] = value; }
+
+  uint32_t fcsr() const { return fcsr_; }
+  void set_fcsr(uint32_t value) { fcsr_ = value & 0xff; }
+
+  uint64_t vl() const { return vl_; }
+  uint64_t vtype() const { return vtype_; }
+
+  void set_vector_configuration(uint64_t vl, uint64_t vtype) {
+    vl_ = vl;
+    vtype_ = vtype;
+  }
+
+  uint8_t* vector_register(size_t index) { return vector_registers + index * vector_register_size; }
+  const uint8_t* vector_register(size_t index) const {
+    return vector_registers + index * vector_register_size;
+  }
+
+  uint64_t reservation_address() const { return reservation_address_; }
+  uint64_t reservation_value() const { return reservation_value_; }
+
+  void set_reservation(uint64_t address, uint64_t value) {
+    reservation_address_ = address;
+    reservation_value_ = value;
+  }
+  void clear_reservation() { reservation_address_ = no_reservation; }
+
   uint64_t* raw_table() { return registers; }
 };
 
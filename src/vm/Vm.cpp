@@ -3,24 +3,63 @@
 
 #include "jit/CreateExecutor.hpp"
 #include "jit/Executor.hpp"
+#include "jit/FaultHandler.hpp"
 
 #include "private/ExecutionLog.hpp"
 
 #include <base/Error.hpp>
 #include <base/Log.hpp>
+#include <base/concurrency/JoinableThreads.hpp>
 
 using namespace vm;
 
-Vm::Vm(size_t memory_size) : memory_(memory_size) {}
+Vm::Vm(size_t memory_size, Memory::Flags memory_flags) : memory_(memory_size, memory_flags) {}
 Vm::~Vm() = default;
 
-void Vm::use_jit(std::shared_ptr<jit::CodeBuffer> code_buffer) {
-  jit_executor = jit::create_arch_specific_executor(std::move(code_buffer));
+void Vm::use_jit(std::shared_ptr<jit::CodeBuffer> code_buffer,
+                 const jit::TieringThresholds& tiering_thresholds) {
+  multithreaded_jit =
+    (code_buffer->flags() & jit::CodeBuffer::Flags::Multithreaded) != jit::CodeBuffer::Flags::None;
+
+  // Blocks are invalidated when their guest code is modified.
+  memory_.set_write_watch_handler(
+    [code_buffer](uint64_t page_address) { code_buffer->invalidate_page(page_address); });
+
+  jit_executor = jit::create_arch_specific_executor(std::move(code_buffer), tiering_thresholds);
   if (!jit_executor) {
     log_warn("couldn't create JIT executor for current platform");
+    memory_.set_write_watch_handler({});
+    return;
+  }
+
+  // Generated code relies on guard page faults to detect invalid memory accesses.
+  if (memory_.uses_guard_pages()) {
+    jit::fault_handler::install();
+  }
+}
+
+size_t Vm::load_translation_cache(const std::string& path, uint64_t image_hash) {
+  if (!jit_executor) {
+    return 0;
+  }
+
+  return jit_executor->load_translation_cache(memory_, path, image_hash);
+}
+
+void Vm::save_translation_cache(const std::string& path, uint64_t image_hash) {
+  if (jit_executor) {
+    jit_executor->save_translation_cache(memory_, path, image_hash);
   }
 }
 
+size_t Vm::pretranslate(std::span<const uint64_t> entry_points, size_t thread_count) {
+  if (!jit_executor) {
+    return 0;
+  }
+
+  return jit_executor->pretranslate(memory_, entry_points, thread_count);
+}
+
 Exit Vm::run(Cpu& cpu) {
   if (!jit_executor) {
     return run_interpreter(cpu);
@@ -56,6 +95,13 @@ Exit Vm::run(Cpu& cpu) {
         break;
       }
 
+      case JE::ColdBlock: {
+        if (!Interpreter::run_block(memory_, cpu, exit, jit_executor->profile())) {
+          return exit;
+        }
+        break;
+      }
+
       default:
         unreachable();
     }
@@ -83,3 +129,27 @@ Exit Vm::run_interpreter(Cpu& cpu) {
 
   return exit;
 }
+
+std::vector<Exit> Vm::run_harts(std::span<Cpu> cpus, const HartExitHandler& exit_handler) {
+  verify(!jit_executor || multithreaded_jit || cpus.size() <= 1,
+         "running multiple harts requires multithreaded JIT code buffer");
+
+  std::vector<Exit> exits(cpus.size());
+
+  {
+    base::JoinableThreads threads;
+
+    for (size_t hart_id = 0; hart_id < cpus.size(); ++hart_id) {
+      threads.spawn([this, &cpus, &exits, &exit_handler, hart_id] {
+        auto& cpu = cpus[hart_id];
+        auto& exit = exits[hart_id];
+
+        do {
+          exit = run(cpu);
+        } while (exit_handler && exit_handler(hart_id, cpu, exit));
+      });
+    }
+  }
+
+  return exits;
+}
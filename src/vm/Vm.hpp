@@ -2,8 +2,13 @@
 #include "Exit.hpp"
 #include "Memory.hpp"
 #include "jit/CodeBuffer.hpp"
+#include "jit/Profile.hpp"
 
+#include <functional>
 #include <memory>
+#include <span>
+#include <string>
+#include <vector>
 
 namespace vm {
 
@@ -16,16 +21,40 @@ class Cpu;
 class Vm {
   Memory memory_;
   std::unique_ptr<jit::Executor> jit_executor;
+  bool multithreaded_jit = false;
 
  public:
-  explicit Vm(size_t memory_size);
+  // Called on the thread of the hart whenever it exits the VM. Returns true if the hart should
+  // resume execution (e.g. after handling an `ecall`).
+  using HartExitHandler = std::function<bool(size_t hart_id, Cpu& cpu, const Exit& exit)>;
+
+  explicit Vm(size_t memory_size, Memory::Flags memory_flags = Memory::Flags::None);
   ~Vm();
 
-  void use_jit(std::shared_ptr<jit::CodeBuffer> code_buffer);
+  // Cold code is interpreted and compiled only once it gets executed often enough, see
+  // `jit::TieringThresholds`.
+  void use_jit(std::shared_ptr<jit::CodeBuffer> code_buffer,
+               const jit::TieringThresholds& tiering_thresholds = {});
+
+  // Inserts blocks compiled by earlier runs of the guest image with `image_hash` into the JIT code
+  // buffer and starts recording compiled blocks for `save_translation_cache`. Must be called
+  // after the image is loaded and before any hart runs. Returns the number of inserted blocks.
+  size_t load_translation_cache(const std::string& path, uint64_t image_hash);
+  void save_translation_cache(const std::string& path, uint64_t image_hash);
+
+  // Compiles code reachable from `entry_points` (e.g. the image entrypoint and its functions) on
+  // `thread_count` threads before any hart runs, so it doesn't go through the interpreter tier.
+  // Returns the number of compiled blocks.
+  size_t pretranslate(std::span<const uint64_t> entry_points, size_t thread_count);
 
   Exit run(Cpu& cpu);
   Exit run_interpreter(Cpu& cpu);
 
+  // Runs every CPU as a separate hart on its own host thread. Harts share guest memory and the
+  // JIT code buffer, which needs `jit::CodeBuffer::Flags::Multithreaded` then. Returns the last
+  // exit of every hart once all of them have stopped.
+  std::vector<Exit> run_harts(std::span<Cpu> cpus, const HartExitHandler& exit_handler = {});
+
   Memory& memory() { return memory_; }
   const Memory& memory() const { return memory_; }
 };
@@ -1,8 +1,13 @@
 #include "CodeBuffer.hpp"
 #include "CodeDump.hpp"
+#include "FaultHandler.hpp"
 
 #include <base/Error.hpp>
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
 using namespace vm::jit;
 
 static CodeDump::Architecture code_dump_architecture() {
@@ -15,13 +20,272 @@ static CodeDump::Architecture code_dump_architecture() {
 #endif
 }
 
+constexpr size_t code_alignment = 16;
+
+// Offset 0 means that there is no block.
+constexpr size_t first_block_offset = code_alignment;
+
+static size_t align_code_offset(size_t offset) {
+  return (offset + code_alignment - 1) & ~(code_alignment - 1);
+}
+
+// Encodes unconditional direct jump from `source` to `target`. Returns the number of bytes
+// written or 0 if the jump cannot be encoded.
+static size_t encode_direct_jump(uint64_t source, uint64_t target, uint8_t* output) {
+#if defined(VM_JIT_X64)
+  // jmp rel32
+  const auto displacement = int64_t(target) - int64_t(source + 5);
+  if (displacement < std::numeric_limits<int32_t>::min() ||
+      displacement > std::numeric_limits<int32_t>::max()) {
+    return 0;
+  }
+
+  const auto displacement32 = int32_t(displacement);
+
+  output[0] = 0xe9;
+  std::memcpy(output + 1, &displacement32, sizeof(displacement32));
+
+  return 5;
+#elif defined(VM_JIT_AARCH64)
+  // b imm26
+  const auto displacement = int64_t(target) - int64_t(source);
+  if ((displacement & 3) != 0 || displacement < -(int64_t(1) << 27) ||
+      displacement >= (int64_t(1) << 27)) {
+    return 0;
+  }
+
+  const auto instruction = uint32_t(0x14000000) | (uint32_t(displacement >> 2) & 0x03ffffff);
+  std::memcpy(output, &instruction, sizeof(instruction));
+
+  return 4;
+#else
+  return 0;
+#endif
+}
+
+// Number of bytes patched at link sites and inline cache slots.
+#if defined(VM_JIT_X64)
+constexpr size_t direct_jump_size = 5;
+constexpr size_t inline_cache_value_size = 4;
+#elif defined(VM_JIT_AARCH64)
+constexpr size_t direct_jump_size = 4;
+constexpr size_t inline_cache_value_size = 8;
+#else
+constexpr size_t direct_jump_size = 0;
+constexpr size_t inline_cache_value_size = 0;
+#endif
+
+static bool patch_in_bounds(uint32_t offset, size_t patch_size, size_t code_size) {
+  return offset < code_size && patch_size <= code_size - offset;
+}
+
+// Embeds relocated `value` in the instruction(s) at `code` and returns their size.
+static size_t encode_relocation_value(uint64_t value, uint8_t* code) {
+#if defined(VM_JIT_X64)
+  // mov reg, imm64
+  std::memcpy(code, &value, sizeof(value));
+
+  return sizeof(value);
+#elif defined(VM_JIT_AARCH64)
+  // movz reg, imm16; movk reg, imm16, lsl 16; movk reg, imm16, lsl 32; movk reg, imm16, lsl 48
+  for (size_t i = 0; i < 4; ++i) {
+    uint32_t instruction;
+    std::memcpy(&instruction, code + i * 4, sizeof(instruction));
+
+    const auto imm16 = uint32_t(value >> (i * 16)) & 0xffff;
+    instruction = (instruction & ~(uint32_t(0xffff) << 5)) | (imm16 << 5);
+
+    std::memcpy(code + i * 4, &instruction, sizeof(instruction));
+  }
+
+  return 16;
+#else
+  fatal_error("cannot encode relocations: unknown code architecture");
+#endif
+}
+
+// Embeds `value` in the compare instruction(s) of an inline cache slot. Returns false if the
+// value cannot be encoded.
+static bool encode_inline_cache_value(uint64_t value, uint8_t* code, size_t& size) {
+#if defined(VM_JIT_X64)
+  // cmp reg, imm32 (sign extended)
+  if (value > uint64_t(std::numeric_limits<int32_t>::max())) {
+    return false;
+  }
+
+  const auto value32 = uint32_t(value);
+  std::memcpy(code, &value32, sizeof(value32));
+  size = sizeof(value32);
+
+  return true;
+#elif defined(VM_JIT_AARCH64)
+  // movz reg, imm16; movk reg, imm16, lsl 16
+  if (value > std::numeric_limits<uint32_t>::max()) {
+    return false;
+  }
+
+  for (size_t i = 0; i < 2; ++i) {
+    uint32_t instruction;
+    std::memcpy(&instruction, code + i * 4, sizeof(instruction));
+
+    const auto imm16 = uint32_t(value >> (i * 16)) & 0xffff;
+    instruction = (instruction & ~(uint32_t(0xffff) << 5)) | (imm16 << 5);
+
+    std::memcpy(code + i * 4, &instruction, sizeof(instruction));
+  }
+  size = 8;
+
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool CodeBuffer::patch_sites_in_bounds(size_t code_size,
+                                       std::span<const LinkSite> link_sites,
+                                       std::span<const InlineCache> inline_caches,
+                                       std::span<const FaultSite> fault_sites) {
+  for (const auto& link_site : link_sites) {
+    if (!patch_in_bounds(link_site.offset, direct_jump_size, code_size)) {
+      return false;
+    }
+  }
+
+  for (const auto& inline_cache : inline_caches) {
+    if (!patch_in_bounds(inline_cache.miss_offset, direct_jump_size, code_size) ||
+        !patch_in_bounds(inline_cache.fallback_offset, 1, code_size)) {
+      return false;
+    }
+
+    for (const auto& slot : inline_cache.slots) {
+      if (!patch_in_bounds(slot.value_offset, inline_cache_value_size, code_size) ||
+          !patch_in_bounds(slot.jump_offset, direct_jump_size, code_size)) {
+        return false;
+      }
+    }
+  }
+
+  for (const auto& fault_site : fault_sites) {
+    if (fault_site.access_offset >= code_size || fault_site.exit_offset >= code_size) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool CodeBuffer::can_flush() const {
+  // Other threads may be executing code of the blocks, see `request_flush`.
+  return (flags_ & Flags::Multithreaded) == Flags::None;
+}
+
+void CodeBuffer::request_flush() {
+  if (flush_requested.exchange(true)) {
+    return;
+  }
+
+  // Generated code of multithreaded buffers always jumps to other blocks via the translation
+  // table. Threads which are running it exit once they reach an empty entry. Leaves are cleared
+  // in place because other threads may be looking up blocks in them.
+  for (const auto& leaf : table_leaves) {
+    for (size_t i = 0; i < table_leaf_entry_count; ++i) {
+      leaf[i].store(0, std::memory_order::release);
+    }
+  }
+}
+
+void CodeBuffer::flush_internal() {
+  // Threads which back out of `enter_code` during a safepoint flush are counted for a moment, see
+  // `wait_for_flush` for why they can't be running generated code.
+  verify(!can_flush() || executing_threads.load(std::memory_order::acquire) == 0,
+         "cannot flush JIT code buffer while its code is running");
+
+  // Generated code isn't running so the leaves can be freed. Leaves of multithreaded buffers were
+  // already cleared by `request_flush` and lookups outside of generated code may still use them.
+  if (can_flush()) {
+    for (size_t i = 0; i < table_directory_size; ++i) {
+      table_directory[i].store(empty_table_leaf.get(), std::memory_order::release);
+    }
+    table_leaves.clear();
+  }
+
+  halfword_blocks.clear();
+  patchable_sites.clear();
+  incoming_links.clear();
+  outgoing_links.clear();
+  inline_caches.clear();
+  block_pages.clear();
+
+  reset_fault_sites();
+  page_blocks.clear();
+
+  next_free_offset = first_block_offset;
+  flush_count_.fetch_add(1);
+}
+
+void CodeBuffer::reset_fault_sites() {
+  constexpr size_t initial_capacity = 1024;
+
+  // Generated code isn't running so the fault handler can't be searching the old tables.
+  auto table = std::make_unique<FaultSiteTable>(initial_capacity);
+  fault_site_table.store(table.get(), std::memory_order::release);
+
+  fault_site_tables.clear();
+  fault_site_tables.push_back(std::move(table));
+}
+
+void CodeBuffer::add_fault_sites(uint32_t offset, std::span<const FaultSite> sites) {
+  if (sites.empty()) {
+    return;
+  }
+
+  auto table = fault_site_tables.back().get();
+  const auto count = table->count.load(std::memory_order::relaxed);
+
+  if (count + sites.size() > table->capacity) {
+    auto new_table =
+      std::make_unique<FaultSiteTable>(std::max(table->capacity * 2, count + sites.size()));
+    std::copy_n(table->sites.get(), count, new_table->sites.get());
+    new_table->count.store(count, std::memory_order::relaxed);
+
+    table = new_table.get();
+    fault_site_table.store(table, std::memory_order::release);
+    fault_site_tables.push_back(std::move(new_table));
+  }
+
+  const auto new_sites = table->sites.get() + count;
+  for (size_t i = 0; i < sites.size(); ++i) {
+    new_sites[i] = FaultSite{
+      .access_offset = offset + sites[i].access_offset,
+      .exit_offset = offset + sites[i].exit_offset,
+    };
+  }
+  std::sort(new_sites, new_sites + sites.size(), [](const FaultSite& a, const FaultSite& b) {
+    return a.access_offset < b.access_offset;
+  });
+
+  // Block code is placed after all existing blocks so the table stays sorted.
+  verify(count == 0 || table->sites[count - 1].access_offset < new_sites[0].access_offset,
+         "fault sites are not inserted in order");
+
+  table->count.store(count + sites.size(), std::memory_order::release);
+}
+
 uint32_t CodeBuffer::allocate_executable_memory(std::span<const uint8_t> code) {
-  constexpr auto code_alignment = uint64_t(16);
+  auto start_offset = align_code_offset(next_free_offset);
+  if (start_offset + code.size() > standalone_offset) {
+    if (!can_flush()) {
+      request_flush();
+      return 0;
+    }
+
+    flush_internal();
+    start_offset = align_code_offset(next_free_offset);
+  }
 
-  const auto start_offset = (next_free_offset + code_alignment - 1) & ~(code_alignment - 1);
   const auto end_offset = start_offset + code.size();
 
-  verify(end_offset <= executable_buffer.size(), "out of executable memory in the jit storage");
+  verify(end_offset <= standalone_offset, "out of executable memory in the jit storage");
 
   executable_buffer.write(start_offset, code.data(), code.size());
   next_free_offset = end_offset;
@@ -29,12 +293,140 @@ uint32_t CodeBuffer::allocate_executable_memory(std::span<const uint8_t> code) {
   return start_offset;
 }
 
+uint32_t CodeBuffer::allocate_standalone_memory(std::span<const uint8_t> code) {
+  verify(code.size() <= standalone_offset, "out of executable memory in the jit storage");
+
+  const auto start_offset = (standalone_offset - code.size()) & ~(code_alignment - 1);
+  if (start_offset < next_free_offset && can_flush()) {
+    flush_internal();
+  }
+
+  verify(start_offset >= next_free_offset, "out of executable memory in the jit storage");
+
+  executable_buffer.write(start_offset, code.data(), code.size());
+  standalone_offset = start_offset;
+
+  return start_offset;
+}
+
+uint32_t CodeBuffer::table_lookup(uint64_t guest_address) const {
+  const auto index = guest_address / table_entry_granularity;
+  if (index >= max_blocks) {
+    return 0;
+  }
+
+  const auto leaf =
+    table_directory[index / table_leaf_entry_count].load(std::memory_order::acquire);
+  const auto entry = leaf[index % table_leaf_entry_count].load(std::memory_order::acquire);
+  if ((entry & halfword_block_tag) != (guest_address & halfword_block_tag)) {
+    return 0;
+  }
+
+  return entry & ~halfword_block_tag;
+}
+
+std::atomic_uint32_t& CodeBuffer::table_entry(uint64_t guest_address) {
+  const auto index = guest_address / table_entry_granularity;
+  verify(index < max_blocks, "guest address {:x} is out of the block translation table",
+         guest_address);
+
+  auto& leaf_pointer = table_directory[index / table_leaf_entry_count];
+
+  auto leaf = leaf_pointer.load(std::memory_order::relaxed);
+  if (leaf == empty_table_leaf.get()) {
+    table_leaves.push_back(std::make_unique<std::atomic_uint32_t[]>(table_leaf_entry_count));
+    leaf = table_leaves.back().get();
+
+    // Zeroed leaf must be visible to generated code before it can reach it.
+    leaf_pointer.store(leaf, std::memory_order::release);
+  }
+
+  return leaf[index % table_leaf_entry_count];
+}
+
+uint32_t CodeBuffer::find_block(uint64_t guest_address) const {
+  if ((guest_address & (block_alignment - 1)) != 0) {
+    return 0;
+  }
+
+  if (const auto offset = table_lookup(guest_address)) {
+    return offset;
+  }
+
+  // Translation table entry may be owned by the block at the preceding aligned address.
+  if ((guest_address & halfword_block_tag) != 0) {
+    if (const auto it = halfword_blocks.find(guest_address); it != halfword_blocks.end()) {
+      return it->second;
+    }
+  }
+
+  return 0;
+}
+
+void CodeBuffer::set_block(uint64_t guest_address, uint32_t offset) {
+  auto& entry = table_entry(guest_address);
+
+  if ((guest_address & halfword_block_tag) == 0) {
+    entry.store(offset, std::memory_order::release);
+    return;
+  }
+
+  halfword_blocks[guest_address] = offset;
+
+  const auto current_entry = entry.load();
+  if (current_entry == 0 || (current_entry & halfword_block_tag) != 0) {
+    entry.store(offset | halfword_block_tag, std::memory_order::release);
+  }
+}
+
+void CodeBuffer::remove_block(uint64_t guest_address) {
+  auto& entry = table_entry(guest_address);
+
+  if ((guest_address & halfword_block_tag) == 0) {
+    // Hand the entry over to the block at the following halfword address.
+    const auto it = halfword_blocks.find(guest_address + halfword_block_tag);
+    entry.store(it != halfword_blocks.end() ? it->second | halfword_block_tag : 0,
+                std::memory_order::release);
+    return;
+  }
+
+  halfword_blocks.erase(guest_address);
+
+  if ((entry.load() & halfword_block_tag) != 0) {
+    entry.store(0, std::memory_order::release);
+  }
+}
+
 CodeBuffer::CodeBuffer(Flags flags, size_t size, size_t max_executable_guest_address)
-    : flags_(flags), executable_buffer(size), next_free_offset(16) {
-  max_blocks = (max_executable_guest_address + block_size - 1) / block_size;
-  block_to_offset = std::make_unique<std::atomic_uint32_t[]>(max_blocks);
+    : flags_(flags),
+      executable_buffer(size),
+      next_free_offset(first_block_offset),
+      standalone_offset(size & ~(code_alignment - 1)) {
+  // Code offsets are 32 bit and 0 is reserved for missing blocks.
+  verify(size <= std::numeric_limits<uint32_t>::max(), "JIT code buffer is too large");
+  verify(size > first_block_offset, "JIT code buffer is too small");
+
+  max_blocks =
+    (max_executable_guest_address + table_entry_granularity - 1) / table_entry_granularity;
+
+  empty_table_leaf = std::make_unique<std::atomic_uint32_t[]>(table_leaf_entry_count);
+
+  // Generated code addresses directory entries with 32 bit displacements.
+  table_directory_size = (max_blocks + table_leaf_entry_count - 1) / table_leaf_entry_count;
+  verify(table_directory_size * sizeof(uint64_t) <= std::numeric_limits<int32_t>::max(),
+         "max executable guest address is too large");
+  table_directory = std::make_unique<std::atomic<std::atomic_uint32_t*>[]>(table_directory_size);
+  for (size_t i = 0; i < table_directory_size; ++i) {
+    table_directory[i].store(empty_table_leaf.get(), std::memory_order::relaxed);
+  }
+
+  reset_fault_sites();
+
+  fault_handler::register_code_buffer(this);
+}
+CodeBuffer::~CodeBuffer() {
+  fault_handler::unregister_code_buffer(this);
 }
-CodeBuffer::~CodeBuffer() = default;
 
 void CodeBuffer::dump_code_to_file(const std::string& path) {
   std::unique_lock lock(mutex);
@@ -43,30 +435,217 @@ void CodeBuffer::dump_code_to_file(const std::string& path) {
 }
 
 void* CodeBuffer::get(uint64_t guest_address) const {
-  if ((guest_address & (block_size - 1)) != 0) {
+  if ((guest_address & (block_alignment - 1)) != 0) {
     return nullptr;
   }
 
-  const auto block = guest_address / block_size;
-  const auto offset = block_to_offset[block].load(std::memory_order::acquire);
+  auto offset = table_lookup(guest_address);
+  if (offset == 0 && (guest_address & halfword_block_tag) != 0) {
+    std::unique_lock lock(mutex);
+    offset = find_block(guest_address);
+  }
 
   return offset ? executable_buffer.address(offset) : nullptr;
 }
 
-void* CodeBuffer::insert(uint64_t guest_address, std::span<const uint8_t> code) {
-  verify((guest_address & (block_size - 1)) == 0, "guest address is misaligned");
+bool CodeBuffer::is_linking_enabled() const {
+  // Patching code that may be concurrently executed by other threads isn't supported.
+  return (flags_ & Flags::Multithreaded) == Flags::None;
+}
 
-  std::unique_lock lock(mutex);
+bool CodeBuffer::write_direct_jump(uint32_t site_offset, uint32_t target_offset) {
+  uint8_t jump[max_direct_jump_size]{};
+  const auto jump_size =
+    encode_direct_jump(uint64_t(executable_buffer.address(site_offset)),
+                       uint64_t(executable_buffer.address(target_offset)), jump);
+  if (jump_size == 0) {
+    return false;
+  }
 
-  if (const auto p = get(guest_address)) {
-    return p;
+  executable_buffer.write(site_offset, jump, jump_size);
+
+  return true;
+}
+
+void CodeBuffer::write_inline_cache_value(uint32_t value_offset, uint64_t value) {
+  uint8_t code[max_direct_jump_size]{};
+  std::memcpy(code, executable_buffer.address(value_offset), sizeof(code));
+
+  size_t size{};
+  verify(encode_inline_cache_value(value, code, size), "failed to encode inline cache value");
+
+  executable_buffer.write(value_offset, code, size);
+}
+
+void CodeBuffer::link_site(uint32_t site_offset, uint32_t target_offset) {
+  auto& site = patchable_sites[site_offset];
+  if (site.linked) {
+    return;
   }
 
+  uint8_t jump[max_direct_jump_size]{};
+  const auto jump_size =
+    encode_direct_jump(uint64_t(executable_buffer.address(site_offset)),
+                       uint64_t(executable_buffer.address(target_offset)), jump);
+  if (jump_size == 0) {
+    return;
+  }
+
+  std::memcpy(site.original_code, executable_buffer.address(site_offset), jump_size);
+  site.original_code_size = uint8_t(jump_size);
+
+  executable_buffer.write(site_offset, jump, jump_size);
+
+  site.linked = true;
+}
+
+void CodeBuffer::unlink_site(uint32_t site_offset) {
+  auto& site = patchable_sites[site_offset];
+  if (!site.linked) {
+    return;
+  }
+
+  executable_buffer.write(site_offset, site.original_code, site.original_code_size);
+
+  site.linked = false;
+}
+
+void CodeBuffer::unlink_incoming_sites(uint64_t guest_address) {
+  if (const auto it = incoming_links.find(guest_address); it != incoming_links.end()) {
+    for (const auto site_offset : it->second) {
+      unlink_site(site_offset);
+    }
+  }
+}
+
+void CodeBuffer::unlink_internal(uint64_t guest_address) {
+  unlink_incoming_sites(guest_address);
+
+  // Make inline cache slots that jump to this block unreachable. They won't be reused.
+  for (auto& [instruction_address, states] : inline_caches) {
+    for (auto& state : states) {
+      for (size_t i = 0; i < state.used_slots; ++i) {
+        if (state.targets[i] == guest_address) {
+          write_inline_cache_value(state.cache.slots[i].value_offset, inline_cache_placeholder);
+          state.targets[i] = inline_cache_placeholder;
+        }
+      }
+    }
+  }
+}
+
+void CodeBuffer::remove_internal(uint64_t guest_address) {
+  remove_block(guest_address);
+
+  // Forget about link sites that are part of the removed block.
+  if (const auto it = outgoing_links.find(guest_address); it != outgoing_links.end()) {
+    for (const auto site_offset : it->second) {
+      auto& target_sites = incoming_links[patchable_sites[site_offset].target];
+      target_sites.erase(std::remove(target_sites.begin(), target_sites.end(), site_offset),
+                         target_sites.end());
+
+      patchable_sites.erase(site_offset);
+    }
+
+    outgoing_links.erase(it);
+  }
+
+  // Forget about inline caches that are part of the removed block.
+  for (auto& [instruction_address, states] : inline_caches) {
+    std::erase_if(states, [&](const InlineCacheState& state) {
+      return state.block_address == guest_address;
+    });
+  }
+
+  if (const auto it = block_pages.find(guest_address); it != block_pages.end()) {
+    for (const auto page_address : it->second) {
+      if (const auto page_it = page_blocks.find(page_address); page_it != page_blocks.end()) {
+        std::erase(page_it->second, guest_address);
+      }
+    }
+
+    block_pages.erase(it);
+  }
+}
+
+void* CodeBuffer::insert_internal(uint64_t guest_address,
+                                  std::span<const uint8_t> code,
+                                  std::span<const LinkSite> link_sites,
+                                  std::span<const InlineCache> inline_caches,
+                                  std::span<const FaultSite> fault_sites,
+                                  std::span<const Relocation> relocations,
+                                  std::span<const uint64_t> code_pages) {
+  verify(patch_sites_in_bounds(code.size(), link_sites, inline_caches, fault_sites),
+         "patch site is out of bounds");
+
   const auto offset = allocate_executable_memory(code);
+  if (offset == 0) {
+    return nullptr;
+  }
+
   const auto allocation = executable_buffer.address(offset);
 
-  const auto block = guest_address / block_size;
-  block_to_offset[block].store(offset, std::memory_order::release);
+  // Block is not reachable yet so its code can be patched freely.
+  for (const auto& relocation : relocations) {
+    verify(relocation.offset < code.size(), "relocation is out of bounds");
+
+    uint8_t relocated_code[16]{};
+    const auto available_size = std::min(sizeof(relocated_code), code.size() - relocation.offset);
+    std::memcpy(relocated_code, code.data() + relocation.offset, available_size);
+
+    const auto size = encode_relocation_value(relocation.value, relocated_code);
+    verify(size <= available_size, "relocation is out of bounds");
+    executable_buffer.write(offset + relocation.offset, relocated_code, size);
+  }
+
+  set_block(guest_address, offset);
+
+  if (!code_pages.empty()) {
+    block_pages[guest_address].assign(code_pages.begin(), code_pages.end());
+    for (const auto page_address : code_pages) {
+      page_blocks[page_address].push_back(guest_address);
+    }
+  }
+
+  if (is_linking_enabled()) {
+    // Link this block to already generated successors.
+    for (const auto& link_site : link_sites) {
+      const auto site_offset = offset + link_site.offset;
+
+      patchable_sites[site_offset] = PatchableSite{.target = link_site.target};
+      incoming_links[link_site.target].push_back(site_offset);
+      outgoing_links[guest_address].push_back(site_offset);
+
+      if (const auto target_offset = find_block(link_site.target)) {
+        this->link_site(site_offset, target_offset);
+      }
+    }
+
+    for (const auto& inline_cache : inline_caches) {
+      auto cache = inline_cache;
+
+      cache.miss_offset += offset;
+      cache.fallback_offset += offset;
+      for (auto& slot : cache.slots) {
+        slot.value_offset += offset;
+        slot.jump_offset += offset;
+      }
+
+      this->inline_caches[cache.instruction_address].push_back(InlineCacheState{
+        .cache = cache,
+        .block_address = guest_address,
+      });
+    }
+
+    // Link already generated predecessors to this block.
+    if (const auto it = incoming_links.find(guest_address); it != incoming_links.end()) {
+      for (const auto site_offset : it->second) {
+        this->link_site(site_offset, offset);
+      }
+    }
+  }
+
+  add_fault_sites(offset, fault_sites);
 
   if (code_dump) {
     code_dump->write(guest_address, code);
@@ -75,8 +654,239 @@ void* CodeBuffer::insert(uint64_t guest_address, std::span<const uint8_t> code)
   return allocation;
 }
 
+void* CodeBuffer::insert(uint64_t guest_address,
+                         std::span<const uint8_t> code,
+                         std::span<const LinkSite> link_sites,
+                         std::span<const InlineCache> inline_caches,
+                         std::span<const FaultSite> fault_sites,
+                         std::span<const Relocation> relocations,
+                         std::span<const uint64_t> code_pages) {
+  verify((guest_address & (block_alignment - 1)) == 0, "guest address is misaligned");
+
+  std::unique_lock lock(mutex);
+
+  // Blocks inserted now would keep threads running the generated code.
+  if (flush_requested) {
+    return nullptr;
+  }
+
+  if (const auto offset = find_block(guest_address)) {
+    return executable_buffer.address(offset);
+  }
+
+  return insert_internal(guest_address, code, link_sites, inline_caches, fault_sites, relocations,
+                         code_pages);
+}
+
+void* CodeBuffer::replace(uint64_t guest_address,
+                          std::span<const uint8_t> code,
+                          std::span<const LinkSite> link_sites,
+                          std::span<const InlineCache> inline_caches,
+                          std::span<const FaultSite> fault_sites,
+                          std::span<const Relocation> relocations,
+                          std::span<const uint64_t> code_pages) {
+  verify((guest_address & (block_alignment - 1)) == 0, "guest address is misaligned");
+
+  std::unique_lock lock(mutex);
+
+  if (flush_requested) {
+    return nullptr;
+  }
+
+  if (find_block(guest_address)) {
+    // Direct jumps to the old code will be linked to the new code by `insert_internal`.
+    unlink_incoming_sites(guest_address);
+    remove_internal(guest_address);
+  }
+
+  const auto allocation = insert_internal(guest_address, code, link_sites, inline_caches,
+                                          fault_sites, relocations, code_pages);
+  if (!allocation) {
+    return nullptr;
+  }
+
+  // Point inline cache slots that jumped to the old code to the new code.
+  const auto offset = find_block(guest_address);
+  for (auto& [instruction_address, states] : this->inline_caches) {
+    for (auto& state : states) {
+      for (size_t i = 0; i < state.used_slots; ++i) {
+        if (state.targets[i] == guest_address &&
+            !write_direct_jump(state.cache.slots[i].jump_offset, offset)) {
+          write_inline_cache_value(state.cache.slots[i].value_offset, inline_cache_placeholder);
+          state.targets[i] = inline_cache_placeholder;
+        }
+      }
+    }
+  }
+
+  return allocation;
+}
+
 void* CodeBuffer::insert_standalone(std::span<const uint8_t> code) {
   std::unique_lock lock(mutex);
 
-  return executable_buffer.address(allocate_executable_memory(code));
+  return executable_buffer.address(allocate_standalone_memory(code));
+}
+
+void CodeBuffer::fill_inline_caches(uint64_t instruction_address, uint64_t target) {
+  std::unique_lock lock(mutex);
+
+  const auto it = inline_caches.find(instruction_address);
+  if (it == inline_caches.end()) {
+    return;
+  }
+
+  const auto target_offset = find_block(target);
+  if (target_offset == 0) {
+    return;
+  }
+
+  for (auto& state : it->second) {
+    if (state.megamorphic ||
+        std::find(state.targets, state.targets + state.used_slots, target) !=
+          state.targets + state.used_slots) {
+      continue;
+    }
+
+    uint8_t code[max_direct_jump_size]{};
+    size_t size{};
+    bool filled = false;
+
+    if (state.used_slots < inline_cache_size && encode_inline_cache_value(target, code, size)) {
+      const auto& slot = state.cache.slots[state.used_slots];
+
+      // Patch the jump first so the slot is fully valid when its value starts matching.
+      if (write_direct_jump(slot.jump_offset, target_offset)) {
+        write_inline_cache_value(slot.value_offset, target);
+        state.targets[state.used_slots++] = target;
+        filled = true;
+      }
+    }
+
+    // This site has seen too many targets, stop exiting the VM on inline cache misses.
+    if (!filled || state.used_slots == inline_cache_size) {
+      verify(write_direct_jump(state.cache.miss_offset, state.cache.fallback_offset),
+             "failed to patch inline cache miss handler");
+      state.megamorphic = true;
+    }
+  }
+}
+
+void CodeBuffer::unlink(uint64_t guest_address) {
+  std::unique_lock lock(mutex);
+
+  unlink_internal(guest_address);
+}
+
+void CodeBuffer::invalidate(uint64_t guest_address) {
+  verify((guest_address & (block_alignment - 1)) == 0, "guest address is misaligned");
+
+  std::unique_lock lock(mutex);
+
+  if (find_block(guest_address) == 0) {
+    return;
+  }
+
+  unlink_internal(guest_address);
+  remove_internal(guest_address);
+}
+
+void CodeBuffer::invalidate_page(uint64_t page_address) {
+  std::unique_lock lock(mutex);
+
+  const auto it = page_blocks.find(page_address);
+  if (it == page_blocks.end()) {
+    return;
+  }
+
+  // Removing the blocks modifies the list.
+  const auto blocks = std::move(it->second);
+  page_blocks.erase(it);
+
+  for (const auto guest_address : blocks) {
+    if (find_block(guest_address) != 0) {
+      unlink_internal(guest_address);
+      remove_internal(guest_address);
+    }
+  }
+}
+
+void CodeBuffer::flush() {
+  verify(can_flush(), "cannot flush multithreaded JIT code buffer");
+
+  std::unique_lock lock(mutex);
+
+  flush_internal();
+}
+
+bool CodeBuffer::enter_code(size_t flush_count) {
+  executing_threads.fetch_add(1);
+  if (!flush_requested && flush_count_ == flush_count) {
+    return true;
+  }
+
+  leave_code();
+  wait_for_flush();
+
+  return false;
+}
+
+void CodeBuffer::leave_code() {
+  if (executing_threads.fetch_sub(1) == 1 && flush_requested) {
+    std::unique_lock lock(safepoint_mutex);
+    safepoint_condition.notify_all();
+  }
+}
+
+void CodeBuffer::wait_for_flush() {
+  std::unique_lock lock(safepoint_mutex);
+
+  safepoint_condition.wait(lock, [&] { return !flush_requested || executing_threads == 0; });
+  if (!flush_requested) {
+    return;
+  }
+
+  // Threads entering generated code from now on see `flush_requested` and back out, so nothing
+  // executes the code while it's flushed.
+  {
+    std::unique_lock buffer_lock(mutex);
+    flush_internal();
+  }
+
+  flush_requested = false;
+  safepoint_condition.notify_all();
+}
+
+size_t CodeBuffer::flush_count() const {
+  return flush_count_;
+}
+
+size_t CodeBuffer::committed_size() const {
+  std::unique_lock lock(mutex);
+
+  return executable_buffer.committed_size();
+}
+
+const void* CodeBuffer::fault_exit(const void* code) const {
+  const auto base = reinterpret_cast<uintptr_t>(executable_buffer.address(0));
+  const auto address = reinterpret_cast<uintptr_t>(code);
+  if (address < base || address - base >= executable_buffer.size()) {
+    return nullptr;
+  }
+
+  const auto offset = uint32_t(address - base);
+
+  const auto table = fault_site_table.load(std::memory_order::acquire);
+  const auto sites = table->sites.get();
+  const auto count = table->count.load(std::memory_order::acquire);
+
+  const auto site =
+    std::lower_bound(sites, sites + count, offset, [](const FaultSite& site, uint32_t offset) {
+      return site.access_offset < offset;
+    });
+  if (site == sites + count || site->access_offset != offset) {
+    return nullptr;
+  }
+
+  return executable_buffer.address(site->exit_offset);
 }
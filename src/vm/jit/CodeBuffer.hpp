@@ -1,10 +1,13 @@
 #pragma once
 #include <atomic>
+#include <condition_variable>
 #include <cstdint>
 #include <memory>
 #include <mutex>
 #include <span>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <base/EnumBitOperations.hpp>
 
@@ -22,37 +25,282 @@ class CodeBuffer {
     SkipPermissionChecks = (1 << 1),
   };
 
+  // Location in the generated block code (relative to the block start) which jumps to `target`
+  // via the block translation table. Once `target` is generated, the site gets patched into
+  // a direct jump.
+  struct LinkSite {
+    uint32_t offset{};
+    uint64_t target{};
+  };
+
+  // Block translation table has one entry per 4 bytes of guest code and each entry holds the
+  // code offset of its block. Blocks can also start in the middle of an entry (after compressed
+  // instructions) so entries of such blocks are tagged with `halfword_block_tag`. Code offsets are
+  // 16 byte aligned so the tag never overlaps them. If blocks exist at both addresses covered by
+  // an entry, the entry belongs to the 4 byte aligned one.
+  constexpr static size_t table_entry_granularity = 4;
+  constexpr static uint32_t halfword_block_tag = 2;
+
+  // Block translation table is split into leaves which cover `table_leaf_size` bytes of guest
+  // code each. Leaves are allocated once a block is inserted into their range and the directory
+  // (array of leaf pointers) points at a shared empty leaf otherwise, so lookups never need to
+  // check for missing leaves.
+  constexpr static size_t table_leaf_shift = 16;
+  constexpr static size_t table_leaf_size = size_t(1) << table_leaf_shift;
+  constexpr static size_t table_leaf_entry_count = table_leaf_size / table_entry_granularity;
+
+  constexpr static size_t inline_cache_size = 4;
+
+  // Value embedded in empty inline cache slots. It's odd so it never matches any jump target.
+  constexpr static uint64_t inline_cache_placeholder = 0x7fff'ffff;
+
+  // Inline cache for an indirect jump at `instruction_address`. Each slot compares the jump
+  // target against a guest address embedded in the code (at `value_offset`) and jumps to its
+  // block on match (patchable site at `jump_offset`). If no slot matches, the code exits the VM
+  // with a request to fill one of the slots. Once all slots are used, site at `miss_offset` is
+  // patched into a direct jump to `fallback_offset` which does the regular table lookup.
+  // All offsets are relative to the block start.
+  struct InlineCache {
+    struct Slot {
+      uint32_t value_offset{};
+      uint32_t jump_offset{};
+    };
+
+    uint64_t instruction_address{};
+    uint32_t miss_offset{};
+    uint32_t fallback_offset{};
+    Slot slots[inline_cache_size]{};
+  };
+
+  // Guest memory access in the block code (relative to the block start) which can fault when
+  // guest memory uses guard pages. Execution of the faulting access resumes at `exit_offset`
+  // which exits the VM with a memory fault.
+  struct FaultSite {
+    uint32_t access_offset{};
+    uint32_t exit_offset{};
+  };
+
+  // Host address embedded in the block code at `offset` (relative to the block start). Code is
+  // generated with a placeholder there and the value is written when the block is inserted, so
+  // the same code can be inserted again with addresses of another process.
+  struct Relocation {
+    enum class Target : uint32_t {
+      FloatArithmetic = 1,
+      VectorArithmetic = 2,
+      Memory = 3,
+      HotCounter = 4,
+      BitManipulation = 5,
+    };
+
+    uint32_t offset{};
+    Target target{};
+    uint64_t value{};
+  };
+
  private:
-  constexpr static size_t block_size = 4;
+  constexpr static size_t block_alignment = 2;
+  constexpr static size_t max_direct_jump_size = 8;
+
+  struct PatchableSite {
+    uint64_t target{};
+    bool linked = false;
+    uint8_t original_code_size{};
+    uint8_t original_code[max_direct_jump_size]{};
+  };
+
+  // Fault sites of the buffer with offsets relative to the buffer start, sorted by the access
+  // offset. The fault handler searches it without taking locks so entries below `count` are never
+  // modified. Block code is allocated upwards so new sites are appended after them and the table
+  // is copied into a larger one once it's full.
+  struct FaultSiteTable {
+    size_t capacity{};
+    std::atomic_size_t count{};
+    std::unique_ptr<FaultSite[]> sites;
+
+    explicit FaultSiteTable(size_t capacity)
+        : capacity(capacity), sites(std::make_unique<FaultSite[]>(capacity)) {}
+  };
+
+  struct InlineCacheState {
+    InlineCache cache;
+    uint64_t block_address{};
+    size_t used_slots{};
+    uint64_t targets[inline_cache_size]{};
+    bool megamorphic = false;
+  };
 
   Flags flags_;
 
-  std::unique_ptr<std::atomic_uint32_t[]> block_to_offset;
+  std::unique_ptr<std::atomic<std::atomic_uint32_t*>[]> table_directory;
+  std::vector<std::unique_ptr<std::atomic_uint32_t[]>> table_leaves;
+  std::unique_ptr<std::atomic_uint32_t[]> empty_table_leaf;
+  size_t table_directory_size{};
   size_t max_blocks{};
 
+  // Code offsets of all blocks at addresses which are not 4 byte aligned, including the ones
+  // which don't own their translation table entry.
+  std::unordered_map<uint64_t, uint32_t> halfword_blocks;
+
+  // Block code is allocated upwards from the start of the buffer and standalone code (which is
+  // never flushed) downwards from its end.
   ExecutableBuffer executable_buffer;
   size_t next_free_offset{};
+  size_t standalone_offset{};
+
+  std::atomic_size_t flush_count_{};
 
   std::unique_ptr<CodeDump> code_dump;
 
+  // Keyed by code offset of the site.
+  std::unordered_map<uint32_t, PatchableSite> patchable_sites;
+  // Keyed by guest address of the target and the source block respectively.
+  std::unordered_map<uint64_t, std::vector<uint32_t>> incoming_links;
+  std::unordered_map<uint64_t, std::vector<uint32_t>> outgoing_links;
+
+  // Keyed by guest address of the indirect jump instruction. The same instruction can be part of
+  // multiple blocks.
+  std::unordered_map<uint64_t, std::vector<InlineCacheState>> inline_caches;
+
+  // Sites of invalidated and replaced blocks are kept because their code can still be executed
+  // (e.g. when returning to it). Tables which were replaced by larger ones are kept alive too
+  // because the fault handler may still be searching them. A flush drops all sites, which is only
+  // safe because it never runs while any thread executes generated code (see `wait_for_flush`).
+  std::atomic<const FaultSiteTable*> fault_site_table{};
+  std::vector<std::unique_ptr<FaultSiteTable>> fault_site_tables;
+
+  // Number of threads between `enter_code` and `leave_code`.
+  std::atomic_size_t executing_threads{};
+
+  // Set once a multithreaded buffer runs out of memory. Threads stop entering generated code and
+  // the buffer is flushed by the first thread that sees `executing_threads` drop to zero.
+  std::atomic_bool flush_requested{};
+  std::mutex safepoint_mutex;
+  std::condition_variable safepoint_condition;
+
+  // Keyed by guest address of the block and guest address of the code page respectively.
+  std::unordered_map<uint64_t, std::vector<uint64_t>> block_pages;
+  std::unordered_map<uint64_t, std::vector<uint64_t>> page_blocks;
+
   mutable std::mutex mutex;
 
+  bool can_flush() const;
+  void request_flush();
+  void flush_internal();
+
+  void reset_fault_sites();
+  void add_fault_sites(uint32_t offset, std::span<const FaultSite> sites);
+
   uint32_t allocate_executable_memory(std::span<const uint8_t> code);
+  uint32_t allocate_standalone_memory(std::span<const uint8_t> code);
+
+  uint32_t table_lookup(uint64_t guest_address) const;
+  std::atomic_uint32_t& table_entry(uint64_t guest_address);
+  uint32_t find_block(uint64_t guest_address) const;
+  void set_block(uint64_t guest_address, uint32_t offset);
+  void remove_block(uint64_t guest_address);
+
+  bool is_linking_enabled() const;
+  void link_site(uint32_t site_offset, uint32_t target_offset);
+  void unlink_site(uint32_t site_offset);
+  void unlink_incoming_sites(uint64_t guest_address);
+  void unlink_internal(uint64_t guest_address);
+
+  void remove_internal(uint64_t guest_address);
+  void* insert_internal(uint64_t guest_address,
+                        std::span<const uint8_t> code,
+                        std::span<const LinkSite> link_sites,
+                        std::span<const InlineCache> inline_caches,
+                        std::span<const FaultSite> fault_sites,
+                        std::span<const Relocation> relocations,
+                        std::span<const uint64_t> code_pages);
+
+  bool write_direct_jump(uint32_t site_offset, uint32_t target_offset);
+  void write_inline_cache_value(uint32_t value_offset, uint64_t value);
 
  public:
+  // `size` is the maximum amount of generated code. Memory for it is committed gradually and once
+  // it runs out, all blocks are flushed.
   CodeBuffer(Flags flags, size_t size, size_t max_executable_guest_address);
   ~CodeBuffer();
 
   void dump_code_to_file(const std::string& path);
 
   void* get(uint64_t guest_address) const;
-  void* insert(uint64_t guest_address, std::span<const uint8_t> code);
+  void* insert(uint64_t guest_address,
+               std::span<const uint8_t> code,
+               std::span<const LinkSite> link_sites = {},
+               std::span<const InlineCache> inline_caches = {},
+               std::span<const FaultSite> fault_sites = {},
+               std::span<const Relocation> relocations = {},
+               std::span<const uint64_t> code_pages = {});
   void* insert_standalone(std::span<const uint8_t> code);
 
+  // Replaces code of the block at `guest_address` (or inserts it if there is none). Direct jumps
+  // and inline caches that targeted the old code are redirected to the new one. Old code is not
+  // reclaimed.
+  //
+  // `code_pages` are guest addresses of pages with the guest code of the block, the block is
+  // invalidated when any of them is modified.
+  void* replace(uint64_t guest_address,
+                std::span<const uint8_t> code,
+                std::span<const LinkSite> link_sites = {},
+                std::span<const InlineCache> inline_caches = {},
+                std::span<const FaultSite> fault_sites = {},
+                std::span<const Relocation> relocations = {},
+                std::span<const uint64_t> code_pages = {});
+
+  // Makes all inline caches of indirect jump at `instruction_address` jump directly to already
+  // generated block at `target`.
+  void fill_inline_caches(uint64_t instruction_address, uint64_t target);
+
+  // Restores all direct jumps to `guest_address` back to translation table lookups.
+  void unlink(uint64_t guest_address);
+
+  // Unlinks the block at `guest_address` and removes it from the block translation table.
+  // Its code is not reclaimed.
+  void invalidate(uint64_t guest_address);
+
+  // Invalidates all blocks with guest code on the page at `page_address` (after it was modified).
+  void invalidate_page(uint64_t page_address);
+
+  // Removes all blocks and reclaims their code, standalone code is kept. Code of removed blocks
+  // must not be executing so multithreaded code buffers can't be flushed and flushing while
+  // a thread is between `enter_code` and `leave_code` is an error. Full buffers are flushed the
+  // same way when a block is inserted.
+  //
+  // Full multithreaded buffers are flushed at a safepoint instead: inserting fails (returns
+  // nullptr) and all blocks are removed from the translation table so running threads exit the
+  // generated code. The flush happens once all of them have left it, see `wait_for_flush`.
+  void flush();
+
+  // Must surround every execution of generated code. `flush_count` is the value of `flush_count()`
+  // read before the code was looked up. Returns false (after waiting for the pending flush) if
+  // the code may have been flushed in the meantime, it must be looked up again then.
+  bool enter_code(size_t flush_count);
+  void leave_code();
+
+  // Waits until the requested flush of a multithreaded buffer is done. The last thread to arrive
+  // at the safepoint flushes the buffer. Must not be called between `enter_code` and `leave_code`.
+  void wait_for_flush();
+
+  // Returns false if any link site, inline cache or fault site of a block with `code_size` bytes
+  // of code points outside of it. Patching such sites would write outside of the block.
+  static bool patch_sites_in_bounds(size_t code_size,
+                                    std::span<const LinkSite> link_sites,
+                                    std::span<const InlineCache> inline_caches,
+                                    std::span<const FaultSite> fault_sites);
+
+  // Returns the code which handles fault of the guest memory access at `code` or nullptr if
+  // there is no such access. Doesn't lock so it can be called from signal handlers.
+  const void* fault_exit(const void* code) const;
+
   Flags flags() const { return flags_; }
+  size_t flush_count() const;
+  size_t committed_size() const;
   size_t max_block_count() const { return max_blocks; }
 
-  const std::atomic_uint32_t* block_translation_table() const { return block_to_offset.get(); }
+  // Directory of the block translation table, see `table_leaf_shift`.
+  const void* block_translation_table() const { return table_directory.get(); }
   const void* code_buffer_base() const { return executable_buffer.address(0); }
 };
 
@@ -10,8 +10,9 @@ using namespace vm::jit;
 #include "aarch64/Executor.hpp"
 
 std::unique_ptr<Executor> jit::create_arch_specific_executor(
-  std::shared_ptr<CodeBuffer> code_buffer) {
-  return std::make_unique<aarch64::Executor>(std::move(code_buffer));
+  std::shared_ptr<CodeBuffer> code_buffer,
+  const TieringThresholds& tiering_thresholds) {
+  return std::make_unique<aarch64::Executor>(std::move(code_buffer), tiering_thresholds);
 }
 
 #elif defined(VM_JIT_X64)
@@ -19,7 +20,8 @@ std::unique_ptr<Executor> jit::create_arch_specific_executor(
 #include "x64/Executor.hpp"
 
 std::unique_ptr<Executor> jit::create_arch_specific_executor(
-  std::shared_ptr<CodeBuffer> code_buffer) {
+  std::shared_ptr<CodeBuffer> code_buffer,
+  const TieringThresholds& tiering_thresholds) {
 #ifdef PLATFORM_WINDOWS
   const auto abi = x64::Abi::windows();
 #elif defined(PLATFORM_LINUX)
@@ -31,7 +33,7 @@ std::unique_ptr<Executor> jit::create_arch_specific_executor(
 #endif
 
 #ifndef JIT_UNUSPPORTED_PLATFORM
-  return std::make_unique<x64::Executor>(std::move(code_buffer), abi);
+  return std::make_unique<x64::Executor>(std::move(code_buffer), abi, tiering_thresholds);
 #else
   return nullptr;
 #endif
@@ -41,7 +43,7 @@ std::unique_ptr<Executor> jit::create_arch_specific_executor(
 
 std::unique_ptr<Executor> jit::create_arch_specific_executor(
   std::shared_ptr<CodeBuffer> code_buffer,
-  std::unique_ptr<CodeDump> code_dump) {
+  const TieringThresholds& tiering_thresholds) {
   return nullptr;
 }
 
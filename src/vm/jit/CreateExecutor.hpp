@@ -3,5 +3,7 @@
 #include "Executor.hpp"
 
 namespace vm::jit {
-std::unique_ptr<Executor> create_arch_specific_executor(std::shared_ptr<CodeBuffer> code_buffer);
+std::unique_ptr<Executor> create_arch_specific_executor(
+  std::shared_ptr<CodeBuffer> code_buffer,
+  const TieringThresholds& tiering_thresholds);
 }
\ No newline at end of file
@@ -3,17 +3,26 @@
 #include <base/Error.hpp>
 #include <base/Platform.hpp>
 
+#include <algorithm>
+#include <cstring>
+
 #ifdef PLATFORM_MAC
 
 #include <libkern/OSCacheControl.h>
 #include <sys/mman.h>
 
-static void* allocate_executable_memory(size_t size) {
+// `MAP_JIT` mappings can't change their protection later. Pages are backed by memory lazily so
+// the whole buffer is mapped upfront.
+static void* reserve_executable_memory(size_t size) {
   const auto p = mmap(nullptr, size, PROT_EXEC | PROT_READ | PROT_WRITE,
                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_JIT, -1, 0);
   return p != MAP_FAILED ? p : nullptr;
 }
 
+static bool commit_executable_memory(void* p, size_t size) {
+  return true;
+}
+
 static void free_executable_memory(void* p, size_t size) {
   munmap(p, size);
 }
@@ -34,12 +43,16 @@ static void flush_instruction_cache(void* memory, size_t size) {
 
 #include <sys/mman.h>
 
-static void* allocate_executable_memory(size_t size) {
+static void* reserve_executable_memory(size_t size) {
   const auto p =
-    mmap(nullptr, size, PROT_EXEC | PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    mmap(nullptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
   return p != MAP_FAILED ? p : nullptr;
 }
 
+static bool commit_executable_memory(void* p, size_t size) {
+  return mprotect(p, size, PROT_EXEC | PROT_READ | PROT_WRITE) == 0;
+}
+
 static void free_executable_memory(void* p, size_t size) {
   munmap(p, size);
 }
@@ -56,8 +69,12 @@ static void flush_instruction_cache(void* memory, size_t size) {
 
 #include <Windows.h>
 
-static void* allocate_executable_memory(size_t size) {
-  return VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+static void* reserve_executable_memory(size_t size) {
+  return VirtualAlloc(nullptr, size, MEM_RESERVE, PAGE_NOACCESS);
+}
+
+static bool commit_executable_memory(void* p, size_t size) {
+  return VirtualAlloc(p, size, MEM_COMMIT, PAGE_EXECUTE_READWRITE) != nullptr;
 }
 
 static void free_executable_memory(void* p, size_t size) {
@@ -78,9 +95,29 @@ static void flush_instruction_cache(void* memory, size_t size) {
 
 using namespace vm::jit;
 
-ExecutableBuffer::ExecutableBuffer(size_t size) : size_(size) {
-  memory_ = reinterpret_cast<uint8_t*>(allocate_executable_memory(size));
-  verify(memory_, "failed to allocate {} bytes of executable memory", size);
+void ExecutableBuffer::commit(uintptr_t offset, size_t size) {
+  const auto first_segment = offset / segment_size;
+  const auto last_segment = (offset + size - 1) / segment_size;
+
+  for (auto segment = first_segment; segment <= last_segment; ++segment) {
+    if (committed_segments[segment]) {
+      continue;
+    }
+
+    const auto segment_offset = segment * segment_size;
+    const auto commit_size = std::min(segment_size, size_ - segment_offset);
+
+    verify(commit_executable_memory(memory_ + segment_offset, commit_size),
+           "failed to commit {} bytes of executable memory", commit_size);
+
+    committed_segments[segment] = true;
+  }
+}
+
+ExecutableBuffer::ExecutableBuffer(size_t size)
+    : size_(size), committed_segments((size + segment_size - 1) / segment_size) {
+  memory_ = reinterpret_cast<uint8_t*>(reserve_executable_memory(size));
+  verify(memory_, "failed to reserve {} bytes of executable memory", size);
 }
 
 ExecutableBuffer::ExecutableBuffer(const void* data, size_t size) : ExecutableBuffer(size) {
@@ -94,8 +131,26 @@ ExecutableBuffer::~ExecutableBuffer() {
 void ExecutableBuffer::write(uintptr_t offset, const void* data, size_t size) {
   verify(offset + size <= size_, "writing out of bounds data to executable buffer");
 
+  if (size == 0) {
+    return;
+  }
+
+  commit(offset, size);
+
   unprotect_executable_memory();
   std::memcpy(memory_ + offset, data, size);
   flush_instruction_cache(memory_ + offset, size);
   protect_executable_memory();
 }
+
+size_t ExecutableBuffer::committed_size() const {
+  size_t size = 0;
+
+  for (size_t segment = 0; segment < committed_segments.size(); ++segment) {
+    if (committed_segments[segment]) {
+      size += std::min(segment_size, size_ - segment * segment_size);
+    }
+  }
+
+  return size;
+}
@@ -3,13 +3,24 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <vector>
 
 namespace vm::jit {
 
+// Address space for the whole buffer is reserved upfront and memory is committed in segments
+// once something gets written to them.
 class ExecutableBuffer {
+ public:
+  constexpr static size_t segment_size = 1024 * 1024;
+
+ private:
   uint8_t* memory_{};
   size_t size_{};
 
+  std::vector<bool> committed_segments;
+
+  void commit(uintptr_t offset, size_t size);
+
  public:
   CLASS_NON_COPYABLE_NON_MOVABLE(ExecutableBuffer)
 
@@ -19,6 +30,8 @@ class ExecutableBuffer {
 
   void write(uintptr_t offset, const void* data, size_t size);
 
+  size_t committed_size() const;
+
   void* address(uintptr_t offset = 0) const { return memory_ + offset; }
   size_t size() const { return size_; }
 };
@@ -1 +1,492 @@
-#include "Executor.hpp"
\ No newline at end of file
+#include "Executor.hpp"
+#include "TranslationCache.hpp"
+
+#include <vm/private/Arithmetic.hpp>
+#include <vm/private/FloatArithmetic.hpp>
+#include <vm/private/VectorArithmetic.hpp>
+
+#include <base/Error.hpp>
+#include <base/concurrency/AtomicIterator.hpp>
+#include <base/concurrency/ForkJoinPool.hpp>
+#include <base/hash/Fnv.hpp>
+
+#include <algorithm>
+
+using namespace vm;
+using namespace vm::jit;
+
+Executor::Tier Executor::select_tier(uint64_t pc) {
+  if (profile_.record_interpreted_block(pc) <= tiering_thresholds.baseline) {
+    return Tier::Interpreter;
+  }
+
+  return tiering_thresholds.optimizing == 0 ? Tier::Optimizing : Tier::Baseline;
+}
+
+TraceOptions Executor::trace_options(Tier tier, bool single_step) const {
+  verify(tier != Tier::Interpreter, "cannot compile code for the interpreter tier");
+
+  if (single_step) {
+    // Make sure that we don't execute 2 instructions when single stepping.
+    return TraceOptions{
+      .max_instructions = 1,
+      .follow_branches = false,
+    };
+  }
+
+  return TraceOptions{
+    .follow_branches = tier == Tier::Optimizing,
+    .profile = &profile_,
+    .optimize = tier == Tier::Optimizing,
+  };
+}
+
+Executor::Executor(std::shared_ptr<CodeBuffer> code_buffer,
+                   const TieringThresholds& tiering_thresholds)
+    : code_buffer(std::move(code_buffer)), tiering_thresholds(tiering_thresholds) {}
+
+void Executor::record_guest_code(const Trace& trace, CompiledBlock& block) {
+  block.code_pages.clear();
+  block.instructions = trace.entries;
+
+  for (const auto& entry : trace.entries) {
+    const auto first_page = entry.pc >> Memory::permission_page_shift;
+    const auto last_page =
+      (entry.pc + entry.instruction.length() - 1) >> Memory::permission_page_shift;
+
+    for (auto page = first_page; page <= last_page; ++page) {
+      block.code_pages.push_back(page << Memory::permission_page_shift);
+    }
+  }
+
+  std::sort(block.code_pages.begin(), block.code_pages.end());
+  block.code_pages.erase(std::unique(block.code_pages.begin(), block.code_pages.end()),
+                         block.code_pages.end());
+}
+
+bool Executor::watch_code_pages(Memory& memory, const CompiledBlock& block) {
+  for (const auto page_address : block.code_pages) {
+    memory.watch_writes(page_address, Memory::permission_page_size);
+  }
+
+  // Generated code writes to memory directly until its pages are watched so these writes aren't
+  // reported. Code is fetched again to catch them.
+  for (const auto& entry : block.instructions) {
+    uint32_t encoded_instruction;
+    if (!Instruction::fetch(memory, entry.pc, encoded_instruction) ||
+        Instruction{encoded_instruction}.raw() != entry.instruction.raw()) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static uint64_t code_page_hash(const Memory& memory, uint64_t page_address) {
+  base::Fnv1a hash;
+  hash.feed(memory.contents() + page_address, Memory::permission_page_size);
+  return hash.hash();
+}
+
+void* Executor::insert_code(Memory& memory, const CompiledBlock& block) {
+  // Baseline code of a discarded optimized block has already decremented its hot counter past
+  // zero. The counter must be re-armed, otherwise the block would never get optimized.
+  const auto discard_block = [&] {
+    if (block.tier == Tier::Optimizing) {
+      profile_.reset_hot_counter(block.pc, tiering_thresholds.optimizing);
+    }
+    return nullptr;
+  };
+
+  // Writes from now on are reported, earlier ones are caught by `watch_code_pages`.
+  std::vector<uint64_t> write_watch_generations;
+  for (const auto page_address : block.code_pages) {
+    write_watch_generations.push_back(memory.write_watch_generation(page_address));
+  }
+
+  if (!watch_code_pages(memory, block)) {
+    return discard_block();
+  }
+
+  const auto allocation =
+    block.tier == Tier::Optimizing
+      ? code_buffer->replace(block.pc, block.code, block.link_sites, block.inline_caches,
+                             block.fault_sites, block.relocations, block.code_pages)
+      : code_buffer->insert(block.pc, block.code, block.link_sites, block.inline_caches,
+                            block.fault_sites, block.relocations, block.code_pages);
+  if (!allocation) {
+    // Multithreaded code buffer is full, the block is compiled again after the flush.
+    code_buffer->wait_for_flush();
+    return discard_block();
+  }
+
+  // Writer changes the generation of the written page before invalidating its blocks. If the
+  // generation hasn't changed yet, the writer will invalidate this block itself. Writes to pages
+  // without code of this block don't affect it.
+  for (size_t i = 0; i < block.code_pages.size(); ++i) {
+    if (memory.write_watch_generation(block.code_pages[i]) != write_watch_generations[i]) {
+      code_buffer->invalidate(block.pc);
+      return discard_block();
+    }
+  }
+
+  std::unique_lock lock(translated_blocks_mutex);
+  if (records_translations) {
+    // Code pages are watched so their contents are still the same as when the block was traced.
+    std::vector<uint64_t> code_page_hashes;
+    for (const auto page_address : block.code_pages) {
+      code_page_hashes.push_back(code_page_hash(memory, page_address));
+    }
+
+    translated_blocks[block.pc] = TranslatedBlock{
+      .block = block,
+      .code_page_hashes = std::move(code_page_hashes),
+    };
+  }
+
+  return allocation;
+}
+
+void Executor::start_compile_threads() {
+  for (size_t i = 0; i < tiering_thresholds.compile_threads; ++i) {
+    compile_threads.spawn([this, i] { compile_thread(i); });
+  }
+}
+
+void Executor::stop_compile_threads() {
+  compile_requests.request_exit();
+  compile_threads.join();
+}
+
+void Executor::compile_thread(size_t thread_index) {
+  CompileRequest request;
+  while (compile_requests.pop_front_blocking(request)) {
+    compiled_blocks.push_back_one(
+      compile_in_background(ContextPool::CompileThreads, thread_index, *request.memory,
+                            request.pc, request.tier));
+  }
+}
+
+void Executor::request_compilation(Memory& memory, uint64_t pc, Tier tier) {
+  {
+    std::unique_lock lock(queued_blocks_mutex);
+    if (!queued_blocks.insert(pc).second) {
+      return;
+    }
+  }
+
+  compile_requests.push_back(CompileRequest{
+    .memory = &memory,
+    .pc = pc,
+    .tier = tier,
+  });
+}
+
+void Executor::publish_compiled_blocks(Memory& memory) {
+  std::vector<CompiledBlock> blocks;
+  compiled_blocks.pop_front_non_blocking(blocks);
+
+  for (const auto& block : blocks) {
+    // Blocks whose code was modified are discarded, they will be requested again.
+    insert_code(memory, block);
+
+    std::unique_lock lock(queued_blocks_mutex);
+    queued_blocks.erase(block.pc);
+  }
+}
+
+bool Executor::relocation_value(Memory& memory,
+                                uint64_t pc,
+                                CodeBuffer::Relocation::Target target,
+                                uint64_t& value) {
+  using Target = CodeBuffer::Relocation::Target;
+
+  switch (target) {
+    case Target::FloatArithmetic:
+      value = uint64_t(&FloatArithmetic::execute_raw);
+      return true;
+    case Target::VectorArithmetic:
+      value = uint64_t(&VectorArithmetic::execute_raw);
+      return true;
+    case Target::Memory:
+      value = uint64_t(&memory);
+      return true;
+    case Target::HotCounter:
+      value = uint64_t(profile_.hot_counter(pc, tiering_thresholds.optimizing));
+      return true;
+    case Target::BitManipulation:
+      value = uint64_t(&Arithmetic::bit_manipulation_raw);
+      return true;
+    default:
+      return false;
+  }
+}
+
+static TranslationCache::Header translation_cache_header(const Memory& memory,
+                                                         const CodeBuffer& code_buffer,
+                                                         uint32_t host_features,
+                                                         uint64_t image_hash) {
+  return TranslationCache::Header{
+    .image_hash = image_hash,
+    .memory_size = memory.size(),
+    .max_block_count = code_buffer.max_block_count(),
+    .memory_flags =
+      uint32_t(memory.uses_guard_pages()) | (uint32_t(memory.uses_byte_permissions()) << 1),
+    .code_buffer_flags = uint32_t(code_buffer.flags()),
+    .host_features = host_features,
+  };
+}
+
+size_t Executor::load_translation_cache(Memory& memory,
+                                        const std::string& path,
+                                        uint64_t image_hash) {
+  {
+    std::unique_lock lock(translated_blocks_mutex);
+    records_translations = true;
+  }
+
+  TranslationCache cache;
+  const auto header =
+    translation_cache_header(memory, *code_buffer, host_feature_mask(), image_hash);
+  if (!cache.load(path, header)) {
+    return 0;
+  }
+
+  // Hashes of guest pages, computed once per page.
+  std::unordered_map<uint64_t, uint64_t> page_hashes;
+  const auto page_valid = [&](const TranslationCache::Page& page) {
+    if (page.address % Memory::permission_page_size != 0 ||
+        page.address + Memory::permission_page_size > memory.size()) {
+      return false;
+    }
+
+    auto it = page_hashes.find(page.address);
+    if (it == page_hashes.end()) {
+      it = page_hashes.emplace(page.address, code_page_hash(memory, page.address)).first;
+    }
+
+    return it->second == page.content_hash;
+  };
+
+  size_t inserted_blocks = 0;
+
+  // Baseline blocks go first, optimized blocks replace them.
+  for (const auto tier : {Tier::Baseline, Tier::Optimizing}) {
+    for (auto& cached_block : cache.blocks) {
+      if (cached_block.tier != uint32_t(tier)) {
+        continue;
+      }
+
+      const auto pages_valid = std::all_of(cached_block.code_pages.begin(),
+                                           cached_block.code_pages.end(), page_valid);
+      const auto relocations_valid = std::all_of(
+        cached_block.relocations.begin(), cached_block.relocations.end(),
+        [&](CodeBuffer::Relocation& relocation) {
+          return relocation_value(memory, cached_block.pc, relocation.target, relocation.value);
+        });
+      const auto sites_valid = CodeBuffer::patch_sites_in_bounds(
+        cached_block.code.size(), cached_block.link_sites, cached_block.inline_caches,
+        cached_block.fault_sites);
+      if (!pages_valid || !relocations_valid || !sites_valid) {
+        continue;
+      }
+
+      CompiledBlock block{
+        .pc = cached_block.pc,
+        .tier = tier,
+        .code = std::move(cached_block.code),
+        .link_sites = std::move(cached_block.link_sites),
+        .inline_caches = std::move(cached_block.inline_caches),
+        .fault_sites = std::move(cached_block.fault_sites),
+        .relocations = std::move(cached_block.relocations),
+        .code_pages = {},
+        // Page contents were verified so there are no instructions to fetch again.
+        .instructions = {},
+      };
+
+      for (const auto& page : cached_block.code_pages) {
+        block.code_pages.push_back(page.address);
+      }
+
+      if (insert_code(memory, block)) {
+        inserted_blocks++;
+      }
+    }
+  }
+
+  return inserted_blocks;
+}
+
+void Executor::save_translation_cache(const Memory& memory,
+                                      const std::string& path,
+                                      uint64_t image_hash) {
+  TranslationCache cache;
+
+  {
+    std::unique_lock lock(translated_blocks_mutex);
+    verify(records_translations, "translation cache must be loaded before saving it");
+
+    for (const auto& [pc, translated_block] : translated_blocks) {
+      // Skip blocks which were invalidated or flushed since they were inserted.
+      if (!code_buffer->get(pc)) {
+        continue;
+      }
+
+      const auto& block = translated_block.block;
+
+      std::vector<TranslationCache::Page> code_pages;
+      for (size_t i = 0; i < block.code_pages.size(); ++i) {
+        code_pages.push_back(TranslationCache::Page{
+          .address = block.code_pages[i],
+          .content_hash = translated_block.code_page_hashes[i],
+        });
+      }
+
+      cache.blocks.push_back(TranslationCache::Block{
+        .pc = pc,
+        .tier = uint32_t(block.tier),
+        .code = block.code,
+        .link_sites = block.link_sites,
+        .inline_caches = block.inline_caches,
+        .fault_sites = block.fault_sites,
+        .relocations = block.relocations,
+        .code_pages = std::move(code_pages),
+      });
+    }
+  }
+
+  cache.save(path,
+             translation_cache_header(memory, *code_buffer, host_feature_mask(), image_hash));
+}
+
+// Finds start addresses of blocks reachable from `entry_points` by following direct jumps and
+// branches. Targets of indirect jumps aren't known so only return addresses of calls are added.
+static std::vector<uint64_t> find_block_leaders(const Memory& memory,
+                                                std::span<const uint64_t> entry_points,
+                                                uint64_t max_executable_pc) {
+  using IT = InstructionType;
+
+  std::vector<uint64_t> leaders;
+  std::vector<uint64_t> pending(entry_points.begin(), entry_points.end());
+  std::unordered_set<uint64_t> visited;
+
+  Trace trace;
+
+  while (!pending.empty()) {
+    const auto pc = pending.back();
+    pending.pop_back();
+
+    if ((pc & 1) != 0 || pc >= max_executable_pc || !visited.insert(pc).second) {
+      continue;
+    }
+
+    // Blocks are discovered the same way as baseline traces are built.
+    build_trace(trace, memory, pc, TraceOptions{.follow_branches = false});
+    if (trace.entries.empty()) {
+      continue;
+    }
+
+    leaders.push_back(pc);
+
+    for (const auto& entry : trace.entries) {
+      switch (entry.instruction.type()) {
+        case IT::Beq:
+        case IT::Bne:
+        case IT::Blt:
+        case IT::Bge:
+        case IT::Bltu:
+        case IT::Bgeu:
+          pending.push_back(entry.pc + entry.instruction.imm());
+          break;
+
+        case IT::Jal:
+          // Trace ends at the call, its target is `end_pc`.
+          if (entry.instruction.rd() != Register::Zero) {
+            pending.push_back(entry.pc + entry.instruction.length());
+          }
+          break;
+
+        default:
+          break;
+      }
+    }
+
+    // Execution doesn't continue after returns, jumps via registers and invalid instructions.
+    const auto& last_instruction = trace.entries.back().instruction;
+    const auto end_reachable =
+      !trace.end_fetch_fault && last_instruction.type() != IT::Undefined &&
+      last_instruction.type() != IT::Ebreak &&
+      (last_instruction.type() != IT::Jalr || last_instruction.rd() != Register::Zero);
+    if (end_reachable) {
+      pending.push_back(trace.end_pc);
+    }
+  }
+
+  std::sort(leaders.begin(), leaders.end());
+
+  return leaders;
+}
+
+size_t Executor::pretranslate(Memory& memory,
+                              std::span<const uint64_t> entry_points,
+                              size_t thread_count) {
+  const auto max_executable_pc =
+    code_buffer->max_block_count() * CodeBuffer::table_entry_granularity;
+
+  auto leaders = find_block_leaders(memory, entry_points, max_executable_pc);
+
+  // Blocks loaded from the translation cache are already there.
+  std::erase_if(leaders, [&](uint64_t pc) { return code_buffer->get(pc) != nullptr; });
+
+  const auto tier = tiering_thresholds.optimizing == 0 ? Tier::Optimizing : Tier::Baseline;
+
+  class PretranslationTask : public base::ForkJoinPool::Task {
+    Executor& executor;
+    Memory& memory;
+    std::span<const uint64_t> leaders;
+    Tier tier;
+
+    base::AtomicIterator<uint64_t> iterator;
+
+   public:
+    std::vector<CompiledBlock> blocks;
+
+    PretranslationTask(Executor& executor,
+                       Memory& memory,
+                       std::span<const uint64_t> leaders,
+                       Tier tier)
+        : executor(executor),
+          memory(memory),
+          leaders(leaders),
+          tier(tier),
+          iterator(leaders.size()),
+          blocks(leaders.size()) {}
+
+    void prepare(uint32_t thread_count) override {
+      executor.reserve_compile_contexts(ContextPool::Pretranslation, thread_count);
+    }
+
+    void execute(uint32_t tid) override {
+      iterator.consume([&](uint64_t i) {
+        blocks[i] = executor.compile_in_background(ContextPool::Pretranslation, tid, memory,
+                                                   leaders[i], tier);
+      });
+    }
+  };
+
+  PretranslationTask task{*this, memory, leaders, tier};
+
+  {
+    base::ForkJoinPool pool(thread_count);
+    pool.run_task(task);
+  }
+
+  size_t inserted_blocks = 0;
+  for (const auto& block : task.blocks) {
+    if (insert_code(memory, block)) {
+      inserted_blocks++;
+    }
+  }
+
+  return inserted_blocks;
+}
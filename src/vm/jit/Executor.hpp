@@ -1,15 +1,167 @@
 #pragma once
+#include "CodeBuffer.hpp"
 #include "Exit.hpp"
+#include "Profile.hpp"
+#include "Trace.hpp"
 
 #include <vm/Cpu.hpp>
 #include <vm/Memory.hpp>
 
+#include <base/concurrency/ConcurrentQueue.hpp>
+#include <base/concurrency/FastConcurrentQueue.hpp>
+#include <base/concurrency/JoinableThreads.hpp>
+
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
 namespace vm::jit {
 
 class Executor {
+ protected:
+  enum class Tier {
+    Interpreter,
+    Baseline,
+    Optimizing,
+  };
+
+  // Block compiled by a compile thread. It gets inserted into the code buffer by the thread which
+  // runs the guest so code patching never races with execution of the patched code.
+  struct CompiledBlock {
+    uint64_t pc{};
+    Tier tier{};
+    std::vector<uint8_t> code;
+    std::vector<CodeBuffer::LinkSite> link_sites;
+    std::vector<CodeBuffer::InlineCache> inline_caches;
+    std::vector<CodeBuffer::FaultSite> fault_sites;
+    std::vector<CodeBuffer::Relocation> relocations;
+    std::vector<uint64_t> code_pages;
+
+    // Guest instructions the block was compiled from. They are fetched again once the code pages
+    // are watched to detect modifications which happened before that.
+    std::vector<Trace::Entry> instructions;
+  };
+
+  std::shared_ptr<CodeBuffer> code_buffer;
+
+  TieringThresholds tiering_thresholds;
+  Profile profile_;
+
+  // Protects the codegen context, blocks are compiled one at a time.
+  std::mutex codegen_mutex;
+
+  // Picks the tier for the block at `pc` which doesn't have any code yet.
+  Tier select_tier(uint64_t pc);
+
+  TraceOptions trace_options(Tier tier, bool single_step) const;
+
+  // Records guest pages and instructions of `trace` in `block`.
+  static void record_guest_code(const Trace& trace, CompiledBlock& block);
+
+  // Watches writes to code pages of `block`. Returns false if its code was modified before the
+  // pages got watched.
+  static bool watch_code_pages(Memory& memory, const CompiledBlock& block);
+
+  // Must be called by the thread which runs the guest: code pages are watched here so no guest
+  // store can slip between watching them and checking that the code is unchanged. Returns nullptr
+  // if the code of the block was modified after it was traced.
+  void* insert_code(Memory& memory, const CompiledBlock& block);
+
+  // Compile threads call `compile_in_background` so they must be started once the derived
+  // executor is fully constructed and stopped before it gets destroyed.
+  void start_compile_threads();
+  void stop_compile_threads();
+
+  bool compiles_in_background() const { return !compile_threads.empty(); }
+
+  // Queues the block at `pc` for compilation unless it's already queued.
+  void request_compilation(Memory& memory, uint64_t pc, Tier tier);
+
+  // Inserts blocks finished by compile threads into the code buffer.
+  void publish_compiled_blocks(Memory& memory);
+
+  // Optional host CPU features which the generated code depends on. Translation cache is only
+  // loaded on hosts with the same features.
+  virtual uint32_t host_feature_mask() const { return 0; }
+
+  // Compile threads and pretranslation workers use separate codegen contexts, so they never share
+  // one and pretranslation can grow its pool while compile threads are running.
+  enum class ContextPool {
+    CompileThreads,
+    Pretranslation,
+  };
+
+  // Makes sure that `compile_in_background` can be called with thread indices below `count`.
+  // Must not be called while threads of the `pool` are compiling.
+  virtual void reserve_compile_contexts(ContextPool pool, size_t count) = 0;
+
+  // Called by compile threads and pretranslation workers, each one with its own thread index in
+  // its pool.
+  virtual CompiledBlock compile_in_background(ContextPool pool,
+                                              size_t thread_index,
+                                              Memory& memory,
+                                              uint64_t pc,
+                                              Tier tier) = 0;
+
+ private:
+  struct CompileRequest {
+    Memory* memory{};
+    uint64_t pc{};
+    Tier tier{};
+  };
+
+  base::ConcurrentQueue<CompileRequest> compile_requests;
+  base::FastConcurrentQueue<CompiledBlock> compiled_blocks;
+  base::JoinableThreads compile_threads;
+
+  // Blocks which were requested but aren't published yet.
+  std::unordered_set<uint64_t> queued_blocks;
+  std::mutex queued_blocks_mutex;
+
+  struct TranslatedBlock {
+    CompiledBlock block;
+    std::vector<uint64_t> code_page_hashes;
+  };
+
+  // Copies of inserted blocks kept for the translation cache. Empty unless a translation cache
+  // was loaded.
+  std::unordered_map<uint64_t, TranslatedBlock> translated_blocks;
+  std::mutex translated_blocks_mutex;
+  bool records_translations = false;
+
+  // Returns the host address which relocation `target` of the block at `pc` refers to in this
+  // process. Returns false for unknown targets.
+  bool relocation_value(Memory& memory,
+                        uint64_t pc,
+                        CodeBuffer::Relocation::Target target,
+                        uint64_t& value);
+
+  void compile_thread(size_t thread_index);
+
  public:
+  explicit Executor(std::shared_ptr<CodeBuffer> code_buffer,
+                    const TieringThresholds& tiering_thresholds);
   virtual ~Executor() = default;
 
+  Profile& profile() { return profile_; }
+
+  // Inserts blocks stored in the translation cache at `path` if it was created for the guest image
+  // with `image_hash` and the same configuration. Blocks whose guest code differs from the current
+  // memory contents are skipped. Blocks compiled from now on are recorded so they can be saved
+  // with `save_translation_cache`. Returns the number of inserted blocks.
+  size_t load_translation_cache(Memory& memory, const std::string& path, uint64_t image_hash);
+  void save_translation_cache(const Memory& memory, const std::string& path, uint64_t image_hash);
+
+  // Compiles blocks reachable from `entry_points` using `thread_count` threads so they are never
+  // interpreted or compiled lazily. Must be called before any hart runs. Returns the number of
+  // inserted blocks.
+  size_t pretranslate(Memory& memory, std::span<const uint64_t> entry_points, size_t thread_count);
+
+  // Can be called concurrently for different CPUs if the code buffer is multithreaded.
   virtual ExitReason run(Memory& memory, Cpu& cpu) = 0;
 };
 
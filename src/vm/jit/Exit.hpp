@@ -12,6 +12,9 @@ enum class ExitReason {
   MemoryWriteFault,
   Ecall,
   Ebreak,
+
+  // Block at PC isn't hot enough to be compiled and should be interpreted.
+  ColdBlock,
 };
 
 }
@@ -0,0 +1,165 @@
+#include "FaultHandler.hpp"
+#include "CodeBuffer.hpp"
+
+#include <base/Error.hpp>
+#include <base/Platform.hpp>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#if defined(PLATFORM_LINUX) || defined(PLATFORM_MAC)
+#include <signal.h>
+#endif
+
+using namespace vm::jit;
+
+constexpr size_t max_code_buffers = 64;
+
+// Fault handler reads the registry without locking, the mutex only serializes its modifications.
+static std::mutex registry_mutex;
+static std::atomic<const CodeBuffer*> code_buffers[max_code_buffers];
+
+// Number of fault handlers which are searching the registry. Unregistering waits until it drops
+// to zero so no handler can use the code buffer after it's freed. Sequentially consistent
+// operations make sure that either the handler doesn't see the removed buffer or the unregistering
+// thread sees the handler.
+static std::atomic_uint32_t searching_handlers;
+
+static const void* find_fault_exit(const void* code) {
+  searching_handlers.fetch_add(1);
+
+  const void* exit = nullptr;
+
+  for (const auto& slot : code_buffers) {
+    const auto code_buffer = slot.load();
+    if (!code_buffer) {
+      continue;
+    }
+
+    exit = code_buffer->fault_exit(code);
+    if (exit) {
+      break;
+    }
+  }
+
+  searching_handlers.fetch_sub(1);
+
+  return exit;
+}
+
+#if defined(PLATFORM_LINUX) || defined(PLATFORM_MAC)
+
+static struct sigaction previous_segv_action;
+static struct sigaction previous_bus_action;
+
+static uintptr_t get_pc(const ucontext_t* context) {
+#if defined(PLATFORM_LINUX) && defined(PLATFORM_X64)
+  return uintptr_t(context->uc_mcontext.gregs[REG_RIP]);
+#elif defined(PLATFORM_LINUX) && defined(PLATFORM_AARCH64)
+  return uintptr_t(context->uc_mcontext.pc);
+#elif defined(PLATFORM_MAC) && defined(PLATFORM_X64)
+  return uintptr_t(context->uc_mcontext->__ss.__rip);
+#elif defined(PLATFORM_MAC) && defined(PLATFORM_AARCH64)
+  return uintptr_t(context->uc_mcontext->__ss.__pc);
+#else
+#error "Unsupported architecture"
+#endif
+}
+
+static void set_pc(ucontext_t* context, uintptr_t pc) {
+#if defined(PLATFORM_LINUX) && defined(PLATFORM_X64)
+  context->uc_mcontext.gregs[REG_RIP] = greg_t(pc);
+#elif defined(PLATFORM_LINUX) && defined(PLATFORM_AARCH64)
+  context->uc_mcontext.pc = pc;
+#elif defined(PLATFORM_MAC) && defined(PLATFORM_X64)
+  context->uc_mcontext->__ss.__rip = pc;
+#elif defined(PLATFORM_MAC) && defined(PLATFORM_AARCH64)
+  context->uc_mcontext->__ss.__pc = pc;
+#else
+#error "Unsupported architecture"
+#endif
+}
+
+static void handle_fault(int signal, siginfo_t* info, void* raw_context) {
+  const auto context = reinterpret_cast<ucontext_t*>(raw_context);
+
+  // Faulting access didn't modify any registers so the exit can flush them as usual.
+  if (const auto exit = find_fault_exit(reinterpret_cast<const void*>(get_pc(context)))) {
+    set_pc(context, uintptr_t(exit));
+    return;
+  }
+
+  // Not a guest memory access, forward it to the previous handler. Our handler must stay installed
+  // because other threads can still fault on guard pages.
+  const auto& previous_action = signal == SIGSEGV ? previous_segv_action : previous_bus_action;
+  if ((previous_action.sa_flags & SA_SIGINFO) != 0) {
+    previous_action.sa_sigaction(signal, info, raw_context);
+    return;
+  }
+
+  if (previous_action.sa_handler != SIG_DFL && previous_action.sa_handler != SIG_IGN) {
+    previous_action.sa_handler(signal);
+    return;
+  }
+
+  // Default action terminates the process once the instruction is executed again. Ignoring the
+  // fault would execute it forever so it gets the default action too.
+  struct sigaction default_action {};
+  default_action.sa_handler = SIG_DFL;
+  sigemptyset(&default_action.sa_mask);
+  sigaction(signal, &default_action, nullptr);
+}
+
+void fault_handler::install() {
+  static std::once_flag once;
+
+  std::call_once(once, [] {
+    struct sigaction action {};
+    action.sa_sigaction = handle_fault;
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+
+    verify(sigaction(SIGSEGV, &action, &previous_segv_action) == 0,
+           "failed to install SIGSEGV handler");
+    verify(sigaction(SIGBUS, &action, &previous_bus_action) == 0,
+           "failed to install SIGBUS handler");
+  });
+}
+
+#else
+
+void fault_handler::install() {
+  fatal_error("guard pages are not supported on this platform");
+}
+
+#endif
+
+void fault_handler::register_code_buffer(const CodeBuffer* code_buffer) {
+  std::unique_lock lock(registry_mutex);
+
+  for (auto& slot : code_buffers) {
+    if (!slot.load(std::memory_order::relaxed)) {
+      slot.store(code_buffer);
+      return;
+    }
+  }
+
+  fatal_error("too many JIT code buffers");
+}
+
+void fault_handler::unregister_code_buffer(const CodeBuffer* code_buffer) {
+  std::unique_lock lock(registry_mutex);
+
+  for (auto& slot : code_buffers) {
+    if (slot.load(std::memory_order::relaxed) == code_buffer) {
+      slot.store(nullptr);
+      break;
+    }
+  }
+
+  // Handlers never block so the wait is short.
+  while (searching_handlers.load() != 0) {
+    std::this_thread::yield();
+  }
+}
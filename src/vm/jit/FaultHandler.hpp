@@ -0,0 +1,21 @@
+#pragma once
+
+namespace vm::jit {
+
+class CodeBuffer;
+
+}
+
+namespace vm::jit::fault_handler {
+
+// Installs process-wide handler of memory access faults which resumes execution of faulting guest
+// memory accesses in generated code at their fault exits (see `CodeBuffer::FaultSite`). Faults
+// anywhere else are forwarded to the previously installed handler.
+void install();
+
+void register_code_buffer(const CodeBuffer* code_buffer);
+
+// Returns once no fault handler can be using `code_buffer` anymore, so it can be freed.
+void unregister_code_buffer(const CodeBuffer* code_buffer);
+
+}  // namespace vm::jit::fault_handler
@@ -0,0 +1,43 @@
+#include "Profile.hpp"
+
+using namespace vm::jit;
+
+uint32_t Profile::record_interpreted_block(uint64_t pc) {
+  return interpreted_blocks.get(pc).fetch_add(1, std::memory_order::relaxed) + 1;
+}
+
+void Profile::record_branch(uint64_t pc, bool taken) {
+  auto& counts = branches.get(pc);
+  if (taken) {
+    counts.taken.fetch_add(1, std::memory_order::relaxed);
+  } else {
+    counts.not_taken.fetch_add(1, std::memory_order::relaxed);
+  }
+}
+
+std::optional<bool> Profile::predict_branch(uint64_t pc) const {
+  const auto counts = branches.find(pc);
+  if (!counts) {
+    return std::nullopt;
+  }
+
+  return counts->taken.load(std::memory_order::relaxed) >
+         counts->not_taken.load(std::memory_order::relaxed);
+}
+
+uint64_t* Profile::hot_counter(uint64_t pc, uint64_t initial_value) {
+  std::unique_lock lock(hot_counters_mutex);
+
+  auto& counter = hot_counters[pc];
+  counter = initial_value;
+  return &counter;
+}
+
+void Profile::reset_hot_counter(uint64_t pc, uint64_t value) {
+  std::unique_lock lock(hot_counters_mutex);
+
+  const auto it = hot_counters.find(pc);
+  if (it != hot_counters.end()) {
+    it->second = value;
+  }
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <unordered_map>
+
+namespace vm::jit {
+
+struct TieringThresholds {
+  // Number of times a block is interpreted before it gets compiled by the baseline JIT.
+  uint32_t baseline = 16;
+
+  // Number of times baseline code of a block is executed before the block gets recompiled by the
+  // optimizing JIT. 0 makes blocks skip the baseline JIT.
+  uint32_t optimizing = 1000;
+
+  // Number of threads which compile blocks in the background. Blocks are interpreted (or keep
+  // running their baseline code) until their code is published. 0 compiles blocks synchronously.
+  uint32_t compile_threads = 0;
+};
+
+// Execution statistics which drive tiered compilation. Shared by all harts of the VM.
+class Profile {
+  constexpr static size_t shard_count = 64;
+
+  // Counters are split into shards by the guest address so harts which run different code rarely
+  // use the same lock. Existing counters are updated with relaxed atomics under a shared lock,
+  // the exclusive lock is only taken to create them. Elements of `std::unordered_map` have stable
+  // addresses so counters can be used after the lock is released.
+  template <typename T>
+  class CounterTable {
+    struct Shard {
+      std::unordered_map<uint64_t, T> counters;
+      mutable std::shared_mutex mutex;
+    };
+
+    Shard shards[shard_count];
+
+    Shard& shard(uint64_t pc) { return shards[(pc * 0x9e37'79b9'7f4a'7c15) >> 58]; }
+    const Shard& shard(uint64_t pc) const { return shards[(pc * 0x9e37'79b9'7f4a'7c15) >> 58]; }
+
+   public:
+    T& get(uint64_t pc) {
+      auto& shard = this->shard(pc);
+
+      {
+        std::shared_lock lock(shard.mutex);
+        if (const auto it = shard.counters.find(pc); it != shard.counters.end()) {
+          return it->second;
+        }
+      }
+
+      std::unique_lock lock(shard.mutex);
+      return shard.counters.try_emplace(pc).first->second;
+    }
+
+    const T* find(uint64_t pc) const {
+      const auto& shard = this->shard(pc);
+
+      std::shared_lock lock(shard.mutex);
+      const auto it = shard.counters.find(pc);
+      return it != shard.counters.end() ? &it->second : nullptr;
+    }
+  };
+
+  struct BranchCounts {
+    std::atomic_uint32_t taken{};
+    std::atomic_uint32_t not_taken{};
+  };
+
+  CounterTable<std::atomic_uint32_t> interpreted_blocks;
+  CounterTable<BranchCounts> branches;
+
+  // Baseline code decrements these in place. Elements of `std::unordered_map` have stable
+  // addresses.
+  std::unordered_map<uint64_t, uint64_t> hot_counters;
+  std::mutex hot_counters_mutex;
+
+ public:
+  // Returns how many times the block at `pc` was interpreted (including this time).
+  uint32_t record_interpreted_block(uint64_t pc);
+  void record_branch(uint64_t pc, bool taken);
+
+  // Returns the more likely direction of the conditional branch at `pc` (true if taken) or
+  // nothing if the branch was never executed by the interpreter.
+  std::optional<bool> predict_branch(uint64_t pc) const;
+
+  // Returns counter which is decremented on every execution of the baseline code of the block
+  // at `pc`. Block gets recompiled by the optimizing JIT once it reaches zero. Harts decrement it
+  // without synchronization, lost updates only delay the recompilation.
+  uint64_t* hot_counter(uint64_t pc, uint64_t initial_value);
+
+  // Sets the hot counter of the block at `pc` (if it has one) to `value` so its baseline code
+  // requests recompilation again.
+  void reset_hot_counter(uint64_t pc, uint64_t value);
+};
+
+}  // namespace vm::jit
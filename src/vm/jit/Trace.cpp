@@ -0,0 +1,136 @@
+#include "Trace.hpp"
+
+#include <algorithm>
+
+using namespace vm;
+using namespace vm::jit;
+
+static bool is_conditional_branch(InstructionType type) {
+  using IT = InstructionType;
+
+  switch (type) {
+    case IT::Beq:
+    case IT::Bne:
+    case IT::Blt:
+    case IT::Bge:
+    case IT::Bltu:
+    case IT::Bgeu:
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+// Instructions after which execution never continues sequentially within the trace.
+static bool ends_trace(const Instruction& instruction) {
+  using IT = InstructionType;
+
+  switch (instruction.type()) {
+    case IT::Jal:
+      // `jal zero` is a plain jump which can be followed.
+      return instruction.rd() != Register::Zero;
+
+    case IT::Jalr:
+    case IT::Ecall:
+    case IT::Ebreak:
+    case IT::Undefined:
+    case IT::Csrrw:
+    case IT::Csrrs:
+    case IT::Csrrc:
+    case IT::Csrrwi:
+    case IT::Csrrsi:
+    case IT::Csrrci:
+      return true;
+
+    case IT::FenceI:
+      // Instructions after it are looked up again so their latest translation gets executed.
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+static bool predict_branch_taken(const Profile* profile,
+                                 uint64_t pc,
+                                 const Instruction& instruction) {
+  if (profile) {
+    if (const auto taken = profile->predict_branch(pc)) {
+      return *taken;
+    }
+  }
+
+  // Backward branches are usually loop back-edges so we predict them as taken. Forward branches
+  // usually skip rarely executed code so we predict them as not taken.
+  return instruction.imm() < 0;
+}
+
+void jit::build_trace(Trace& trace,
+                      const Memory& memory,
+                      uint64_t pc,
+                      const TraceOptions& options) {
+  trace.clear();
+
+  const auto is_in_trace = [&](uint64_t address) {
+    return std::any_of(trace.entries.begin(), trace.entries.end(),
+                       [&](const Trace::Entry& entry) { return entry.pc == address; });
+  };
+
+  // Whether `pc` was reached by a jump (and not by sequential execution).
+  bool jumped = false;
+
+  while (true) {
+    // Stop at the already covered instruction so loops get closed with a branch to their head.
+    if (trace.entries.size() >= options.max_instructions || is_in_trace(pc)) {
+      trace.end_pc = pc;
+      return;
+    }
+
+    uint32_t encoded_instruction;
+    if ((pc & 1) != 0 || !Instruction::fetch(memory, pc, encoded_instruction)) {
+      // Invalid jump targets are reported by the branch to `end_pc` so we only need to
+      // handle fetch faults during sequential execution.
+      trace.end_pc = pc;
+      trace.end_fetch_fault = !jumped;
+      return;
+    }
+
+    const Instruction instruction{encoded_instruction};
+    const auto instruction_type = instruction.type();
+
+    Trace::Entry entry{
+      .pc = pc,
+      .instruction = instruction,
+    };
+
+    const auto fallthrough_pc = pc + instruction.length();
+
+    uint64_t next_pc = fallthrough_pc;
+
+    if (instruction_type == InstructionType::Jal) {
+      next_pc = pc + instruction.imm();
+    } else if (is_conditional_branch(instruction_type) && options.follow_branches) {
+      entry.branch_taken = predict_branch_taken(options.profile, pc, instruction);
+      if (entry.branch_taken) {
+        next_pc = pc + instruction.imm();
+      }
+    }
+
+    trace.entries.push_back(entry);
+
+    if (ends_trace(instruction)) {
+      trace.end_pc = next_pc;
+      return;
+    }
+
+    jumped = next_pc != fallthrough_pc;
+
+    if (jumped && !options.follow_branches) {
+      trace.end_pc = next_pc;
+      return;
+    }
+
+    pc = next_pc;
+  }
+}
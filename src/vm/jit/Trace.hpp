@@ -0,0 +1,57 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include <vm/Instruction.hpp>
+#include <vm/Memory.hpp>
+
+#include "Profile.hpp"
+
+namespace vm::jit {
+
+// Sequence of guest instructions which is compiled as a single unit. Trace follows the predicted
+// path through conditional branches and unconditional jumps so it can span multiple basic blocks.
+// Paths that leave the trace are compiled as side exits.
+struct Trace {
+  struct Entry {
+    uint64_t pc{};
+    Instruction instruction;
+
+    // Only used by conditional branches: trace continues at the branch target and the side exit
+    // goes to the fallthrough instruction.
+    bool branch_taken{};
+  };
+
+  std::vector<Entry> entries;
+
+  // If the last instruction doesn't transfer control by itself, execution continues at `end_pc`.
+  uint64_t end_pc{};
+
+  // Instruction at `end_pc` couldn't be fetched.
+  bool end_fetch_fault{};
+
+  void clear() {
+    entries.clear();
+    end_pc = 0;
+    end_fetch_fault = false;
+  }
+};
+
+struct TraceOptions {
+  size_t max_instructions = 128;
+
+  // Follow unconditional jumps and predicted directions of conditional branches. Otherwise trace
+  // covers a single basic block (conditional branches don't end it but are never followed).
+  bool follow_branches = true;
+
+  // Used to predict directions of conditional branches. Branches without profile data are
+  // predicted statically.
+  const Profile* profile = nullptr;
+
+  // Run IR optimization passes before compiling the trace.
+  bool optimize = false;
+};
+
+void build_trace(Trace& trace, const Memory& memory, uint64_t pc, const TraceOptions& options);
+
+}  // namespace vm::jit
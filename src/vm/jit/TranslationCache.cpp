@@ -0,0 +1,149 @@
+#include "TranslationCache.hpp"
+#include "CodeDump.hpp"
+
+#include <base/Error.hpp>
+#include <base/File.hpp>
+
+#include <type_traits>
+
+using namespace vm::jit;
+
+constexpr uint32_t cache_magic = 0x7c3a19e5;
+
+// Must be bumped whenever generated code or the layout of its metadata changes, otherwise blocks
+// generated by older versions would get loaded.
+constexpr uint32_t cache_version = 2;
+
+static CodeDump::Architecture cache_architecture() {
+#if defined(VM_JIT_X64)
+  return CodeDump::Architecture::X64;
+#elif defined(VM_JIT_AARCH64)
+  return CodeDump::Architecture::AArch64;
+#else
+  fatal_error("cannot use translation cache: unknown code architecture");
+#endif
+}
+
+class CacheWriter {
+  base::File& file;
+
+ public:
+  explicit CacheWriter(base::File& file) : file(file) {}
+
+  template <typename T>
+  void write(const T& value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    verify(file.write(&value, sizeof(T)) == sizeof(T), "writing translation cache failed");
+  }
+
+  template <typename T>
+  void write_vector(const std::vector<T>& values) {
+    static_assert(std::is_trivially_copyable_v<T>);
+
+    write(uint64_t(values.size()));
+
+    const auto size = values.size() * sizeof(T);
+    verify(file.write(values.data(), size) == size, "writing translation cache failed");
+  }
+};
+
+class CacheReader {
+  base::File& file;
+
+ public:
+  explicit CacheReader(base::File& file) : file(file) {}
+
+  template <typename T>
+  bool read(T& value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    return file.read(&value, sizeof(T)) == sizeof(T);
+  }
+
+  template <typename T>
+  bool read_vector(std::vector<T>& values) {
+    static_assert(std::is_trivially_copyable_v<T>);
+
+    // Limit the element count so malformed files can't cause huge allocations.
+    uint64_t count;
+    if (!read(count) || count > (uint64_t(1) << 28) / sizeof(T)) {
+      return false;
+    }
+
+    values.resize(count);
+
+    const auto size = count * sizeof(T);
+    return file.read(values.data(), size) == size;
+  }
+};
+
+bool TranslationCache::load(const std::string& path, const Header& header) {
+  blocks.clear();
+
+  base::File file(path, "rb");
+  if (!file) {
+    return false;
+  }
+
+  CacheReader reader(file);
+
+  uint32_t magic, version, architecture;
+  if (!reader.read(magic) || !reader.read(version) || !reader.read(architecture) ||
+      magic != cache_magic || version != cache_version ||
+      architecture != uint32_t(cache_architecture())) {
+    return false;
+  }
+
+  Header file_header;
+  if (!reader.read(file_header) || file_header.image_hash != header.image_hash ||
+      file_header.memory_size != header.memory_size ||
+      file_header.max_block_count != header.max_block_count ||
+      file_header.memory_flags != header.memory_flags ||
+      file_header.code_buffer_flags != header.code_buffer_flags ||
+      file_header.host_features != header.host_features) {
+    return false;
+  }
+
+  uint64_t block_count;
+  if (!reader.read(block_count)) {
+    return false;
+  }
+
+  for (uint64_t i = 0; i < block_count; ++i) {
+    Block block;
+    if (!reader.read(block.pc) || !reader.read(block.tier) || !reader.read_vector(block.code) ||
+        !reader.read_vector(block.link_sites) || !reader.read_vector(block.inline_caches) ||
+        !reader.read_vector(block.fault_sites) || !reader.read_vector(block.relocations) ||
+        !reader.read_vector(block.code_pages)) {
+      blocks.clear();
+      return false;
+    }
+
+    blocks.push_back(std::move(block));
+  }
+
+  return true;
+}
+
+void TranslationCache::save(const std::string& path, const Header& header) const {
+  base::File file(path, "wb");
+  verify(file, "failed to open translation cache for writing ({})", path);
+
+  CacheWriter writer(file);
+
+  writer.write(cache_magic);
+  writer.write(cache_version);
+  writer.write(uint32_t(cache_architecture()));
+  writer.write(header);
+
+  writer.write(uint64_t(blocks.size()));
+  for (const auto& block : blocks) {
+    writer.write(block.pc);
+    writer.write(block.tier);
+    writer.write_vector(block.code);
+    writer.write_vector(block.link_sites);
+    writer.write_vector(block.inline_caches);
+    writer.write_vector(block.fault_sites);
+    writer.write_vector(block.relocations);
+    writer.write_vector(block.code_pages);
+  }
+}
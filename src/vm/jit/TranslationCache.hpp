@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "CodeBuffer.hpp"
+
+namespace vm::jit {
+
+// Generated block code saved to disk so later runs of the same guest image don't have to compile
+// its blocks again. Blocks are stored as they were generated (before linking and inline cache
+// patching) together with everything needed to insert them into a code buffer again. Host
+// addresses embedded in the code are described by relocations and are recomputed when loading.
+class TranslationCache {
+ public:
+  // Configuration which affects generated code. Cache is only loaded if all fields match.
+  struct Header {
+    uint64_t image_hash{};
+    uint64_t memory_size{};
+    uint64_t max_block_count{};
+    uint32_t memory_flags{};
+    uint32_t code_buffer_flags{};
+    uint32_t host_features{};
+  };
+
+  // Guest page with code of a block. Block must not be used if contents of any of its pages don't
+  // have the same hash when loading.
+  struct Page {
+    uint64_t address{};
+    uint64_t content_hash{};
+  };
+
+  struct Block {
+    uint64_t pc{};
+    uint32_t tier{};
+    std::vector<uint8_t> code;
+    std::vector<CodeBuffer::LinkSite> link_sites;
+    std::vector<CodeBuffer::InlineCache> inline_caches;
+    std::vector<CodeBuffer::FaultSite> fault_sites;
+    std::vector<CodeBuffer::Relocation> relocations;
+    std::vector<Page> code_pages;
+  };
+
+  std::vector<Block> blocks;
+
+  // Returns false if the file doesn't exist, is malformed or was created for a different
+  // configuration or by a different version of the code generator.
+  bool load(const std::string& path, const Header& header);
+  void save(const std::string& path, const Header& header) const;
+};
+
+}  // namespace vm::jit
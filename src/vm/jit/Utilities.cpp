@@ -4,6 +4,49 @@
 
 using namespace vm::jit;
 
+bool utils::is_memory_access(InstructionType type) {
+  using IT = InstructionType;
+
+  switch (type) {
+    case IT::Lb:
+    case IT::Lh:
+    case IT::Lw:
+    case IT::Ld:
+    case IT::Lbu:
+    case IT::Lhu:
+    case IT::Lwu:
+    case IT::Sb:
+    case IT::Sh:
+    case IT::Sw:
+    case IT::Sd:
+    case IT::Flw:
+    case IT::Fsw:
+    case IT::Fld:
+    case IT::Fsd:
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+bool utils::is_memory_write(InstructionType type) {
+  using IT = InstructionType;
+
+  switch (type) {
+    case IT::Sb:
+    case IT::Sh:
+    case IT::Sw:
+    case IT::Sd:
+    case IT::Fsw:
+    case IT::Fsd:
+      return true;
+
+    default:
+      return false;
+  }
+}
+
 uint64_t utils::memory_access_size_log2(InstructionType type) {
   using IT = InstructionType;
 
@@ -21,10 +64,36 @@ uint64_t utils::memory_access_size_log2(InstructionType type) {
     case IT::Sw:
     case IT::Lw:
     case IT::Lwu:
+    case IT::Flw:
+    case IT::Fsw:
+    case IT::LrW:
+    case IT::ScW:
+    case IT::AmoswapW:
+    case IT::AmoaddW:
+    case IT::AmoxorW:
+    case IT::AmoandW:
+    case IT::AmoorW:
+    case IT::AmominW:
+    case IT::AmomaxW:
+    case IT::AmominuW:
+    case IT::AmomaxuW:
       return 2;
 
     case IT::Sd:
     case IT::Ld:
+    case IT::Fld:
+    case IT::Fsd:
+    case IT::LrD:
+    case IT::ScD:
+    case IT::AmoswapD:
+    case IT::AmoaddD:
+    case IT::AmoxorD:
+    case IT::AmoandD:
+    case IT::AmoorD:
+    case IT::AmominD:
+    case IT::AmomaxD:
+    case IT::AmominuD:
+    case IT::AmomaxuD:
       return 3;
 
     default:
@@ -10,6 +10,8 @@ std::span<const uint8_t> cast_to_bytes(std::span<const T> data) {
   return std::span{reinterpret_cast<const uint8_t*>(data.data()), data.size() * sizeof(T)};
 }
 
+bool is_memory_access(InstructionType type);
+bool is_memory_write(InstructionType type);
 uint64_t memory_access_size_log2(InstructionType type);
 
 }  // namespace vm::jit::utils
\ No newline at end of file
@@ -1,7 +1,19 @@
 #include "CodeGenerator.hpp"
 
 #include <vm/Instruction.hpp>
+#include <vm/RegisterState.hpp>
+#include <vm/jit/Trace.hpp>
+#include <vm/jit/ir/Block.hpp>
+#include <vm/jit/ir/Fusion.hpp>
+#include <vm/jit/ir/MemoryChecks.hpp>
+#include <vm/jit/ir/Passes.hpp>
 #include <vm/jit/Utilities.hpp>
+#include <vm/private/Arithmetic.hpp>
+#include <vm/private/FloatArithmetic.hpp>
+#include <vm/private/VectorArithmetic.hpp>
+
+#include <algorithm>
+#include <optional>
 
 using namespace vm;
 using namespace vm::jit::aarch64;
@@ -10,17 +22,47 @@ using namespace asmlib;
 
 using CodeBufferFlags = jit::CodeBuffer::Flags;
 
+constexpr uint64_t table_entry_granularity = jit::CodeBuffer::table_entry_granularity;
+constexpr uint32_t halfword_block_tag = jit::CodeBuffer::halfword_block_tag;
+constexpr uint64_t table_leaf_shift = jit::CodeBuffer::table_leaf_shift;
+constexpr uint64_t table_leaf_size = jit::CodeBuffer::table_leaf_size;
+
+constexpr size_t max_return_stack_depth = 1024;
+
+// Memory access bits of the predecessor and successor sets of `fence`.
+constexpr uint64_t fence_reads = 0b0010;
+constexpr uint64_t fence_writes = 0b0001;
+constexpr uint64_t fence_accesses = fence_reads | fence_writes;
+
 struct CodeGenerator {
   a64::Assembler& as;
   const Memory& memory;
   const jit::CodeBuffer& code_buffer;
 
   bool single_step{};
+  uint64_t* hot_counter{};
 
   std::vector<CodegenContext::Exit>& pending_exits;
+  std::vector<CodegenContext::Branch>& pending_branches;
+  std::vector<jit::CodeBuffer::LinkSite>& link_sites;
+  std::vector<jit::CodeBuffer::InlineCache>& inline_caches;
+  std::vector<jit::CodeBuffer::FaultSite>& fault_sites;
+  std::vector<jit::CodeBuffer::Relocation>& relocations;
 
   uint64_t base_pc{};
   uint64_t current_pc{};
+  uint64_t next_pc{};
+
+  // Vector configuration set by `vsetvli` or `vsetivli` earlier in the block. Only `vsetvl`
+  // changes `vtype` afterwards and fault-only-first loads can shorten `vl`.
+  struct VectorConfiguration {
+    uint32_t sew_log2{};
+    uint64_t vlmax{};
+
+    // `vl` is known to be VLMAX.
+    bool full_length = false;
+  };
+  std::optional<VectorConfiguration> vector_configuration{};
 
   RegisterCache register_cache{as};
 
@@ -41,6 +83,22 @@ struct CodeGenerator {
     return load_immediate(target, int64_t(immediate));
   }
 
+  // Code buffer writes the value when inserting the block.
+  void load_relocated_value(A64R target,
+                            jit::CodeBuffer::Relocation::Target relocation_target,
+                            uint64_t value) {
+    relocations.push_back({
+      .offset = uint32_t(as.assembled_instructions().size() * sizeof(uint32_t)),
+      .target = relocation_target,
+      .value = value,
+    });
+
+    as.movz(target, value & 0xffff, 0);
+    as.movk(target, (value >> 16) & 0xffff, 16);
+    as.movk(target, (value >> 32) & 0xffff, 32);
+    as.movk(target, (value >> 48) & 0xffff, 48);
+  }
+
   A64R load_immediate_or_zero(A64R target, int64_t immediate) {
     if (immediate == 0) {
       return A64R::Xzr;
@@ -71,18 +129,27 @@ struct CodeGenerator {
     return scratch_reg;
   }
 
+  void generate_return_to_trampoline() {
+    // Drop all return address stack entries and restore the trampoline return address.
+    as.mov(A64R::Sp, RegisterAllocation::stack_base);
+    as.ldp(A64R::X30, RegisterAllocation::b_reg, A64R::Sp, 16, a64::Writeback::Post);
+    as.ret();
+  }
+
   void generate_exit(ArchExitReason reason) { generate_exit(reason, current_pc); }
-  void generate_exit(ArchExitReason reason, uint64_t pc) {
-    register_cache.flush_current_registers();
+  void generate_exit(ArchExitReason reason, uint64_t pc, bool flush_registers = true) {
+    if (flush_registers) {
+      register_cache.flush_current_registers();
+    }
     load_immediate_u(RegisterAllocation::exit_pc, pc);
     load_immediate_u(RegisterAllocation::exit_reason, uint64_t(reason));
-    as.ret();
+    generate_return_to_trampoline();
   }
   void generate_exit(ArchExitReason reason, A64R pc) {
     register_cache.flush_current_registers();
     as.mov(RegisterAllocation::exit_pc, pc);
     load_immediate_u(RegisterAllocation::exit_reason, uint64_t(reason));
-    as.ret();
+    generate_return_to_trampoline();
   }
 
   void add_pending_exit(a64::Label label,
@@ -106,250 +173,1882 @@ struct CodeGenerator {
         flush_registers ? register_cache.take_state_snapshot() : RegisterCache::StateSnapshot{},
     });
   }
+  void add_pending_branch(a64::Label label, uint64_t target_pc) {
+    pending_branches.push_back({
+      .label = label,
+      .target_pc = target_pc,
+      .snapshot = register_cache.take_state_snapshot(),
+    });
+  }
+  void generate_pending_branches() {
+    for (const auto& pending_branch : pending_branches) {
+      as.insert_label(pending_branch.label);
+
+      register_cache.flush_registers(pending_branch.snapshot);
+      generate_static_branch(pending_branch.target_pc, RegisterAllocation::a_reg, false);
+    }
+  }
+
   void generate_pending_exits() {
     for (const auto& pending_exit : pending_exits) {
       as.insert_label(pending_exit.label);
 
-      register_cache.flush_registers(pending_exit.snapshot);
+      if (pending_exit.faulting_access_offset) {
+        fault_sites.push_back({
+          .access_offset = *pending_exit.faulting_access_offset,
+          .exit_offset = uint32_t(as.assembled_instructions().size() * sizeof(uint32_t)),
+        });
+      }
+
+      register_cache.flush_registers(pending_exit.snapshot);
+
+      if (pending_exit.pc_register != A64R::Xzr) {
+        as.mov(RegisterAllocation::exit_pc, pending_exit.pc_register);
+      } else {
+        load_immediate_u(RegisterAllocation::exit_pc, pending_exit.pc_value);
+      }
+
+      load_immediate_u(RegisterAllocation::exit_reason, uint64_t(pending_exit.reason));
+
+      generate_return_to_trampoline();
+    }
+  }
+
+  bool load_memory_permission_mask(A64R target, MemoryFlags flags, size_t access_size_log2) {
+    const auto uflags = uint64_t(flags);
+
+    switch (access_size_log2) {
+      case 0: {
+        as.mov(target, uflags);
+        break;
+      }
+
+      case 1: {
+        as.mov(target, (uflags << 8) | uflags);
+        break;
+      }
+
+      case 2:
+      case 3: {
+        uint64_t mask = 0;
+        for (size_t i = 0; i < 8; ++i) {
+          mask |= uflags << (i * 8);
+        }
+        as.mov(target, mask);
+
+        // Truncate to 32 bit registers when access size == 4.
+        return access_size_log2 == 2;
+      }
+
+      default:
+        unreachable();
+    }
+
+    return false;
+  }
+
+  void add_faulting_access_exit(a64::Label fault_label, ArchExitReason fault_reason) {
+    add_pending_exit(fault_label, fault_reason, true, current_pc);
+
+    // Caller emits the memory access right after the validation.
+    pending_exits.back().faulting_access_offset =
+      uint32_t(as.assembled_instructions().size() * sizeof(uint32_t));
+  }
+
+  bool should_check_permissions() const {
+    return (code_buffer.flags() & CodeBufferFlags::SkipPermissionChecks) == CodeBufferFlags::None;
+  }
+
+  bool is_multithreaded() const {
+    return (code_buffer.flags() & CodeBufferFlags::Multithreaded) != CodeBufferFlags::None;
+  }
+
+  void generate_page_permissions_check(A64R address_reg,
+                                       A64R scratch_reg,
+                                       MemoryFlags required_flags,
+                                       a64::Label fault_label) {
+    as.lsr(scratch_reg, address_reg, vm::Memory::permission_page_shift);
+    as.ldrb(scratch_reg, RegisterAllocation::permissions_base, scratch_reg);
+
+    for (const auto flag : {MemoryFlags::Read, MemoryFlags::Write}) {
+      if ((required_flags & flag) != MemoryFlags::None) {
+        as.tst(scratch_reg, uint64_t(flag));
+        as.b(a64::Condition::Zero, fault_label);
+      }
+    }
+  }
+
+  static ArchExitReason memory_fault_reason(MemoryFlags required_flags) {
+    return (required_flags & MemoryFlags::Write) != MemoryFlags::None
+             ? ArchExitReason::MemoryWriteFault
+             : ArchExitReason::MemoryReadFault;
+  }
+
+  void generate_validate_memory_access(A64R address_reg,
+                                       A64R scratch_reg,
+                                       A64R scratch_reg2,
+                                       uint64_t access_size_log2,
+                                       MemoryFlags required_flags) {
+    const auto fault_label = as.allocate_label();
+    const auto fault_reason = memory_fault_reason(required_flags);
+
+    if (memory.uses_guard_pages()) {
+      // Permissions are enforced by page protection and accesses crossing the end of the memory
+      // hit the guard region so we only need to check the start of the access.
+      as.cmp(address_reg, RegisterAllocation::memory_size);
+      as.b(a64::Condition::UnsignedGreaterEqual, fault_label);
+
+      add_faulting_access_exit(fault_label, fault_reason);
+      return;
+    }
+
+    const auto access_size = int64_t(1) << access_size_log2;
+
+    // Check if address >= memory_size.
+    as.cmp(address_reg, RegisterAllocation::memory_size);
+    as.b(a64::Condition::UnsignedGreaterEqual, fault_label);
+
+    // Accesses don't need to be aligned so check the last accessed byte too. Address is below
+    // memory_size so this can't overflow.
+    A64R last_byte_reg = address_reg;
+    if (access_size > 1) {
+      last_byte_reg = add_offset_to_register(address_reg, scratch_reg, access_size - 1);
+
+      as.cmp(last_byte_reg, RegisterAllocation::memory_size);
+      as.b(a64::Condition::UnsignedGreaterEqual, fault_label);
+    }
+
+    if (should_check_permissions()) {
+      if (!memory.uses_byte_permissions()) {
+        // Misaligned accesses which cross permission page boundary are rare so we let the
+        // interpreter handle them and check only one page entry.
+        if (access_size > 1) {
+          as.eor(scratch_reg, last_byte_reg, address_reg);
+          as.lsr(scratch_reg, scratch_reg, vm::Memory::permission_page_shift);
+          as.cbnz(scratch_reg, fault_label);
+        }
+
+        generate_page_permissions_check(address_reg, scratch_reg, required_flags, fault_label);
+      } else {
+        auto perms_reg = scratch_reg;
+        auto mask_reg = scratch_reg2;
+
+        const auto pb = RegisterAllocation::permissions_base;
+
+        switch (access_size_log2) {
+            // clang-format off
+          case 0: as.ldrb(perms_reg, pb, address_reg); break;
+          case 1: as.ldrh(perms_reg, pb, address_reg); break;
+          case 2: as.ldr(cast_to_32bit(perms_reg), pb, address_reg); break;
+          case 3: as.ldr(perms_reg, pb, address_reg); break;
+            // clang-format on
+
+          default:
+            unreachable();
+        }
+
+        const auto truncate_to_32bit =
+          load_memory_permission_mask(mask_reg, required_flags, access_size_log2);
+
+        if (truncate_to_32bit) {
+          perms_reg = cast_to_32bit(perms_reg);
+          mask_reg = cast_to_32bit(mask_reg);
+        }
+
+        as.and_(perms_reg, perms_reg, mask_reg);
+        as.cmp(perms_reg, mask_reg);
+        as.b(a64::Condition::NotEqual, fault_label);
+      }
+    }
+
+    add_pending_exit(fault_label, fault_reason, true, current_pc);
+  }
+
+  // Checks that `size` bytes at `range_begin_reg` are in bounds and, unless page protection
+  // enforces them, have `required_flags` permissions.
+  void generate_range_check(A64R range_begin_reg,
+                            A64R scratch_reg,
+                            uint32_t size,
+                            MemoryFlags required_flags,
+                            a64::Label fault_label) {
+    // Range start can be below the accessed address so it can wrap around. Then it's bigger than
+    // the limit and the check fails.
+    load_immediate_u(scratch_reg, memory.size() - size);
+    as.cmp(range_begin_reg, scratch_reg);
+    as.b(a64::Condition::UnsignedGreater, fault_label);
+
+    if (!memory.uses_guard_pages() && should_check_permissions()) {
+      // Range is at most one permission page long so it spans at most two pages.
+      generate_page_permissions_check(range_begin_reg, scratch_reg, required_flags, fault_label);
+
+      const auto range_last_reg = add_offset_to_register(range_begin_reg, scratch_reg, size - 1);
+      generate_page_permissions_check(range_last_reg, scratch_reg, required_flags, fault_label);
+    }
+  }
+
+  // Validates the whole range accessed by the memory accesses covered by `instruction`.
+  void generate_validate_memory_range(const jit::ir::Instruction& instruction,
+                                      A64R address_reg,
+                                      A64R scratch_reg,
+                                      A64R scratch_reg2) {
+    const auto fault_label = as.allocate_label();
+    const auto fault_reason = jit::utils::is_memory_write(instruction.type)
+                                ? ArchExitReason::MemoryWriteFault
+                                : ArchExitReason::MemoryReadFault;
+
+    const auto range_begin_reg =
+      add_offset_to_register(address_reg, scratch_reg, instruction.check_offset);
+
+    generate_range_check(range_begin_reg, scratch_reg2, instruction.check_size,
+                         instruction.check_flags, fault_label);
+
+    if (memory.uses_guard_pages()) {
+      add_faulting_access_exit(fault_label, fault_reason);
+    } else {
+      add_pending_exit(fault_label, fault_reason, true, current_pc);
+    }
+  }
+
+  // Loads the start of the loop guard range for the current value of its base register. Registers
+  // are read from the register state so the code doesn't depend on the register cache.
+  void load_loop_guard_begin(A64R target_reg, A64R scratch_reg, const jit::ir::LoopGuard& guard) {
+    if (guard.base == Register::Zero) {
+      load_immediate(target_reg, guard.offset);
+      return;
+    }
+
+    as.ldr(scratch_reg, RegisterAllocation::register_state,
+           uint32_t(size_t(guard.base) * sizeof(uint64_t)));
+
+    const auto begin_reg = add_offset_to_register(scratch_reg, target_reg, guard.offset);
+    if (begin_reg != target_reg) {
+      as.mov(target_reg, begin_reg);
+    }
+  }
+
+  // Validates loop guard ranges before the first instruction of the block. If a check fails we
+  // exit with a memory fault at the block start so the interpreter executes the first instruction.
+  void generate_loop_guards(const jit::ir::Block& block) {
+    const auto a = RegisterAllocation::a_reg;
+    const auto b = RegisterAllocation::b_reg;
+    const auto c = RegisterAllocation::c_reg;
+
+    for (const auto& guard : block.loop_guards) {
+      const auto fault_label = as.allocate_label();
+
+      load_loop_guard_begin(a, c, guard);
+      generate_range_check(a, b, guard.size, guard.flags, fault_label);
+
+      add_pending_exit(fault_label, memory_fault_reason(guard.flags), false, current_pc);
+    }
+  }
+
+  // Other harts can change permissions while the loop runs so multithreaded code validates the
+  // loop guards in every iteration (unless page protection enforces the permissions).
+  bool can_skip_loop_guards() const {
+    return !single_step &&
+           (!is_multithreaded() || memory.uses_guard_pages() || !should_check_permissions());
+  }
+
+  // Branches back to `loop_label` past the loop guards if the next iteration accesses only pages
+  // which were already validated. Otherwise the block is entered again from its start. Registers
+  // must be already flushed.
+  void generate_loop_back_edge(const jit::ir::Block& block, a64::Label loop_label) {
+    const auto a = RegisterAllocation::a_reg;
+    const auto b = RegisterAllocation::b_reg;
+    const auto c = RegisterAllocation::c_reg;
+
+    const auto moves =
+      std::any_of(block.loop_guards.begin(), block.loop_guards.end(),
+                  [](const jit::ir::LoopGuard& guard) { return guard.stride != 0; });
+    std::optional<a64::Label> guard_label;
+    if (moves) {
+      guard_label = as.allocate_label();
+    }
+
+    for (const auto& guard : block.loop_guards) {
+      // Range which doesn't move stays validated.
+      if (guard.stride == 0) {
+        continue;
+      }
+
+      load_loop_guard_begin(a, c, guard);
+      load_immediate_u(b, memory.size() - guard.size);
+      as.cmp(a, b);
+      as.b(a64::Condition::UnsignedGreater, *guard_label);
+
+      if (!memory.uses_guard_pages() && should_check_permissions()) {
+        // Range that moves up stays in the validated pages if its last byte stays in the same page.
+        // Range that moves down stays there if its first byte does.
+        const auto edge_reg = guard.stride > 0 ? add_offset_to_register(a, b, guard.size - 1) : a;
+        const auto previous_edge_reg = add_offset_to_register(edge_reg, c, -guard.stride);
+
+        as.eor(c, previous_edge_reg, edge_reg);
+        as.lsr(c, c, vm::Memory::permission_page_shift);
+        as.cbnz(c, *guard_label);
+      }
+    }
+
+    // Hot counter of the block start is skipped too.
+    if (hot_counter) {
+      generate_hot_counter_update();
+    }
+    as.b(loop_label);
+
+    if (moves) {
+      as.insert_label(*guard_label);
+      generate_static_branch(block.end_pc, RegisterAllocation::a_reg, false);
+    }
+  }
+
+  void generate_validate_memory_access(const jit::ir::Instruction& instruction,
+                                       A64R address_reg,
+                                       A64R scratch_reg,
+                                       A64R scratch_reg2) {
+    const auto write = jit::utils::is_memory_write(instruction.type);
+
+    switch (instruction.memory_check) {
+      case jit::ir::MemoryCheck::Access: {
+        generate_validate_memory_access(address_reg, scratch_reg, scratch_reg2,
+                                        jit::utils::memory_access_size_log2(instruction.type),
+                                        write ? MemoryFlags::Write : MemoryFlags::Read);
+        break;
+      }
+
+      case jit::ir::MemoryCheck::Range: {
+        generate_validate_memory_range(instruction, address_reg, scratch_reg, scratch_reg2);
+        break;
+      }
+
+      case jit::ir::MemoryCheck::Covered: {
+        // Access is in bounds but it still can fault on a page without the permission.
+        if (memory.uses_guard_pages()) {
+          add_faulting_access_exit(as.allocate_label(), write ? ArchExitReason::MemoryWriteFault
+                                                              : ArchExitReason::MemoryReadFault);
+        }
+        break;
+      }
+
+      default:
+        unreachable();
+    }
+  }
+
+  // Atomic accesses must be naturally aligned so they never cross a permission page. With guard
+  // pages, every instruction that accesses the memory must be marked by `add_atomic_fault_site`.
+  void generate_validate_atomic_access(A64R address_reg,
+                                       A64R scratch_reg,
+                                       A64R scratch_reg2,
+                                       uint64_t access_size_log2,
+                                       MemoryFlags required_flags) {
+    const auto fault_label = as.allocate_label();
+
+    as.tst(address_reg, (uint64_t(1) << access_size_log2) - 1);
+    as.b(a64::Condition::NotZero, fault_label);
+
+    if (memory.uses_guard_pages()) {
+      as.cmp(address_reg, RegisterAllocation::memory_size);
+      as.b(a64::Condition::UnsignedGreaterEqual, fault_label);
+    }
+
+    add_pending_exit(fault_label, memory_fault_reason(required_flags), true, current_pc);
+
+    if (!memory.uses_guard_pages()) {
+      generate_validate_memory_access(address_reg, scratch_reg, scratch_reg2, access_size_log2,
+                                      required_flags);
+    }
+  }
+
+  void add_atomic_fault_site(MemoryFlags required_flags) {
+    if (memory.uses_guard_pages()) {
+      add_faulting_access_exit(as.allocate_label(), memory_fault_reason(required_flags));
+    }
+  }
+
+  // Loads the 32 bit code offset at `leaf_offset_reg` in the table leaf at `entry_reg`.
+  void load_table_leaf_entry(A64R entry_reg, A64R leaf_offset_reg) {
+    if (!is_multithreaded()) {
+      as.ldr(cast_to_32bit(entry_reg), entry_reg, leaf_offset_reg);
+    } else {
+      as.add(entry_reg, entry_reg, leaf_offset_reg);
+      as.ldar(cast_to_32bit(entry_reg), entry_reg);
+    }
+  }
+
+  // Loads the block translation table entry of `target_pc` into `entry_reg`. Clobbers `c_reg`.
+  void load_block_table_entry(A64R entry_reg, uint64_t target_pc) {
+    const auto leaf_offset_reg = RegisterAllocation::c_reg;
+
+    load_immediate_u(entry_reg, (target_pc >> table_leaf_shift) * sizeof(uint64_t));
+    as.ldr(entry_reg, RegisterAllocation::block_base, entry_reg);
+
+    load_immediate_u(leaf_offset_reg,
+                     (target_pc & (table_leaf_size - 1)) & ~(table_entry_granularity - 1));
+    load_table_leaf_entry(entry_reg, leaf_offset_reg);
+  }
+
+  // Loads the block translation table entry of `target_pc` into `entry_reg`. Clobbers `c_reg`.
+  void load_block_table_entry(A64R entry_reg, A64R target_pc) {
+    const auto leaf_offset_reg = RegisterAllocation::c_reg;
+    verify(entry_reg != leaf_offset_reg && target_pc != leaf_offset_reg,
+           "block table lookup cannot use c_reg");
+
+    as.lsr(entry_reg, target_pc, table_leaf_shift);
+    as.lsl(entry_reg, entry_reg, 3);
+    as.ldr(entry_reg, RegisterAllocation::block_base, entry_reg);
+
+    // Table entries are 4 bytes long and each one covers 4 bytes of guest code.
+    static_assert(table_entry_granularity == sizeof(uint32_t));
+    as.and_(leaf_offset_reg, target_pc,
+            (table_leaf_size - 1) & ~uint64_t(table_entry_granularity - 1));
+    load_table_leaf_entry(entry_reg, leaf_offset_reg);
+  }
+
+  void jump_to_block_code(A64R code_offset_reg) {
+    as.add(code_offset_reg, RegisterAllocation::code_base, code_offset_reg);
+    as.br(code_offset_reg);
+  }
+
+  // Jumps to the block at statically known `target_pc` if its table entry belongs to it.
+  a64::Label generate_validated_branch(A64R entry_reg, uint64_t target_pc) {
+    const auto no_block_label = as.allocate_label();
+
+    load_block_table_entry(entry_reg, target_pc);
+
+    as.tst(entry_reg, uint64_t(halfword_block_tag));
+    if ((target_pc & halfword_block_tag) != 0) {
+      as.b(a64::Condition::Zero, no_block_label);
+      as.and_(entry_reg, entry_reg, ~uint64_t(halfword_block_tag));
+    } else {
+      as.b(a64::Condition::NotZero, no_block_label);
+      as.cbz(entry_reg, no_block_label);
+    }
+
+    jump_to_block_code(entry_reg);
+
+    return no_block_label;
+  }
+
+  // Jumps to the block at `target_pc` if its table entry belongs to it.
+  a64::Label generate_validated_branch(A64R entry_reg, A64R target_pc) {
+    const auto no_block_label = as.allocate_label();
+
+    load_block_table_entry(entry_reg, target_pc);
+
+    // Entry tag must be equal to bit 1 of the target PC.
+    as.eor(entry_reg, entry_reg, target_pc);
+    as.tst(entry_reg, uint64_t(halfword_block_tag));
+    as.b(a64::Condition::NotZero, no_block_label);
+    as.eor(entry_reg, entry_reg, target_pc);
+
+    // Only entries of aligned targets can be empty here.
+    as.and_(entry_reg, entry_reg, ~uint64_t(halfword_block_tag));
+    as.cbz(entry_reg, no_block_label);
+
+    jump_to_block_code(entry_reg);
+
+    return no_block_label;
+  }
+
+  // If `flush_registers` is false, registers must be already flushed.
+  void generate_static_branch(uint64_t target_pc, A64R scratch_reg, bool flush_registers = true) {
+    const auto block = target_pc / table_entry_granularity;
+
+    // We can statically handle some error conditions.
+    if ((target_pc & 1) != 0) {
+      return generate_exit(ArchExitReason::UnalignedPc, target_pc, flush_registers);
+    }
+    if (block >= code_buffer.max_block_count()) {
+      return generate_exit(ArchExitReason::OutOfBoundsPc, target_pc, flush_registers);
+    }
+
+    if (single_step) {
+      // Exit the VM to make sure that we don't execute 2 instructions when single stepping
+      // (branch + 1 instruction after the branch).
+      generate_exit(ArchExitReason::SingleStep, target_pc, flush_registers);
+    } else {
+      if (flush_registers) {
+        register_cache.flush_current_registers();
+      }
+
+      // Code buffer will patch the first instruction of the table lookup sequence into a direct
+      // branch once the target block is generated.
+      link_sites.push_back({
+        .offset = uint32_t(as.assembled_instructions().size() * sizeof(uint32_t)),
+        .target = target_pc,
+      });
+
+      const auto exit_label = generate_validated_branch(scratch_reg, target_pc);
+      add_pending_exit(exit_label, ArchExitReason::BlockNotGenerated, false, target_pc);
+    }
+  }
+
+  void generate_inline_cache_slots(A64R target_pc,
+                                   A64R scratch_reg,
+                                   jit::CodeBuffer::InlineCache& inline_cache) {
+    constexpr auto placeholder = jit::CodeBuffer::inline_cache_placeholder;
+
+    for (auto& slot : inline_cache.slots) {
+      const auto next_label = as.allocate_label();
+
+      // Code buffer will patch immediates of these instructions when filling the slot.
+      slot.value_offset = uint32_t(as.assembled_instructions().size() * sizeof(uint32_t));
+      as.movz(scratch_reg, placeholder & 0xffff, 0);
+      as.movk(scratch_reg, (placeholder >> 16) & 0xffff, 16);
+
+      as.cmp(target_pc, scratch_reg);
+      as.b(a64::Condition::NotEqual, next_label);
+
+      // Code buffer will patch this into a branch to the target block when filling the slot.
+      slot.jump_offset = uint32_t(as.assembled_instructions().size() * sizeof(uint32_t));
+      as.b(next_label);
+
+      as.insert_label(next_label);
+    }
+  }
+
+  // Registers must be already flushed.
+  void generate_dynamic_branch(A64R target_pc, A64R scratch_reg, bool use_inline_cache = false) {
+    verify(target_pc != scratch_reg, "target_pc cannot be equal to scratch_reg");
+
+    const auto oob_label = as.allocate_label();
+    const auto unaligned_label = as.allocate_label();
+
+    // Inline caches rely on code patching which is disabled for multithreaded code buffers.
+    use_inline_cache = use_inline_cache && !single_step && !is_multithreaded();
+
+    jit::CodeBuffer::InlineCache inline_cache{.instruction_address = current_pc};
+    if (use_inline_cache) {
+      generate_inline_cache_slots(target_pc, scratch_reg, inline_cache);
+    }
+
+    // Exit the VM if the address is not properly aligned.
+    as.tst(target_pc, 1);
+    as.b(a64::Condition::NotZero, unaligned_label);
+
+    // Exit the VM if target_pc >= max_executable_pc.
+    as.cmp(target_pc, RegisterAllocation::max_executable_pc);
+    as.b(a64::Condition::UnsignedGreaterEqual, oob_label);
+
+    if (single_step) {
+      // Exit the VM to make sure that we don't execute 2 instructions when single stepping
+      // (branch + 1 instruction after the branch).
+      generate_exit(ArchExitReason::SingleStep, target_pc);
+    } else {
+      if (use_inline_cache) {
+        const auto miss_label = as.allocate_label();
+
+        // Exit the VM so the inline cache can be filled. Once the inline cache becomes full,
+        // code buffer will patch the first instruction into a branch to the table lookup below.
+        inline_cache.miss_offset = uint32_t(as.assembled_instructions().size() * sizeof(uint32_t));
+        load_immediate_u(RegisterAllocation::exit_data, current_pc);
+        as.b(miss_label);
+
+        inline_cache.fallback_offset =
+          uint32_t(as.assembled_instructions().size() * sizeof(uint32_t));
+
+        add_pending_exit(miss_label, ArchExitReason::InlineCacheMiss, false, target_pc);
+        inline_caches.push_back(inline_cache);
+      }
+
+      const auto exit_label = generate_validated_branch(scratch_reg, target_pc);
+      add_pending_exit(exit_label, ArchExitReason::BlockNotGenerated, false, target_pc);
+    }
+
+    add_pending_exit(oob_label, ArchExitReason::OutOfBoundsPc, false, target_pc);
+    add_pending_exit(unaligned_label, ArchExitReason::UnalignedPc, false, target_pc);
+  }
+
+  static bool is_link_register(Register reg) { return reg == Register::Ra || reg == Register::T0; }
+
+  bool can_use_return_stack(uint64_t return_pc) const {
+    return !single_step && (return_pc & 1) == 0 &&
+           return_pc / table_entry_granularity < code_buffer.max_block_count();
+  }
+
+  // Guest calls push return address stack entry on the host stack:
+  //   [sp + 0] - `return_pc`
+  //   [sp + 8] - previous X30
+  // and use `bl` so X30 contains host address of the code that continues execution at
+  // `return_pc`. Guest returns to `return_pc` can then use native `ret` which is well predicted
+  // by the CPU. Registers must be already flushed.
+  template <typename Fn>
+  void generate_call(uint64_t return_pc, Fn&& generate_target_branch) {
+    const auto push_label = as.allocate_label();
+    const auto call_label = as.allocate_label();
+
+    // Entries are only hints so we can drop all of them if the stack grows too large.
+    as.mov(RegisterAllocation::b_reg, A64R::Sp);
+    as.sub(RegisterAllocation::b_reg, RegisterAllocation::stack_base, RegisterAllocation::b_reg);
+    as.macro_mov(RegisterAllocation::c_reg, int64_t(max_return_stack_depth * 16));
+    as.cmp(RegisterAllocation::b_reg, RegisterAllocation::c_reg);
+    as.b(a64::Condition::UnsignedLess, push_label);
+    as.mov(A64R::Sp, RegisterAllocation::stack_base);
+    as.insert_label(push_label);
+
+    load_immediate_u(RegisterAllocation::b_reg, return_pc);
+    as.stp(RegisterAllocation::b_reg, A64R::X30, A64R::Sp, -16, a64::Writeback::Pre);
+    as.bl(call_label);
+
+    // Guest has returned to `return_pc`. Host registers are clobbered here so we cannot flush
+    // them again.
+    as.ldp(RegisterAllocation::b_reg, A64R::X30, A64R::Sp, 16, a64::Writeback::Post);
+    generate_static_branch(return_pc, RegisterAllocation::b_reg, false);
+
+    as.insert_label(call_label);
+    generate_target_branch();
+  }
+
+  // Falls through if the top return address stack entry doesn't match `target_pc`.
+  // Registers must be already flushed.
+  void generate_return(A64R target_pc) {
+    const auto mismatch_label = as.allocate_label();
+
+    as.mov(RegisterAllocation::b_reg, A64R::Sp);
+    as.cmp(RegisterAllocation::b_reg, RegisterAllocation::stack_base);
+    as.b(a64::Condition::Equal, mismatch_label);
+
+    as.ldr(RegisterAllocation::b_reg, A64R::Sp, 0);
+    as.cmp(RegisterAllocation::b_reg, target_pc);
+    as.b(a64::Condition::NotEqual, mismatch_label);
+    as.ret();
+
+    as.insert_label(mismatch_label);
+  }
+
+  // Jumps to the side exit if the conditional branch goes the other way than the trace. Flags
+  // must be already set by comparing branch operands.
+  void generate_branch_side_exit(const jit::ir::Instruction& instruction) {
+    using IT = InstructionType;
+
+    a64::Condition condition;
+    a64::Condition inverted_condition;
+
+    switch (instruction.type) {
+      case IT::Beq:
+        condition = a64::Condition::Equal;
+        inverted_condition = a64::Condition::NotEqual;
+        break;
+      case IT::Bne:
+        condition = a64::Condition::NotEqual;
+        inverted_condition = a64::Condition::Equal;
+        break;
+      case IT::Blt:
+        condition = a64::Condition::Less;
+        inverted_condition = a64::Condition::GreaterEqual;
+        break;
+      case IT::Bge:
+        condition = a64::Condition::GreaterEqual;
+        inverted_condition = a64::Condition::Less;
+        break;
+      case IT::Bltu:
+        condition = a64::Condition::UnsignedLess;
+        inverted_condition = a64::Condition::UnsignedGreaterEqual;
+        break;
+      case IT::Bgeu:
+        condition = a64::Condition::UnsignedGreaterEqual;
+        inverted_condition = a64::Condition::UnsignedLess;
+        break;
+
+      default:
+        unreachable();
+    }
+
+    const auto side_exit_label = as.allocate_label();
+    const auto side_exit_pc =
+      instruction.branch_taken ? next_pc : current_pc + instruction.imm;
+
+    as.b(instruction.branch_taken ? inverted_condition : condition, side_exit_label);
+    add_pending_branch(side_exit_label, side_exit_pc);
+  }
+
+  // Writes the return address to `rd` and jumps to the statically known `target`.
+  void generate_direct_jump(Register rd, uint64_t target) {
+    if (rd != Register::Zero) {
+      const auto reg = register_cache.lock_register(RegisterCache::WriteOnly{rd});
+      load_immediate_u(reg, next_pc);
+      register_cache.unlock_register_dirty(reg);
+    }
+
+    if (is_link_register(rd) && can_use_return_stack(next_pc)) {
+      register_cache.flush_current_registers();
+      generate_call(next_pc, [&] {
+        generate_static_branch(target, RegisterAllocation::a_reg, false);
+      });
+    } else {
+      generate_static_branch(target, RegisterAllocation::a_reg);
+    }
+  }
+
+  // `sc` compares the memory with the value loaded by `lr` and AMOs are lowered to exclusive
+  // load/store loops. LSE atomics would be shorter but they aren't available on all hosts.
+  void generate_atomic_instruction(const jit::ir::Instruction& instruction) {
+    using IT = InstructionType;
+    using WO = RegisterCache::WriteOnly;
+
+    const auto instruction_type = instruction.type;
+    const auto is_32bit = jit::utils::memory_access_size_log2(instruction_type) == 2;
+
+    const auto is_lr = instruction_type == IT::LrW || instruction_type == IT::LrD;
+    const auto is_sc = instruction_type == IT::ScW || instruction_type == IT::ScD;
+
+    auto required_flags = MemoryFlags::Read | MemoryFlags::Write;
+    if (is_lr) {
+      required_flags = MemoryFlags::Read;
+    } else if (is_sc) {
+      required_flags = MemoryFlags::Write;
+    }
+
+    // Exclusive stores need a status register which differs from all other operands.
+    const auto status_reg = A64R::X27;
+    register_cache.lock_platform_register(status_reg);
+
+    const auto [address_reg, value_reg, dest_reg] =
+      register_cache.lock_registers(instruction.rs1, instruction.rs2, WO{instruction.rd});
+
+    const auto host_address_reg = RegisterAllocation::a_reg;
+    const auto old_reg = RegisterAllocation::b_reg;
+    const auto new_reg = RegisterAllocation::c_reg;
+
+    // Exclusive loads and stores don't take an index register.
+    as.add(host_address_reg, RegisterAllocation::memory_base, address_reg);
+
+    generate_validate_atomic_access(address_reg, old_reg, new_reg,
+                                    jit::utils::memory_access_size_log2(instruction_type),
+                                    required_flags);
+
+    const auto sized = [is_32bit](A64R reg) { return is_32bit ? cast_to_32bit(reg) : reg; };
+    const auto status32 = cast_to_32bit(status_reg);
+
+    const auto reservation_address_offset = uint32_t(RegisterState::reservation_address_offset);
+    const auto reservation_value_offset = uint32_t(RegisterState::reservation_value_offset);
+
+    switch (instruction_type) {
+      case IT::LrW:
+      case IT::LrD: {
+        add_atomic_fault_site(required_flags);
+        as.ldar(sized(old_reg), host_address_reg);
+        if (is_32bit) {
+          as.sxtw(old_reg, old_reg);
+        }
+
+        as.str(address_reg, RegisterAllocation::register_state, reservation_address_offset);
+        as.str(old_reg, RegisterAllocation::register_state, reservation_value_offset);
+
+        break;
+      }
+
+      case IT::ScW:
+      case IT::ScD: {
+        const auto retry_label = as.allocate_label();
+        const auto fail_label = as.allocate_label();
+        const auto end_label = as.allocate_label();
+
+        as.ldr(new_reg, RegisterAllocation::register_state, reservation_address_offset);
+        as.cmp(new_reg, address_reg);
+        as.b(a64::Condition::NotEqual, fail_label);
+
+        const auto expected_reg = new_reg;
+        as.ldr(expected_reg, RegisterAllocation::register_state, reservation_value_offset);
+
+        as.insert_label(retry_label);
+
+        add_atomic_fault_site(required_flags);
+        as.ldaxr(sized(old_reg), host_address_reg);
+        as.cmp(sized(old_reg), sized(expected_reg));
+        as.b(a64::Condition::NotEqual, fail_label);
+
+        add_atomic_fault_site(required_flags);
+        as.stlxr(status32, sized(value_reg), host_address_reg);
+        as.cbnz(status32, retry_label);
+
+        as.mov(old_reg, uint64_t(0));
+        as.b(end_label);
+
+        as.insert_label(fail_label);
+        as.mov(old_reg, uint64_t(1));
+
+        as.insert_label(end_label);
+
+        // Reservation is cleared only after the access so the interpreter can retry `sc` if it
+        // faults.
+        as.mov(new_reg, RegisterState::no_reservation);
+        as.str(new_reg, RegisterAllocation::register_state, reservation_address_offset);
+
+        break;
+      }
+
+      default: {
+        const auto retry_label = as.allocate_label();
+
+        const auto old_value = sized(old_reg);
+        const auto new_value = sized(new_reg);
+        const auto operand = sized(value_reg);
+
+        as.insert_label(retry_label);
+
+        add_atomic_fault_site(required_flags);
+        as.ldaxr(old_value, host_address_reg);
+
+        auto stored_value = new_value;
+
+        // Keeps the old value if the condition holds, otherwise stores the operand.
+        const auto select_value = [&](a64::Condition keep_old) {
+          as.cmp(old_value, operand);
+          as.csel(new_value, old_value, operand, keep_old);
+        };
+
+        switch (instruction_type) {
+            // clang-format off
+          case IT::AmoaddW: case IT::AmoaddD: as.add(new_value, old_value, operand); break;
+          case IT::AmoxorW: case IT::AmoxorD: as.eor(new_value, old_value, operand); break;
+          case IT::AmoandW: case IT::AmoandD: as.and_(new_value, old_value, operand); break;
+          case IT::AmoorW:  case IT::AmoorD:  as.orr(new_value, old_value, operand); break;
+            // clang-format on
+
+          case IT::AmoswapW:
+          case IT::AmoswapD: {
+            stored_value = operand;
+            break;
+          }
+
+          case IT::AmominW:
+          case IT::AmominD: {
+            select_value(a64::Condition::Less);
+            break;
+          }
+          case IT::AmomaxW:
+          case IT::AmomaxD: {
+            select_value(a64::Condition::GreaterEqual);
+            break;
+          }
+          case IT::AmominuW:
+          case IT::AmominuD: {
+            select_value(a64::Condition::UnsignedLess);
+            break;
+          }
+          case IT::AmomaxuW:
+          case IT::AmomaxuD: {
+            select_value(a64::Condition::UnsignedGreaterEqual);
+            break;
+          }
+
+          default:
+            unreachable();
+        }
+
+        add_atomic_fault_site(required_flags);
+        as.stlxr(status32, stored_value, host_address_reg);
+        as.cbnz(status32, retry_label);
+
+        if (is_32bit) {
+          as.sxtw(old_reg, old_reg);
+        }
+
+        break;
+      }
+    }
+
+    if (instruction.rd != Register::Zero) {
+      as.mov(dest_reg, old_reg);
+    }
+
+    register_cache.unlock_registers(address_reg, value_reg);
+    register_cache.unlock_register_dirty(dest_reg);
+
+    register_cache.unlock_platform_register(status_reg);
+  }
+
+  // Floating point registers are not cached, they are accessed directly in the register state.
+  static uint32_t float_register_offset(Register reg) {
+    return uint32_t(RegisterState::float_registers_offset + size_t(reg) * sizeof(uint64_t));
+  }
+
+  void generate_float_load(const jit::ir::Instruction& instruction) {
+    const auto unoffseted_address_reg = register_cache.lock_register(instruction.rs1);
+
+    const auto address_reg =
+      add_offset_to_register(unoffseted_address_reg, RegisterAllocation::a_reg, instruction.imm);
+
+    generate_validate_memory_access(instruction, address_reg, RegisterAllocation::b_reg,
+                                    RegisterAllocation::c_reg);
+
+    const auto mb = RegisterAllocation::memory_base;
+    const auto value = RegisterAllocation::b_reg;
+
+    if (instruction.type == InstructionType::Flw) {
+      // Single precision value is NaN-boxed by setting the upper half of the register.
+      as.ldr(cast_to_32bit(value), mb, address_reg);
+      verify(as.try_orr(value, value, 0xffff'ffff'0000'0000), "failed to encode NaN-boxing");
+    } else {
+      as.ldr(value, mb, address_reg);
+    }
+
+    as.str(value, RegisterAllocation::register_state, float_register_offset(instruction.rd));
+
+    register_cache.unlock_register(unoffseted_address_reg);
+  }
+
+  void generate_float_store(const jit::ir::Instruction& instruction) {
+    // With guard pages the store must directly follow the validation so the value is loaded
+    // before it (to the register which isn't used by the validation).
+    const auto value = A64R::X27;
+    register_cache.lock_platform_register(value);
+
+    const auto unoffseted_address_reg = register_cache.lock_register(instruction.rs1);
+
+    as.ldr(value, RegisterAllocation::register_state, float_register_offset(instruction.rs2));
+
+    const auto address_reg =
+      add_offset_to_register(unoffseted_address_reg, RegisterAllocation::a_reg, instruction.imm);
+
+    generate_validate_memory_access(instruction, address_reg, RegisterAllocation::b_reg,
+                                    RegisterAllocation::c_reg);
+
+    const auto mb = RegisterAllocation::memory_base;
+
+    if (instruction.type == InstructionType::Fsw) {
+      as.str(cast_to_32bit(value), mb, address_reg);
+    } else {
+      as.str(value, mb, address_reg);
+    }
+
+    register_cache.unlock_register(unoffseted_address_reg);
+    register_cache.unlock_platform_register(value);
+  }
+
+  // Moves between integer and floating point registers and sign injection of double precision
+  // values are simple bit manipulations so they don't need to call `FloatArithmetic`.
+  void generate_float_move(const jit::ir::Instruction& instruction) {
+    using IT = InstructionType;
+    using WO = RegisterCache::WriteOnly;
+
+    const auto rs = RegisterAllocation::register_state;
+    const auto sign_mask = uint64_t(1) << 63;
+
+    switch (instruction.type) {
+      case IT::FmvXW:
+      case IT::FmvXD: {
+        if (instruction.rd != Register::Zero) {
+          const auto dest = register_cache.lock_register(WO{instruction.rd});
+
+          if (instruction.type == IT::FmvXW) {
+            as.ldr(cast_to_32bit(dest), rs, float_register_offset(instruction.rs1));
+            as.sxtw(dest, dest);
+          } else {
+            as.ldr(dest, rs, float_register_offset(instruction.rs1));
+          }
+
+          register_cache.unlock_register_dirty(dest);
+        }
+        break;
+      }
+
+      case IT::FmvWX: {
+        const auto source = register_cache.lock_register(instruction.rs1);
+
+        const auto value = RegisterAllocation::a_reg;
+        verify(as.try_orr(value, source, 0xffff'ffff'0000'0000), "failed to encode NaN-boxing");
+        as.str(value, rs, float_register_offset(instruction.rd));
+
+        register_cache.unlock_register(source);
+        break;
+      }
+
+      case IT::FmvDX: {
+        const auto source = register_cache.lock_register(instruction.rs1);
+        as.str(source, rs, float_register_offset(instruction.rd));
+        register_cache.unlock_register(source);
+        break;
+      }
+
+      case IT::FsgnjD:
+      case IT::FsgnjnD:
+      case IT::FsgnjxD: {
+        const auto value = RegisterAllocation::a_reg;
+        const auto sign = RegisterAllocation::b_reg;
+
+        as.ldr(value, rs, float_register_offset(instruction.rs1));
+        as.ldr(sign, rs, float_register_offset(instruction.rs2));
+
+        verify(as.try_and_(sign, sign, sign_mask), "failed to encode sign mask");
+        if (instruction.type == IT::FsgnjnD) {
+          verify(as.try_eor(sign, sign, sign_mask), "failed to encode sign mask");
+        }
+
+        if (instruction.type != IT::FsgnjxD) {
+          verify(as.try_and_(value, value, ~sign_mask), "failed to encode sign mask");
+        }
+        as.eor(value, value, sign);
+
+        as.str(value, rs, float_register_offset(instruction.rd));
+        break;
+      }
+
+      default:
+        unreachable();
+    }
+  }
+
+  // Calls `function(register_state, raw_instruction, argument)` on the host. Host registers which
+  // are live in the generated code and not preserved by the callee are saved around the call.
+  // Result is returned in `a_reg`.
+  void generate_host_call(jit::CodeBuffer::Relocation::Target function_target,
+                          uint64_t function,
+                          uint64_t raw_instruction,
+                          A64R argument) {
+    // Caller saved registers used by the generated code (in pairs to keep the stack aligned).
+    constexpr A64R saved_regs[]{
+      A64R::X0,  A64R::X1,  A64R::X2,  A64R::X3,  A64R::X4,  A64R::X5,  A64R::X6,  A64R::X7,
+      A64R::X11, A64R::X12, A64R::X13, A64R::X14, A64R::X15, A64R::X16, A64R::X17, A64R::X30,
+    };
+    static_assert(std::size(saved_regs) % 2 == 0);
+
+    for (size_t i = 0; i < std::size(saved_regs); i += 2) {
+      as.stp(saved_regs[i], saved_regs[i + 1], A64R::Sp, -16, a64::Writeback::Pre);
+    }
+
+    // First argument is already the register state.
+    static_assert(RegisterAllocation::register_state == A64R::X0);
+    as.mov(A64R::X2, argument);
+    load_immediate_u(A64R::X1, raw_instruction);
+    load_relocated_value(RegisterAllocation::a_reg, function_target, function);
+
+    const auto call_label = as.allocate_label();
+    const auto return_label = as.allocate_label();
+
+    as.bl(call_label);
+    as.b(return_label);
+    as.insert_label(call_label);
+    as.br(RegisterAllocation::a_reg);
+    as.insert_label(return_label);
+
+    as.mov(RegisterAllocation::a_reg, A64R::X0);
+
+    for (size_t i = std::size(saved_regs); i > 0; i -= 2) {
+      as.ldp(saved_regs[i - 2], saved_regs[i - 1], A64R::Sp, 16, a64::Writeback::Post);
+    }
+  }
+
+  // Other floating point instructions call `FloatArithmetic` which runs them on the host FPU.
+  void generate_float_operation(const jit::ir::Instruction& instruction) {
+    using WO = RegisterCache::WriteOnly;
+
+    const auto guest_instruction =
+      vm::Instruction::from_fields(instruction.type, uint32_t(instruction.rd),
+                                   uint32_t(instruction.rs1), uint32_t(instruction.rs2),
+                                   uint32_t(instruction.imm));
+
+    if (FloatArithmetic::uses_rounding_mode(instruction.type) &&
+        guest_instruction.rounding_mode() == vm::Instruction::RoundingMode::Dynamic) {
+      // Rounding mode is in bits 5-7 of `fcsr` and values above 4 are reserved.
+      const auto undefined_label = as.allocate_label();
+
+      as.ldr(cast_to_32bit(RegisterAllocation::a_reg), RegisterAllocation::register_state,
+             uint32_t(RegisterState::fcsr_offset));
+      verify(as.try_cmp(RegisterAllocation::a_reg, 5 << 5), "failed to encode rounding mode check");
+      as.b(a64::Condition::UnsignedGreaterEqual, undefined_label);
+
+      add_pending_exit(undefined_label, ArchExitReason::UndefinedInstruction, true, current_pc);
+    }
+
+    const auto writes_rd = FloatArithmetic::writes_integer_register(instruction.type) &&
+                           instruction.rd != Register::Zero;
+
+    const auto source = register_cache.lock_register(
+      FloatArithmetic::reads_integer_register(instruction.type) ? instruction.rs1 : Register::Zero);
+    const auto dest = writes_rd ? register_cache.lock_register(WO{instruction.rd}) : A64R::Xzr;
+
+    generate_host_call(jit::CodeBuffer::Relocation::Target::FloatArithmetic,
+                       uint64_t(&FloatArithmetic::execute_raw), guest_instruction.raw(), source);
+
+    if (writes_rd) {
+      as.mov(dest, RegisterAllocation::a_reg);
+      register_cache.unlock_register_dirty(dest);
+    }
+    register_cache.unlock_register(source);
+  }
+
+  // `vsetvli` and `vsetivli` encode `vtype` in the instruction so VLMAX is known at compile
+  // time and the new vector length is computed inline.
+  void generate_vector_configuration(const jit::ir::Instruction& instruction) {
+    using WO = RegisterCache::WriteOnly;
+
+    const auto encoding = uint32_t(instruction.imm);
+    const auto immediate_avl = instruction.type == InstructionType::Vsetivli;
+    const auto vtype = (encoding >> 20) & (immediate_avl ? 0x3ff : 0x7ff);
+    const auto vlmax = VectorArithmetic::max_vector_length(vtype);
+
+    const auto vl = RegisterAllocation::a_reg;
+    const auto vtype_reg = RegisterAllocation::b_reg;
+
+    vector_configuration = std::nullopt;
+
+    if (vlmax == 0) {
+      load_immediate(vl, 0);
+      load_immediate_u(vtype_reg, RegisterState::vtype_illegal);
+    } else {
+      load_immediate_u(vtype_reg, vtype);
+
+      vector_configuration = VectorConfiguration{
+        .sew_log2 = uint32_t((vtype >> 3) & 0b111),
+        .vlmax = vlmax,
+      };
+
+      if (immediate_avl) {
+        load_immediate_u(vl, std::min(uint64_t(instruction.rs1), vlmax));
+        vector_configuration->full_length = uint64_t(instruction.rs1) >= vlmax;
+      } else if (instruction.rs1 == Register::Zero && instruction.rd != Register::Zero) {
+        load_immediate_u(vl, vlmax);
+        vector_configuration->full_length = true;
+      } else {
+        // AVL is either in `rs1` or the current vector length is kept (if both `rs1` and `rd`
+        // are zero).
+        if (instruction.rs1 != Register::Zero) {
+          const auto avl_reg = register_cache.lock_register(instruction.rs1);
+          as.mov(vl, avl_reg);
+          register_cache.unlock_register(avl_reg);
+        } else {
+          as.ldr(vl, RegisterAllocation::register_state, uint32_t(RegisterState::vl_offset));
+        }
+
+        const auto vlmax_reg = RegisterAllocation::c_reg;
+        const auto in_range_label = as.allocate_label();
+
+        load_immediate_u(vlmax_reg, vlmax);
+        as.cmp(vlmax_reg, vl);
+        as.b(a64::Condition::UnsignedGreaterEqual, in_range_label);
+        as.mov(vl, vlmax_reg);
+        as.insert_label(in_range_label);
+      }
+    }
+
+    as.str(vl, RegisterAllocation::register_state, uint32_t(RegisterState::vl_offset));
+    as.str(vtype_reg, RegisterAllocation::register_state, uint32_t(RegisterState::vtype_offset));
+
+    if (instruction.rd != Register::Zero) {
+      const auto dest = register_cache.lock_register(WO{instruction.rd});
+      as.mov(dest, vl);
+      register_cache.unlock_register_dirty(dest);
+    }
+  }
+
+  // Vector instruction which is generated inline, see `generate_inline_vector_instruction`.
+  struct InlineVectorOperation {
+    enum class Kind {
+      Load,
+      Store,
+      Add,
+      Sub,
+      And,
+      Or,
+      Xor,
+      Mul,
+    };
+
+    enum class Operand {
+      Vector,
+      Scalar,
+      Immediate,
+    };
+
+    Kind kind{};
+    Operand operand{};
+
+    // `vd` holds the stored register (`vs3`) for stores.
+    uint32_t vd{};
+    uint32_t vs1{};
+    uint32_t vs2{};
+    int64_t immediate{};
+
+    // EEW of memory accesses and SEW of other operations.
+    uint32_t element_size_log2{};
+
+    // Number of bytes accessed in each register when `vl` is VLMAX.
+    size_t size{};
+  };
+
+  std::optional<InlineVectorOperation> inline_vector_operation(
+    const jit::ir::Instruction& instruction) const {
+    using IT = InstructionType;
+    using K = InlineVectorOperation::Kind;
+    using O = InlineVectorOperation::Operand;
+
+    if (!vector_configuration) {
+      return std::nullopt;
+    }
+
+    const auto encoding = uint32_t(instruction.imm);
+    if (((encoding >> 25) & 1) == 0) {
+      // Masked operations are left to `VectorArithmetic`.
+      return std::nullopt;
+    }
+
+    InlineVectorOperation operation{
+      .vd = (encoding >> 7) & 0b11111,
+      .vs1 = (encoding >> 15) & 0b11111,
+      .vs2 = (encoding >> 20) & 0b11111,
+      .element_size_log2 = vector_configuration->sew_log2,
+    };
+
+    switch (instruction.type) {
+      case IT::VectorLoad:
+      case IT::VectorStore: {
+        // Only plain unit-stride accesses (`lumop` and `nf` are zero) of integer elements.
+        const auto width = (encoding >> 12) & 0b111;
+        if (operation.vs2 != 0 || (encoding >> 29) != 0 || (width != 0 && width < 0b101)) {
+          return std::nullopt;
+        }
+
+        operation.kind = instruction.type == IT::VectorLoad ? K::Load : K::Store;
+        operation.element_size_log2 = width == 0 ? 0 : width - 4;
+        break;
+      }
+
+      case IT::VectorOperation:
+      case IT::VectorOperationScalar: {
+        const auto funct3 = (encoding >> 12) & 0b111;
+        const auto funct6 = encoding >> 26;
+
+        // OPIVV, OPIVI and OPIVX.
+        if (funct3 == 0b000 || funct3 == 0b011 || funct3 == 0b100) {
+          switch (funct6) {
+              // clang-format off
+            case 0b00'0000: operation.kind = K::Add; break;
+            case 0b00'0010: operation.kind = K::Sub; break;
+            case 0b00'1001: operation.kind = K::And; break;
+            case 0b00'1010: operation.kind = K::Or; break;
+            case 0b00'1011: operation.kind = K::Xor; break;
+              // clang-format on
+
+            default:
+              return std::nullopt;
+          }
+
+          if (funct3 == 0b011 && operation.kind == K::Sub) {
+            return std::nullopt;
+          }
+        } else if ((funct3 == 0b010 || funct3 == 0b110) && funct6 == 0b10'0101) {
+          // OPMVV and OPMVX `vmul`.
+          operation.kind = K::Mul;
+        } else {
+          return std::nullopt;
+        }
+
+        if (funct3 == 0b011) {
+          operation.operand = O::Immediate;
+          operation.immediate = int64_t(operation.vs1 << 27) >> 27;
+        } else if (funct3 == 0b100 || funct3 == 0b110) {
+          operation.operand = O::Scalar;
+        } else {
+          operation.operand = O::Vector;
+        }
+        break;
+      }
+
+      default:
+        return std::nullopt;
+    }
+
+    // Operands must be single registers (EMUL <= 1). EMUL below 1/8 is reserved.
+    operation.size = vector_configuration->vlmax << operation.element_size_log2;
+    if (operation.size > RegisterState::vector_register_size || operation.size < 2) {
+      return std::nullopt;
+    }
+
+    return operation;
+  }
+
+  static uint32_t vector_register_offset(uint32_t reg, size_t offset) {
+    return uint32_t(RegisterState::vector_registers_offset +
+                    reg * RegisterState::vector_register_size + offset);
+  }
+
+  // Loads `1 << size_log2` bytes zero extended to 64 bits. `base` is offseted by a register or an
+  // immediate.
+  template <typename T>
+  void load_zero_extended(A64R target, A64R base, T offset, uint32_t size_log2) {
+    switch (size_log2) {
+        // clang-format off
+      case 0: as.ldrb(target, base, offset); break;
+      case 1: as.ldrh(target, base, offset); break;
+      case 2: as.ldr(cast_to_32bit(target), base, offset); break;
+      case 3: as.ldr(target, base, offset); break;
+        // clang-format on
+
+      default:
+        unreachable();
+    }
+  }
+
+  template <typename T>
+  void store_sized(A64R source, A64R base, T offset, uint32_t size_log2) {
+    switch (size_log2) {
+        // clang-format off
+      case 0: as.strb(source, base, offset); break;
+      case 1: as.strh(source, base, offset); break;
+      case 2: as.str(cast_to_32bit(source), base, offset); break;
+      case 3: as.str(source, base, offset); break;
+        // clang-format on
+
+      default:
+        unreachable();
+    }
+  }
+
+  // Copies the element to all `8 << element_size_log2` bit lanes of a 64 bit value.
+  static uint64_t lane_replication(uint32_t element_size_log2) {
+    const auto element_bits = uint32_t(8) << element_size_log2;
+    return element_bits == 64 ? 1 : ~uint64_t(0) / ((uint64_t(1) << element_bits) - 1);
+  }
+
+  // Vector registers are processed in (at most) 8 byte chunks in general purpose registers because
+  // the assembler has no NEON encoders. Memory accesses and bitwise operations handle whole
+  // chunks, additions and subtractions of elements narrower than 64 bits use SWAR arithmetic
+  // (carries are kept from crossing the lanes) and multiplications go element by element.
+  //
+  // The code assumes that `vl` is VLMAX and jumps to `fallback_label` (which calls
+  // `VectorArithmetic`) if that isn't known at compile time and doesn't hold.
+  void generate_inline_vector_instruction(const jit::ir::Instruction& instruction,
+                                          const InlineVectorOperation& operation,
+                                          a64::Label fallback_label) {
+    using K = InlineVectorOperation::Kind;
+    using O = InlineVectorOperation::Operand;
+
+    const auto a = RegisterAllocation::a_reg;
+    const auto b = RegisterAllocation::b_reg;
+    const auto c = RegisterAllocation::c_reg;
+    const auto d = A64R::X27;
+
+    const auto rs = RegisterAllocation::register_state;
+    const auto mb = RegisterAllocation::memory_base;
+
+    const auto chunk_size = std::min(operation.size, sizeof(uint64_t));
+    const auto chunk_size_log2 = uint32_t(chunk_size == 8 ? 3 : chunk_size == 4 ? 2 : 1);
+    const auto chunk_count = operation.size / chunk_size;
+
+    register_cache.lock_platform_register(d);
+
+    const auto uses_rs1 = operation.kind == K::Load || operation.kind == K::Store ||
+                          operation.operand == O::Scalar;
+    const auto rs1_reg =
+      register_cache.lock_register(uses_rs1 ? instruction.rs1 : Register::Zero);
+
+    if (!vector_configuration->full_length) {
+      as.ldr(a, rs, uint32_t(RegisterState::vl_offset));
+      verify(as.try_cmp(a, vector_configuration->vlmax), "failed to encode vl check");
+      as.b(a64::Condition::NotEqual, fallback_label);
+    }
+
+    switch (operation.kind) {
+      case K::Load: {
+        // All chunks are loaded before the destination is written, so a faulting load has no
+        // side effects.
+        const A64R values[]{d, c};
+
+        as.mov(a, rs1_reg);
+        for (size_t i = 0; i < chunk_count; ++i) {
+          if (i > 0) {
+            add_offset_to_register(a, a, int64_t(chunk_size));
+          }
+          generate_validate_memory_access(a, b, c, chunk_size_log2, MemoryFlags::Read);
+          load_zero_extended(values[i], mb, a, chunk_size_log2);
+        }
+
+        for (size_t i = 0; i < chunk_count; ++i) {
+          store_sized(values[i], rs, vector_register_offset(operation.vd, i * chunk_size),
+                      chunk_size_log2);
+        }
+        break;
+      }
+
+      case K::Store: {
+        // Like a trapping RVV store, a fault on the second chunk leaves the first one written.
+        // The interpreter executes the store again and reports the fault.
+        as.mov(a, rs1_reg);
+        for (size_t i = 0; i < chunk_count; ++i) {
+          if (i > 0) {
+            add_offset_to_register(a, a, int64_t(chunk_size));
+          }
+
+          // With guard pages the store must directly follow the validation.
+          load_zero_extended(d, rs, vector_register_offset(operation.vd, i * chunk_size),
+                             chunk_size_log2);
+          generate_validate_memory_access(a, b, c, chunk_size_log2, MemoryFlags::Write);
+          store_sized(d, mb, a, chunk_size_log2);
+        }
+        break;
+      }
+
+      case K::Mul: {
+        const auto element_size_log2 = operation.element_size_log2;
+        const auto element_size = size_t(1) << element_size_log2;
+
+        // Low bits of the product depend only on the low bits of the factors.
+        for (size_t offset = 0; offset < operation.size; offset += element_size) {
+          load_zero_extended(a, rs, vector_register_offset(operation.vs2, offset),
+                             element_size_log2);
+          if (operation.operand == O::Vector) {
+            load_zero_extended(b, rs, vector_register_offset(operation.vs1, offset),
+                               element_size_log2);
+            as.mul(a, a, b);
+          } else {
+            as.mul(a, a, rs1_reg);
+          }
+          store_sized(a, rs, vector_register_offset(operation.vd, offset), element_size_log2);
+        }
+        break;
+      }
+
+      default: {
+        const auto element_size_log2 = operation.element_size_log2;
+        const auto element_bits = uint32_t(8) << element_size_log2;
+        const auto replication = lane_replication(element_size_log2);
+        const auto element_mask =
+          element_bits == 64 ? ~uint64_t(0) : (uint64_t(1) << element_bits) - 1;
+        const auto high_bits = replication << (element_bits - 1);
+
+        // Scalar operands are replicated to all lanes of the chunk.
+        if (operation.operand == O::Scalar) {
+          if (element_bits == 64) {
+            as.mov(b, rs1_reg);
+          } else {
+            verify(as.try_and_(b, rs1_reg, element_mask), "failed to encode element mask");
+            load_immediate_u(c, replication);
+            as.mul(b, b, c);
+          }
+        } else if (operation.operand == O::Immediate) {
+          load_immediate_u(b, (uint64_t(operation.immediate) & element_mask) * replication);
+        }
+
+        const auto swar =
+          element_bits < 64 && (operation.kind == K::Add || operation.kind == K::Sub);
+
+        for (size_t i = 0; i < chunk_count; ++i) {
+          const auto offset = i * chunk_size;
+
+          load_zero_extended(a, rs, vector_register_offset(operation.vs2, offset),
+                             chunk_size_log2);
+          if (operation.operand == O::Vector) {
+            load_zero_extended(b, rs, vector_register_offset(operation.vs1, offset),
+                               chunk_size_log2);
+          }
+
+          if (swar) {
+            // Lanes are added without their high bits so carries stay in the lanes. High bits of
+            // the result are the xor of the high bits and the carry (or borrow) into them:
+            //   a + b = ((a & ~H) + (b & ~H)) ^ ((a ^ b) & H)
+            //   a - b = ((a | H) - (b & ~H)) ^ ((a ^ ~b) & H)
+            // Lane masks repeat in every element so they are encodable as logical immediates.
+            if (operation.kind == K::Add) {
+              as.eor(c, a, b);
+              verify(as.try_and_(a, a, ~high_bits), "failed to encode lane mask");
+            } else {
+              as.eon(c, a, b);
+              verify(as.try_orr(a, a, high_bits), "failed to encode lane mask");
+            }
+            verify(as.try_and_(c, c, high_bits), "failed to encode lane mask");
+            verify(as.try_and_(d, b, ~high_bits), "failed to encode lane mask");
+
+            if (operation.kind == K::Add) {
+              as.add(a, a, d);
+            } else {
+              as.sub(a, a, d);
+            }
+            as.eor(a, a, c);
+          } else {
+            switch (operation.kind) {
+                // clang-format off
+              case K::Add: as.add(a, a, b); break;
+              case K::Sub: as.sub(a, a, b); break;
+              case K::And: as.and_(a, a, b); break;
+              case K::Or: as.orr(a, a, b); break;
+              case K::Xor: as.eor(a, a, b); break;
+                // clang-format on
+
+              default:
+                unreachable();
+            }
+          }
+
+          store_sized(a, rs, vector_register_offset(operation.vd, offset), chunk_size_log2);
+        }
+        break;
+      }
+    }
+
+    register_cache.unlock_register(rs1_reg);
+    register_cache.unlock_platform_register(d);
+  }
+
+  // Other vector instructions call `VectorArithmetic`. It reads scalar operands from the register
+  // state and fails without side effects (so the interpreter can execute the instruction again
+  // and report the exact exit).
+  void generate_vector_instruction(const jit::ir::Instruction& instruction) {
+    using WO = RegisterCache::WriteOnly;
 
-      if (pending_exit.pc_register != A64R::Xzr) {
-        as.mov(RegisterAllocation::exit_pc, pending_exit.pc_register);
-      } else {
-        load_immediate_u(RegisterAllocation::exit_pc, pending_exit.pc_value);
+    if (instruction.type == InstructionType::Vsetvli ||
+        instruction.type == InstructionType::Vsetivli) {
+      return generate_vector_configuration(instruction);
+    }
+
+    const auto store_operand = [&](Register reg) {
+      if (reg == Register::Zero) {
+        return;
       }
 
-      load_immediate_u(RegisterAllocation::exit_reason, uint64_t(pending_exit.reason));
+      const auto value = register_cache.lock_register(reg);
+      as.str(value, RegisterAllocation::register_state, uint32_t(size_t(reg) * sizeof(uint64_t)));
+      register_cache.unlock_register(value);
+    };
 
-      as.ret();
+    if (instruction.reads_rs1()) {
+      store_operand(instruction.rs1);
+    }
+    if (instruction.reads_rs2()) {
+      store_operand(instruction.rs2);
     }
-  }
 
-  bool load_memory_permission_mask(A64R target, MemoryFlags flags, size_t access_size_log2) {
-    const auto uflags = uint64_t(flags);
+    std::optional<a64::Label> end_label;
+    if (const auto operation = inline_vector_operation(instruction)) {
+      const auto fallback_label = as.allocate_label();
+      end_label = as.allocate_label();
 
-    switch (access_size_log2) {
-      case 0: {
-        as.mov(target, uflags);
-        break;
-      }
+      generate_inline_vector_instruction(instruction, *operation, fallback_label);
+      as.b(*end_label);
 
-      case 1: {
-        as.mov(target, (uflags << 8) | uflags);
-        break;
-      }
+      as.insert_label(fallback_label);
+    }
 
-      case 2:
-      case 3: {
-        uint64_t mask = 0;
-        for (size_t i = 0; i < 8; ++i) {
-          mask |= uflags << (i * 8);
-        }
-        as.mov(target, mask);
+    const auto guest_instruction =
+      vm::Instruction::from_fields(instruction.type, uint32_t(instruction.rd),
+                                   uint32_t(instruction.rs1), uint32_t(instruction.rs2),
+                                   uint32_t(instruction.imm));
 
-        // Truncate to 32 bit registers when access size == 4.
-        return access_size_log2 == 2;
-      }
+    load_relocated_value(RegisterAllocation::b_reg, jit::CodeBuffer::Relocation::Target::Memory,
+                         uint64_t(&memory));
+    generate_host_call(jit::CodeBuffer::Relocation::Target::VectorArithmetic,
+                       uint64_t(&VectorArithmetic::execute_raw), guest_instruction.raw(),
+                       RegisterAllocation::b_reg);
 
-      default:
-        unreachable();
+    const auto failed_label = as.allocate_label();
+    as.cbnz(RegisterAllocation::a_reg, failed_label);
+
+    add_pending_exit(failed_label, ArchExitReason::UnsupportedInstruction, true, current_pc);
+
+    if (instruction.writes_rd()) {
+      const auto dest = register_cache.lock_register(WO{instruction.rd});
+      as.ldr(dest, RegisterAllocation::register_state,
+             uint32_t(size_t(instruction.rd) * sizeof(uint64_t)));
+      register_cache.unlock_register_dirty(dest);
     }
 
-    return false;
+    if (end_label) {
+      as.insert_label(*end_label);
+    }
+
+    // `vsetvl` takes `vtype` from a register and fault-only-first loads can shorten `vl`.
+    const auto encoding = uint32_t(instruction.imm);
+    if (instruction.type == InstructionType::Vsetvl) {
+      vector_configuration = std::nullopt;
+    } else if (instruction.type == InstructionType::VectorLoad &&
+               ((encoding >> 20) & 0b11111) == 0b10000 && vector_configuration) {
+      vector_configuration->full_length = false;
+    }
   }
 
-  void generate_validate_memory_access(A64R address_reg,
-                                       A64R scratch_reg,
-                                       A64R scratch_reg2,
-                                       uint64_t access_size_log2,
-                                       bool write) {
-    const auto fault_label = as.allocate_label();
+  // Zba/Zbb/Zbs instructions map to single host instructions where aarch64 has an equivalent.
+  // Base ISA has no scalar population count so `cpop` uses a bit-parallel sequence.
+  void generate_bit_manipulation(const jit::ir::Instruction& instruction) {
+    using IT = InstructionType;
+    using WO = RegisterCache::WriteOnly;
 
-    // Make sure that address is aligned otherwise the bound check later won't be accurate.
-    if (access_size_log2 > 0) {
-      as.tst(address_reg, (1 << access_size_log2) - 1);
-      as.b(a64::Condition::NotZero, fault_label);
+    if (instruction.rd == Register::Zero) {
+      return;
     }
 
-    // Check if address >= memory_size. We don't need to account for the access size because we
-    // have already checked for alignment.
-    as.cmp(address_reg, RegisterAllocation::memory_size);
-    as.b(a64::Condition::UnsignedGreaterEqual, fault_label);
+    const auto instruction_type = instruction.type;
+    const auto [a, b, dest] = register_cache.lock_registers(
+      instruction.rs1,
+      Arithmetic::reads_second_register(instruction_type) ? instruction.rs2 : Register::Zero,
+      WO{instruction.rd});
 
-    if ((code_buffer.flags() & CodeBufferFlags::SkipPermissionChecks) == CodeBufferFlags::None) {
-      auto perms_reg = scratch_reg;
-      auto mask_reg = scratch_reg2;
+    const auto a32 = cast_to_32bit(a);
+    const auto b32 = cast_to_32bit(b);
+    const auto dest32 = cast_to_32bit(dest);
 
-      const auto pb = RegisterAllocation::permissions_base;
+    const auto tmp = RegisterAllocation::a_reg;
+    const auto tmp32 = cast_to_32bit(tmp);
+    const auto tmp2 = RegisterAllocation::b_reg;
 
-      switch (access_size_log2) {
-          // clang-format off
-        case 0: as.ldrb(perms_reg, pb, address_reg); break;
-        case 1: as.ldrh(perms_reg, pb, address_reg); break;
-        case 2: as.ldr(cast_to_32bit(perms_reg), pb, address_reg); break;
-        case 3: as.ldr(perms_reg, pb, address_reg); break;
-          // clang-format on
+    const auto shamt = uint32_t(instruction.imm);
+    const auto bit = uint64_t(1) << (shamt & 63);
 
-        default:
-          unreachable();
-      }
+    switch (instruction_type) {
+      case IT::Sh1add:
+      case IT::Sh2add:
+      case IT::Sh3add:
+      case IT::AddUw:
+      case IT::Sh1addUw:
+      case IT::Sh2addUw:
+      case IT::Sh3addUw: {
+        uint32_t shift = 0;
+        switch (instruction_type) {
+            // clang-format off
+          case IT::Sh1add: case IT::Sh1addUw: shift = 1; break;
+          case IT::Sh2add: case IT::Sh2addUw: shift = 2; break;
+          case IT::Sh3add: case IT::Sh3addUw: shift = 3; break;
+            // clang-format on
 
-      const auto truncate_to_32bit = load_memory_permission_mask(
-        mask_reg, write ? MemoryFlags::Write : MemoryFlags::Read, access_size_log2);
+          default:
+            break;
+        }
 
-      if (truncate_to_32bit) {
-        perms_reg = cast_to_32bit(perms_reg);
-        mask_reg = cast_to_32bit(mask_reg);
+        if (instruction_type == IT::Sh1add || instruction_type == IT::Sh2add ||
+            instruction_type == IT::Sh3add) {
+          as.lsl(tmp, a, shift);
+        } else {
+          // 32 bit move zero extends the index.
+          as.mov(tmp32, a32);
+          if (shift != 0) {
+            as.lsl(tmp, tmp, shift);
+          }
+        }
+        as.add(dest, b, tmp);
+        break;
       }
 
-      as.and_(perms_reg, perms_reg, mask_reg);
-      as.cmp(perms_reg, mask_reg);
-      as.b(a64::Condition::NotEqual, fault_label);
-    }
-
-    add_pending_exit(fault_label,
-                     write ? ArchExitReason::MemoryWriteFault : ArchExitReason::MemoryReadFault,
-                     true, current_pc);
-  }
+      case IT::SlliUw: {
+        as.mov(tmp32, a32);
+        as.lsl(dest, tmp, shamt);
+        break;
+      }
 
-  a64::Label generate_validated_branch(A64R block_offset_reg) {
-    // Load the 32 bit code offset from block translation table.
-    if ((code_buffer.flags() & CodeBufferFlags::Multithreaded) == CodeBufferFlags::None) {
-      as.ldr(cast_to_32bit(block_offset_reg), RegisterAllocation::block_base, block_offset_reg);
-    } else {
-      as.add(block_offset_reg, RegisterAllocation::block_base, block_offset_reg);
-      as.ldar(cast_to_32bit(block_offset_reg), block_offset_reg);
-    }
+        // clang-format off
+      case IT::Andn: as.bic(dest, a, b); break;
+      case IT::Orn:  as.orn(dest, a, b); break;
+      case IT::Xnor: as.eon(dest, a, b); break;
+      case IT::Ror:  as.ror(dest, a, b); break;
+      case IT::Rori: as.ror(dest, a, shamt); break;
+      case IT::Rorw: as.ror(dest32, a32, b32); as.sxtw(dest, dest); break;
+      case IT::Roriw: as.ror(dest32, a32, shamt); as.sxtw(dest, dest); break;
+      case IT::Rev8: as.rev(dest, a); break;
+      case IT::Clz:  as.clz(dest, a); break;
+      case IT::Clzw: as.clz(dest32, a32); break;
+      case IT::Ctz:  as.rbit(tmp, a); as.clz(dest, tmp); break;
+      case IT::Ctzw: as.rbit(tmp32, a32); as.clz(dest32, tmp32); break;
+      case IT::SextB: as.lsl(tmp, a, 56); as.asr(dest, tmp, 56); break;
+      case IT::SextH: as.lsl(tmp, a, 48); as.asr(dest, tmp, 48); break;
+        // clang-format on
+
+      case IT::Min:
+      case IT::Minu:
+      case IT::Max:
+      case IT::Maxu: {
+        a64::Condition condition{};
+        switch (instruction_type) {
+            // clang-format off
+          case IT::Min:  condition = a64::Condition::Less; break;
+          case IT::Minu: condition = a64::Condition::UnsignedLess; break;
+          case IT::Max:  condition = a64::Condition::Greater; break;
+          case IT::Maxu: condition = a64::Condition::UnsignedGreater; break;
+            // clang-format on
 
-    const auto code_offset_reg = block_offset_reg;
+          default:
+            unreachable();
+        }
 
-    // Exit the VM if the block isn't generated yet.
-    const auto no_block_label = as.allocate_label();
-    as.cbz(code_offset_reg, no_block_label);
+        as.cmp(a, b);
+        as.csel(dest, a, b, condition);
+        break;
+      }
 
-    // Jump to the block.
-    as.add(code_offset_reg, RegisterAllocation::code_base, code_offset_reg);
-    as.br(code_offset_reg);
+      // Rotation left by `b` is a rotation right by `-b` (only the low bits are used).
+      case IT::Rol: {
+        as.sub(tmp, A64R::Xzr, b);
+        as.ror(dest, a, tmp);
+        break;
+      }
+      case IT::Rolw: {
+        as.sub(tmp32, cast_to_32bit(A64R::Xzr), b32);
+        as.ror(dest32, a32, tmp32);
+        as.sxtw(dest, dest);
+        break;
+      }
 
-    return no_block_label;
-  }
+      case IT::Bclr:
+      case IT::Bset:
+      case IT::Binv: {
+        load_immediate(tmp, 1);
+        as.lsl(tmp, tmp, b);
 
-  void generate_static_branch(uint64_t target_pc, A64R scratch_reg) {
-    const auto block = target_pc / 4;
+        switch (instruction_type) {
+            // clang-format off
+          case IT::Bclr: as.bic(dest, a, tmp); break;
+          case IT::Bset: as.orr(dest, a, tmp); break;
+          case IT::Binv: as.eor(dest, a, tmp); break;
+            // clang-format on
 
-    // We can statically handle some error conditions.
-    if ((target_pc & 3) != 0) {
-      return generate_exit(ArchExitReason::UnalignedPc);
-    }
-    if (block >= code_buffer.max_block_count()) {
-      return generate_exit(ArchExitReason::OutOfBoundsPc);
-    }
+          default:
+            unreachable();
+        }
+        break;
+      }
 
-    if (single_step) {
-      // Exit the VM to make sure that we don't execute 2 instructions when single stepping
-      // (branch + 1 instruction after the branch).
-      generate_exit(ArchExitReason::SingleStep, target_pc);
-    } else {
-      // Calculate the memory offset from `block_base`.
-      load_immediate_u(scratch_reg, block * 4);
+      // Single bit masks and their inversions are always encodable as logical immediates.
+      case IT::Bclri: {
+        verify(as.try_and_(dest, a, ~bit), "failed to encode bit mask");
+        break;
+      }
+      case IT::Bseti: {
+        verify(as.try_orr(dest, a, bit), "failed to encode bit mask");
+        break;
+      }
+      case IT::Binvi: {
+        verify(as.try_eor(dest, a, bit), "failed to encode bit mask");
+        break;
+      }
 
-      register_cache.flush_current_registers();
+      case IT::Bext:
+      case IT::Bexti: {
+        if (instruction_type == IT::Bext) {
+          as.lsr(tmp, a, b);
+        } else {
+          as.lsr(tmp, a, shamt);
+        }
+        verify(as.try_and_(dest, tmp, 1), "failed to encode bit mask");
+        break;
+      }
 
-      const auto exit_label = generate_validated_branch(scratch_reg);
-      add_pending_exit(exit_label, ArchExitReason::BlockNotGenerated, false, target_pc);
-    }
-  }
+      case IT::ZextH: {
+        verify(as.try_and_(dest, a, 0xffff), "failed to encode zero extension mask");
+        break;
+      }
 
-  void generate_dynamic_branch(A64R target_pc, A64R scratch_reg) {
-    verify(target_pc != scratch_reg, "target_pc cannot be equal to scratch_reg");
+      // Bits are counted in 2, 4 and 8 bit fields and byte counts are summed by a multiplication.
+      case IT::Cpop:
+      case IT::Cpopw: {
+        if (instruction_type == IT::Cpopw) {
+          as.mov(tmp32, a32);
+        } else {
+          as.mov(tmp, a);
+        }
 
-    const auto oob_label = as.allocate_label();
-    const auto unaligned_label = as.allocate_label();
+        as.lsr(tmp2, tmp, 1);
+        verify(as.try_and_(tmp2, tmp2, 0x5555'5555'5555'5555), "failed to encode bit mask");
+        as.sub(tmp, tmp, tmp2);
 
-    // Mask off last bit as it is required by the architecture.
-    as.and_(scratch_reg, target_pc, ~uint64_t(1));
+        as.lsr(tmp2, tmp, 2);
+        verify(as.try_and_(tmp2, tmp2, 0x3333'3333'3333'3333), "failed to encode bit mask");
+        verify(as.try_and_(tmp, tmp, 0x3333'3333'3333'3333), "failed to encode bit mask");
+        as.add(tmp, tmp, tmp2);
 
-    register_cache.flush_current_registers();
+        as.lsr(tmp2, tmp, 4);
+        as.add(tmp, tmp, tmp2);
+        verify(as.try_and_(tmp, tmp, 0x0f0f'0f0f'0f0f'0f0f), "failed to encode bit mask");
 
-    // Exit the VM if the address is not properly aligned.
-    as.tst(scratch_reg, 0b11);
-    as.b(a64::Condition::NotZero, unaligned_label);
+        load_immediate_u(tmp2, 0x0101'0101'0101'0101);
+        as.mul(tmp, tmp, tmp2);
+        as.lsr(dest, tmp, 56);
+        break;
+      }
 
-    // Exit the VM if target_pc >= max_executable_pc.
-    as.cmp(scratch_reg, RegisterAllocation::max_executable_pc);
-    as.b(a64::Condition::UnsignedGreaterEqual, oob_label);
+      // Byte is 0x80 after masking if it's non-zero, it's then spread to the whole byte.
+      //   t = ((a & 0x7f..7f) + 0x7f..7f | a) & 0x80..80
+      //   result = (t << 1) - (t >> 7)
+      case IT::OrcB: {
+        load_immediate_u(tmp2, 0x7f7f'7f7f'7f7f'7f7f);
+        as.and_(tmp, a, tmp2);
+        as.add(tmp, tmp, tmp2);
+        as.orr(tmp, tmp, a);
+        verify(as.try_and_(tmp, tmp, 0x8080'8080'8080'8080), "failed to encode bit mask");
+        as.lsr(tmp2, tmp, 7);
+        as.lsl(tmp, tmp, 1);
+        as.sub(dest, tmp, tmp2);
+        break;
+      }
 
-    if (single_step) {
-      // Exit the VM to make sure that we don't execute 2 instructions when single stepping
-      // (branch + 1 instruction after the branch).
-      generate_exit(ArchExitReason::SingleStep, target_pc);
-    } else {
-      const auto exit_label = generate_validated_branch(scratch_reg);
-      add_pending_exit(exit_label, ArchExitReason::BlockNotGenerated, false, target_pc);
+      default:
+        unreachable();
     }
 
-    add_pending_exit(oob_label, ArchExitReason::OutOfBoundsPc, false, target_pc);
-    add_pending_exit(unaligned_label, ArchExitReason::UnalignedPc, false, target_pc);
+    register_cache.unlock_registers(a, b);
+    register_cache.unlock_register_dirty(dest);
   }
 
-  bool generate_instruction(const Instruction& instruction) {
-    const auto instruction_type = instruction.type();
+  bool generate_guest_instruction(const jit::ir::Instruction& instruction) {
+    const auto instruction_type = instruction.type;
 
     using IT = InstructionType;
     using WO = RegisterCache::WriteOnly;
 
     switch (instruction_type) {
       case IT::Lui: {
-        if (instruction.rd() != Register::Zero) {
-          const auto reg = register_cache.lock_register(WO{instruction.rd()});
-          load_immediate(reg, instruction.imm());
+        if (instruction.rd != Register::Zero) {
+          const auto reg = register_cache.lock_register(WO{instruction.rd});
+          load_immediate(reg, instruction.imm);
           register_cache.unlock_register_dirty(reg);
         }
         break;
       }
 
       case IT::Auipc: {
-        if (instruction.rd() != Register::Zero) {
-          const auto reg = register_cache.lock_register(WO{instruction.rd()});
-          load_immediate_u(reg, current_pc + instruction.imm());
+        if (instruction.rd != Register::Zero) {
+          const auto reg = register_cache.lock_register(WO{instruction.rd});
+          load_immediate_u(reg, current_pc + instruction.imm);
           register_cache.unlock_register_dirty(reg);
         }
         break;
       }
 
       case InstructionType::Jal: {
-        if (instruction.rd() != Register::Zero) {
-          const auto reg = register_cache.lock_register(WO{instruction.rd()});
-          load_immediate_u(reg, current_pc + 4);
-          register_cache.unlock_register_dirty(reg);
+        // Trace continues at the target of plain jumps.
+        if (instruction.rd == Register::Zero) {
+          break;
         }
 
-        const auto target = current_pc + instruction.imm();
-        generate_static_branch(target, RegisterAllocation::a_reg);
+        generate_direct_jump(instruction.rd, current_pc + instruction.imm);
 
         return false;
       }
 
       case InstructionType::Jalr: {
-        const auto target_reg = register_cache.lock_register(instruction.rs1());
-        auto offseted_reg =
-          add_offset_to_register(target_reg, RegisterAllocation::a_reg, instruction.imm());
+        // Target is known at compile time (e.g. fused `auipc` + `jalr`).
+        if (instruction.rs1 == Register::Zero) {
+          generate_direct_jump(instruction.rd, uint64_t(instruction.imm) & ~uint64_t(1));
+          return false;
+        }
 
-        if (instruction.rd() != Register::Zero) {
-          const auto dest_reg = register_cache.lock_register(WO{instruction.rd()});
+        const auto target_reg = register_cache.lock_register(instruction.rs1);
+        const auto offseted_reg =
+          add_offset_to_register(target_reg, RegisterAllocation::a_reg, instruction.imm);
 
-          if (dest_reg == offseted_reg) {
-            as.mov(RegisterAllocation::a_reg, offseted_reg);
-            offseted_reg = RegisterAllocation::a_reg;
-          }
+        // Mask off last bit as it is required by the architecture.
+        as.and_(RegisterAllocation::a_reg, offseted_reg, ~uint64_t(1));
 
-          load_immediate_u(dest_reg, current_pc + 4);
+        register_cache.unlock_register(target_reg);
 
+        if (instruction.rd != Register::Zero) {
+          const auto dest_reg = register_cache.lock_register(WO{instruction.rd});
+          load_immediate_u(dest_reg, next_pc);
           register_cache.unlock_register_dirty(dest_reg);
         }
 
-        generate_dynamic_branch(offseted_reg, RegisterAllocation::b_reg);
+        register_cache.flush_current_registers();
 
-        register_cache.unlock_register(target_reg);
+        const auto is_call = is_link_register(instruction.rd);
+        const auto is_return = !is_call && is_link_register(instruction.rs1);
+
+        if (is_call && can_use_return_stack(next_pc)) {
+          generate_call(next_pc, [&] {
+            generate_dynamic_branch(RegisterAllocation::a_reg, RegisterAllocation::b_reg, true);
+          });
+        } else if (is_return && !single_step) {
+          generate_return(RegisterAllocation::a_reg);
+          generate_dynamic_branch(RegisterAllocation::a_reg, RegisterAllocation::b_reg);
+        } else {
+          generate_dynamic_branch(RegisterAllocation::a_reg, RegisterAllocation::b_reg, true);
+        }
 
         return false;
       }
@@ -360,33 +2059,10 @@ struct CodeGenerator {
       case IT::Bge:
       case IT::Bltu:
       case IT::Bgeu: {
-        a64::Condition condition;
-
-        // Condition is inverted.
-        switch (instruction_type) {
-            // clang-format off
-          case IT::Beq:  condition = a64::Condition::NotEqual; break;
-          case IT::Bne:  condition = a64::Condition::Equal; break;
-          case IT::Blt:  condition = a64::Condition::GreaterEqual; break;
-          case IT::Bge:  condition = a64::Condition::Less; break;
-          case IT::Bltu: condition = a64::Condition::UnsignedGreaterEqual; break;
-          case IT::Bgeu: condition = a64::Condition::UnsignedLess; break;
-            // clang-format on
-
-          default:
-            unreachable();
-        }
-
-        const auto [a, b] = register_cache.lock_registers(instruction.rs1(), instruction.rs2());
-
-        const auto skip_label = as.allocate_label();
+        const auto [a, b] = register_cache.lock_registers(instruction.rs1, instruction.rs2);
 
         as.cmp(a, b);
-        as.b(condition, skip_label);
-
-        generate_static_branch(current_pc + instruction.imm(), RegisterAllocation::a_reg);
-
-        as.insert_label(skip_label);
+        generate_branch_side_exit(instruction);
 
         register_cache.unlock_registers(a, b);
 
@@ -400,16 +2076,15 @@ struct CodeGenerator {
       case IT::Lbu:
       case IT::Lhu:
       case IT::Lwu: {
-        if (instruction.rd() != Register::Zero) {
+        if (instruction.rd != Register::Zero) {
           const auto [unoffseted_address_reg, dest_reg] =
-            register_cache.lock_registers(instruction.rs1(), WO{instruction.rd()});
+            register_cache.lock_registers(instruction.rs1, WO{instruction.rd});
 
           const auto address_reg = add_offset_to_register(
-            unoffseted_address_reg, RegisterAllocation::a_reg, instruction.imm());
+            unoffseted_address_reg, RegisterAllocation::a_reg, instruction.imm);
 
-          generate_validate_memory_access(
-            address_reg, RegisterAllocation::b_reg, RegisterAllocation::c_reg,
-            jit::utils::memory_access_size_log2(instruction_type), false);
+          generate_validate_memory_access(instruction, address_reg, RegisterAllocation::b_reg,
+                                          RegisterAllocation::c_reg);
 
           const auto mb = RegisterAllocation::memory_base;
 
@@ -440,14 +2115,13 @@ struct CodeGenerator {
       case IT::Sw:
       case IT::Sd: {
         const auto [unoffseted_address_reg, value_reg] =
-          register_cache.lock_registers(instruction.rs1(), instruction.rs2());
+          register_cache.lock_registers(instruction.rs1, instruction.rs2);
 
         const auto address_reg = add_offset_to_register(
-          unoffseted_address_reg, RegisterAllocation::a_reg, instruction.imm());
+          unoffseted_address_reg, RegisterAllocation::a_reg, instruction.imm);
 
-        generate_validate_memory_access(
-          address_reg, RegisterAllocation::b_reg, RegisterAllocation::c_reg,
-          jit::utils::memory_access_size_log2(instruction_type), true);
+        generate_validate_memory_access(instruction, address_reg, RegisterAllocation::b_reg,
+                                        RegisterAllocation::c_reg);
 
         const auto mb = RegisterAllocation::memory_base;
 
@@ -473,10 +2147,10 @@ struct CodeGenerator {
       case IT::Ori:
       case IT::Andi:
       case IT::Addiw: {
-        if (instruction.rd() != Register::Zero) {
+        if (instruction.rd != Register::Zero) {
           const auto [a, dest] =
-            register_cache.lock_registers(instruction.rs1(), WO{instruction.rd()});
-          const auto imm = instruction.imm();
+            register_cache.lock_registers(instruction.rs1, WO{instruction.rd});
+          const auto imm = instruction.imm;
 
           bool succeeded = false;
 
@@ -543,14 +2217,14 @@ struct CodeGenerator {
       case IT::Slliw:
       case IT::Srliw:
       case IT::Sraiw: {
-        if (instruction.rd() != Register::Zero) {
+        if (instruction.rd != Register::Zero) {
           const auto [a, dest] =
-            register_cache.lock_registers(instruction.rs1(), WO{instruction.rd()});
+            register_cache.lock_registers(instruction.rs1, WO{instruction.rd});
 
           const auto a32 = cast_to_32bit(a);
           const auto dest32 = cast_to_32bit(dest);
 
-          const auto shamt = instruction.shamt();
+          const auto shamt = uint32_t(instruction.imm);
 
           switch (instruction_type) {
               // clang-format off
@@ -575,9 +2249,9 @@ struct CodeGenerator {
 
       case IT::Slt:
       case IT::Sltu: {
-        if (instruction.rd() != Register::Zero) {
+        if (instruction.rd != Register::Zero) {
           const auto [a, b, dest] = register_cache.lock_registers(
-            instruction.rs1(), instruction.rs2(), WO{instruction.rd()});
+            instruction.rs1, instruction.rs2, WO{instruction.rd});
 
           as.cmp(a, b);
           as.cset(dest, instruction_type == IT::Sltu ? a64::Condition::UnsignedLess
@@ -592,20 +2266,20 @@ struct CodeGenerator {
 
       case IT::Slti:
       case IT::Sltiu: {
-        if (instruction.rd() != Register::Zero) {
+        if (instruction.rd != Register::Zero) {
           // cmp (immediate) takes SP as first operand so we need to special case zero register.
-          if (instruction.rs1() == Register::Zero) {
-            const auto dest = register_cache.lock_register(WO{instruction.rd()});
+          if (instruction.rs1 == Register::Zero) {
+            const auto dest = register_cache.lock_register(WO{instruction.rd});
 
             load_immediate_u(dest, instruction_type == InstructionType::Slti
-                                     ? (int64_t(0) < int64_t(instruction.imm()))
-                                     : (uint64_t(0) < uint64_t(instruction.imm())));
+                                     ? (int64_t(0) < int64_t(instruction.imm))
+                                     : (uint64_t(0) < uint64_t(instruction.imm)));
 
             register_cache.unlock_register_dirty(dest);
           } else {
             const auto [a, dest] =
-              register_cache.lock_registers(instruction.rs1(), WO{instruction.rd()});
-            const auto imm = instruction.imm();
+              register_cache.lock_registers(instruction.rs1, WO{instruction.rd});
+            const auto imm = instruction.imm;
 
             if (!as.try_cmp(a, imm)) {
               const auto b = load_immediate_or_zero(RegisterAllocation::a_reg, imm);
@@ -636,9 +2310,9 @@ struct CodeGenerator {
       case IT::Sllw:
       case IT::Srlw:
       case IT::Sraw: {
-        if (instruction.rd() != Register::Zero) {
+        if (instruction.rd != Register::Zero) {
           const auto [a, b, dest] = register_cache.lock_registers(
-            instruction.rs1(), instruction.rs2(), WO{instruction.rd()});
+            instruction.rs1, instruction.rs2, WO{instruction.rd});
 
           const auto a32 = cast_to_32bit(a);
           const auto b32 = cast_to_32bit(b);
@@ -673,6 +2347,9 @@ struct CodeGenerator {
 
       case IT::Mul:
       case IT::Mulw:
+      case IT::Mulh:
+      case IT::Mulhu:
+      case IT::Mulhsu:
       case IT::Div:
       case IT::Divw:
       case IT::Divu:
@@ -681,26 +2358,54 @@ struct CodeGenerator {
       case IT::Remu:
       case IT::Remw:
       case IT::Remuw: {
-        if (instruction.rd() != Register::Zero) {
+        if (instruction.rd != Register::Zero) {
           const auto [a, b, dest] = register_cache.lock_registers(
-            instruction.rs1(), instruction.rs2(), WO{instruction.rd()});
+            instruction.rs1, instruction.rs2, WO{instruction.rd});
           const auto tmp = RegisterAllocation::a_reg;
+          const auto tmp2 = RegisterAllocation::b_reg;
 
           const auto a32 = cast_to_32bit(a);
           const auto b32 = cast_to_32bit(b);
           const auto dest32 = cast_to_32bit(dest);
           const auto tmp32 = cast_to_32bit(tmp);
 
+          // aarch64 division by zero returns 0 but RISC-V quotient has all bits set. Remainder
+          // is equal to the dividend on both. Signed overflow behaves the same way too.
+          const auto is_quotient = instruction_type == IT::Div || instruction_type == IT::Divw ||
+                                   instruction_type == IT::Divu || instruction_type == IT::Divuw;
+          const auto divide_label = as.allocate_label();
+          const auto end_label = as.allocate_label();
+
+          if (is_quotient) {
+            const auto is_32bit = instruction_type == IT::Divw || instruction_type == IT::Divuw;
+
+            as.cbnz(is_32bit ? b32 : b, divide_label);
+            load_immediate(dest, -1);
+            as.b(end_label);
+
+            as.insert_label(divide_label);
+          }
+
           switch (instruction_type) {
               // clang-format off
             case IT::Mul:   as.mul(dest, a, b); break;
             case IT::Mulw:  as.mul(dest32, a32, b32);  as.sxtw(dest, dest); break;
+            case IT::Mulh:  as.smulh(dest, a, b); break;
+            case IT::Mulhu: as.umulh(dest, a, b); break;
             case IT::Div:   as.sdiv(dest, a, b); break;
             case IT::Divw:  as.sdiv(dest32, a32, b32); as.sxtw(dest, dest); break;
             case IT::Divu:  as.udiv(dest, a, b); break;
             case IT::Divuw: as.udiv(dest32, a32, b32); as.sxtw(dest, dest); break;
               // clang-format on
 
+            case IT::Mulhsu: {
+              // Unsigned high half is too big by `b` if signed `a` is negative.
+              as.umulh(tmp, a, b);
+              as.asr(tmp2, a, 63);
+              as.and_(tmp2, tmp2, b);
+              as.sub(dest, tmp, tmp2);
+              break;
+            }
             case IT::Rem: {
               as.sdiv(tmp, a, b);
               as.msub(dest, tmp, b, a);
@@ -728,24 +2433,105 @@ struct CodeGenerator {
               unreachable();
           }
 
+          if (is_quotient) {
+            as.insert_label(end_label);
+          }
+
           register_cache.unlock_registers(a, b);
           register_cache.unlock_register_dirty(dest);
+        }
+
+        break;
+      }
+
+      case IT::Fence: {
+        if (!is_multithreaded()) {
+          break;
+        }
 
+        const auto predecessors = (uint64_t(instruction.imm) >> 4) & fence_accesses;
+        const auto successors = uint64_t(instruction.imm) & fence_accesses;
+        if (predecessors == 0 || successors == 0) {
           break;
         }
+
+        // Plain aarch64 accesses are ordered as weakly as RVWMO ones so the fence maps to the
+        // narrowest barrier covering its sets.
+        if (predecessors == fence_reads) {
+          as.dmb(a64::Barrier::IshLd);
+        } else if (predecessors == fence_writes && successors == fence_writes) {
+          as.dmb(a64::Barrier::IshSt);
+        } else {
+          as.dmb(a64::Barrier::Ish);
+        }
+        break;
       }
 
-      case IT::Mulh:
-      case IT::Mulhu:
-      case IT::Mulhsu: {
-        generate_exit(ArchExitReason::UnsupportedInstruction);
-        return false;
+      case IT::FenceI: {
+        // Blocks are invalidated when their code is written and the trace ends here.
+        break;
       }
 
-      case IT::Fence: {
+      case IT::LrW:
+      case IT::LrD:
+      case IT::ScW:
+      case IT::ScD:
+      case IT::AmoswapW:
+      case IT::AmoaddW:
+      case IT::AmoxorW:
+      case IT::AmoandW:
+      case IT::AmoorW:
+      case IT::AmominW:
+      case IT::AmomaxW:
+      case IT::AmominuW:
+      case IT::AmomaxuW:
+      case IT::AmoswapD:
+      case IT::AmoaddD:
+      case IT::AmoxorD:
+      case IT::AmoandD:
+      case IT::AmoorD:
+      case IT::AmominD:
+      case IT::AmomaxD:
+      case IT::AmominuD:
+      case IT::AmomaxuD: {
+        generate_atomic_instruction(instruction);
+        break;
+      }
+
+      case IT::Flw:
+      case IT::Fld: {
+        generate_float_load(instruction);
+        break;
+      }
+
+      case IT::Fsw:
+      case IT::Fsd: {
+        generate_float_store(instruction);
         break;
       }
 
+      case IT::FmvXW:
+      case IT::FmvWX:
+      case IT::FmvXD:
+      case IT::FmvDX:
+      case IT::FsgnjD:
+      case IT::FsgnjnD:
+      case IT::FsgnjxD: {
+        generate_float_move(instruction);
+        break;
+      }
+
+      case IT::Csrrw:
+      case IT::Csrrs:
+      case IT::Csrrc:
+      case IT::Csrrwi:
+      case IT::Csrrsi:
+      case IT::Csrrci: {
+        // Floating point and vector CSR accesses are rare so they are left to the interpreter.
+        generate_exit(ArchExitReason::UnsupportedInstruction);
+        return false;
+      }
+
       case IT::Ecall: {
         generate_exit(ArchExitReason::Ecall);
         return false;
@@ -760,49 +2546,166 @@ struct CodeGenerator {
       }
 
       default:
-        fatal_error("unknown instruction {}", instruction);
+        if (Arithmetic::is_bit_manipulation(instruction_type)) {
+          generate_bit_manipulation(instruction);
+          break;
+        }
+        if (VectorArithmetic::is_vector_instruction(instruction_type)) {
+          generate_vector_instruction(instruction);
+          break;
+        }
+        if (!FloatArithmetic::is_float_operation(instruction_type)) {
+          fatal_error("unknown instruction {}", instruction_type);
+        }
+        generate_float_operation(instruction);
+        break;
     }
 
     return true;
   }
 
-  void generate_block(uint64_t block_pc) {
-    current_pc = block_pc;
+  // Exits the VM once the block becomes hot so it can be recompiled by the optimizing tier.
+  void generate_hot_counter_update() {
+    const auto hot_label = as.allocate_label();
 
-    while (true) {
-      uint32_t instruction_encoded;
-      if (!memory.read(current_pc, MemoryFlags::Execute, instruction_encoded)) {
-        generate_exit(ArchExitReason::InstructionFetchFault);
-        break;
+    load_relocated_value(RegisterAllocation::a_reg, jit::CodeBuffer::Relocation::Target::HotCounter,
+                         uint64_t(hot_counter));
+    as.ldr(RegisterAllocation::b_reg, RegisterAllocation::a_reg, 0);
+    verify(as.try_add_i(RegisterAllocation::b_reg, RegisterAllocation::b_reg, -1),
+           "failed to encode hot counter decrement");
+    as.str(RegisterAllocation::b_reg, RegisterAllocation::a_reg, 0);
+    as.cbz(RegisterAllocation::b_reg, hot_label);
+
+    add_pending_exit(hot_label, ArchExitReason::BlockHot, false, current_pc);
+  }
+
+  bool generate_instruction(const jit::ir::Instruction& instruction) {
+    using WO = RegisterCache::WriteOnly;
+
+    switch (instruction.kind) {
+      case jit::ir::InstructionKind::Guest:
+        return generate_guest_instruction(instruction);
+
+      case jit::ir::InstructionKind::Constant: {
+        if (instruction.writes_rd()) {
+          const auto reg = register_cache.lock_register(WO{instruction.rd});
+          load_immediate(reg, instruction.imm);
+          register_cache.unlock_register_dirty(reg);
+        }
+        return true;
+      }
+
+      case jit::ir::InstructionKind::Move: {
+        if (instruction.writes_rd()) {
+          const auto [source, dest] =
+            register_cache.lock_registers(instruction.rs1, WO{instruction.rd});
+          if (dest != source) {
+            as.mov(dest, source);
+          }
+          register_cache.unlock_register(source);
+          register_cache.unlock_register_dirty(dest);
+        }
+        return true;
+      }
+
+      case jit::ir::InstructionKind::ZeroExtend: {
+        if (instruction.writes_rd()) {
+          const auto [source, dest] =
+            register_cache.lock_registers(instruction.rs1, WO{instruction.rd});
+          const auto mask = (uint64_t(1) << instruction.imm) - 1;
+          verify(as.try_and_(dest, source, mask), "failed to encode zero extension mask");
+          register_cache.unlock_register(source);
+          register_cache.unlock_register_dirty(dest);
+        }
+        return true;
+      }
+
+      case jit::ir::InstructionKind::SetAndBranch: {
+        const auto [a, b, dest] =
+          register_cache.lock_registers(instruction.rs1, instruction.rs2, WO{instruction.rd});
+        const auto is_unsigned = instruction.type == InstructionType::Bltu ||
+                                 instruction.type == InstructionType::Bgeu;
+
+        // Flags of the comparison are reused by the branch.
+        as.cmp(a, b);
+        as.cset(dest, is_unsigned ? a64::Condition::UnsignedLess : a64::Condition::Less);
+
+        register_cache.unlock_registers(a, b);
+        register_cache.unlock_register_dirty(dest);
+
+        generate_branch_side_exit(instruction);
+
+        return true;
       }
 
-      Instruction instruction{instruction_encoded};
+      case jit::ir::InstructionKind::Nop:
+        return true;
+
+      default:
+        unreachable();
+    }
+  }
+
+  void generate_block(const jit::ir::Block& block) {
+    std::optional<a64::Label> loop_label;
+    if (!block.loop_guards.empty()) {
+      generate_loop_guards(block);
+
+      loop_label = as.allocate_label();
+      as.insert_label(*loop_label);
+    }
+
+    for (const auto& instruction : block.instructions) {
+      current_pc = instruction.pc;
+      next_pc = instruction.next_pc();
 
       const auto continue_execution = generate_instruction(instruction);
 
       register_cache.finish_instruction();
 
       if (!continue_execution) {
-        break;
+        return;
       }
+    }
 
-      current_pc += 4;
+    if (block.end_fetch_fault) {
+      generate_exit(ArchExitReason::InstructionFetchFault, block.end_pc);
+    } else if (loop_label && can_skip_loop_guards()) {
+      register_cache.flush_current_registers();
 
-      if (single_step) {
-        generate_exit(ArchExitReason::SingleStep);
-        break;
-      }
+      current_pc = block.end_pc;
+      generate_loop_back_edge(block, *loop_label);
+    } else {
+      generate_static_branch(block.end_pc, RegisterAllocation::a_reg);
     }
   }
 
-  void generate_code(uint64_t pc) {
+  void generate_code(jit::Trace& trace,
+                     jit::ir::Block& block,
+                     const jit::TraceOptions& trace_options,
+                     uint64_t pc) {
     base_pc = pc;
     current_pc = pc;
 
     // We cannot use load_immediate here.
     as.macro_mov(RegisterAllocation::base_pc, int64_t(base_pc));
 
-    generate_block(pc);
+    if (hot_counter) {
+      generate_hot_counter_update();
+    }
+
+    jit::build_trace(trace, memory, pc, trace_options);
+    jit::ir::build_block(block, trace);
+    jit::ir::fuse_instructions(block);
+    if (trace_options.optimize) {
+      jit::ir::optimize(block);
+    }
+    if (!memory.uses_byte_permissions()) {
+      jit::ir::combine_memory_checks(block);
+    }
+
+    generate_block(block);
+    generate_pending_branches();
     generate_pending_exits();
   }
 };
@@ -810,6 +2713,8 @@ struct CodeGenerator {
 std::span<const uint32_t> jit::aarch64::generate_block_code(CodegenContext& context,
                                                             const CodeBuffer& code_buffer,
                                                             const Memory& memory,
+                                                            const TraceOptions& trace_options,
+                                                            uint64_t* hot_counter,
                                                             bool single_step,
                                                             uint64_t pc) {
   context.prepare();
@@ -819,10 +2724,16 @@ std::span<const uint32_t> jit::aarch64::generate_block_code(CodegenContext& cont
     .memory = memory,
     .code_buffer = code_buffer,
     .single_step = single_step,
+    .hot_counter = hot_counter,
     .pending_exits = context.pending_exits,
+    .pending_branches = context.pending_branches,
+    .link_sites = context.link_sites,
+    .inline_caches = context.inline_caches,
+    .fault_sites = context.fault_sites,
+    .relocations = context.relocations,
   };
 
-  code_generator.generate_code(pc);
+  code_generator.generate_code(context.trace, context.block, trace_options, pc);
 
   return code_generator.as.assembled_instructions();
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 #include <vm/Memory.hpp>
 #include <vm/jit/CodeBuffer.hpp>
+#include <vm/jit/Trace.hpp>
 
 #include "CodegenContext.hpp"
 
@@ -9,6 +10,8 @@ namespace vm::jit::aarch64 {
 std::span<const uint32_t> generate_block_code(CodegenContext& context,
                                               const CodeBuffer& code_buffer,
                                               const Memory& memory,
+                                              const TraceOptions& trace_options,
+                                              uint64_t* hot_counter,
                                               bool single_step,
                                               uint64_t pc);
 
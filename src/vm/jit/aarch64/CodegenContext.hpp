@@ -1,10 +1,16 @@
 #pragma once
 #include <asmlib_a64/Assembler.hpp>
 
+#include <vm/jit/CodeBuffer.hpp>
+#include <vm/jit/Trace.hpp>
+#include <vm/jit/ir/Block.hpp>
+
 #include "Exit.hpp"
 #include "RegisterCache.hpp"
 #include "Registers.hpp"
 
+#include <optional>
+
 namespace vm::jit::aarch64 {
 
 struct CodegenContext {
@@ -16,12 +22,39 @@ struct CodegenContext {
     A64R pc_register{A64R::Xzr};
     uint64_t pc_value{};
     RegisterCache::StateSnapshot snapshot;
+
+    // Code offset of the guest memory access which continues at this exit if it faults on
+    // a guard page.
+    std::optional<uint32_t> faulting_access_offset;
   };
   std::vector<Exit> pending_exits;
 
+  // Side exit of the trace which continues execution at `target_pc` in another block.
+  struct Branch {
+    asmlib::a64::Label label;
+    uint64_t target_pc{};
+    RegisterCache::StateSnapshot snapshot;
+  };
+  std::vector<Branch> pending_branches;
+
+  std::vector<CodeBuffer::LinkSite> link_sites;
+  std::vector<CodeBuffer::InlineCache> inline_caches;
+  std::vector<CodeBuffer::FaultSite> fault_sites;
+  std::vector<CodeBuffer::Relocation> relocations;
+
+  Trace trace;
+  ir::Block block;
+
   CodegenContext& prepare() {
     assembler.clear();
     pending_exits.clear();
+    pending_branches.clear();
+    link_sites.clear();
+    inline_caches.clear();
+    fault_sites.clear();
+    relocations.clear();
+    trace.clear();
+    block.clear();
 
     return *this;
   }
@@ -8,41 +8,134 @@
 #include <vm/jit/Utilities.hpp>
 #include <vm/private/ExecutionLog.hpp>
 
+#include <optional>
+
 using namespace vm;
 using namespace vm::jit::aarch64;
 
-void* Executor::generate_code(const Memory& memory, uint64_t pc) {
+std::span<const uint8_t> Executor::generate_block(CodegenContext& context,
+                                                  const Memory& memory,
+                                                  uint64_t pc,
+                                                  Tier tier) {
 #ifdef PRINT_EXECUTION_LOG
   const bool single_step = true;
 #else
   const bool single_step = false;
 #endif
 
+  // Baseline code counts its executions so hot blocks can be recompiled by the optimizing tier.
+  const auto hot_counter =
+    tier == Tier::Baseline ? profile_.hot_counter(pc, tiering_thresholds.optimizing) : nullptr;
+
   const auto instructions =
-    generate_block_code(codegen_context, *code_buffer, memory, single_step, pc);
-  const auto instruction_bytes = utils::cast_to_bytes(instructions);
+    generate_block_code(context, *code_buffer, memory, trace_options(tier, single_step),
+                        hot_counter, single_step, pc);
 
 #ifdef JIT_LOG_GENERATED_BLOCKS
   log_debug("generated code for {:x}: {} instructions...", pc, instructions.size());
 #endif
 
-  return code_buffer->insert(pc, instruction_bytes);
+  return utils::cast_to_bytes(instructions);
+}
+
+jit::Executor::CompiledBlock Executor::compile_block(CodegenContext& context,
+                                                     Memory& memory,
+                                                     uint64_t pc,
+                                                     Tier tier) {
+  const auto code = generate_block(context, memory, pc, tier);
+
+  CompiledBlock block{
+    .pc = pc,
+    .tier = tier,
+    .code = {code.begin(), code.end()},
+    .link_sites = context.link_sites,
+    .inline_caches = context.inline_caches,
+    .fault_sites = context.fault_sites,
+    .relocations = context.relocations,
+    .code_pages = {},
+    .instructions = {},
+  };
+  record_guest_code(context.trace, block);
+
+  return block;
+}
+
+void* Executor::generate_code(Memory& memory, uint64_t pc, Tier tier) {
+  std::unique_lock lock(codegen_mutex);
+  return insert_code(memory, compile_block(codegen_context, memory, pc, tier));
+}
+
+std::vector<std::unique_ptr<CodegenContext>>& Executor::context_pool(ContextPool pool) {
+  return pool == ContextPool::CompileThreads ? compile_thread_contexts : pretranslation_contexts;
+}
+
+void Executor::reserve_compile_contexts(ContextPool pool, size_t count) {
+  auto& contexts = context_pool(pool);
+  while (contexts.size() < count) {
+    contexts.push_back(std::make_unique<CodegenContext>());
+  }
 }
 
-Executor::Executor(std::shared_ptr<CodeBuffer> code_buffer) : code_buffer(std::move(code_buffer)) {
+jit::Executor::CompiledBlock Executor::compile_in_background(ContextPool pool,
+                                                             size_t thread_index,
+                                                             Memory& memory,
+                                                             uint64_t pc,
+                                                             Tier tier) {
+  return compile_block(*context_pool(pool)[thread_index], memory, pc, tier);
+}
+
+Executor::Executor(std::shared_ptr<CodeBuffer> code_buffer,
+                   const TieringThresholds& tiering_thresholds)
+    : jit::Executor(std::move(code_buffer), tiering_thresholds) {
   trampoline_fn = generate_trampoline(codegen_context, *this->code_buffer);
+
+  reserve_compile_contexts(ContextPool::CompileThreads, tiering_thresholds.compile_threads);
+  start_compile_threads();
+}
+
+Executor::~Executor() {
+  stop_compile_threads();
 }
 
 jit::ExitReason Executor::run(Memory& memory, Cpu& cpu) {
   ArchExitReason exit_reason{};
 
+  // Address of the indirect jump instruction that has missed its inline cache.
+  std::optional<uint64_t> inline_cache_miss_address;
+
   while (true) {
+    if (compiles_in_background()) {
+      publish_compiled_blocks(memory);
+    }
+
     const auto pc = cpu.pc();
 
+    // Code found now may get flushed before it's entered.
+    const auto flush_count = code_buffer->flush_count();
+
     auto code = code_buffer->get(pc);
     if (!code) {
-      code = generate_code(memory, pc);
-      verify(code, "failed to jit code for pc {:x}", pc);
+      const auto tier = select_tier(pc);
+      if (tier == Tier::Interpreter) {
+        return ExitReason::ColdBlock;
+      }
+
+      // Interpret the block until its code is ready.
+      if (compiles_in_background()) {
+        request_compilation(memory, pc, tier);
+        return ExitReason::ColdBlock;
+      }
+
+      // Interpret the block if its code was modified while it was being compiled.
+      code = generate_code(memory, pc, tier);
+      if (!code) {
+        return ExitReason::ColdBlock;
+      }
+    }
+
+    if (inline_cache_miss_address) {
+      code_buffer->fill_inline_caches(*inline_cache_miss_address, pc);
+      inline_cache_miss_address = std::nullopt;
     }
 
 #ifdef PRINT_EXECUTION_LOG
@@ -51,16 +144,21 @@ jit::ExitReason Executor::run(Memory& memory, Cpu& cpu) {
 
     TrampolineBlock trampoline_block{
       .register_state = uint64_t(cpu.register_state().raw_table()),
-      .memory_base = uint64_t(memory.contents()),
+      .memory_base = uint64_t(memory.uses_guard_pages() ? memory.guarded_contents()
+                                                        : memory.contents()),
       .permissions_base = uint64_t(memory.permissions()),
       .memory_size = memory.size(),
       .block_base = uint64_t(code_buffer->block_translation_table()),
-      .max_executable_pc = code_buffer->max_block_count() * 4,
+      .max_executable_pc = code_buffer->max_block_count() * CodeBuffer::table_entry_granularity,
       .code_base = uint64_t(code_buffer->code_buffer_base()),
       .entrypoint = uint64_t(code),
     };
 
+    if (!code_buffer->enter_code(flush_count)) {
+      continue;
+    }
     reinterpret_cast<void (*)(TrampolineBlock*)>(trampoline_fn)(&trampoline_block);
+    code_buffer->leave_code();
 
     cpu.set_reg(Register::Pc, trampoline_block.exit_pc);
 
@@ -69,6 +167,22 @@ jit::ExitReason Executor::run(Memory& memory, Cpu& cpu) {
 #endif
 
     exit_reason = ArchExitReason(trampoline_block.exit_reason);
+    if (exit_reason == ArchExitReason::InlineCacheMiss) {
+      inline_cache_miss_address = trampoline_block.exit_data;
+      continue;
+    }
+
+    if (exit_reason == ArchExitReason::BlockHot) {
+      // Baseline code keeps running until the optimized code is published, its hot counter
+      // won't reach zero again.
+      if (compiles_in_background()) {
+        request_compilation(memory, cpu.pc(), Tier::Optimizing);
+      } else {
+        generate_code(memory, cpu.pc(), Tier::Optimizing);
+      }
+      continue;
+    }
+
     if (exit_reason != ArchExitReason::BlockNotGenerated &&
         exit_reason != ArchExitReason::SingleStep) {
       break;
@@ -2,6 +2,7 @@
 
 #include <base/Error.hpp>
 
+#include <algorithm>
 #include <bit>
 
 using namespace vm::jit::aarch64;
@@ -164,6 +165,45 @@ void RegisterCache::unlock_register(A64R reg, bool make_dirty) {
   slots[slot_id].dirty |= make_dirty;
 }
 
+void RegisterCache::lock_platform_register(A64R reg) {
+  const auto slot_id = platform_register_to_slot[size_t(reg)];
+  if (slot_id == invalid_id) {
+    return;
+  }
+
+  auto& slot = slots[slot_id];
+  verify(!slot.locked, "cannot take away platform register that is locked");
+
+  if (slot.reg != Register::Zero) {
+    if (slot.dirty) {
+      emit_register_store(slot.reg, reg);
+    }
+    register_to_slot[size_t(slot.reg)] = invalid_id;
+  } else {
+    const auto it = std::find(free_slots.begin(), free_slots.end(), slot_id);
+    verify(it != free_slots.end(), "empty register cache slot is not marked as free");
+    std::swap(*it, free_slots.back());
+    free_slots.pop_back();
+  }
+
+  // Slot without a register that is locked will never be used or evicted.
+  slot = Slot{.locked = true};
+}
+
+void RegisterCache::unlock_platform_register(A64R reg) {
+  const auto slot_id = platform_register_to_slot[size_t(reg)];
+  if (slot_id == invalid_id) {
+    return;
+  }
+
+  auto& slot = slots[slot_id];
+  verify(slot.locked && slot.reg == Register::Zero,
+         "cannot give back platform register that wasn't taken away");
+
+  slot = Slot{};
+  free_slots.push_back(slot_id);
+}
+
 RegisterCache::StateSnapshot RegisterCache::take_state_snapshot() const {
   StateSnapshot snapshot{};
 
@@ -88,6 +88,12 @@ class RegisterCache {
     (unlock_register(args), ...);
   }
 
+  // Atomic instructions need more scratch registers than the fixed ones. These functions take
+  // a cache register away from the cache for the duration of the current instruction (writing
+  // back its contents if needed).
+  void lock_platform_register(A64R reg);
+  void unlock_platform_register(A64R reg);
+
   StateSnapshot take_state_snapshot() const;
   void flush_registers(const StateSnapshot& snapshot);
   void flush_current_registers() { flush_registers(take_state_snapshot()); }
@@ -11,6 +11,7 @@ class RegisterAllocation {
  public:
   constexpr static auto exit_reason = A64R::X0;
   constexpr static auto exit_pc = A64R::X1;
+  constexpr static auto exit_data = A64R::X10;
 
   constexpr static auto register_state = A64R::X0;
   constexpr static auto memory_base = A64R::X1;
@@ -27,10 +28,14 @@ class RegisterAllocation {
 
   constexpr static auto trampoline_block = a_reg;
 
+  // Value of the stack pointer on JIT code entry. Guest calls push return address stack entries
+  // on the host stack and exits reset the stack pointer back to this value.
+  constexpr static auto stack_base = A64R::X28;
+
   constexpr static A64R cache[]{
     A64R::X11, A64R::X12, A64R::X13, A64R::X14, A64R::X15, A64R::X16,
     A64R::X17, A64R::X19, A64R::X20, A64R::X21, A64R::X22, A64R::X23,
-    A64R::X24, A64R::X25, A64R::X26, A64R::X27, A64R::X28,
+    A64R::X24, A64R::X25, A64R::X26, A64R::X27,
   };
   constexpr static size_t cache_size = std::size(cache);
 };
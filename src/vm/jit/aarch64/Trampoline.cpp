@@ -101,7 +101,8 @@ void* aarch64::generate_trampoline(CodegenContext& context, CodeBuffer& code_buf
     .add(RA::register_state, RA::memory_base, RA::permissions_base, RA::memory_size, RA::block_base,
          RA::max_executable_pc, RA::code_base, RA::base_pc)
     .add(RA::a_reg, RA::b_reg, RA::c_reg)
-    .add(RA::exit_reason, RA::exit_pc)
+    .add(RA::exit_reason, RA::exit_pc, RA::exit_data)
+    .add(RA::stack_base)
     .add_always(RA::trampoline_block);
 
   for (const auto reg : RA::cache) {
@@ -123,14 +124,24 @@ void* aarch64::generate_trampoline(CodegenContext& context, CodeBuffer& code_buf
     as.ldr(RA::max_executable_pc, tb, offsetof(TrampolineBlock, max_executable_pc));
     as.ldr(RA::code_base, tb, offsetof(TrampolineBlock, code_base));
 
+    const auto enter_label = as.allocate_label();
+
     as.ldr(tb, tb, offsetof(TrampolineBlock, entrypoint));
-    as.blr(tb);
+    as.bl(enter_label);
 
     register_saver.restore();
 
     as.str(RA::exit_reason, tb, offsetof(TrampolineBlock, exit_reason));
     as.str(RA::exit_pc, tb, offsetof(TrampolineBlock, exit_pc));
+    as.str(RA::exit_data, tb, offsetof(TrampolineBlock, exit_data));
     as.ret();
+
+    // JIT code uses X30 for guest calls so save our return address on the stack. Exits will
+    // restore it from `stack_base`.
+    as.insert_label(enter_label);
+    as.stp(A64R::X30, A64R::X30, A64R::Sp, -16, a64::Writeback::Pre);
+    as.mov(RA::stack_base, A64R::Sp);
+    as.br(tb);
   }
 
   return code_buffer.insert_standalone(utils::cast_to_bytes(as.assembled_instructions()));
@@ -19,6 +19,7 @@ struct TrampolineBlock {
 
   uint64_t exit_reason;
   uint64_t exit_pc;
+  uint64_t exit_data;
 };
 
 void* generate_trampoline(CodegenContext& context, CodeBuffer& code_buffer);
@@ -0,0 +1,63 @@
+#include "Block.hpp"
+
+using namespace vm;
+using namespace vm::jit;
+
+void ir::build_block(Block& block, const Trace& trace) {
+  block.clear();
+
+  block.end_pc = trace.end_pc;
+  block.end_fetch_fault = trace.end_fetch_fault;
+
+  block.instructions.reserve(trace.entries.size());
+
+  for (const auto& entry : trace.entries) {
+    const auto& guest = entry.instruction;
+
+    Instruction instruction{
+      .kind = InstructionKind::Guest,
+      .type = guest.type(),
+      .pc = entry.pc,
+      .length = guest.length(),
+      .rd = guest.rd(),
+      .rs1 = guest.rs1(),
+      .rs2 = guest.rs2(),
+      .imm = guest.imm(),
+      .branch_taken = entry.branch_taken,
+    };
+
+    // `mv` pseudoinstruction.
+    if (instruction.type == InstructionType::Addi && instruction.imm == 0) {
+      instruction.make_move(instruction.rs1, invalid_value);
+    }
+
+    block.instructions.push_back(instruction);
+  }
+
+  number_values(block);
+}
+
+void ir::number_values(Block& block) {
+  Value register_values[32]{};
+  for (Value i = 0; i < entry_value_count; ++i) {
+    register_values[i] = i;
+  }
+
+  Value next_value = entry_value_count;
+
+  for (auto& instruction : block.instructions) {
+    instruction.rs1_value =
+      instruction.reads_rs1() ? register_values[size_t(instruction.rs1)] : invalid_value;
+    instruction.rs2_value =
+      instruction.reads_rs2() ? register_values[size_t(instruction.rs2)] : invalid_value;
+
+    if (instruction.writes_rd()) {
+      instruction.rd_value = next_value++;
+      register_values[size_t(instruction.rd)] = instruction.rd_value;
+    } else {
+      instruction.rd_value = invalid_value;
+    }
+  }
+
+  block.value_count = next_value;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include <vm/jit/Trace.hpp>
+
+#include "Instruction.hpp"
+
+namespace vm::jit::ir {
+
+// Memory range validated before the first instruction of a block which branches back to its own
+// start. Range is `size` bytes at `offset` from the value of `base` at the block entry and every
+// iteration moves it by `stride` bytes.
+struct LoopGuard {
+  Register base{};
+  int64_t offset{};
+  uint32_t size{};
+  MemoryFlags flags{};
+  int64_t stride{};
+};
+
+// SSA form of a trace. Instructions execute in order, conditional branches leave the block via
+// side exits.
+struct Block {
+  std::vector<Instruction> instructions;
+
+  // Same meaning as in `Trace`.
+  uint64_t end_pc{};
+  bool end_fetch_fault{};
+
+  Value value_count = entry_value_count;
+
+  // Only set by `combine_memory_checks`.
+  std::vector<LoopGuard> loop_guards;
+
+  void clear() {
+    instructions.clear();
+    end_pc = 0;
+    end_fetch_fault = false;
+    value_count = entry_value_count;
+    loop_guards.clear();
+  }
+};
+
+void build_block(Block& block, const Trace& trace);
+
+// Recalculates SSA values of all instructions. Needs to be called after passes that change
+// instruction operands.
+void number_values(Block& block);
+
+}  // namespace vm::jit::ir
@@ -0,0 +1,140 @@
+#include "Fusion.hpp"
+
+#include <vm/jit/Utilities.hpp>
+
+using namespace vm;
+using namespace vm::jit;
+
+using IT = InstructionType;
+
+static bool fuse_lui(ir::Instruction& lui, ir::Instruction& second) {
+  if (second.rs1 != lui.rd) {
+    return false;
+  }
+
+  const auto value = uint64_t(lui.imm + second.imm);
+
+  switch (second.type) {
+    case IT::Addi:
+      second.make_constant(value);
+      return true;
+
+    case IT::Addiw:
+      second.make_constant(uint64_t(int64_t(int32_t(value))));
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+static bool fuse_auipc(ir::Instruction& auipc, ir::Instruction& second) {
+  if (second.rs1 != auipc.rd) {
+    return false;
+  }
+
+  const auto address = auipc.pc + auipc.imm + second.imm;
+
+  if (second.type == IT::Addi) {
+    second.make_constant(address);
+    return true;
+  }
+
+  if (second.type == IT::Jalr || utils::is_memory_access(second.type)) {
+    // Base register is zero so the immediate becomes an absolute address.
+    second.rs1 = Register::Zero;
+    second.imm = int64_t(address);
+    return true;
+  }
+
+  return false;
+}
+
+static bool fuse_slli(ir::Instruction& slli, ir::Instruction& second) {
+  if (second.type != IT::Srli || second.rs1 != slli.rd || second.imm != slli.imm ||
+      slli.imm == 0) {
+    return false;
+  }
+
+  // `slli` result is kept so its source must be still available.
+  if (second.rd != slli.rd && slli.rd == slli.rs1) {
+    return false;
+  }
+
+  second.make_zero_extend(slli.rs1, 64 - uint32_t(slli.imm));
+  return true;
+}
+
+static bool fuse_set_less_than(ir::Instruction& slt, ir::Instruction& second) {
+  if (second.type != IT::Beq && second.type != IT::Bne) {
+    return false;
+  }
+
+  const auto compares_to_zero = (second.rs1 == slt.rd && second.rs2 == Register::Zero) ||
+                                (second.rs1 == Register::Zero && second.rs2 == slt.rd);
+  if (!compares_to_zero) {
+    return false;
+  }
+
+  const auto is_unsigned = slt.type == IT::Sltu;
+
+  // Branch condition is expressed in terms of `slt` operands.
+  if (second.type == IT::Bne) {
+    second.type = is_unsigned ? IT::Bltu : IT::Blt;
+  } else {
+    second.type = is_unsigned ? IT::Bgeu : IT::Bge;
+  }
+
+  second.kind = ir::InstructionKind::SetAndBranch;
+  second.rd = slt.rd;
+  second.rs1 = slt.rs1;
+  second.rs2 = slt.rs2;
+
+  // Fused instruction writes `rd` by itself.
+  slt.make_nop();
+
+  return true;
+}
+
+void ir::fuse_instructions(Block& block) {
+  auto& instructions = block.instructions;
+
+  for (size_t i = 1; i < instructions.size(); ++i) {
+    auto& first = instructions[i - 1];
+    auto& second = instructions[i];
+
+    if (first.kind != InstructionKind::Guest || second.kind != InstructionKind::Guest ||
+        first.rd == Register::Zero) {
+      continue;
+    }
+
+    bool fused = false;
+
+    switch (first.type) {
+      case IT::Lui:
+        fused = fuse_lui(first, second);
+        break;
+      case IT::Auipc:
+        fused = fuse_auipc(first, second);
+        break;
+      case IT::Slli:
+        fused = fuse_slli(first, second);
+        break;
+      case IT::Slt:
+      case IT::Sltu:
+        fused = fuse_set_less_than(first, second);
+        break;
+      default:
+        break;
+    }
+
+    // Result of the first instruction is overwritten immediately so it's not needed. Memory
+    // accesses can fault before writing `rd` and the fault must observe the first result.
+    if (fused && first.kind == InstructionKind::Guest && second.writes_rd() &&
+        second.rd == first.rd && !utils::is_memory_access(second.type)) {
+      first.make_nop();
+    }
+  }
+
+  number_values(block);
+}
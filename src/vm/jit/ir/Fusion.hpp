@@ -0,0 +1,16 @@
+#pragma once
+#include "Block.hpp"
+
+namespace vm::jit::ir {
+
+// Combines pairs of adjacent instructions which compilers emit for common idioms so backends can
+// lower them as a single host sequence:
+//   lui + addi(w)      -> constant
+//   auipc + addi       -> constant
+//   auipc + jalr       -> jalr with absolute target (direct jump or call)
+//   auipc + load/store -> memory access with absolute address
+//   slli + srli        -> zero extension
+//   slt(u) + beqz/bnez -> compare and branch
+void fuse_instructions(Block& block);
+
+}  // namespace vm::jit::ir
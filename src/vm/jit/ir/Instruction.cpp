@@ -0,0 +1,337 @@
+#include "Instruction.hpp"
+
+#include <vm/private/Arithmetic.hpp>
+#include <vm/private/FloatArithmetic.hpp>
+#include <vm/private/VectorArithmetic.hpp>
+
+#include <base/Error.hpp>
+
+using namespace vm;
+using namespace vm::jit;
+
+using IT = InstructionType;
+
+// Floating point register operands are not tracked, only the integer ones.
+static bool guest_reads_rs1(InstructionType type) {
+  if (FloatArithmetic::is_float_operation(type)) {
+    return FloatArithmetic::reads_integer_register(type);
+  }
+
+  switch (type) {
+    case IT::Undefined:
+    case IT::Lui:
+    case IT::Auipc:
+    case IT::Jal:
+    case IT::Ebreak:
+    case IT::Ecall:
+    case IT::Fence:
+    case IT::FenceI:
+    case IT::Csrrwi:
+    case IT::Csrrsi:
+    case IT::Csrrci:
+    case IT::Vsetivli:
+    case IT::VectorOperation:
+    case IT::VectorMoveToScalar:
+      return false;
+
+    default:
+      return true;
+  }
+}
+
+static bool guest_reads_rs2(InstructionType type) {
+  if (Arithmetic::is_bit_manipulation(type)) {
+    return Arithmetic::reads_second_register(type);
+  }
+
+  switch (type) {
+    case IT::Beq:
+    case IT::Bne:
+    case IT::Blt:
+    case IT::Bge:
+    case IT::Bltu:
+    case IT::Bgeu:
+    case IT::Sb:
+    case IT::Sh:
+    case IT::Sw:
+    case IT::Sd:
+    case IT::Slt:
+    case IT::Sltu:
+    case IT::Add:
+    case IT::Sub:
+    case IT::Xor:
+    case IT::Or:
+    case IT::And:
+    case IT::Sll:
+    case IT::Srl:
+    case IT::Sra:
+    case IT::Addw:
+    case IT::Subw:
+    case IT::Sllw:
+    case IT::Srlw:
+    case IT::Sraw:
+    case IT::Mul:
+    case IT::Mulw:
+    case IT::Mulh:
+    case IT::Mulhu:
+    case IT::Mulhsu:
+    case IT::Div:
+    case IT::Divu:
+    case IT::Divw:
+    case IT::Divuw:
+    case IT::Rem:
+    case IT::Remu:
+    case IT::Remw:
+    case IT::Remuw:
+    case IT::ScW:
+    case IT::ScD:
+    case IT::AmoswapW:
+    case IT::AmoaddW:
+    case IT::AmoxorW:
+    case IT::AmoandW:
+    case IT::AmoorW:
+    case IT::AmominW:
+    case IT::AmomaxW:
+    case IT::AmominuW:
+    case IT::AmomaxuW:
+    case IT::AmoswapD:
+    case IT::AmoaddD:
+    case IT::AmoxorD:
+    case IT::AmoandD:
+    case IT::AmoorD:
+    case IT::AmominD:
+    case IT::AmomaxD:
+    case IT::AmominuD:
+    case IT::AmomaxuD:
+    case IT::Vsetvl:
+    case IT::VectorLoadStrided:
+    case IT::VectorStoreStrided:
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+static bool guest_writes_rd(InstructionType type) {
+  if (FloatArithmetic::is_float_operation(type)) {
+    return FloatArithmetic::writes_integer_register(type);
+  }
+
+  switch (type) {
+    case IT::Undefined:
+    case IT::Beq:
+    case IT::Bne:
+    case IT::Blt:
+    case IT::Bge:
+    case IT::Bltu:
+    case IT::Bgeu:
+    case IT::Sb:
+    case IT::Sh:
+    case IT::Sw:
+    case IT::Sd:
+    case IT::Ebreak:
+    case IT::Ecall:
+    case IT::Fence:
+    case IT::FenceI:
+    case IT::Flw:
+    case IT::Fsw:
+    case IT::Fld:
+    case IT::Fsd:
+    case IT::VectorLoad:
+    case IT::VectorStore:
+    case IT::VectorLoadStrided:
+    case IT::VectorStoreStrided:
+    case IT::VectorOperation:
+    case IT::VectorOperationScalar:
+      return false;
+
+    default:
+      return true;
+  }
+}
+
+static bool guest_may_exit(InstructionType type) {
+  // Invalid dynamic rounding mode makes the instruction undefined.
+  if (FloatArithmetic::is_float_operation(type)) {
+    return FloatArithmetic::uses_rounding_mode(type);
+  }
+
+  switch (type) {
+    case IT::Undefined:
+    case IT::Jal:
+    case IT::Jalr:
+    case IT::Beq:
+    case IT::Bne:
+    case IT::Blt:
+    case IT::Bge:
+    case IT::Bltu:
+    case IT::Bgeu:
+    case IT::Lb:
+    case IT::Lh:
+    case IT::Lw:
+    case IT::Ld:
+    case IT::Lbu:
+    case IT::Lhu:
+    case IT::Lwu:
+    case IT::Sb:
+    case IT::Sh:
+    case IT::Sw:
+    case IT::Sd:
+    case IT::LrW:
+    case IT::LrD:
+    case IT::ScW:
+    case IT::ScD:
+    case IT::AmoswapW:
+    case IT::AmoaddW:
+    case IT::AmoxorW:
+    case IT::AmoandW:
+    case IT::AmoorW:
+    case IT::AmominW:
+    case IT::AmomaxW:
+    case IT::AmominuW:
+    case IT::AmomaxuW:
+    case IT::AmoswapD:
+    case IT::AmoaddD:
+    case IT::AmoxorD:
+    case IT::AmoandD:
+    case IT::AmoorD:
+    case IT::AmominD:
+    case IT::AmomaxD:
+    case IT::AmominuD:
+    case IT::AmomaxuD:
+    case IT::Ebreak:
+    case IT::Ecall:
+    case IT::Csrrw:
+    case IT::Csrrs:
+    case IT::Csrrc:
+    case IT::Csrrwi:
+    case IT::Csrrsi:
+    case IT::Csrrci:
+    case IT::Flw:
+    case IT::Fsw:
+    case IT::Fld:
+    case IT::Fsd:
+    case IT::VectorLoad:
+    case IT::VectorStore:
+    case IT::VectorLoadStrided:
+    case IT::VectorStoreStrided:
+    case IT::VectorOperation:
+    case IT::VectorOperationScalar:
+    case IT::VectorMoveToScalar:
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+bool ir::Instruction::reads_rs1() const {
+  switch (kind) {
+    case InstructionKind::Guest:
+      return guest_reads_rs1(type);
+    case InstructionKind::Move:
+    case InstructionKind::ZeroExtend:
+    case InstructionKind::SetAndBranch:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool ir::Instruction::reads_rs2() const {
+  switch (kind) {
+    case InstructionKind::Guest:
+      return guest_reads_rs2(type);
+    case InstructionKind::SetAndBranch:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool ir::Instruction::writes_rd() const {
+  if (rd == Register::Zero) {
+    return false;
+  }
+
+  switch (kind) {
+    case InstructionKind::Guest:
+      return guest_writes_rd(type);
+    case InstructionKind::Constant:
+    case InstructionKind::Move:
+    case InstructionKind::ZeroExtend:
+    case InstructionKind::SetAndBranch:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool ir::Instruction::may_exit() const {
+  switch (kind) {
+    case InstructionKind::Guest:
+      return guest_may_exit(type);
+    case InstructionKind::SetAndBranch:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool ir::Instruction::is_pure() const {
+  switch (kind) {
+    case InstructionKind::Guest:
+      // Floating point operations also write floating point registers or accrue exceptions and
+      // vector configuration instructions also write `vl` and `vtype`.
+      return guest_writes_rd(type) && !guest_may_exit(type) &&
+             !FloatArithmetic::is_float_operation(type) &&
+             !VectorArithmetic::is_vector_instruction(type);
+    case InstructionKind::Constant:
+    case InstructionKind::Move:
+    case InstructionKind::ZeroExtend:
+    case InstructionKind::Nop:
+      return true;
+    case InstructionKind::SetAndBranch:
+      return false;
+    default:
+      unreachable();
+  }
+}
+
+void ir::Instruction::make_constant(uint64_t value) {
+  kind = InstructionKind::Constant;
+  imm = int64_t(value);
+  rs1 = Register::Zero;
+  rs2 = Register::Zero;
+  rs1_value = invalid_value;
+  rs2_value = invalid_value;
+}
+
+void ir::Instruction::make_move(Register source, Value source_value) {
+  kind = InstructionKind::Move;
+  imm = 0;
+  rs1 = source;
+  rs2 = Register::Zero;
+  rs1_value = source_value;
+  rs2_value = invalid_value;
+}
+
+void ir::Instruction::make_zero_extend(Register source, uint32_t bits) {
+  kind = InstructionKind::ZeroExtend;
+  imm = bits;
+  rs1 = source;
+  rs2 = Register::Zero;
+  rs1_value = invalid_value;
+  rs2_value = invalid_value;
+}
+
+void ir::Instruction::make_nop() {
+  kind = InstructionKind::Nop;
+  rd = Register::Zero;
+  rs1 = Register::Zero;
+  rs2 = Register::Zero;
+  rd_value = invalid_value;
+  rs1_value = invalid_value;
+  rs2_value = invalid_value;
+}
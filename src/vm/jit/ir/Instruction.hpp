@@ -0,0 +1,97 @@
+#pragma once
+#include <cstdint>
+#include <limits>
+
+#include <vm/Instruction.hpp>
+#include <vm/Memory.hpp>
+#include <vm/Register.hpp>
+
+namespace vm::jit::ir {
+
+// SSA value. Values [0, 32) are guest registers at the block entry and every instruction that
+// writes a guest register defines a new value.
+using Value = uint32_t;
+
+constexpr Value invalid_value = std::numeric_limits<Value>::max();
+constexpr Value entry_value_count = 32;
+
+enum class InstructionKind {
+  // Guest instruction, operands have the same meaning as in `vm::Instruction`.
+  Guest,
+
+  // rd = imm
+  Constant,
+
+  // rd = rs1
+  Move,
+
+  // rd = rs1 zero extended from `imm` bits (fused `slli` + `srli`).
+  ZeroExtend,
+
+  // Fused `slt`/`sltu` + `bnez`/`beqz`. rd = rs1 < rs2 (unsigned for `Bltu` and `Bgeu`) and then
+  // the instruction behaves like a conditional branch of `type` on rs1 and rs2.
+  SetAndBranch,
+
+  // Instruction removed by the optimization passes.
+  Nop,
+};
+
+enum class MemoryCheck {
+  // Memory access validates only its own address.
+  Access,
+
+  // Memory access validates the whole range accessed by the following `Covered` accesses.
+  Range,
+
+  // Memory access was already validated by a preceding `Range` access.
+  Covered,
+};
+
+struct Instruction {
+  InstructionKind kind{};
+  InstructionType type{};
+
+  uint64_t pc{};
+  // Size of the guest instruction in bytes (2 for compressed instructions).
+  uint32_t length{};
+
+  Register rd{};
+  Register rs1{};
+  Register rs2{};
+  int64_t imm{};
+
+  // Only used by conditional branches: block continues at the branch target and the side exit
+  // goes to the fallthrough instruction.
+  bool branch_taken{};
+
+  // Only used by memory accesses. `Range` checks use the other fields: start of the range
+  // relative to the accessed address, its size and permissions required for the whole range.
+  MemoryCheck memory_check{};
+  int64_t check_offset{};
+  uint32_t check_size{};
+  MemoryFlags check_flags{};
+
+  Value rd_value = invalid_value;
+  Value rs1_value = invalid_value;
+  Value rs2_value = invalid_value;
+
+  uint64_t next_pc() const { return pc + length; }
+
+  bool reads_rs1() const;
+  bool reads_rs2() const;
+  bool writes_rd() const;
+
+  // Instruction can leave the block (via a side exit, a fault or a VM exit) so all guest
+  // registers must hold their architectural values before it.
+  bool may_exit() const;
+
+  // Instruction can be removed if its result is unused.
+  bool is_pure() const;
+
+  void make_constant(uint64_t value);
+  void make_move(Register source, Value source_value);
+  void make_zero_extend(Register source, uint32_t bits);
+  void make_nop();
+};
+
+}  // namespace vm::jit::ir
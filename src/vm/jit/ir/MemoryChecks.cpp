@@ -0,0 +1,197 @@
+#include "MemoryChecks.hpp"
+
+#include <vm/jit/Utilities.hpp>
+
+#include <algorithm>
+#include <optional>
+#include <vector>
+
+using namespace vm;
+using namespace vm::jit;
+
+// Range which spans at most two permission pages can be validated with two page table lookups.
+constexpr uint64_t max_range_size = Memory::permission_page_size;
+
+namespace {
+
+// Value is `root + offset`. Zero register (value 0) is the root of all constants.
+struct AddressBase {
+  ir::Value root{};
+  uint64_t offset{};
+};
+
+struct Range {
+  size_t leader{};
+  ir::Value root{};
+  uint64_t leader_offset{};
+
+  // Relative to the leader address.
+  int64_t begin{};
+  int64_t end{};
+
+  MemoryFlags flags{};
+
+  size_t member_count{};
+};
+
+}  // namespace
+
+static AddressBase address_base(const ir::Instruction& instruction,
+                                const std::vector<AddressBase>& bases) {
+  switch (instruction.kind) {
+    case ir::InstructionKind::Constant:
+      return {0, uint64_t(instruction.imm)};
+
+    case ir::InstructionKind::Move:
+      return bases[instruction.rs1_value];
+
+    case ir::InstructionKind::Guest: {
+      if (instruction.type == InstructionType::Addi) {
+        const auto base = bases[instruction.rs1_value];
+        return {base.root, base.offset + uint64_t(instruction.imm)};
+      }
+      break;
+    }
+
+    default:
+      break;
+  }
+
+  return {instruction.rd_value, 0};
+}
+
+// Integer loads to the zero register are never generated so they don't validate anything.
+static bool is_checked_memory_access(const ir::Instruction& instruction) {
+  return instruction.kind == ir::InstructionKind::Guest &&
+         utils::is_memory_access(instruction.type) &&
+         (utils::is_memory_write(instruction.type) || instruction.type == InstructionType::Flw ||
+          instruction.type == InstructionType::Fld || instruction.rd != Register::Zero);
+}
+
+static bool try_extend_range(Range& range, uint64_t offset, uint64_t size_log2, bool write) {
+  const auto size = int64_t(1) << size_log2;
+  const auto distance = int64_t(offset - range.leader_offset);
+
+  if (distance < -int64_t(max_range_size) || distance > int64_t(max_range_size)) {
+    return false;
+  }
+
+  const auto begin = std::min(range.begin, distance);
+  const auto end = std::max(range.end, distance + size);
+  if (uint64_t(end - begin) > max_range_size) {
+    return false;
+  }
+
+  range.begin = begin;
+  range.end = end;
+  range.flags = range.flags | (write ? MemoryFlags::Write : MemoryFlags::Read);
+  range.member_count++;
+
+  return true;
+}
+
+// Returns the number of bytes every iteration adds to the value of `reg` if the block branches back
+// to its own start and the register changes by a constant amount.
+static std::optional<int64_t> loop_stride(const ir::Block& block,
+                                          const std::vector<AddressBase>& bases,
+                                          const ir::Value (&register_values)[32],
+                                          ir::Value reg) {
+  const auto& instructions = block.instructions;
+  if (instructions.empty() || block.end_fetch_fault || block.end_pc != instructions.front().pc) {
+    return std::nullopt;
+  }
+
+  const auto base = bases[register_values[reg]];
+  if (base.root != reg) {
+    return std::nullopt;
+  }
+
+  return int64_t(base.offset);
+}
+
+void ir::combine_memory_checks(Block& block) {
+  auto& instructions = block.instructions;
+
+  std::vector<AddressBase> bases(block.value_count);
+  for (Value i = 0; i < entry_value_count; ++i) {
+    bases[i] = {i, 0};
+  }
+
+  // Values of guest registers at the end of the block.
+  Value register_values[32]{};
+  for (Value i = 0; i < entry_value_count; ++i) {
+    register_values[i] = i;
+  }
+
+  std::vector<Range> ranges;
+
+  for (size_t i = 0; i < instructions.size(); ++i) {
+    auto& instruction = instructions[i];
+
+    if (instruction.writes_rd()) {
+      bases[instruction.rd_value] = address_base(instruction, bases);
+      register_values[size_t(instruction.rd)] = instruction.rd_value;
+    }
+
+    if (!is_checked_memory_access(instruction)) {
+      continue;
+    }
+
+    instruction.memory_check = MemoryCheck::Access;
+
+    const auto base = bases[instruction.rs1_value];
+    const auto offset = base.offset + uint64_t(instruction.imm);
+    const auto size_log2 = utils::memory_access_size_log2(instruction.type);
+    const auto write = utils::is_memory_write(instruction.type);
+
+    const auto range = std::find_if(ranges.begin(), ranges.end(),
+                                    [&](const Range& range) { return range.root == base.root; });
+    if (range != ranges.end()) {
+      if (try_extend_range(*range, offset, size_log2, write)) {
+        instruction.memory_check = MemoryCheck::Covered;
+      }
+      continue;
+    }
+
+    ranges.push_back(Range{
+      .leader = i,
+      .root = base.root,
+      .leader_offset = offset,
+      .begin = 0,
+      .end = int64_t(1) << size_log2,
+      .flags = write ? MemoryFlags::Write : MemoryFlags::Read,
+      .member_count = 1,
+    });
+  }
+
+  for (const auto& range : ranges) {
+    // Range based on a register which every iteration moves by less than a permission page is
+    // validated once before the loop. Backends don't validate it again while the next iteration
+    // accesses the same pages.
+    if (range.root < entry_value_count) {
+      const auto stride = loop_stride(block, bases, register_values, range.root);
+      if (stride && *stride > -int64_t(max_range_size) && *stride < int64_t(max_range_size)) {
+        block.loop_guards.push_back(LoopGuard{
+          .base = Register(range.root),
+          .offset = int64_t(range.leader_offset) + range.begin,
+          .size = uint32_t(range.end - range.begin),
+          .flags = range.flags,
+          .stride = *stride,
+        });
+
+        instructions[range.leader].memory_check = MemoryCheck::Covered;
+        continue;
+      }
+    }
+
+    if (range.member_count < 2) {
+      continue;
+    }
+
+    auto& leader = instructions[range.leader];
+    leader.memory_check = MemoryCheck::Range;
+    leader.check_offset = range.begin;
+    leader.check_size = uint32_t(range.end - range.begin);
+    leader.check_flags = range.flags;
+  }
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include "Block.hpp"
+
+namespace vm::jit::ir {
+
+// Groups memory accesses whose addresses are constant offsets from the same value (e.g.
+// `ld a0, 0(sp)`, `ld a1, 8(sp)`, `sd a2, 16(sp)`) so only the first access of every group
+// validates the whole accessed range and the others aren't checked at all.
+//
+// Range check is stricter than the checks of individual accesses. Backends exit with a memory
+// fault if it fails so the first access is retried by the interpreter which validates it
+// precisely.
+//
+// If the block branches back to its own start, ranges based on registers which every iteration
+// moves by a constant (or keeps unchanged) become loop guards checked at the block entry. Backends
+// skip them on the back-edge while the next iteration stays in the already validated pages.
+void combine_memory_checks(Block& block);
+
+}  // namespace vm::jit::ir
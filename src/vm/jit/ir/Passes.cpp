@@ -0,0 +1,376 @@
+#include "Passes.hpp"
+
+#include <vm/private/Arithmetic.hpp>
+
+#include <bitset>
+#include <optional>
+#include <vector>
+
+using namespace vm;
+using namespace vm::jit;
+
+using IT = InstructionType;
+
+static uint64_t sign_extend_32(uint64_t value) {
+  return uint64_t(int64_t(int32_t(value)));
+}
+
+// Returns nothing if the instruction cannot be evaluated at compile time.
+static std::optional<uint64_t> evaluate(const ir::Instruction& instruction,
+                                        uint64_t a,
+                                        uint64_t b) {
+  const auto imm = uint64_t(instruction.imm);
+  const auto shamt = uint32_t(instruction.imm);
+
+  switch (instruction.type) {
+      // clang-format off
+    case IT::Lui:   return imm;
+    case IT::Auipc: return instruction.pc + imm;
+
+    case IT::Addi:  return a + imm;
+    case IT::Xori:  return a ^ imm;
+    case IT::Ori:   return a | imm;
+    case IT::Andi:  return a & imm;
+    case IT::Addiw: return sign_extend_32(a + imm);
+    case IT::Slli:  return a << shamt;
+    case IT::Srli:  return a >> shamt;
+    case IT::Srai:  return uint64_t(int64_t(a) >> shamt);
+    case IT::Slliw: return sign_extend_32(uint32_t(a) << shamt);
+    case IT::Srliw: return sign_extend_32(uint32_t(a) >> shamt);
+    case IT::Sraiw: return sign_extend_32(uint32_t(int32_t(a) >> shamt));
+    case IT::Slti:  return int64_t(a) < int64_t(imm);
+    case IT::Sltiu: return a < imm;
+
+    case IT::Slt:  return int64_t(a) < int64_t(b);
+    case IT::Sltu: return a < b;
+    case IT::Add:  return a + b;
+    case IT::Sub:  return a - b;
+    case IT::Xor:  return a ^ b;
+    case IT::Or:   return a | b;
+    case IT::And:  return a & b;
+    case IT::Sll:  return a << (b & 63);
+    case IT::Srl:  return a >> (b & 63);
+    case IT::Sra:  return uint64_t(int64_t(a) >> (b & 63));
+    case IT::Addw: return sign_extend_32(uint32_t(a) + uint32_t(b));
+    case IT::Subw: return sign_extend_32(uint32_t(a) - uint32_t(b));
+    case IT::Sllw: return sign_extend_32(uint32_t(a) << (b & 31));
+    case IT::Srlw: return sign_extend_32(uint32_t(a) >> (b & 31));
+    case IT::Sraw: return sign_extend_32(uint32_t(int32_t(a) >> (b & 31)));
+    case IT::Mul:    return a * b;
+    case IT::Mulw:   return sign_extend_32(uint32_t(a) * uint32_t(b));
+    case IT::Mulh:   return Arithmetic::mulh(a, b);
+    case IT::Mulhu:  return Arithmetic::mulhu(a, b);
+    case IT::Mulhsu: return Arithmetic::mulhsu(a, b);
+    case IT::Div:    return Arithmetic::div(a, b);
+    case IT::Divu:   return Arithmetic::divu(a, b);
+    case IT::Divw:   return Arithmetic::divw(a, b);
+    case IT::Divuw:  return Arithmetic::divuw(a, b);
+    case IT::Rem:    return Arithmetic::rem(a, b);
+    case IT::Remu:   return Arithmetic::remu(a, b);
+    case IT::Remw:   return Arithmetic::remw(a, b);
+    case IT::Remuw:  return Arithmetic::remuw(a, b);
+      // clang-format on
+
+    default:
+      if (Arithmetic::is_bit_manipulation(instruction.type)) {
+        return Arithmetic::bit_manipulation(
+          instruction.type, a, Arithmetic::reads_second_register(instruction.type) ? b : imm);
+      }
+      return std::nullopt;
+  }
+}
+
+// Returns nothing if the instruction is not a conditional branch.
+static std::optional<bool> evaluate_branch(InstructionType type, uint64_t a, uint64_t b) {
+  switch (type) {
+      // clang-format off
+    case IT::Beq:  return a == b;
+    case IT::Bne:  return a != b;
+    case IT::Blt:  return int64_t(a) < int64_t(b);
+    case IT::Bge:  return int64_t(a) >= int64_t(b);
+    case IT::Bltu: return a < b;
+    case IT::Bgeu: return a >= b;
+      // clang-format on
+
+    default:
+      return std::nullopt;
+  }
+}
+
+static uint64_t zero_extend(uint64_t value, uint32_t bits) {
+  return bits >= 64 ? value : value & ((uint64_t(1) << bits) - 1);
+}
+
+// Instructions which compute an address as rs1 + imm.
+static bool has_address_operand(InstructionType type) {
+  switch (type) {
+    case IT::Jalr:
+    case IT::Lb:
+    case IT::Lh:
+    case IT::Lw:
+    case IT::Ld:
+    case IT::Lbu:
+    case IT::Lhu:
+    case IT::Lwu:
+    case IT::Sb:
+    case IT::Sh:
+    case IT::Sw:
+    case IT::Sd:
+    case IT::Flw:
+    case IT::Fsw:
+    case IT::Fld:
+    case IT::Fsd:
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+static bool produces_sign_extended_value(InstructionType type) {
+  switch (type) {
+    case IT::Lui:
+    case IT::Lb:
+    case IT::Lh:
+    case IT::Lw:
+    case IT::Lbu:
+    case IT::Lhu:
+    case IT::Slt:
+    case IT::Sltu:
+    case IT::Slti:
+    case IT::Sltiu:
+    case IT::Addiw:
+    case IT::Slliw:
+    case IT::Srliw:
+    case IT::Sraiw:
+    case IT::Addw:
+    case IT::Subw:
+    case IT::Sllw:
+    case IT::Srlw:
+    case IT::Sraw:
+    case IT::Mulw:
+    case IT::Divw:
+    case IT::Divuw:
+    case IT::Remw:
+    case IT::Remuw:
+    case IT::Rolw:
+    case IT::Rorw:
+    case IT::Roriw:
+    case IT::Bext:
+    case IT::Bexti:
+    case IT::Clz:
+    case IT::Clzw:
+    case IT::Ctz:
+    case IT::Ctzw:
+    case IT::Cpop:
+    case IT::Cpopw:
+    case IT::SextB:
+    case IT::SextH:
+    case IT::ZextH:
+    case IT::LrW:
+    case IT::ScW:
+    case IT::ScD:
+    case IT::AmoswapW:
+    case IT::AmoaddW:
+    case IT::AmoxorW:
+    case IT::AmoandW:
+    case IT::AmoorW:
+    case IT::AmominW:
+    case IT::AmomaxW:
+    case IT::AmominuW:
+    case IT::AmomaxuW:
+    case IT::FcvtWS:
+    case IT::FcvtWuS:
+    case IT::FmvXW:
+    case IT::FeqS:
+    case IT::FltS:
+    case IT::FleS:
+    case IT::FclassS:
+    case IT::FcvtWD:
+    case IT::FcvtWuD:
+    case IT::FeqD:
+    case IT::FltD:
+    case IT::FleD:
+    case IT::FclassD:
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+void ir::propagate_constants(Block& block) {
+  std::vector<std::optional<uint64_t>> constants(block.value_count);
+  constants[size_t(Register::Zero)] = 0;
+
+  for (auto& instruction : block.instructions) {
+    const auto a =
+      instruction.reads_rs1() ? constants[instruction.rs1_value] : std::optional<uint64_t>{0};
+    const auto b =
+      instruction.reads_rs2() ? constants[instruction.rs2_value] : std::optional<uint64_t>{0};
+
+    if (a && b) {
+      if (instruction.kind == InstructionKind::Move) {
+        instruction.make_constant(*a);
+      } else if (instruction.kind == InstructionKind::ZeroExtend) {
+        instruction.make_constant(zero_extend(*a, uint32_t(instruction.imm)));
+      } else if (instruction.kind == InstructionKind::Guest) {
+        if (instruction.is_pure()) {
+          if (const auto result = evaluate(instruction, *a, *b)) {
+            instruction.make_constant(*result);
+          }
+        } else if (const auto taken = evaluate_branch(instruction.type, *a, *b)) {
+          // Side exit of this branch is never taken.
+          if (*taken == instruction.branch_taken) {
+            instruction.make_nop();
+          }
+        }
+      }
+    }
+
+    // Use absolute address so the base register doesn't need to be loaded.
+    if (a && instruction.kind == InstructionKind::Guest && instruction.rs1 != Register::Zero &&
+        has_address_operand(instruction.type)) {
+      instruction.rs1 = Register::Zero;
+      instruction.rs1_value = size_t(Register::Zero);
+      instruction.imm = int64_t(*a + uint64_t(instruction.imm));
+    }
+
+    if (instruction.kind == InstructionKind::Constant && instruction.writes_rd()) {
+      constants[instruction.rd_value] = uint64_t(instruction.imm);
+    }
+  }
+}
+
+void ir::eliminate_sign_extensions(Block& block) {
+  std::vector<bool> sign_extended(block.value_count);
+  sign_extended[size_t(Register::Zero)] = true;
+
+  for (auto& instruction : block.instructions) {
+    // `sext.w` pseudoinstruction.
+    if (instruction.kind == InstructionKind::Guest && instruction.type == IT::Addiw &&
+        instruction.imm == 0 && sign_extended[instruction.rs1_value]) {
+      instruction.make_move(instruction.rs1, instruction.rs1_value);
+    }
+
+    if (!instruction.writes_rd()) {
+      continue;
+    }
+
+    bool result = false;
+
+    switch (instruction.kind) {
+      case InstructionKind::Guest:
+        result = produces_sign_extended_value(instruction.type);
+        break;
+      case InstructionKind::Constant:
+        result = uint64_t(instruction.imm) == sign_extend_32(instruction.imm);
+        break;
+      case InstructionKind::Move:
+        result = sign_extended[instruction.rs1_value];
+        break;
+      case InstructionKind::ZeroExtend:
+        result = instruction.imm < 32;
+        break;
+      case InstructionKind::SetAndBranch:
+        result = true;
+        break;
+      default:
+        break;
+    }
+
+    sign_extended[instruction.rd_value] = result;
+  }
+}
+
+void ir::propagate_copies(Block& block) {
+  // Register which was written when the value was defined.
+  std::vector<Register> value_registers(block.value_count);
+  // Value which was copied to create the value (if any).
+  std::vector<Value> original_values(block.value_count, invalid_value);
+
+  Value register_values[32]{};
+  for (Value i = 0; i < entry_value_count; ++i) {
+    value_registers[i] = Register(i);
+    register_values[i] = i;
+  }
+
+  const auto propagate = [&](Register& reg, Value& value) {
+    const auto original = original_values[value];
+    if (original != invalid_value &&
+        register_values[size_t(value_registers[original])] == original) {
+      reg = value_registers[original];
+      value = original;
+    }
+  };
+
+  for (auto& instruction : block.instructions) {
+    if (instruction.reads_rs1()) {
+      propagate(instruction.rs1, instruction.rs1_value);
+    }
+    if (instruction.reads_rs2()) {
+      propagate(instruction.rs2, instruction.rs2_value);
+    }
+
+    if (!instruction.writes_rd()) {
+      continue;
+    }
+
+    if (instruction.kind == InstructionKind::Move) {
+      original_values[instruction.rd_value] = instruction.rs1_value;
+
+      // Register already holds the copied value.
+      if (instruction.rs1 == instruction.rd) {
+        instruction.make_nop();
+        continue;
+      }
+    }
+
+    value_registers[instruction.rd_value] = instruction.rd;
+    register_values[size_t(instruction.rd)] = instruction.rd_value;
+  }
+}
+
+void ir::eliminate_dead_writes(Block& block) {
+  // Registers whose current values can be read later. All registers are observable at the end
+  // of the block.
+  std::bitset<32> live;
+  live.set();
+
+  for (auto it = block.instructions.rbegin(); it != block.instructions.rend(); ++it) {
+    auto& instruction = *it;
+
+    if (instruction.writes_rd()) {
+      const auto rd = size_t(instruction.rd);
+      if (!live[rd] && instruction.is_pure()) {
+        instruction.make_nop();
+        continue;
+      }
+
+      live[rd] = false;
+    }
+
+    if (instruction.may_exit()) {
+      live.set();
+    }
+
+    if (instruction.reads_rs1()) {
+      live[size_t(instruction.rs1)] = true;
+    }
+    if (instruction.reads_rs2()) {
+      live[size_t(instruction.rs2)] = true;
+    }
+  }
+}
+
+void ir::optimize(Block& block) {
+  propagate_constants(block);
+  eliminate_sign_extensions(block);
+  propagate_copies(block);
+
+  // Copy propagation can remove definitions of values which are still referenced.
+  number_values(block);
+
+  eliminate_dead_writes(block);
+  number_values(block);
+}
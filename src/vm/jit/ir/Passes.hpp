@@ -0,0 +1,24 @@
+#pragma once
+#include "Block.hpp"
+
+namespace vm::jit::ir {
+
+// Replaces instructions with constant operands by constants (e.g. `lui` + `addi` or
+// `auipc` + `addi` sequences) and removes branches which always follow the block. Memory
+// accesses and indirect jumps with constant base register use absolute addresses.
+void propagate_constants(Block& block);
+
+// Replaces `sext.w` of values which are already sign extended from 32 bits with moves.
+void eliminate_sign_extensions(Block& block);
+
+// Makes instructions read the original register instead of its copy when possible.
+void propagate_copies(Block& block);
+
+// Removes pure instructions whose results are overwritten before being read or observed
+// at any block exit.
+void eliminate_dead_writes(Block& block);
+
+// Runs all passes above.
+void optimize(Block& block);
+
+}  // namespace vm::jit::ir
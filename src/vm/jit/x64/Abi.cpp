@@ -16,6 +16,8 @@ Abi Abi::windows() {
         X64R::R15,
       },
     .argument_reg = X64R::Rcx,
+    .call_argument_regs = {X64R::Rcx, X64R::Rdx, X64R::R8, X64R::R9},
+    .shadow_space_size = 32,
   };
 }
 
@@ -31,5 +33,6 @@ Abi Abi::systemv() {
         X64R::R15,
       },
     .argument_reg = X64R::Rdi,
+    .call_argument_regs = {X64R::Rdi, X64R::Rsi, X64R::Rdx, X64R::Rcx, X64R::R8, X64R::R9},
   };
 }
\ No newline at end of file
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <vector>
 
 #include "Registers.hpp"
@@ -9,6 +10,10 @@ struct Abi {
   std::vector<X64R> callee_saved_regs{};
   X64R argument_reg{};
 
+  // Used by the generated code to call host functions.
+  std::vector<X64R> call_argument_regs{};
+  int64_t shadow_space_size{};
+
   static Abi windows();
   static Abi systemv();
 };
@@ -1,13 +1,26 @@
 #include "CodeGenerator.hpp"
 #include "Exit.hpp"
+#include "RegisterCache.hpp"
 #include "Registers.hpp"
 
 #include <vm/Instruction.hpp>
+#include <vm/RegisterState.hpp>
+#include <vm/jit/Trace.hpp>
+#include <vm/jit/ir/Block.hpp>
+#include <vm/jit/ir/Fusion.hpp>
+#include <vm/jit/ir/MemoryChecks.hpp>
+#include <vm/jit/ir/Passes.hpp>
 #include <vm/jit/Utilities.hpp>
+#include <vm/private/Arithmetic.hpp>
+#include <vm/private/FloatArithmetic.hpp>
+#include <vm/private/VectorArithmetic.hpp>
 
 #include <base/Error.hpp>
+#include <base/containers/StaticVector.hpp>
 
+#include <algorithm>
 #include <limits>
+#include <optional>
 
 using namespace vm;
 using namespace vm::jit::x64;
@@ -16,6 +29,17 @@ using namespace asmlib;
 
 using CodeBufferFlags = jit::CodeBuffer::Flags;
 
+constexpr uint64_t table_entry_granularity = jit::CodeBuffer::table_entry_granularity;
+constexpr uint32_t halfword_block_tag = jit::CodeBuffer::halfword_block_tag;
+constexpr uint64_t table_leaf_shift = jit::CodeBuffer::table_leaf_shift;
+constexpr uint64_t table_leaf_size = jit::CodeBuffer::table_leaf_size;
+
+constexpr size_t max_return_stack_depth = 1024;
+
+// Memory access bits of the predecessor and successor sets of `fence`.
+constexpr uint64_t fence_reads = 0b0010;
+constexpr uint64_t fence_writes = 0b0001;
+
 constexpr x64::OperandSize access_size_log2_to_operand_size[]{
   x64::OperandSize::Bits8,
   x64::OperandSize::Bits16,
@@ -32,312 +56,2146 @@ struct CodeGenerator {
   x64::Assembler& as;
   const Memory& memory;
   const jit::CodeBuffer& code_buffer;
+  const Abi& abi;
+  const HostFeatures& host_features;
 
   bool single_step{};
+  uint64_t* hot_counter{};
 
   std::vector<CodegenContext::Exit>& pending_exits;
+  std::vector<CodegenContext::Branch>& pending_branches;
+  std::vector<jit::CodeBuffer::LinkSite>& link_sites;
+  std::vector<jit::CodeBuffer::InlineCache>& inline_caches;
+  std::vector<jit::CodeBuffer::FaultSite>& fault_sites;
+  std::vector<jit::CodeBuffer::Relocation>& relocations;
 
   uint64_t current_pc{};
+  uint64_t next_pc{};
+
+  // Vector configuration set by `vsetvli` or `vsetivli` earlier in the block. Only `vsetvl`
+  // changes `vtype` afterwards and fault-only-first loads can shorten `vl`.
+  struct VectorConfiguration {
+    uint32_t sew_log2{};
+    uint64_t vlmax{};
+
+    // `vl` is known to be VLMAX.
+    bool full_length = false;
+  };
+  std::optional<VectorConfiguration> vector_configuration{};
+
+  RegisterCache register_cache{as};
+
+  static bool is_zero_register(X64R reg) { return reg == RegisterCache::zero_register; }
+
+  // Returns operand that can be used as a source. Zero register is represented as immediate 0.
+  static x64::Operand source_operand(X64R reg) {
+    return is_zero_register(reg) ? x64::Operand{0} : x64::Operand{reg};
+  }
+
+  // Returns register that can be used as a source. Zero register is materialized in `scratch`.
+  X64R materialize_register(X64R reg, X64R scratch) {
+    if (!is_zero_register(reg)) {
+      return reg;
+    }
+
+    as.xor_(scratch, scratch);
+    return scratch;
+  }
+
+  void load_immediate(X64R target, int64_t immediate) { as.mov(target, immediate); }
+  void load_immediate_u(X64R target, uint64_t immediate) {
+    return load_immediate(target, int64_t(immediate));
+  }
 
-  static x64::Operand register_operand(Register reg) {
-    verify(reg != Register::Zero, "cannot get operand for zero register");
-    verify(reg != Register::Pc, "cannot get operand for PC register");
-    return x64::Memory::base_disp(RegisterAllocation::register_state, int32_t(reg) * 8);
+  // Code buffer writes the value when inserting the block.
+  void load_relocated_value(X64R target,
+                            jit::CodeBuffer::Relocation::Target relocation_target,
+                            uint64_t value) {
+    // Placeholder doesn't fit in 32 bits so the immediate is always encoded with 64 bits.
+    as.mov(target, std::numeric_limits<int64_t>::max());
+
+    relocations.push_back({
+      .offset = uint32_t(as.assembled_instructions().size() - sizeof(uint64_t)),
+      .target = relocation_target,
+      .value = value,
+    });
+  }
+
+  void load_offseted_register(X64R target, X64R value_reg, int64_t offset) {
+    if (is_zero_register(value_reg)) {
+      load_immediate(target, offset);
+    } else {
+      as.mov(target, value_reg);
+      if (offset != 0) {
+        as.add(target, offset);
+      }
+    }
   }
 
-  static x64::Operand register_operand_or_zero(Register reg) {
-    return reg == Register::Zero ? x64::Operand{0} : register_operand(reg);
+  void generate_return_to_trampoline() {
+    // Drop all return address stack entries.
+    as.mov(X64R::Rsp, RegisterAllocation::stack_base);
+    as.ret();
   }
 
   void generate_exit(ArchExitReason reason) { generate_exit(reason, current_pc); }
-  void generate_exit(ArchExitReason reason, uint64_t pc) {
+  void generate_exit(ArchExitReason reason, uint64_t pc, bool flush_registers = true) {
+    if (flush_registers) {
+      register_cache.flush_current_registers();
+    }
     as.mov(RegisterAllocation::exit_pc, int64_t(pc));
     as.mov(RegisterAllocation::exit_reason, int64_t(reason));
-    as.ret();
+    generate_return_to_trampoline();
   }
   void generate_exit(ArchExitReason reason, X64R pc) {
+    register_cache.flush_current_registers();
     as.mov(RegisterAllocation::exit_pc, pc);
     as.mov(RegisterAllocation::exit_reason, int64_t(reason));
-    as.ret();
+    generate_return_to_trampoline();
   }
 
-  void add_pending_exit(x64::Label label, ArchExitReason reason, uint64_t pc) {
+  void add_pending_exit(x64::Label label,
+                        ArchExitReason reason,
+                        bool flush_registers,
+                        uint64_t pc) {
     pending_exits.push_back({
       .label = label,
       .reason = reason,
       .pc_value = pc,
+      .snapshot =
+        flush_registers ? register_cache.take_state_snapshot() : RegisterCache::StateSnapshot{},
     });
   }
-  void add_pending_exit(x64::Label label, ArchExitReason reason, X64R pc) {
+  void add_pending_exit(x64::Label label, ArchExitReason reason, bool flush_registers, X64R pc) {
     pending_exits.push_back({
       .label = label,
       .reason = reason,
       .pc_register = pc,
+      .snapshot =
+        flush_registers ? register_cache.take_state_snapshot() : RegisterCache::StateSnapshot{},
     });
   }
+  void add_pending_branch(x64::Label label, uint64_t target_pc) {
+    pending_branches.push_back({
+      .label = label,
+      .target_pc = target_pc,
+      .snapshot = register_cache.take_state_snapshot(),
+    });
+  }
+  void generate_pending_branches() {
+    for (const auto& pending_branch : pending_branches) {
+      as.insert_label(pending_branch.label);
+
+      register_cache.flush_registers(pending_branch.snapshot);
+      generate_static_branch(pending_branch.target_pc, RegisterAllocation::a_reg, false);
+    }
+  }
+
   void generate_pending_exits() {
     for (const auto& pending_exit : pending_exits) {
       as.insert_label(pending_exit.label);
 
+      if (pending_exit.faulting_access_offset) {
+        fault_sites.push_back({
+          .access_offset = *pending_exit.faulting_access_offset,
+          .exit_offset = uint32_t(as.assembled_instructions().size()),
+        });
+      }
+
+      register_cache.flush_registers(pending_exit.snapshot);
+
       if (pending_exit.pc_register != X64R::Rsp) {
-        generate_exit(pending_exit.reason, pending_exit.pc_register);
+        as.mov(RegisterAllocation::exit_pc, pending_exit.pc_register);
       } else {
-        generate_exit(pending_exit.reason, pending_exit.pc_value);
+        as.mov(RegisterAllocation::exit_pc, int64_t(pending_exit.pc_value));
       }
+
+      as.mov(RegisterAllocation::exit_reason, int64_t(pending_exit.reason));
+      generate_return_to_trampoline();
     }
   }
 
-  void load_register(X64R target, Register reg, int64_t offset = 0) {
-    if (reg == Register::Zero) {
-      as.mov(target, offset);
+  void add_faulting_access_exit(x64::Label fault_label, ArchExitReason fault_reason) {
+    add_pending_exit(fault_label, fault_reason, true, current_pc);
+
+    // Caller emits the memory access right after the validation.
+    pending_exits.back().faulting_access_offset = uint32_t(as.assembled_instructions().size());
+  }
+
+  bool should_check_permissions() const {
+    return (code_buffer.flags() & CodeBufferFlags::SkipPermissionChecks) == CodeBufferFlags::None;
+  }
+
+  bool is_multithreaded() const {
+    return (code_buffer.flags() & CodeBufferFlags::Multithreaded) != CodeBufferFlags::None;
+  }
+
+  void generate_page_permissions_check(X64R address,
+                                       X64R scratch,
+                                       MemoryFlags required_flags,
+                                       x64::Label fault_label) {
+    as.mov(scratch, address);
+    as.shr(scratch, int64_t(vm::Memory::permission_page_shift));
+    as.movzxb(scratch, x64::Memory::base_index(RegisterAllocation::permissions_base, scratch, 1));
+
+    if (required_flags == MemoryFlags::Read || required_flags == MemoryFlags::Write) {
+      as.test(scratch, int64_t(required_flags));
+      as.jz(fault_label);
     } else {
-      as.mov(target, register_operand(reg));
-      if (offset != 0) {
-        as.add(target, offset);
+      as.and_(scratch, int64_t(required_flags));
+      as.cmp(scratch, int64_t(required_flags));
+      as.jne(fault_label);
+    }
+  }
+
+  static ArchExitReason memory_fault_reason(MemoryFlags required_flags) {
+    return (required_flags & MemoryFlags::Write) != MemoryFlags::None
+             ? ArchExitReason::MemoryWriteFault
+             : ArchExitReason::MemoryReadFault;
+  }
+
+  void generate_validate_memory_access(X64R address,
+                                       X64R scratch1,
+                                       X64R scratch2,
+                                       uint64_t access_size_log2,
+                                       MemoryFlags required_flags) {
+    const auto fault_label = as.allocate_label();
+    const auto fault_reason = memory_fault_reason(required_flags);
+
+    if (memory.uses_guard_pages()) {
+      // Permissions are enforced by page protection and accesses crossing the end of the memory
+      // hit the guard region so we only need to check the start of the access.
+      as.cmp(address, int64_t(memory.size()));
+      as.jae(fault_label);
+
+      add_faulting_access_exit(fault_label, fault_reason);
+      return;
+    }
+
+    const auto access_size = int64_t(1) << access_size_log2;
+
+    // Check if address + access_size > memory_size. Accesses don't need to be aligned.
+    as.cmp(address, int64_t(memory.size()) - access_size);
+    as.ja(fault_label);
+
+    if (should_check_permissions()) {
+      if (!memory.uses_byte_permissions()) {
+        // Misaligned accesses which cross permission page boundary are rare so we let the
+        // interpreter handle them and check only one page entry.
+        if (access_size > 1) {
+          as.mov(scratch1, address);
+          as.and_(scratch1, int64_t(vm::Memory::permission_page_size - 1));
+          as.cmp(scratch1, int64_t(vm::Memory::permission_page_size) - access_size);
+          as.ja(fault_label);
+        }
+
+        generate_page_permissions_check(address, scratch1, required_flags, fault_label);
+      } else {
+        const auto operand_size = access_size_log2_to_operand_size[access_size_log2];
+
+        const auto perms_reg = scratch1;
+        const auto mask_reg = scratch2;
+
+        as.with_operand_size(operand_size, [&] {
+          as.mov(perms_reg,
+                 x64::Memory::base_index(RegisterAllocation::permissions_base, address, 1));
+        });
+
+        {
+          uint64_t mask = 0;
+          for (size_t i = 0; i < (1 << access_size_log2); ++i) {
+            mask |= uint64_t(required_flags) << (i * 8);
+          }
+          as.mov(mask_reg, int64_t(mask));
+        }
+
+        as.and_(perms_reg, mask_reg);
+        as.cmp(perms_reg, mask_reg);
+        as.jne(fault_label);
       }
     }
+
+    add_pending_exit(fault_label, fault_reason, true, current_pc);
   }
 
-  void store_register(Register target, X64R reg, bool sign_extend = false) {
-    if (sign_extend) {
-      as.movsxd(reg, reg);
+  // Checks that `size` bytes at `range_begin` are in bounds and, unless page protection enforces
+  // them, have `required_flags` permissions. Clobbers `range_begin`.
+  void generate_range_check(X64R range_begin,
+                            X64R scratch,
+                            uint32_t size,
+                            MemoryFlags required_flags,
+                            x64::Label fault_label) {
+    // Range start can be below the accessed address so it can wrap around. Then it's bigger than
+    // the limit and the check fails.
+    as.cmp(range_begin, int64_t(memory.size() - size));
+    as.ja(fault_label);
+
+    if (!memory.uses_guard_pages() && should_check_permissions()) {
+      // Range is at most one permission page long so it spans at most two pages.
+      generate_page_permissions_check(range_begin, scratch, required_flags, fault_label);
+      as.add(range_begin, int64_t(size - 1));
+      generate_page_permissions_check(range_begin, scratch, required_flags, fault_label);
     }
-    as.mov(register_operand(target), reg);
   }
 
-  void store_imm_to_register(Register reg, X64R scratch, int64_t imm) {
-    if (reg == Register::Zero) {
-      return;
+  // Validates the whole range accessed by the memory accesses covered by `instruction`.
+  void generate_validate_memory_range(const jit::ir::Instruction& instruction,
+                                      X64R address,
+                                      X64R scratch1,
+                                      X64R scratch2) {
+    const auto fault_label = as.allocate_label();
+    const auto fault_reason = jit::utils::is_memory_write(instruction.type)
+                                ? ArchExitReason::MemoryWriteFault
+                                : ArchExitReason::MemoryReadFault;
+
+    const auto range_begin = scratch1;
+    load_offseted_register(range_begin, address, instruction.check_offset);
+
+    generate_range_check(range_begin, scratch2, instruction.check_size, instruction.check_flags,
+                         fault_label);
+
+    if (memory.uses_guard_pages()) {
+      add_faulting_access_exit(fault_label, fault_reason);
+    } else {
+      add_pending_exit(fault_label, fault_reason, true, current_pc);
     }
+  }
 
-    using I32Limits = std::numeric_limits<int32_t>;
+  // Loads the start of the loop guard range for the current value of its base register. Registers
+  // are read from the register state so the code doesn't depend on the register cache.
+  void load_loop_guard_begin(X64R target, X64R scratch, const jit::ir::LoopGuard& guard) {
+    if (guard.base == Register::Zero) {
+      load_immediate(target, guard.offset);
+      return;
+    }
 
-    if (imm >= I32Limits::min() && imm <= I32Limits::max()) {
-      as.mov(register_operand(reg), imm);
+    as.mov(target, x64::Memory::base_disp(RegisterAllocation::register_state,
+                                          int32_t(size_t(guard.base) * sizeof(uint64_t))));
+    if (guard.offset >= std::numeric_limits<int32_t>::min() &&
+        guard.offset <= std::numeric_limits<int32_t>::max()) {
+      if (guard.offset != 0) {
+        as.add(target, guard.offset);
+      }
     } else {
-      as.mov(scratch, imm);
-      as.mov(register_operand(reg), scratch);
+      load_immediate(scratch, guard.offset);
+      as.add(target, scratch);
     }
   }
-  void store_uimm_to_register(Register reg, X64R scratch, uint64_t imm) {
-    store_imm_to_register(reg, scratch, int64_t(imm));
+
+  // Validates loop guard ranges before the first instruction of the block. If a check fails we
+  // exit with a memory fault at the block start so the interpreter executes the first instruction.
+  void generate_loop_guards(const jit::ir::Block& block) {
+    const auto a = RegisterAllocation::a_reg;
+    const auto b = RegisterAllocation::b_reg;
+    const auto c = RegisterAllocation::c_reg;
+
+    for (const auto& guard : block.loop_guards) {
+      const auto fault_label = as.allocate_label();
+
+      load_loop_guard_begin(a, c, guard);
+      generate_range_check(a, b, guard.size, guard.flags, fault_label);
+
+      add_pending_exit(fault_label, memory_fault_reason(guard.flags), false, current_pc);
+    }
   }
 
-  void generate_validate_memory_access(X64R address,
-                                       X64R scratch1,
-                                       X64R scratch2,
-                                       uint64_t access_size_log2,
-                                       bool write) {
-    const auto fault_label = as.allocate_label();
+  // Other harts can change permissions while the loop runs so multithreaded code validates the
+  // loop guards in every iteration (unless page protection enforces the permissions).
+  bool can_skip_loop_guards() const {
+    return !single_step &&
+           (!is_multithreaded() || memory.uses_guard_pages() || !should_check_permissions());
+  }
 
-    // Make sure that address is aligned otherwise the bound check later won't be accurate.
-    if (access_size_log2 > 0) {
-      as.test(address, (1 << access_size_log2) - 1);
-      as.jnz(fault_label);
+  // Branches back to `loop_label` past the loop guards if the next iteration accesses only pages
+  // which were already validated. Otherwise the block is entered again from its start. Registers
+  // must be already flushed.
+  void generate_loop_back_edge(const jit::ir::Block& block, x64::Label loop_label) {
+    const auto a = RegisterAllocation::a_reg;
+    const auto b = RegisterAllocation::b_reg;
+    const auto c = RegisterAllocation::c_reg;
+
+    const auto moves =
+      std::any_of(block.loop_guards.begin(), block.loop_guards.end(),
+                  [](const jit::ir::LoopGuard& guard) { return guard.stride != 0; });
+    std::optional<x64::Label> guard_label;
+    if (moves) {
+      guard_label = as.allocate_label();
     }
 
-    // Check if address >= memory_size. We don't need to account for the access size because we
-    // have already checked for alignment.
-    as.cmp(address, int64_t(memory.size()));
-    as.jae(fault_label);
+    for (const auto& guard : block.loop_guards) {
+      // Range which doesn't move stays validated.
+      if (guard.stride == 0) {
+        continue;
+      }
+
+      load_loop_guard_begin(a, c, guard);
+      as.cmp(a, int64_t(memory.size() - guard.size));
+      as.ja(*guard_label);
 
-    if ((code_buffer.flags() & CodeBufferFlags::SkipPermissionChecks) == CodeBufferFlags::None) {
-      const auto operand_size = access_size_log2_to_operand_size[access_size_log2];
+      if (!memory.uses_guard_pages() && should_check_permissions()) {
+        // Range that moves up stays in the validated pages if its last byte stays in the same page.
+        // Range that moves down stays there if its first byte does.
+        if (guard.stride > 0) {
+          as.add(a, int64_t(guard.size - 1));
+        }
+        as.mov(b, a);
+        as.sub(b, guard.stride);
+        as.xor_(b, a);
+        as.shr(b, int64_t(vm::Memory::permission_page_shift));
+        as.jnz(*guard_label);
+      }
+    }
 
-      const auto perms_reg = scratch1;
-      const auto mask_reg = scratch2;
+    // Hot counter of the block start is skipped too.
+    if (hot_counter) {
+      generate_hot_counter_update();
+    }
+    as.jmp(loop_label);
 
-      as.with_operand_size(operand_size, [&] {
-        as.mov(perms_reg,
-               x64::Memory::base_index(RegisterAllocation::permissions_base, address, 1));
-      });
+    if (moves) {
+      as.insert_label(*guard_label);
+      generate_static_branch(block.end_pc, RegisterAllocation::a_reg, false);
+    }
+  }
+
+  void generate_validate_memory_access(const jit::ir::Instruction& instruction,
+                                       X64R address,
+                                       X64R scratch1,
+                                       X64R scratch2) {
+    const auto write = jit::utils::is_memory_write(instruction.type);
+
+    switch (instruction.memory_check) {
+      case jit::ir::MemoryCheck::Access: {
+        generate_validate_memory_access(address, scratch1, scratch2,
+                                        jit::utils::memory_access_size_log2(instruction.type),
+                                        write ? MemoryFlags::Write : MemoryFlags::Read);
+        break;
+      }
+
+      case jit::ir::MemoryCheck::Range: {
+        generate_validate_memory_range(instruction, address, scratch1, scratch2);
+        break;
+      }
 
-      {
-        uint64_t mask = 0;
-        for (size_t i = 0; i < (1 << access_size_log2); ++i) {
-          mask |= uint64_t(write ? MemoryFlags::Write : MemoryFlags::Read) << (i * 8);
+      case jit::ir::MemoryCheck::Covered: {
+        // Access is in bounds but it still can fault on a page without the permission.
+        if (memory.uses_guard_pages()) {
+          add_faulting_access_exit(as.allocate_label(), write ? ArchExitReason::MemoryWriteFault
+                                                              : ArchExitReason::MemoryReadFault);
         }
-        as.mov(mask_reg, int64_t(mask));
+        break;
       }
 
-      as.and_(perms_reg, mask_reg);
-      as.cmp(perms_reg, mask_reg);
-      as.jne(fault_label);
+      default:
+        unreachable();
+    }
+  }
+
+  // Atomic accesses must be naturally aligned so they never cross a permission page. With guard
+  // pages, every instruction that accesses the memory must be marked by `add_atomic_fault_site`.
+  void generate_validate_atomic_access(X64R address,
+                                       X64R scratch1,
+                                       X64R scratch2,
+                                       uint64_t access_size_log2,
+                                       MemoryFlags required_flags) {
+    const auto fault_label = as.allocate_label();
+
+    as.test(address, (int64_t(1) << access_size_log2) - 1);
+    as.jnz(fault_label);
+
+    if (memory.uses_guard_pages()) {
+      as.cmp(address, int64_t(memory.size()));
+      as.jae(fault_label);
     }
 
-    add_pending_exit(fault_label,
-                     write ? ArchExitReason::MemoryWriteFault : ArchExitReason::MemoryReadFault,
-                     current_pc);
+    add_pending_exit(fault_label, memory_fault_reason(required_flags), true, current_pc);
+
+    if (!memory.uses_guard_pages()) {
+      generate_validate_memory_access(address, scratch1, scratch2, access_size_log2,
+                                      required_flags);
+    }
   }
 
-  x64::Label generate_validated_branch(X64R block_index) {
-    const auto no_block_label = as.allocate_label();
+  void add_atomic_fault_site(MemoryFlags required_flags) {
+    if (memory.uses_guard_pages()) {
+      add_faulting_access_exit(as.allocate_label(), memory_fault_reason(required_flags));
+    }
+  }
 
+  // Loads the block translation table entry of `target_pc` into `entry`.
+  void load_block_table_entry(X64R entry, uint64_t target_pc) {
+    const auto directory_offset = (target_pc >> table_leaf_shift) * sizeof(uint64_t);
+    const auto leaf_offset = (target_pc & (table_leaf_size - 1)) & ~(table_entry_granularity - 1);
+
+    as.mov(entry,
+           x64::Memory::base_disp(RegisterAllocation::block_base, int32_t(directory_offset)));
     as.with_operand_size(x64::OperandSize::Bits32, [&] {
-      as.mov(block_index, x64::Memory::base_index(RegisterAllocation::block_base, block_index, 4));
+      as.mov(entry, x64::Memory::base_disp(entry, int32_t(leaf_offset)));
     });
-    const auto code_offset = block_index;
+  }
 
-    as.test(code_offset, code_offset);
-    as.jz(no_block_label);
+  // Loads the block translation table entry of `target_pc` into `block_index` which holds its
+  // index in the table. Clobbers `c_reg`.
+  void load_block_table_entry(X64R block_index, X64R target_pc) {
+    const auto leaf_offset = RegisterAllocation::c_reg;
+    verify(block_index != leaf_offset && target_pc != leaf_offset,
+           "block table lookup cannot use c_reg");
+
+    static_assert(table_entry_granularity == sizeof(uint32_t));
+    as.shr(block_index, table_leaf_shift - 2);
+    as.mov(block_index, x64::Memory::base_index(RegisterAllocation::block_base, block_index, 8));
+
+    as.mov(leaf_offset, target_pc);
+    as.and_(leaf_offset, int64_t((table_leaf_size - 1) & ~(table_entry_granularity - 1)));
+    as.with_operand_size(x64::OperandSize::Bits32, [&] {
+      as.mov(block_index, x64::Memory::base_index(block_index, leaf_offset));
+    });
+  }
 
+  void jump_to_block_code(X64R code_offset) {
     as.add(code_offset, RegisterAllocation::code_base);
     as.jmp(code_offset);
+  }
+
+  // Jumps to the block at statically known `target_pc` if its table entry belongs to it.
+  x64::Label generate_validated_branch(X64R entry, uint64_t target_pc) {
+    const auto no_block_label = as.allocate_label();
+
+    load_block_table_entry(entry, target_pc);
+
+    as.test(entry, int64_t(halfword_block_tag));
+    if ((target_pc & halfword_block_tag) != 0) {
+      as.jz(no_block_label);
+      as.and_(entry, ~int64_t(halfword_block_tag));
+    } else {
+      as.jnz(no_block_label);
+      as.test(entry, entry);
+      as.jz(no_block_label);
+    }
+
+    jump_to_block_code(entry);
+
+    return no_block_label;
+  }
+
+  // Jumps to the block at `target_pc` if its table entry belongs to it. `block_index` must hold
+  // index of the entry.
+  x64::Label generate_validated_branch(X64R block_index, X64R target_pc) {
+    const auto no_block_label = as.allocate_label();
+
+    load_block_table_entry(block_index, target_pc);
+    const auto entry = block_index;
+
+    // Entry tag must be equal to bit 1 of the target PC.
+    as.xor_(entry, target_pc);
+    as.test(entry, int64_t(halfword_block_tag));
+    as.jnz(no_block_label);
+    as.xor_(entry, target_pc);
+
+    // Only entries of aligned targets can be empty here.
+    as.and_(entry, ~int64_t(halfword_block_tag));
+    as.jz(no_block_label);
+
+    jump_to_block_code(entry);
 
     return no_block_label;
   }
 
-  void generate_static_branch(uint64_t target_pc, X64R scratch) {
-    const auto block = target_pc / 4;
+  // If `flush_registers` is false, registers must be already flushed.
+  void generate_static_branch(uint64_t target_pc, X64R scratch, bool flush_registers = true) {
+    const auto block = target_pc / table_entry_granularity;
 
     // We can statically handle some error conditions.
-    if ((target_pc & 3) != 0) {
-      return generate_exit(ArchExitReason::UnalignedPc);
+    if ((target_pc & 1) != 0) {
+      return generate_exit(ArchExitReason::UnalignedPc, target_pc, flush_registers);
     }
     if (block >= code_buffer.max_block_count()) {
-      return generate_exit(ArchExitReason::OutOfBoundsPc);
+      return generate_exit(ArchExitReason::OutOfBoundsPc, target_pc, flush_registers);
     }
 
     if (single_step) {
       // Exit the VM to make sure that we don't execute 2 instructions when single stepping
       // (branch + 1 instruction after the branch).
-      generate_exit(ArchExitReason::SingleStep, target_pc);
+      generate_exit(ArchExitReason::SingleStep, target_pc, flush_registers);
     } else {
-      as.mov(scratch, int64_t(block));
+      if (flush_registers) {
+        register_cache.flush_current_registers();
+      }
+
+      // Code buffer will patch the start of the table lookup sequence into a direct jump once
+      // the target block is generated. The sequence is always longer than `jmp rel32`.
+      link_sites.push_back({
+        .offset = uint32_t(as.assembled_instructions().size()),
+        .target = target_pc,
+      });
 
-      const auto exit_label = generate_validated_branch(scratch);
-      add_pending_exit(exit_label, ArchExitReason::BlockNotGenerated, target_pc);
+      const auto exit_label = generate_validated_branch(scratch, target_pc);
+      add_pending_exit(exit_label, ArchExitReason::BlockNotGenerated, false, target_pc);
     }
   }
 
-  void generate_dynamic_branch(X64R target_pc, X64R scratch) {
+  void generate_inline_cache_slots(X64R target_pc,
+                                   X64R scratch,
+                                   jit::CodeBuffer::InlineCache& inline_cache) {
+    for (auto& slot : inline_cache.slots) {
+      const auto next_label = as.allocate_label();
+
+      as.cmp(target_pc, int64_t(jit::CodeBuffer::inline_cache_placeholder));
+      slot.value_offset = uint32_t(as.assembled_instructions().size() - sizeof(int32_t));
+      as.jne(next_label);
+
+      // Code buffer will patch this into `jmp rel32` when filling the slot.
+      slot.jump_offset = uint32_t(as.assembled_instructions().size());
+      as.mov(scratch, std::numeric_limits<int64_t>::max());
+
+      as.insert_label(next_label);
+    }
+  }
+
+  // Registers must be already flushed.
+  void generate_dynamic_branch(X64R target_pc, X64R scratch, bool use_inline_cache = false) {
+    verify(target_pc != scratch, "target_pc cannot be equal to scratch");
+
     const auto unaligned_label = as.allocate_label();
     const auto oob_label = as.allocate_label();
 
-    // Exit the VM if the address is not properly aligned.
-    as.test(target_pc, 0b10);
-    as.jnz(unaligned_label);
+    // Inline caches rely on code patching which is disabled for multithreaded code buffers.
+    use_inline_cache = use_inline_cache && !single_step && !is_multithreaded();
+
+    jit::CodeBuffer::InlineCache inline_cache{.instruction_address = current_pc};
+    if (use_inline_cache) {
+      generate_inline_cache_slots(target_pc, scratch, inline_cache);
+    }
+
+    // Exit the VM if the address is not properly aligned.
+    as.test(target_pc, 1);
+    as.jnz(unaligned_label);
+
+    // Calculate block translation table index from PC.
+    as.mov(scratch, target_pc);
+    as.shr(scratch, 2);
+
+    // Exit the VM if target_pc >= max_executable_pc.
+    as.cmp(scratch, int64_t(code_buffer.max_block_count()));
+    as.jae(oob_label);
+
+    if (single_step) {
+      // Exit the VM to make sure that we don't execute 2 instructions when single stepping
+      // (branch + 1 instruction after the branch).
+      generate_exit(ArchExitReason::SingleStep, target_pc);
+    } else {
+      if (use_inline_cache) {
+        const auto miss_label = as.allocate_label();
+
+        // Exit the VM so the inline cache can be filled. Once the inline cache becomes full,
+        // code buffer will patch this into `jmp rel32` to the table lookup below.
+        inline_cache.miss_offset = uint32_t(as.assembled_instructions().size());
+        as.mov(RegisterAllocation::exit_data, int64_t(current_pc));
+        verify(as.assembled_instructions().size() - inline_cache.miss_offset >= 5,
+               "inline cache miss site is too small");
+        as.jmp(miss_label);
+
+        inline_cache.fallback_offset = uint32_t(as.assembled_instructions().size());
+
+        add_pending_exit(miss_label, ArchExitReason::InlineCacheMiss, false, target_pc);
+        inline_caches.push_back(inline_cache);
+      }
+
+      const auto exit_label = generate_validated_branch(scratch, target_pc);
+      add_pending_exit(exit_label, ArchExitReason::BlockNotGenerated, false, target_pc);
+    }
+
+    add_pending_exit(unaligned_label, ArchExitReason::UnalignedPc, false, target_pc);
+    add_pending_exit(oob_label, ArchExitReason::OutOfBoundsPc, false, target_pc);
+  }
+
+  static bool is_link_register(Register reg) { return reg == Register::Ra || reg == Register::T0; }
+
+  bool can_use_return_stack(uint64_t return_pc) const {
+    return !single_step && (return_pc & 1) == 0 &&
+           return_pc / table_entry_granularity < code_buffer.max_block_count();
+  }
+
+  // Guest calls push return address stack entry on the host stack:
+  //   [rsp + 0] - host address of the code that continues execution at `return_pc`
+  //   [rsp + 8] - `return_pc`
+  // Guest returns to `return_pc` can then use native `ret` which is well predicted by the CPU.
+  // Registers must be already flushed.
+  template <typename Fn>
+  void generate_call(uint64_t return_pc, Fn&& generate_target_branch) {
+    const auto push_label = as.allocate_label();
+    const auto call_label = as.allocate_label();
+
+    // Entries are only hints so we can drop all of them if the stack grows too large.
+    as.mov(RegisterAllocation::b_reg, RegisterAllocation::stack_base);
+    as.sub(RegisterAllocation::b_reg, X64R::Rsp);
+    as.cmp(RegisterAllocation::b_reg, int64_t(max_return_stack_depth * 16));
+    as.jb(push_label);
+    as.mov(X64R::Rsp, RegisterAllocation::stack_base);
+    as.insert_label(push_label);
+
+    as.mov(RegisterAllocation::b_reg, int64_t(return_pc));
+    as.push(RegisterAllocation::b_reg);
+    as.call(call_label);
+
+    // Guest has returned to `return_pc`. Host registers are clobbered here so we cannot flush
+    // them again.
+    as.add(X64R::Rsp, 8);
+    generate_static_branch(return_pc, RegisterAllocation::b_reg, false);
+
+    as.insert_label(call_label);
+    generate_target_branch();
+  }
+
+  // Falls through if the top return address stack entry doesn't match `target_pc`.
+  // Registers must be already flushed.
+  void generate_return(X64R target_pc) {
+    const auto mismatch_label = as.allocate_label();
+
+    as.cmp(X64R::Rsp, RegisterAllocation::stack_base);
+    as.je(mismatch_label);
+    as.cmp(x64::Memory::base_disp(X64R::Rsp, 8), target_pc);
+    as.jne(mismatch_label);
+    as.ret();
+
+    as.insert_label(mismatch_label);
+  }
+
+  void generate_binary_operation(InstructionType instruction_type,
+                                 x64::Operand op1,
+                                 x64::Operand op2) {
+    using IT = InstructionType;
+
+    switch (instruction_type) {
+      case IT::Add:
+      case IT::Addi:
+      case IT::Addw:
+      case IT::Addiw:
+        as.add(op1, op2);
+        break;
+
+      case IT::Sub:
+      case IT::Subw:
+        as.sub(op1, op2);
+        break;
+
+      case IT::Xor:
+      case IT::Xori:
+        as.xor_(op1, op2);
+        break;
+
+      case IT::Or:
+      case IT::Ori:
+        as.or_(op1, op2);
+        break;
+
+      case IT::And:
+      case IT::Andi:
+        as.and_(op1, op2);
+        break;
+
+      case IT::Sll:
+      case IT::Slli:
+      case IT::Sllw:
+      case IT::Slliw:
+        as.shl(op1, op2);
+        break;
+
+      case IT::Srl:
+      case IT::Srlw:
+      case IT::Srli:
+      case IT::Srliw:
+        as.shr(op1, op2);
+        break;
+
+      case IT::Sra:
+      case IT::Srai:
+      case IT::Sraiw:
+      case IT::Sraw:
+        as.sar(op1, op2);
+        break;
+
+      case IT::Mul:
+      case IT::Mulw:
+        as.imul(op1, op2);
+        break;
+
+      default:
+        unreachable();
+    }
+  }
+
+  // dest = a op b
+  // mov dest, a
+  // op  dest, b
+  // (movsx dest, dest32)
+  //
+  // `b` must not alias `dest` unless `a` aliases it too.
+  void generate_two_operand_instruction(InstructionType instruction_type,
+                                        X64R dest,
+                                        X64R a,
+                                        x64::Operand b,
+                                        bool is_32bit) {
+    if (dest != a) {
+      as.mov(dest, source_operand(a));
+    }
+
+    as.with_operand_size(is_32bit ? x64::OperandSize::Bits32 : x64::OperandSize::Bits64,
+                         [&] { generate_binary_operation(instruction_type, dest, b); });
+
+    if (is_32bit) {
+      as.movsxd(dest, dest);
+    }
+  }
+
+  // Same as above but handles the case when second source register is equal to the destination.
+  void generate_two_operand_instruction(InstructionType instruction_type,
+                                        X64R dest,
+                                        X64R a,
+                                        X64R b,
+                                        bool is_32bit,
+                                        bool is_commutative) {
+    x64::Operand b_operand = source_operand(b);
+
+    if (b == dest && a != dest) {
+      if (is_commutative) {
+        b_operand = source_operand(a);
+        a = dest;
+      } else {
+        as.mov(RegisterAllocation::a_reg, b);
+        b_operand = RegisterAllocation::a_reg;
+      }
+    }
+
+    generate_two_operand_instruction(instruction_type, dest, a, b_operand, is_32bit);
+  }
+
+  void generate_conditional_jump(InstructionType instruction_type, bool invert, x64::Label label) {
+    using IT = InstructionType;
+
+    switch (instruction_type) {
+        // clang-format off
+      case IT::Beq: invert ? as.jne(label) : as.je(label); break;
+      case IT::Bne: invert ? as.je(label) : as.jne(label); break;
+      case IT::Blt: invert ? as.jnl(label) : as.jnge(label); break;
+      case IT::Bge: invert ? as.jnge(label) : as.jnl(label); break;
+      case IT::Bltu: invert ? as.jnb(label) : as.jnae(label); break;
+      case IT::Bgeu: invert ? as.jnae(label) : as.jnb(label); break;
+        // clang-format on
+
+      default:
+        unreachable();
+    }
+  }
+
+  // Jumps to the side exit if the conditional branch goes the other way than the trace. Flags
+  // must be already set by comparing branch operands.
+  void generate_branch_side_exit(const jit::ir::Instruction& instruction) {
+    const auto side_exit_label = as.allocate_label();
+    const auto side_exit_pc =
+      instruction.branch_taken ? next_pc : current_pc + instruction.imm;
+
+    generate_conditional_jump(instruction.type, instruction.branch_taken, side_exit_label);
+    add_pending_branch(side_exit_label, side_exit_pc);
+  }
+
+  // Writes the return address to `rd` and jumps to the statically known `target`.
+  void generate_direct_jump(Register rd, uint64_t target) {
+    if (rd != Register::Zero) {
+      const auto reg = register_cache.lock_register(RegisterCache::WriteOnly{rd});
+      load_immediate_u(reg, next_pc);
+      register_cache.unlock_register_dirty(reg);
+    }
+
+    if (is_link_register(rd) && can_use_return_stack(next_pc)) {
+      register_cache.flush_current_registers();
+      generate_call(next_pc, [&] {
+        generate_static_branch(target, RegisterAllocation::a_reg, false);
+      });
+    } else {
+      generate_static_branch(target, RegisterAllocation::a_reg);
+    }
+  }
+
+  void generate_zero_extend(X64R dest, X64R source, uint32_t bits) {
+    if (dest != source) {
+      load_offseted_register(dest, source, 0);
+    }
+
+    if (bits == 32) {
+      as.with_operand_size(x64::OperandSize::Bits32, [&] { as.mov(dest, dest); });
+    } else if (bits < 32) {
+      as.and_(dest, int64_t((uint64_t(1) << bits) - 1));
+    } else {
+      as.shl(dest, 64 - bits);
+      as.shr(dest, 64 - bits);
+    }
+  }
+
+  // `sc` compares the memory with the value loaded by `lr` and all AMOs are lowered to locked
+  // instructions, `lock cmpxchg` loops are used for the ones which don't have x64 equivalent.
+  void generate_atomic_instruction(const jit::ir::Instruction& instruction) {
+    using IT = InstructionType;
+    using WO = RegisterCache::WriteOnly;
+
+    const auto instruction_type = instruction.type;
+    const auto access_size_log2 = jit::utils::memory_access_size_log2(instruction_type);
+    const auto operand_size = access_size_log2_to_operand_size[access_size_log2];
+
+    const auto is_lr = instruction_any_of(instruction_type, IT::LrW, IT::LrD);
+    const auto is_sc = instruction_any_of(instruction_type, IT::ScW, IT::ScD);
+
+    auto required_flags = MemoryFlags::Read | MemoryFlags::Write;
+    if (is_lr) {
+      required_flags = MemoryFlags::Read;
+    } else if (is_sc) {
+      required_flags = MemoryFlags::Write;
+    }
+
+    // `cmpxchg` implicitly uses RAX so the address is kept in RBX and the operand in RDX.
+    register_cache.lock_platform_register(X64R::Rdx);
+
+    const auto [address_reg, value_reg, dest] =
+      register_cache.lock_registers(instruction.rs1, instruction.rs2, WO{instruction.rd});
+
+    const auto address = RegisterAllocation::b_reg;
+    const auto operand = X64R::Rdx;
+    auto result = RegisterAllocation::a_reg;
+
+    load_offseted_register(address, address_reg, 0);
+    generate_validate_atomic_access(address, RegisterAllocation::a_reg, RegisterAllocation::c_reg,
+                                    access_size_log2, required_flags);
+
+    const auto memory_operand =
+      x64::Memory::base_index(RegisterAllocation::memory_base, address, 1);
+    const auto reservation_address = x64::Memory::base_disp(
+      RegisterAllocation::register_state, int32_t(RegisterState::reservation_address_offset));
+    const auto reservation_value = x64::Memory::base_disp(
+      RegisterAllocation::register_state, int32_t(RegisterState::reservation_value_offset));
+
+    if (!is_lr) {
+      as.mov(operand, source_operand(value_reg));
+    }
+
+    switch (instruction_type) {
+      case IT::LrW:
+      case IT::LrD: {
+        add_atomic_fault_site(required_flags);
+        if (instruction_type == IT::LrW) {
+          as.movsxd(operand, memory_operand);
+        } else {
+          as.mov(operand, memory_operand);
+        }
+
+        as.mov(reservation_address, address);
+        as.mov(reservation_value, operand);
+
+        result = operand;
+        break;
+      }
+
+      case IT::ScW:
+      case IT::ScD: {
+        const auto fail_label = as.allocate_label();
+        const auto end_label = as.allocate_label();
+
+        as.mov(RegisterAllocation::a_reg, reservation_value);
+        as.cmp(reservation_address, address);
+        as.jne(fail_label);
+
+        add_atomic_fault_site(required_flags);
+        as.with_operand_size(operand_size, [&] {
+          as.lock();
+          as.cmpxchg(memory_operand, operand);
+        });
+        as.jne(fail_label);
+
+        as.xor_(RegisterAllocation::a_reg, RegisterAllocation::a_reg);
+        as.jmp(end_label);
+
+        as.insert_label(fail_label);
+        as.mov(RegisterAllocation::a_reg, 1);
+
+        as.insert_label(end_label);
+
+        // Reservation is cleared only after the access so the interpreter can retry `sc` if it
+        // faults.
+        as.mov(RegisterAllocation::c_reg, int64_t(RegisterState::no_reservation));
+        as.mov(reservation_address, RegisterAllocation::c_reg);
+
+        break;
+      }
+
+      case IT::AmoswapW:
+      case IT::AmoswapD:
+      case IT::AmoaddW:
+      case IT::AmoaddD: {
+        add_atomic_fault_site(required_flags);
+        as.with_operand_size(operand_size, [&] {
+          if (instruction_any_of(instruction_type, IT::AmoswapW, IT::AmoswapD)) {
+            // `xchg` with a memory operand is always locked.
+            as.xchg(memory_operand, operand);
+          } else {
+            as.lock();
+            as.xadd(memory_operand, operand);
+          }
+        });
+
+        result = operand;
+        break;
+      }
+
+      default: {
+        const auto retry_label = as.allocate_label();
+        const auto new_value = RegisterAllocation::c_reg;
+
+        add_atomic_fault_site(required_flags);
+        as.with_operand_size(operand_size,
+                             [&] { as.mov(RegisterAllocation::a_reg, memory_operand); });
+
+        as.insert_label(retry_label);
+
+        as.with_operand_size(operand_size, [&] {
+          as.mov(new_value, RegisterAllocation::a_reg);
+
+          switch (instruction_type) {
+              // clang-format off
+            case IT::AmoxorW:  case IT::AmoxorD:  as.xor_(new_value, operand); break;
+            case IT::AmoandW:  case IT::AmoandD:  as.and_(new_value, operand); break;
+            case IT::AmoorW:   case IT::AmoorD:   as.or_(new_value, operand); break;
+              // clang-format on
+
+            case IT::AmominW:
+            case IT::AmominD: {
+              as.cmp(new_value, operand);
+              as.cmovg(new_value, operand);
+              break;
+            }
+            case IT::AmomaxW:
+            case IT::AmomaxD: {
+              as.cmp(new_value, operand);
+              as.cmovl(new_value, operand);
+              break;
+            }
+            case IT::AmominuW:
+            case IT::AmominuD: {
+              as.cmp(new_value, operand);
+              as.cmova(new_value, operand);
+              break;
+            }
+            case IT::AmomaxuW:
+            case IT::AmomaxuD: {
+              as.cmp(new_value, operand);
+              as.cmovb(new_value, operand);
+              break;
+            }
+
+            default:
+              unreachable();
+          }
+        });
+
+        // Failed `cmpxchg` loads the current memory value to RAX.
+        add_atomic_fault_site(required_flags);
+        as.with_operand_size(operand_size, [&] {
+          as.lock();
+          as.cmpxchg(memory_operand, new_value);
+        });
+        as.jne(retry_label);
+
+        break;
+      }
+    }
+
+    if (instruction.rd != Register::Zero) {
+      if (access_size_log2 == 2 && !is_sc) {
+        as.movsxd(dest, result);
+      } else {
+        as.mov(dest, result);
+      }
+    }
+
+    register_cache.unlock_registers(address_reg, value_reg);
+    register_cache.unlock_register_dirty(dest);
+
+    register_cache.unlock_platform_register(X64R::Rdx);
+  }
+
+  // Floating point registers are not cached, they are accessed directly in the register state.
+  static x64::Memory float_register_operand(Register reg, int32_t offset = 0) {
+    return x64::Memory::base_disp(
+      RegisterAllocation::register_state,
+      int32_t(RegisterState::float_registers_offset + size_t(reg) * sizeof(uint64_t)) + offset);
+  }
+
+  void generate_float_load(const jit::ir::Instruction& instruction) {
+    const auto address_reg = register_cache.lock_register(instruction.rs1);
+
+    load_offseted_register(RegisterAllocation::a_reg, address_reg, instruction.imm);
+    generate_validate_memory_access(instruction, RegisterAllocation::a_reg,
+                                    RegisterAllocation::b_reg, RegisterAllocation::c_reg);
+
+    const auto address =
+      x64::Memory::base_index(RegisterAllocation::memory_base, RegisterAllocation::a_reg, 1);
+    const auto value = RegisterAllocation::b_reg;
+
+    if (instruction.type == InstructionType::Flw) {
+      // Single precision value is NaN-boxed by setting the upper half of the register.
+      as.with_operand_size(x64::OperandSize::Bits32, [&] {
+        as.mov(value, address);
+        as.mov(float_register_operand(instruction.rd), value);
+        as.mov(float_register_operand(instruction.rd, 4), int64_t(-1));
+      });
+    } else {
+      as.mov(value, address);
+      as.mov(float_register_operand(instruction.rd), value);
+    }
+
+    register_cache.unlock_register(address_reg);
+  }
+
+  void generate_float_store(const jit::ir::Instruction& instruction) {
+    const auto access_size_log2 = jit::utils::memory_access_size_log2(instruction.type);
+
+    // With guard pages the store must directly follow the validation so the value is loaded
+    // before it (to the register which isn't used by the validation).
+    register_cache.lock_platform_register(X64R::Rdx);
+
+    const auto address_reg = register_cache.lock_register(instruction.rs1);
+    const auto value = X64R::Rdx;
+
+    as.mov(value, float_register_operand(instruction.rs2));
+
+    load_offseted_register(RegisterAllocation::a_reg, address_reg, instruction.imm);
+    generate_validate_memory_access(instruction, RegisterAllocation::a_reg,
+                                    RegisterAllocation::b_reg, RegisterAllocation::c_reg);
+
+    const auto operand_size = access_size_log2_to_operand_size[access_size_log2];
+    const auto address =
+      x64::Memory::base_index(RegisterAllocation::memory_base, RegisterAllocation::a_reg, 1);
+
+    as.with_operand_size(operand_size, [&] { as.mov(address, value); });
+
+    register_cache.unlock_register(address_reg);
+    register_cache.unlock_platform_register(X64R::Rdx);
+  }
+
+  // Moves between integer and floating point registers and sign injection of double precision
+  // values are simple bit manipulations so they don't need to call `FloatArithmetic`.
+  void generate_float_move(const jit::ir::Instruction& instruction) {
+    using IT = InstructionType;
+    using WO = RegisterCache::WriteOnly;
+
+    switch (instruction.type) {
+      case IT::FmvXW:
+      case IT::FmvXD: {
+        if (instruction.rd != Register::Zero) {
+          const auto dest = register_cache.lock_register(WO{instruction.rd});
+
+          if (instruction.type == IT::FmvXW) {
+            as.movsxd(dest, float_register_operand(instruction.rs1));
+          } else {
+            as.mov(dest, float_register_operand(instruction.rs1));
+          }
+
+          register_cache.unlock_register_dirty(dest);
+        }
+        break;
+      }
+
+      case IT::FmvWX: {
+        const auto source = register_cache.lock_register(instruction.rs1);
+
+        as.with_operand_size(x64::OperandSize::Bits32, [&] {
+          as.mov(float_register_operand(instruction.rd), source_operand(source));
+          as.mov(float_register_operand(instruction.rd, 4), int64_t(-1));
+        });
+
+        register_cache.unlock_register(source);
+        break;
+      }
+
+      case IT::FmvDX: {
+        const auto source = register_cache.lock_register(instruction.rs1);
+        as.mov(float_register_operand(instruction.rd), source_operand(source));
+        register_cache.unlock_register(source);
+        break;
+      }
+
+      case IT::FsgnjD:
+      case IT::FsgnjnD:
+      case IT::FsgnjxD: {
+        const auto value = RegisterAllocation::a_reg;
+        const auto sign = RegisterAllocation::b_reg;
+
+        as.mov(value, float_register_operand(instruction.rs1));
+        as.mov(sign, float_register_operand(instruction.rs2));
+
+        as.shr(sign, int64_t(63));
+        if (instruction.type == IT::FsgnjnD) {
+          as.xor_(sign, int64_t(1));
+        }
+        as.shl(sign, int64_t(63));
+
+        if (instruction.type == IT::FsgnjxD) {
+          as.xor_(value, sign);
+        } else {
+          as.shl(value, int64_t(1));
+          as.shr(value, int64_t(1));
+          as.or_(value, sign);
+        }
+
+        as.mov(float_register_operand(instruction.rd), value);
+        break;
+      }
+
+      default:
+        unreachable();
+    }
+  }
+
+  // Calls `function(register_state, raw_instruction, argument + argument_offset)` on the host.
+  // Host registers which are live in the generated code and not preserved by the callee are
+  // saved around the call. Result is returned in `a_reg`.
+  void generate_host_call(jit::CodeBuffer::Relocation::Target function_target,
+                          uint64_t function,
+                          uint64_t raw_instruction,
+                          X64R argument,
+                          int64_t argument_offset) {
+    base::StaticVector<X64R, 16> saved_regs;
+    {
+      const X64R live_regs[]{
+        RegisterAllocation::register_state, RegisterAllocation::memory_base,
+        RegisterAllocation::permissions_base, RegisterAllocation::code_base,
+        RegisterAllocation::block_base, RegisterAllocation::stack_base,
+      };
+
+      const auto save_if_clobbered = [&](X64R reg) {
+        if (std::find(abi.callee_saved_regs.begin(), abi.callee_saved_regs.end(), reg) ==
+            abi.callee_saved_regs.end()) {
+          saved_regs.push_back(reg);
+        }
+      };
+
+      for (const auto reg : live_regs) {
+        save_if_clobbered(reg);
+      }
+      for (const auto reg : RegisterAllocation::cache) {
+        save_if_clobbered(reg);
+      }
+    }
+
+    for (const auto reg : saved_regs) {
+      as.push(reg);
+    }
+
+    // Argument can be in one of the argument registers so it's moved first.
+    const auto& arguments = abi.call_argument_regs;
+    load_offseted_register(arguments[2], argument, argument_offset);
+    as.mov(arguments[0], RegisterAllocation::register_state);
+    load_immediate_u(arguments[1], raw_instruction);
+
+    // Stack pointer is restored from a callee saved register.
+    const auto stack_pointer = RegisterAllocation::b_reg;
+    as.mov(stack_pointer, X64R::Rsp);
+    as.and_(X64R::Rsp, int64_t(-16));
+    if (abi.shadow_space_size > 0) {
+      as.sub(X64R::Rsp, abi.shadow_space_size);
+    }
+
+    load_relocated_value(RegisterAllocation::a_reg, function_target, function);
+    as.call(RegisterAllocation::a_reg);
+
+    as.mov(X64R::Rsp, stack_pointer);
+
+    for (size_t i = saved_regs.size(); i > 0; i--) {
+      as.pop(saved_regs[i - 1]);
+    }
+  }
+
+  // Other floating point instructions call `FloatArithmetic` which runs them on the host FPU.
+  void generate_float_operation(const jit::ir::Instruction& instruction) {
+    using WO = RegisterCache::WriteOnly;
+
+    const auto guest_instruction =
+      vm::Instruction::from_fields(instruction.type, uint32_t(instruction.rd),
+                                   uint32_t(instruction.rs1), uint32_t(instruction.rs2),
+                                   uint32_t(instruction.imm));
+
+    if (FloatArithmetic::uses_rounding_mode(instruction.type) &&
+        guest_instruction.rounding_mode() == vm::Instruction::RoundingMode::Dynamic) {
+      // Rounding mode is in bits 5-7 of `fcsr` and values above 4 are reserved.
+      const auto undefined_label = as.allocate_label();
+
+      as.with_operand_size(x64::OperandSize::Bits32, [&] {
+        as.mov(RegisterAllocation::a_reg,
+               x64::Memory::base_disp(RegisterAllocation::register_state,
+                                      int32_t(RegisterState::fcsr_offset)));
+      });
+      as.cmp(RegisterAllocation::a_reg, int64_t(5 << 5));
+      as.jae(undefined_label);
+
+      add_pending_exit(undefined_label, ArchExitReason::UndefinedInstruction, true, current_pc);
+    }
+
+    const auto writes_rd = FloatArithmetic::writes_integer_register(instruction.type) &&
+                           instruction.rd != Register::Zero;
+
+    const auto source = register_cache.lock_register(
+      FloatArithmetic::reads_integer_register(instruction.type) ? instruction.rs1 : Register::Zero);
+    const auto dest = writes_rd ? register_cache.lock_register(WO{instruction.rd})
+                                : RegisterCache::zero_register;
+
+    generate_host_call(jit::CodeBuffer::Relocation::Target::FloatArithmetic,
+                       uint64_t(&FloatArithmetic::execute_raw), guest_instruction.raw(), source, 0);
+
+    if (writes_rd) {
+      as.mov(dest, RegisterAllocation::a_reg);
+      register_cache.unlock_register_dirty(dest);
+    }
+    register_cache.unlock_register(source);
+  }
+
+  // `vsetvli` and `vsetivli` encode `vtype` in the instruction so VLMAX is known at compile
+  // time and the new vector length is computed inline.
+  void generate_vector_configuration(const jit::ir::Instruction& instruction) {
+    using WO = RegisterCache::WriteOnly;
+
+    const auto encoding = uint32_t(instruction.imm);
+    const auto immediate_avl = instruction.type == InstructionType::Vsetivli;
+    const auto vtype = (encoding >> 20) & (immediate_avl ? 0x3ff : 0x7ff);
+    const auto vlmax = VectorArithmetic::max_vector_length(vtype);
+
+    const auto vl = RegisterAllocation::a_reg;
+    const auto vtype_reg = RegisterAllocation::b_reg;
+
+    vector_configuration = std::nullopt;
+
+    if (vlmax == 0) {
+      load_immediate(vl, 0);
+      load_immediate_u(vtype_reg, RegisterState::vtype_illegal);
+    } else {
+      load_immediate_u(vtype_reg, vtype);
+
+      vector_configuration = VectorConfiguration{
+        .sew_log2 = uint32_t((vtype >> 3) & 0b111),
+        .vlmax = vlmax,
+      };
+
+      if (immediate_avl) {
+        load_immediate_u(vl, std::min(uint64_t(instruction.rs1), vlmax));
+        vector_configuration->full_length = uint64_t(instruction.rs1) >= vlmax;
+      } else if (instruction.rs1 == Register::Zero && instruction.rd != Register::Zero) {
+        load_immediate_u(vl, vlmax);
+        vector_configuration->full_length = true;
+      } else {
+        // AVL is either in `rs1` or the current vector length is kept (if both `rs1` and `rd`
+        // are zero).
+        if (instruction.rs1 != Register::Zero) {
+          const auto avl_reg = register_cache.lock_register(instruction.rs1);
+          as.mov(vl, avl_reg);
+          register_cache.unlock_register(avl_reg);
+        } else {
+          as.mov(vl, x64::Memory::base_disp(RegisterAllocation::register_state,
+                                            int32_t(RegisterState::vl_offset)));
+        }
+
+        load_immediate_u(RegisterAllocation::c_reg, vlmax);
+        as.cmp(vl, RegisterAllocation::c_reg);
+        as.cmova(vl, RegisterAllocation::c_reg);
+      }
+    }
+
+    as.mov(x64::Memory::base_disp(RegisterAllocation::register_state,
+                                  int32_t(RegisterState::vl_offset)),
+           vl);
+    as.mov(x64::Memory::base_disp(RegisterAllocation::register_state,
+                                  int32_t(RegisterState::vtype_offset)),
+           vtype_reg);
+
+    if (instruction.rd != Register::Zero) {
+      const auto dest = register_cache.lock_register(WO{instruction.rd});
+      as.mov(dest, vl);
+      register_cache.unlock_register_dirty(dest);
+    }
+  }
+
+  // Vector instruction which is generated inline, see `generate_inline_vector_instruction`.
+  struct InlineVectorOperation {
+    enum class Kind {
+      Load,
+      Store,
+      Add,
+      Sub,
+      And,
+      Or,
+      Xor,
+      Mul,
+    };
+
+    enum class Operand {
+      Vector,
+      Scalar,
+      Immediate,
+    };
+
+    Kind kind{};
+    Operand operand{};
+
+    // `vd` holds the stored register (`vs3`) for stores.
+    uint32_t vd{};
+    uint32_t vs1{};
+    uint32_t vs2{};
+    int64_t immediate{};
+
+    // EEW of memory accesses and SEW of other operations.
+    uint32_t element_size_log2{};
+
+    // Number of bytes accessed in each register when `vl` is VLMAX.
+    size_t size{};
+  };
+
+  std::optional<InlineVectorOperation> inline_vector_operation(
+    const jit::ir::Instruction& instruction) const {
+    using IT = InstructionType;
+    using K = InlineVectorOperation::Kind;
+    using O = InlineVectorOperation::Operand;
+
+    if (!vector_configuration) {
+      return std::nullopt;
+    }
+
+    const auto encoding = uint32_t(instruction.imm);
+    if (((encoding >> 25) & 1) == 0) {
+      // Masked operations are left to `VectorArithmetic`.
+      return std::nullopt;
+    }
+
+    InlineVectorOperation operation{
+      .vd = (encoding >> 7) & 0b11111,
+      .vs1 = (encoding >> 15) & 0b11111,
+      .vs2 = (encoding >> 20) & 0b11111,
+      .element_size_log2 = vector_configuration->sew_log2,
+    };
+
+    switch (instruction.type) {
+      case IT::VectorLoad:
+      case IT::VectorStore: {
+        // Only plain unit-stride accesses (`lumop` and `nf` are zero) of integer elements.
+        const auto width = (encoding >> 12) & 0b111;
+        if (operation.vs2 != 0 || (encoding >> 29) != 0 || (width != 0 && width < 0b101)) {
+          return std::nullopt;
+        }
+
+        operation.kind = instruction.type == IT::VectorLoad ? K::Load : K::Store;
+        operation.element_size_log2 = width == 0 ? 0 : width - 4;
+        break;
+      }
+
+      case IT::VectorOperation:
+      case IT::VectorOperationScalar: {
+        const auto funct3 = (encoding >> 12) & 0b111;
+        const auto funct6 = encoding >> 26;
+
+        // OPIVV, OPIVI and OPIVX.
+        if (funct3 == 0b000 || funct3 == 0b011 || funct3 == 0b100) {
+          switch (funct6) {
+              // clang-format off
+            case 0b00'0000: operation.kind = K::Add; break;
+            case 0b00'0010: operation.kind = K::Sub; break;
+            case 0b00'1001: operation.kind = K::And; break;
+            case 0b00'1010: operation.kind = K::Or; break;
+            case 0b00'1011: operation.kind = K::Xor; break;
+              // clang-format on
+
+            default:
+              return std::nullopt;
+          }
+
+          if (funct3 == 0b011 && operation.kind == K::Sub) {
+            return std::nullopt;
+          }
+        } else if ((funct3 == 0b010 || funct3 == 0b110) && funct6 == 0b10'0101) {
+          // OPMVV and OPMVX `vmul`.
+          operation.kind = K::Mul;
+        } else {
+          return std::nullopt;
+        }
+
+        if (funct3 == 0b011) {
+          operation.operand = O::Immediate;
+          operation.immediate = int64_t(operation.vs1 << 27) >> 27;
+        } else if (funct3 == 0b100 || funct3 == 0b110) {
+          operation.operand = O::Scalar;
+        } else {
+          operation.operand = O::Vector;
+        }
+        break;
+      }
+
+      default:
+        return std::nullopt;
+    }
+
+    // Operands must be single registers (EMUL <= 1). EMUL below 1/8 is reserved.
+    operation.size = vector_configuration->vlmax << operation.element_size_log2;
+    if (operation.size > RegisterState::vector_register_size || operation.size < 2) {
+      return std::nullopt;
+    }
+
+    return operation;
+  }
+
+  static x64::Memory vector_register_operand(uint32_t reg, size_t offset) {
+    return x64::Memory::base_disp(
+      RegisterAllocation::register_state,
+      int32_t(RegisterState::vector_registers_offset + reg * RegisterState::vector_register_size +
+              offset));
+  }
+
+  // Loads `1 << size_log2` bytes zero extended to 64 bits.
+  void load_zero_extended(X64R target, const x64::Memory& source, uint32_t size_log2) {
+    switch (size_log2) {
+      case 0:
+        as.movzxb(target, source);
+        break;
+      case 1:
+        as.movzxw(target, source);
+        break;
+      case 2:
+        // 32 bit moves clear the upper half.
+        as.with_operand_size(x64::OperandSize::Bits32, [&] { as.mov(target, source); });
+        break;
+      case 3:
+        as.mov(target, source);
+        break;
+
+      default:
+        unreachable();
+    }
+  }
+
+  void store_sized(const x64::Memory& target, X64R source, uint32_t size_log2) {
+    as.with_operand_size(access_size_log2_to_operand_size[size_log2],
+                         [&] { as.mov(target, source); });
+  }
+
+  // Copies the element to all `8 << element_size_log2` bit lanes of a 64 bit value.
+  static uint64_t lane_replication(uint32_t element_size_log2) {
+    const auto element_bits = uint32_t(8) << element_size_log2;
+    return element_bits == 64 ? 1 : ~uint64_t(0) / ((uint64_t(1) << element_bits) - 1);
+  }
+
+  // Vector registers are processed in (at most) 8 byte chunks in general purpose registers because
+  // the assembler has no SIMD encoders. Memory accesses and bitwise operations handle whole
+  // chunks, additions and subtractions of elements narrower than 64 bits use SWAR arithmetic
+  // (carries are kept from crossing the lanes) and multiplications go element by element.
+  //
+  // The code assumes that `vl` is VLMAX and jumps to `fallback_label` (which calls
+  // `VectorArithmetic`) if that isn't known at compile time and doesn't hold.
+  void generate_inline_vector_instruction(const jit::ir::Instruction& instruction,
+                                          const InlineVectorOperation& operation,
+                                          x64::Label fallback_label) {
+    using K = InlineVectorOperation::Kind;
+    using O = InlineVectorOperation::Operand;
+
+    const auto a = RegisterAllocation::a_reg;
+    const auto b = RegisterAllocation::b_reg;
+    const auto c = RegisterAllocation::c_reg;
+    const auto d = X64R::Rdx;
+
+    const auto chunk_size = std::min(operation.size, sizeof(uint64_t));
+    const auto chunk_size_log2 = uint32_t(chunk_size == 8 ? 3 : chunk_size == 4 ? 2 : 1);
+    const auto chunk_count = operation.size / chunk_size;
+
+    register_cache.lock_platform_register(d);
+
+    const auto uses_rs1 = operation.kind == K::Load || operation.kind == K::Store ||
+                          operation.operand == O::Scalar;
+    const auto rs1_reg =
+      register_cache.lock_register(uses_rs1 ? instruction.rs1 : Register::Zero);
+
+    if (!vector_configuration->full_length) {
+      as.cmp(x64::Memory::base_disp(RegisterAllocation::register_state,
+                                    int32_t(RegisterState::vl_offset)),
+             int64_t(vector_configuration->vlmax));
+      as.jne(fallback_label);
+    }
+
+    switch (operation.kind) {
+      case K::Load: {
+        // All chunks are loaded before the destination is written, so a faulting load has no
+        // side effects.
+        const X64R values[]{d, c};
+
+        load_offseted_register(a, rs1_reg, 0);
+        for (size_t i = 0; i < chunk_count; ++i) {
+          if (i > 0) {
+            as.add(a, int64_t(chunk_size));
+          }
+          generate_validate_memory_access(a, b, c, chunk_size_log2, MemoryFlags::Read);
+          load_zero_extended(values[i],
+                             x64::Memory::base_index(RegisterAllocation::memory_base, a, 1),
+                             chunk_size_log2);
+        }
+
+        for (size_t i = 0; i < chunk_count; ++i) {
+          store_sized(vector_register_operand(operation.vd, i * chunk_size), values[i],
+                      chunk_size_log2);
+        }
+        break;
+      }
+
+      case K::Store: {
+        // Like a trapping RVV store, a fault on the second chunk leaves the first one written.
+        // The interpreter executes the store again and reports the fault.
+        load_offseted_register(a, rs1_reg, 0);
+        for (size_t i = 0; i < chunk_count; ++i) {
+          if (i > 0) {
+            as.add(a, int64_t(chunk_size));
+          }
+
+          // With guard pages the store must directly follow the validation.
+          load_zero_extended(d, vector_register_operand(operation.vd, i * chunk_size),
+                             chunk_size_log2);
+          generate_validate_memory_access(a, b, c, chunk_size_log2, MemoryFlags::Write);
+          store_sized(x64::Memory::base_index(RegisterAllocation::memory_base, a, 1), d,
+                      chunk_size_log2);
+        }
+        break;
+      }
+
+      case K::Mul: {
+        const auto element_size_log2 = operation.element_size_log2;
+        const auto element_size = size_t(1) << element_size_log2;
+
+        if (operation.operand == O::Scalar) {
+          load_offseted_register(b, rs1_reg, 0);
+        }
+
+        // Low bits of the product depend only on the low bits of the factors.
+        for (size_t offset = 0; offset < operation.size; offset += element_size) {
+          load_zero_extended(a, vector_register_operand(operation.vs2, offset), element_size_log2);
+          if (operation.operand == O::Vector) {
+            load_zero_extended(b, vector_register_operand(operation.vs1, offset),
+                               element_size_log2);
+          }
+          as.imul(a, b);
+          store_sized(vector_register_operand(operation.vd, offset), a, element_size_log2);
+        }
+        break;
+      }
+
+      default: {
+        const auto element_size_log2 = operation.element_size_log2;
+        const auto element_bits = uint32_t(8) << element_size_log2;
+        const auto replication = lane_replication(element_size_log2);
+        const auto high_bits = replication << (element_bits - 1);
+
+        // Scalar operands are replicated to all lanes of the chunk.
+        if (operation.operand == O::Scalar) {
+          if (element_bits == 64) {
+            load_offseted_register(b, rs1_reg, 0);
+          } else {
+            generate_zero_extend(b, rs1_reg, element_bits);
+            load_immediate_u(c, replication);
+            as.imul(b, c);
+          }
+        } else if (operation.operand == O::Immediate) {
+          const auto element_mask = element_bits == 64 ? ~uint64_t(0)
+                                                       : (uint64_t(1) << element_bits) - 1;
+          load_immediate_u(b, (uint64_t(operation.immediate) & element_mask) * replication);
+        }
+
+        const auto swar =
+          element_bits < 64 && (operation.kind == K::Add || operation.kind == K::Sub);
+
+        for (size_t i = 0; i < chunk_count; ++i) {
+          const auto offset = i * chunk_size;
+
+          load_zero_extended(a, vector_register_operand(operation.vs2, offset), chunk_size_log2);
+          if (operation.operand == O::Vector) {
+            load_zero_extended(b, vector_register_operand(operation.vs1, offset), chunk_size_log2);
+          }
+
+          if (swar) {
+            // Lanes are added without their high bits so carries stay in the lanes. High bits of
+            // the result are the xor of the high bits and the carry (or borrow) into them:
+            //   a + b = ((a & ~H) + (b & ~H)) ^ ((a ^ b) & H)
+            //   a - b = ((a | H) - (b & ~H)) ^ ((a ^ ~b) & H)
+            load_immediate_u(d, high_bits);
+
+            as.mov(c, a);
+            as.xor_(c, b);
+            as.and_(c, d);
+            as.or_(a, d);
+            if (operation.kind == K::Add) {
+              as.xor_(a, d);
+            } else {
+              as.xor_(c, d);
+            }
+
+            // `b` keeps the replicated scalar for the next chunk.
+            as.and_(d, b);
+            as.xor_(d, b);
+
+            if (operation.kind == K::Add) {
+              as.add(a, d);
+            } else {
+              as.sub(a, d);
+            }
+            as.xor_(a, c);
+          } else {
+            switch (operation.kind) {
+                // clang-format off
+              case K::Add: as.add(a, b); break;
+              case K::Sub: as.sub(a, b); break;
+              case K::And: as.and_(a, b); break;
+              case K::Or: as.or_(a, b); break;
+              case K::Xor: as.xor_(a, b); break;
+                // clang-format on
+
+              default:
+                unreachable();
+            }
+          }
+
+          store_sized(vector_register_operand(operation.vd, offset), a, chunk_size_log2);
+        }
+        break;
+      }
+    }
+
+    register_cache.unlock_register(rs1_reg);
+    register_cache.unlock_platform_register(d);
+  }
+
+  // Other vector instructions call `VectorArithmetic`. It reads scalar operands from the register
+  // state and fails without side effects (so the interpreter can execute the instruction again
+  // and report the exact exit).
+  void generate_vector_instruction(const jit::ir::Instruction& instruction) {
+    using WO = RegisterCache::WriteOnly;
+
+    if (instruction_any_of(instruction.type, InstructionType::Vsetvli,
+                           InstructionType::Vsetivli)) {
+      return generate_vector_configuration(instruction);
+    }
+
+    const auto store_operand = [&](Register reg) {
+      if (reg == Register::Zero) {
+        return;
+      }
+
+      const auto value = register_cache.lock_register(reg);
+      as.mov(x64::Memory::base_disp(RegisterAllocation::register_state,
+                                    int32_t(size_t(reg) * sizeof(uint64_t))),
+             value);
+      register_cache.unlock_register(value);
+    };
+
+    if (instruction.reads_rs1()) {
+      store_operand(instruction.rs1);
+    }
+    if (instruction.reads_rs2()) {
+      store_operand(instruction.rs2);
+    }
+
+    std::optional<x64::Label> end_label;
+    if (const auto operation = inline_vector_operation(instruction)) {
+      const auto fallback_label = as.allocate_label();
+      end_label = as.allocate_label();
+
+      generate_inline_vector_instruction(instruction, *operation, fallback_label);
+      as.jmp(*end_label);
+
+      as.insert_label(fallback_label);
+    }
+
+    const auto guest_instruction =
+      vm::Instruction::from_fields(instruction.type, uint32_t(instruction.rd),
+                                   uint32_t(instruction.rs1), uint32_t(instruction.rs2),
+                                   uint32_t(instruction.imm));
+
+    load_relocated_value(RegisterAllocation::b_reg, jit::CodeBuffer::Relocation::Target::Memory,
+                         uint64_t(&memory));
+    generate_host_call(jit::CodeBuffer::Relocation::Target::VectorArithmetic,
+                       uint64_t(&VectorArithmetic::execute_raw), guest_instruction.raw(),
+                       RegisterAllocation::b_reg, 0);
+
+    const auto failed_label = as.allocate_label();
+    as.test(RegisterAllocation::a_reg, RegisterAllocation::a_reg);
+    as.jnz(failed_label);
+
+    add_pending_exit(failed_label, ArchExitReason::UnsupportedInstruction, true, current_pc);
+
+    if (instruction.writes_rd()) {
+      const auto dest = register_cache.lock_register(WO{instruction.rd});
+      as.mov(dest, x64::Memory::base_disp(RegisterAllocation::register_state,
+                                          int32_t(size_t(instruction.rd) * sizeof(uint64_t))));
+      register_cache.unlock_register_dirty(dest);
+    }
+
+    if (end_label) {
+      as.insert_label(*end_label);
+    }
+
+    // `vsetvl` takes `vtype` from a register and fault-only-first loads can shorten `vl`.
+    const auto encoding = uint32_t(instruction.imm);
+    if (instruction.type == InstructionType::Vsetvl) {
+      vector_configuration = std::nullopt;
+    } else if (instruction.type == InstructionType::VectorLoad &&
+               ((encoding >> 20) & 0b11111) == 0b10000 && vector_configuration) {
+      vector_configuration->full_length = false;
+    }
+  }
+
+  // Zba/Zbb/Zbs instructions map to single host instructions where x64 has an equivalent.
+  // `lzcnt`, `tzcnt` and `popcnt` are used only if the host supports them, `Arithmetic` computes
+  // the result otherwise.
+  void generate_bit_manipulation(const jit::ir::Instruction& instruction) {
+    using IT = InstructionType;
+    using WO = RegisterCache::WriteOnly;
+
+    if (instruction.rd == Register::Zero) {
+      return;
+    }
+
+    const auto instruction_type = instruction.type;
+    const auto [rs1_reg, rs2_reg, dest] = register_cache.lock_registers(
+      instruction.rs1,
+      Arithmetic::reads_second_register(instruction_type) ? instruction.rs2 : Register::Zero,
+      WO{instruction.rd});
+
+    // Operations which can't write `dest` directly compute the result in a scratch register so
+    // sources can alias the destination.
+    const auto result = RegisterAllocation::a_reg;
+    const auto a = materialize_register(rs1_reg, RegisterAllocation::b_reg);
+    const auto b = materialize_register(rs2_reg, RegisterAllocation::c_reg);
+    const auto imm = int64_t(instruction.imm);
+
+    const auto with_32bit = [&](auto&& fn) { as.with_operand_size(x64::OperandSize::Bits32, fn); };
+
+    bool uses_result = true;
+
+    switch (instruction_type) {
+      case IT::Sh1add:
+      case IT::Sh2add:
+      case IT::Sh3add:
+      case IT::AddUw:
+      case IT::Sh1addUw:
+      case IT::Sh2addUw:
+      case IT::Sh3addUw: {
+        uint8_t scale = 1;
+        switch (instruction_type) {
+            // clang-format off
+          case IT::Sh1add: case IT::Sh1addUw: scale = 2; break;
+          case IT::Sh2add: case IT::Sh2addUw: scale = 4; break;
+          case IT::Sh3add: case IT::Sh3addUw: scale = 8; break;
+            // clang-format on
+
+          default:
+            break;
+        }
+
+        auto index = a;
+        if (instruction_any_of(instruction_type, IT::AddUw, IT::Sh1addUw, IT::Sh2addUw,
+                               IT::Sh3addUw)) {
+          // 32 bit move zero extends the index.
+          with_32bit([&] { as.mov(result, a); });
+          index = result;
+        }
+
+        as.lea(dest, x64::Memory::base_index(b, index, scale));
+        uses_result = false;
+        break;
+      }
+
+      case IT::SlliUw: {
+        with_32bit([&] { as.mov(result, a); });
+        as.shl(result, imm);
+        break;
+      }
+
+      case IT::Andn:
+      case IT::Orn: {
+        as.mov(result, b);
+        as.not_(result);
+        if (instruction_type == IT::Andn) {
+          as.and_(result, a);
+        } else {
+          as.or_(result, a);
+        }
+        break;
+      }
 
-    // Calculate block index from PC.
-    as.mov(scratch, target_pc);
-    as.shr(scratch, 2);
+      case IT::Xnor: {
+        as.mov(result, a);
+        as.xor_(result, b);
+        as.not_(result);
+        break;
+      }
 
-    // Exit the VM if target_pc >= max_executable_pc.
-    as.cmp(scratch, int64_t(code_buffer.max_block_count()));
-    as.jae(oob_label);
+      case IT::Min:
+      case IT::Minu:
+      case IT::Max:
+      case IT::Maxu: {
+        as.mov(result, a);
+        as.cmp(result, b);
 
-    if (single_step) {
-      // Exit the VM to make sure that we don't execute 2 instructions when single stepping
-      // (branch + 1 instruction after the branch).
-      generate_exit(ArchExitReason::SingleStep, target_pc);
-    } else {
-      const auto exit_label = generate_validated_branch(scratch);
-      add_pending_exit(exit_label, ArchExitReason::BlockNotGenerated, target_pc);
-    }
+        switch (instruction_type) {
+            // clang-format off
+          case IT::Min:  as.cmovg(result, b); break;
+          case IT::Minu: as.cmova(result, b); break;
+          case IT::Max:  as.cmovl(result, b); break;
+          case IT::Maxu: as.cmovb(result, b); break;
+            // clang-format on
 
-    add_pending_exit(unaligned_label, ArchExitReason::UnalignedPc, target_pc);
-    add_pending_exit(oob_label, ArchExitReason::OutOfBoundsPc, target_pc);
-  }
+          default:
+            unreachable();
+        }
+        break;
+      }
 
-  void generate_binary_operation(InstructionType instruction_type,
-                                 x64::Operand op1,
-                                 x64::Operand op2) {
-    using IT = InstructionType;
+      case IT::Rol:
+      case IT::Ror:
+      case IT::Rolw:
+      case IT::Rorw: {
+        const auto is_32bit = instruction_any_of(instruction_type, IT::Rolw, IT::Rorw);
 
-    switch (instruction_type) {
-      case IT::Add:
-      case IT::Addi:
-      case IT::Addw:
-      case IT::Addiw:
-        as.add(op1, op2);
+        if (b != RegisterAllocation::c_reg) {
+          as.mov(RegisterAllocation::c_reg, b);
+        }
+        as.mov(result, a);
+        as.with_operand_size(is_32bit ? x64::OperandSize::Bits32 : x64::OperandSize::Bits64, [&] {
+          if (instruction_any_of(instruction_type, IT::Rol, IT::Rolw)) {
+            as.rol(result, RegisterAllocation::c_reg);
+          } else {
+            as.ror(result, RegisterAllocation::c_reg);
+          }
+        });
+        if (is_32bit) {
+          as.movsxd(result, result);
+        }
         break;
+      }
 
-      case IT::Sub:
-      case IT::Subw:
-        as.sub(op1, op2);
+      case IT::Rori: {
+        as.mov(result, a);
+        as.ror(result, imm);
         break;
+      }
 
-      case IT::Xor:
-      case IT::Xori:
-        as.xor_(op1, op2);
+      case IT::Roriw: {
+        as.mov(result, a);
+        with_32bit([&] { as.ror(result, imm); });
+        as.movsxd(result, result);
         break;
+      }
 
-      case IT::Or:
-      case IT::Ori:
-        as.or_(op1, op2);
+      // Bit index of register operands is taken modulo 64.
+      case IT::Bclr:
+      case IT::Bset:
+      case IT::Binv:
+      case IT::Bclri:
+      case IT::Bseti:
+      case IT::Binvi: {
+        const auto bit = Arithmetic::reads_second_register(instruction_type) ? x64::Operand{b}
+                                                                               : x64::Operand{imm};
+        as.mov(result, a);
+
+        switch (instruction_type) {
+            // clang-format off
+          case IT::Bclr: case IT::Bclri: as.btr(result, bit); break;
+          case IT::Bset: case IT::Bseti: as.bts(result, bit); break;
+          case IT::Binv: case IT::Binvi: as.btc(result, bit); break;
+            // clang-format on
+
+          default:
+            unreachable();
+        }
         break;
+      }
 
-      case IT::And:
-      case IT::Andi:
-        as.and_(op1, op2);
+      case IT::Bext:
+      case IT::Bexti: {
+        if (instruction_type == IT::Bext && b != RegisterAllocation::c_reg) {
+          as.mov(RegisterAllocation::c_reg, b);
+        }
+        as.mov(result, a);
+        if (instruction_type == IT::Bext) {
+          as.shr(result, RegisterAllocation::c_reg);
+        } else {
+          as.shr(result, imm);
+        }
+        as.and_(result, 1);
         break;
+      }
 
-      case IT::Sll:
-      case IT::Slli:
-      case IT::Sllw:
-      case IT::Slliw:
-        as.shl(op1, op2);
+      case IT::Clz:
+      case IT::Ctz:
+      case IT::Cpop:
+      case IT::Clzw:
+      case IT::Ctzw:
+      case IT::Cpopw: {
+        const auto supported_by_host =
+          instruction_any_of(instruction_type, IT::Clz, IT::Clzw)   ? host_features.lzcnt
+          : instruction_any_of(instruction_type, IT::Ctz, IT::Ctzw) ? host_features.bmi1
+                                                                    : host_features.popcnt;
+        if (!supported_by_host) {
+          const auto guest_instruction = vm::Instruction::from_fields(
+            instruction_type, uint32_t(instruction.rd), uint32_t(instruction.rs1), 0, 0);
+
+          generate_host_call(jit::CodeBuffer::Relocation::Target::BitManipulation,
+                             uint64_t(&Arithmetic::bit_manipulation_raw), guest_instruction.raw(),
+                             a, 0);
+          break;
+        }
+
+        const auto is_32bit = instruction_any_of(instruction_type, IT::Clzw, IT::Ctzw, IT::Cpopw);
+
+        as.with_operand_size(is_32bit ? x64::OperandSize::Bits32 : x64::OperandSize::Bits64, [&] {
+          switch (instruction_type) {
+              // clang-format off
+            case IT::Clz: case IT::Clzw: as.lzcnt(dest, a); break;
+            case IT::Ctz: case IT::Ctzw: as.tzcnt(dest, a); break;
+            case IT::Cpop: case IT::Cpopw: as.popcnt(dest, a); break;
+              // clang-format on
+
+            default:
+              unreachable();
+          }
+        });
+        uses_result = false;
         break;
+      }
 
-      case IT::Srl:
-      case IT::Srlw:
-      case IT::Srli:
-      case IT::Srliw:
-        as.shr(op1, op2);
+      case IT::SextB:
+      case IT::SextH:
+      case IT::ZextH: {
+        switch (instruction_type) {
+            // clang-format off
+          case IT::SextB: as.movsxb(dest, a); break;
+          case IT::SextH: as.movsxw(dest, a); break;
+          case IT::ZextH: as.movzxw(dest, a); break;
+            // clang-format on
+
+          default:
+            unreachable();
+        }
+        uses_result = false;
         break;
+      }
 
-      case IT::Sra:
-      case IT::Srai:
-      case IT::Sraiw:
-      case IT::Sraw:
-        as.sar(op1, op2);
+      case IT::Rev8: {
+        as.mov(result, a);
+        as.bswap(result);
+        break;
+      }
+
+      // Byte is 0x80 after masking if it's non-zero, it's then spread to the whole byte.
+      //   t = ((a & 0x7f..7f) + 0x7f..7f | a) & 0x80..80
+      //   result = (t << 1) - (t >> 7)
+      case IT::OrcB: {
+        const auto scratch = RegisterAllocation::c_reg;
+
+        load_immediate_u(scratch, 0x7f7f'7f7f'7f7f'7f7f);
+        as.mov(result, a);
+        as.and_(result, scratch);
+        as.add(result, scratch);
+        as.or_(result, a);
+        load_immediate_u(scratch, 0x8080'8080'8080'8080);
+        as.and_(result, scratch);
+        as.mov(scratch, result);
+        as.shr(scratch, int64_t(7));
+        as.shl(result, int64_t(1));
+        as.sub(result, scratch);
         break;
+      }
 
       default:
         unreachable();
     }
+
+    if (uses_result) {
+      as.mov(dest, result);
+    }
+
+    register_cache.unlock_registers(rs1_reg, rs2_reg);
+    register_cache.unlock_register_dirty(dest);
   }
 
-  bool generate_instruction(const Instruction& instruction) {
-    const auto instruction_type = instruction.type();
+  bool generate_guest_instruction(const jit::ir::Instruction& instruction) {
+    const auto instruction_type = instruction.type;
 
     using IT = InstructionType;
+    using WO = RegisterCache::WriteOnly;
 
     switch (instruction_type) {
       case IT::Lui: {
-        if (instruction.rd() != Register::Zero) {
-          store_imm_to_register(instruction.rd(), RegisterAllocation::a_reg, instruction.imm());
+        if (instruction.rd != Register::Zero) {
+          const auto reg = register_cache.lock_register(WO{instruction.rd});
+          load_immediate(reg, instruction.imm);
+          register_cache.unlock_register_dirty(reg);
         }
         break;
       }
 
       case IT::Auipc: {
-        if (instruction.rd() != Register::Zero) {
-          store_uimm_to_register(instruction.rd(), RegisterAllocation::a_reg,
-                                 current_pc + instruction.imm());
+        if (instruction.rd != Register::Zero) {
+          const auto reg = register_cache.lock_register(WO{instruction.rd});
+          load_immediate_u(reg, current_pc + instruction.imm);
+          register_cache.unlock_register_dirty(reg);
         }
         break;
       }
 
       case IT::Jal: {
-        if (instruction.rd() != Register::Zero) {
-          store_uimm_to_register(instruction.rd(), RegisterAllocation::a_reg, current_pc + 4);
+        // Trace continues at the target of plain jumps.
+        if (instruction.rd == Register::Zero) {
+          break;
         }
 
-        const auto target = current_pc + instruction.imm();
-        generate_static_branch(target, RegisterAllocation::a_reg);
+        generate_direct_jump(instruction.rd, current_pc + instruction.imm);
 
         return false;
       }
 
       case IT::Jalr: {
-        load_register(RegisterAllocation::a_reg, instruction.rs1(), instruction.imm());
+        // Target is known at compile time (e.g. fused `auipc` + `jalr`).
+        if (instruction.rs1 == Register::Zero) {
+          generate_direct_jump(instruction.rd, uint64_t(instruction.imm) & ~uint64_t(1));
+          return false;
+        }
+
+        // Calculate the target before writing to `rd` as it may be the same register as `rs1`.
+        const auto target_reg = register_cache.lock_register(instruction.rs1);
+        load_offseted_register(RegisterAllocation::a_reg, target_reg, instruction.imm);
+        register_cache.unlock_register(target_reg);
+
+        // Mask off last bit as it is required by the architecture.
+        as.and_(RegisterAllocation::a_reg, -2);
 
-        if (instruction.rd() != Register::Zero) {
-          store_uimm_to_register(instruction.rd(), RegisterAllocation::b_reg, current_pc + 4);
+        if (instruction.rd != Register::Zero) {
+          const auto dest_reg = register_cache.lock_register(WO{instruction.rd});
+          load_immediate_u(dest_reg, next_pc);
+          register_cache.unlock_register_dirty(dest_reg);
         }
 
-        generate_dynamic_branch(RegisterAllocation::a_reg, RegisterAllocation::b_reg);
+        register_cache.flush_current_registers();
+
+        const auto is_call = is_link_register(instruction.rd);
+        const auto is_return = !is_call && is_link_register(instruction.rs1);
+
+        if (is_call && can_use_return_stack(next_pc)) {
+          generate_call(next_pc, [&] {
+            generate_dynamic_branch(RegisterAllocation::a_reg, RegisterAllocation::b_reg, true);
+          });
+        } else if (is_return && !single_step) {
+          generate_return(RegisterAllocation::a_reg);
+          generate_dynamic_branch(RegisterAllocation::a_reg, RegisterAllocation::b_reg);
+        } else {
+          generate_dynamic_branch(RegisterAllocation::a_reg, RegisterAllocation::b_reg, true);
+        }
 
         return false;
       }
@@ -348,29 +2206,12 @@ struct CodeGenerator {
       case IT::Bge:
       case IT::Bltu:
       case IT::Bgeu: {
-        load_register(RegisterAllocation::a_reg, instruction.rs1());
-
-        as.cmp(RegisterAllocation::a_reg, register_operand_or_zero(instruction.rs2()));
-
-        const auto fallthrough = as.allocate_label();
-
-        switch (instruction_type) {
-            // clang-format off
-          case IT::Beq: as.jne(fallthrough); break;
-          case IT::Bne: as.je(fallthrough); break;
-          case IT::Blt: as.jnl(fallthrough); break;
-          case IT::Bge: as.jnge(fallthrough); break;
-          case IT::Bltu: as.jnb(fallthrough); break;
-          case IT::Bgeu: as.jnae(fallthrough); break;
-            // clang-format on
-
-          default:
-            unreachable();
-        }
+        const auto [a, b] = register_cache.lock_registers(instruction.rs1, instruction.rs2);
 
-        generate_static_branch(current_pc + instruction.imm(), RegisterAllocation::a_reg);
+        as.cmp(materialize_register(a, RegisterAllocation::c_reg), source_operand(b));
+        generate_branch_side_exit(instruction);
 
-        as.insert_label(fallthrough);
+        register_cache.unlock_registers(a, b);
 
         break;
       }
@@ -382,15 +2223,16 @@ struct CodeGenerator {
       case IT::Lbu:
       case IT::Lhu:
       case IT::Lwu: {
-        if (instruction.rd() != Register::Zero) {
-          load_register(RegisterAllocation::a_reg, instruction.rs1(), instruction.imm());
-          generate_validate_memory_access(
-            RegisterAllocation::a_reg, RegisterAllocation::b_reg, RegisterAllocation::c_reg,
-            jit::utils::memory_access_size_log2(instruction_type), false);
+        if (instruction.rd != Register::Zero) {
+          const auto [address_reg, dest] =
+            register_cache.lock_registers(instruction.rs1, WO{instruction.rd});
+
+          load_offseted_register(RegisterAllocation::a_reg, address_reg, instruction.imm);
+          generate_validate_memory_access(instruction, RegisterAllocation::a_reg,
+                                          RegisterAllocation::b_reg, RegisterAllocation::c_reg);
 
           const auto address =
             x64::Memory::base_index(RegisterAllocation::memory_base, RegisterAllocation::a_reg, 1);
-          const auto dest = RegisterAllocation::b_reg;
 
           switch (instruction_type) {
               // clang-format off
@@ -411,7 +2253,8 @@ struct CodeGenerator {
               unreachable();
           }
 
-          store_register(instruction.rd(), dest);
+          register_cache.unlock_register(address_reg);
+          register_cache.unlock_register_dirty(dest);
         }
 
         break;
@@ -423,17 +2266,20 @@ struct CodeGenerator {
       case IT::Sd: {
         const auto access_size_log2 = jit::utils::memory_access_size_log2(instruction_type);
 
-        load_register(RegisterAllocation::a_reg, instruction.rs1(), instruction.imm());
-        generate_validate_memory_access(RegisterAllocation::a_reg, RegisterAllocation::b_reg,
-                                        RegisterAllocation::c_reg, access_size_log2, true);
+        const auto [address_reg, value_reg] =
+          register_cache.lock_registers(instruction.rs1, instruction.rs2);
 
-        load_register(RegisterAllocation::b_reg, instruction.rs2());
+        load_offseted_register(RegisterAllocation::a_reg, address_reg, instruction.imm);
+        generate_validate_memory_access(instruction, RegisterAllocation::a_reg,
+                                        RegisterAllocation::b_reg, RegisterAllocation::c_reg);
 
         const auto operand_size = access_size_log2_to_operand_size[access_size_log2];
         const auto address =
           x64::Memory::base_index(RegisterAllocation::memory_base, RegisterAllocation::a_reg, 1);
 
-        as.with_operand_size(operand_size, [&] { as.mov(address, RegisterAllocation::b_reg); });
+        as.with_operand_size(operand_size, [&] { as.mov(address, source_operand(value_reg)); });
+
+        register_cache.unlock_registers(address_reg, value_reg);
 
         break;
       }
@@ -449,41 +2295,34 @@ struct CodeGenerator {
       case IT::Slliw:
       case IT::Srliw:
       case IT::Sraiw: {
-        // Instructions with 1st source == destination and 64 bit operand size:
-        // op [rd], imm
+        if (instruction.rd != Register::Zero) {
+          const auto [a, dest] =
+            register_cache.lock_registers(instruction.rs1, WO{instruction.rd});
 
-        // Other instructions:
-        // mov rax, [rs1]
-        // op  rax, imm
-        // (movsx rax, eax)
-        // mov [rd], rax
+          const auto is_32bit =
+            instruction_any_of(instruction_type, IT::Addiw, IT::Slliw, IT::Srliw, IT::Sraiw);
+          const auto is_shift = instruction_any_of(instruction_type, IT::Slli, IT::Srli, IT::Srai,
+                                                   IT::Slliw, IT::Srliw, IT::Sraiw);
+
+          const auto imm = is_shift ? instruction.imm : int64_t(instruction.imm);
 
-        if (instruction.rd() != Register::Zero) {
-          if (instruction_type == IT::Addi && instruction.rs1() == Register::Zero) {
+          if (instruction_type == IT::Addi && is_zero_register(a)) {
             // li pseudoinstruction
-            store_imm_to_register(instruction.rd(), RegisterAllocation::a_reg, instruction.imm());
-          } else if (instruction_type == IT::Addi && instruction.imm() == 0) {
+            load_immediate(dest, imm);
+          } else if (instruction_type == IT::Addi && imm == 0) {
             // mv pseudoinstruction
-            load_register(RegisterAllocation::a_reg, instruction.rs1());
-            store_register(instruction.rd(), RegisterAllocation::a_reg);
-          } else if (instruction_type == IT::Addiw && instruction.imm() == 0) {
+            if (dest != a) {
+              as.mov(dest, a);
+            }
+          } else if (instruction_type == IT::Addiw && imm == 0) {
             // sext.w pseudoinstruction
-            as.movsxd(RegisterAllocation::a_reg, register_operand_or_zero(instruction.rs1()));
-            store_register(instruction.rd(), RegisterAllocation::a_reg);
+            as.movsxd(dest, source_operand(a));
           } else {
-            const auto is_32bit =
-              instruction_any_of(instruction_type, IT::Addiw, IT::Slliw, IT::Srliw, IT::Sraiw);
-
-            if (!is_32bit && instruction.rd() == instruction.rs1()) {
-              generate_binary_operation(instruction_type, register_operand(instruction.rd()),
-                                        instruction.imm());
-            } else {
-              load_register(RegisterAllocation::a_reg, instruction.rs1());
-              generate_binary_operation(instruction_type, RegisterAllocation::a_reg,
-                                        instruction.imm());
-              store_register(instruction.rd(), RegisterAllocation::a_reg, is_32bit);
-            }
+            generate_two_operand_instruction(instruction_type, dest, a, imm, is_32bit);
           }
+
+          register_cache.unlock_register(a);
+          register_cache.unlock_register_dirty(dest);
         }
 
         break;
@@ -493,30 +2332,22 @@ struct CodeGenerator {
       case IT::Sltu:
       case IT::Slti:
       case IT::Sltiu: {
-        if (instruction.rd() != Register::Zero) {
+        if (instruction.rd != Register::Zero) {
           const auto has_imm = instruction_any_of(instruction_type, IT::Slti, IT::Sltiu);
           const auto is_unsigned = instruction_any_of(instruction_type, IT::Sltu, IT::Sltiu);
 
-          // Instructions with immediate second argument:
           // xor   rax, rax
-          // cmp   [rs1], imm
+          // cmp   rs1, rs2/imm
           // setcc al
-          // mov   [rd], rax
+          // mov   rd, rax
 
-          // Instructions with register second argument:
-          // xor   rax, rax
-          // mov   rcx, [rs1]
-          // cmp   rcx, [rs2]
-          // setcc al
-          // mov   [rd], rax
+          const auto [a, b, dest] = register_cache.lock_registers(
+            instruction.rs1, has_imm ? Register::Zero : instruction.rs2, WO{instruction.rd});
 
           as.xor_(RegisterAllocation::a_reg, RegisterAllocation::a_reg);
-          if (has_imm) {
-            as.cmp(register_operand(instruction.rs1()), instruction.imm());
-          } else {
-            load_register(RegisterAllocation::b_reg, instruction.rs1());
-            as.cmp(RegisterAllocation::b_reg, register_operand_or_zero(instruction.rs2()));
-          }
+
+          as.cmp(materialize_register(a, RegisterAllocation::c_reg),
+                 has_imm ? x64::Operand{instruction.imm} : source_operand(b));
 
           if (is_unsigned) {
             as.setb(RegisterAllocation::a_reg);
@@ -524,7 +2355,10 @@ struct CodeGenerator {
             as.setl(RegisterAllocation::a_reg);
           }
 
-          store_register(instruction.rd(), RegisterAllocation::a_reg);
+          as.mov(dest, RegisterAllocation::a_reg);
+
+          register_cache.unlock_registers(a, b);
+          register_cache.unlock_register_dirty(dest);
         }
 
         break;
@@ -535,71 +2369,55 @@ struct CodeGenerator {
       case IT::Xor:
       case IT::Or:
       case IT::And:
-      case IT::Sll:
-      case IT::Srl:
-      case IT::Sra:
       case IT::Addw:
       case IT::Subw:
-      case IT::Sllw:
-      case IT::Srlw:
-      case IT::Sraw: {
-        // Instructions with 1st source == destination and 64 bit operand size:
-        // mov rcx, [rs2]
-        // op  [rd], rcx
-
-        // Other shift instructions:
-        // mov rax, [rs1]
-        // mov rcx, [rs2]
-        // op  rax, rcx
-        // (movsx rax, eax)
-        // mov [rd], rax
-
-        // Other instructions:
-        // mov rax, [rs1]
-        // op  rax, [rs2]
-        // (movsx rax, eax)
-        // mov [rd], rax
-
-        if (instruction.rd() != Register::Zero) {
-          const auto is_32bit =
-            instruction_any_of(instruction_type, IT::Addw, IT::Subw, IT::Sllw, IT::Srlw, IT::Sraw);
-          const auto is_shift = instruction_any_of(instruction_type, IT::Sll, IT::Srl, IT::Sra,
-                                                   IT::Sllw, IT::Srlw, IT::Sraw);
+      case IT::Mul:
+      case IT::Mulw: {
+        if (instruction.rd != Register::Zero) {
+          const auto [a, b, dest] = register_cache.lock_registers(
+            instruction.rs1, instruction.rs2, WO{instruction.rd});
 
-          if (!is_32bit && instruction.rd() == instruction.rs1()) {
-            generate_binary_operation(instruction_type, register_operand(instruction.rd()),
-                                      instruction.imm());
-          } else {
-            load_register(RegisterAllocation::a_reg, instruction.rs1());
+          const auto is_32bit = instruction_any_of(instruction_type, IT::Addw, IT::Subw, IT::Mulw);
+          const auto is_commutative = !instruction_any_of(instruction_type, IT::Sub, IT::Subw);
 
-            if (is_shift) {
-              load_register(RegisterAllocation::c_reg, instruction.rs2());
-            }
+          // Two operand `imul` doesn't take immediates.
+          const auto b_reg = instruction_any_of(instruction_type, IT::Mul, IT::Mulw)
+                               ? materialize_register(b, RegisterAllocation::c_reg)
+                               : b;
 
-            generate_binary_operation(
-              instruction_type, RegisterAllocation::a_reg,
-              is_shift ? RegisterAllocation::c_reg : register_operand_or_zero(instruction.rs2()));
+          generate_two_operand_instruction(instruction_type, dest, a, b_reg, is_32bit,
+                                           is_commutative);
 
-            store_register(instruction.rd(), RegisterAllocation::a_reg, is_32bit);
-          }
+          register_cache.unlock_registers(a, b);
+          register_cache.unlock_register_dirty(dest);
         }
 
         break;
       }
 
-      case IT::Mul:
-      case IT::Mulw: {
-        if (instruction.rd() != Register::Zero) {
-          const auto is_32bit = instruction_any_of(instruction_type, IT::Mulw);
+      case IT::Sll:
+      case IT::Srl:
+      case IT::Sra:
+      case IT::Sllw:
+      case IT::Srlw:
+      case IT::Sraw: {
+        // mov rcx,  rs2
+        // mov rd,   rs1
+        // op  rd,   cl
+        // (movsx rd, rd32)
 
-          load_register(RegisterAllocation::a_reg, instruction.rs1());
-          load_register(RegisterAllocation::b_reg, instruction.rs2());
+        if (instruction.rd != Register::Zero) {
+          const auto [a, b, dest] = register_cache.lock_registers(
+            instruction.rs1, instruction.rs2, WO{instruction.rd});
 
-          as.with_operand_size(is_32bit ? x64::OperandSize::Bits32 : x64::OperandSize::Bits64, [&] {
-            as.imul(RegisterAllocation::a_reg, RegisterAllocation::b_reg);
-          });
+          const auto is_32bit = instruction_any_of(instruction_type, IT::Sllw, IT::Srlw, IT::Sraw);
 
-          store_register(instruction.rd(), RegisterAllocation::a_reg, is_32bit);
+          as.mov(RegisterAllocation::c_reg, source_operand(b));
+          generate_two_operand_instruction(instruction_type, dest, a, RegisterAllocation::c_reg,
+                                           is_32bit);
+
+          register_cache.unlock_registers(a, b);
+          register_cache.unlock_register_dirty(dest);
         }
 
         break;
@@ -613,7 +2431,7 @@ struct CodeGenerator {
       case IT::Remu:
       case IT::Remw:
       case IT::Remuw: {
-        if (instruction.rd() != Register::Zero) {
+        if (instruction.rd != Register::Zero) {
           const auto is_32bit =
             instruction_any_of(instruction_type, IT::Divw, IT::Divuw, IT::Remw, IT::Remuw);
           const auto is_unsigned =
@@ -623,19 +2441,43 @@ struct CodeGenerator {
 
           const auto operand_size = is_32bit ? x64::OperandSize::Bits32 : x64::OperandSize::Bits64;
 
-          load_register(X64R::Rax, instruction.rs1());
-          load_register(X64R::Rbx, instruction.rs2());
+          // x64 division uses RDX:RAX as the dividend, take RDX away from the register cache.
+          register_cache.lock_platform_register(X64R::Rdx);
+
+          const auto [a, b, dest] = register_cache.lock_registers(
+            instruction.rs1, instruction.rs2, WO{instruction.rd});
 
+          as.mov(X64R::Rax, source_operand(a));
+          as.mov(X64R::Rbx, source_operand(b));
+
+          const auto check_overflow = as.allocate_label();
           const auto continue_division = as.allocate_label();
           const auto skip_division = as.allocate_label();
 
+          // Division by zero would crash the program too. Quotient has all bits set and
+          // remainder is equal to the dividend in that case.
+          as.with_operand_size(operand_size, [&] { as.test(X64R::Rbx, X64R::Rbx); });
+          as.jnz(check_overflow);
+
+          if (is_remainder) {
+            as.mov(X64R::Rdx, X64R::Rax);
+          } else {
+            as.mov(X64R::Rax, -1);
+          }
+          as.jmp(skip_division);
+
+          as.insert_label(check_overflow);
+
           // Handle case where signed disivion may overflow and crash the program.
+          // Quotient is equal to the dividend and remainder is 0 in that case.
           if (!is_unsigned) {
-            as.cmp(X64R::Rbx, -1);
+            as.with_operand_size(operand_size, [&] { as.cmp(X64R::Rbx, -1); });
             as.jne(continue_division);
 
             if (is_32bit) {
-              as.cmp(X64R::Rax, std::numeric_limits<int32_t>::min());
+              as.with_operand_size(operand_size, [&] {
+                as.cmp(X64R::Rax, std::numeric_limits<int32_t>::min());
+              });
             } else {
               as.mov(X64R::Rdx, std::numeric_limits<int64_t>::min());
               as.cmp(X64R::Rax, X64R::Rdx);
@@ -643,8 +2485,7 @@ struct CodeGenerator {
 
             as.jne(continue_division);
 
-            store_uimm_to_register(instruction.rd(), RegisterAllocation::a_reg, 0);
-
+            as.xor_(X64R::Rdx, X64R::Rdx);
             as.jmp(skip_division);
           }
 
@@ -660,9 +2501,18 @@ struct CodeGenerator {
             }
           });
 
-          store_register(instruction.rd(), is_remainder ? X64R::Rdx : X64R::Rax, is_32bit);
-
           as.insert_label(skip_division);
+
+          if (is_32bit) {
+            as.movsxd(dest, is_remainder ? X64R::Rdx : X64R::Rax);
+          } else {
+            as.mov(dest, is_remainder ? X64R::Rdx : X64R::Rax);
+          }
+
+          register_cache.unlock_registers(a, b);
+          register_cache.unlock_register_dirty(dest);
+
+          register_cache.unlock_platform_register(X64R::Rdx);
         }
 
         break;
@@ -671,14 +2521,117 @@ struct CodeGenerator {
       case IT::Mulh:
       case IT::Mulhu:
       case IT::Mulhsu: {
-        generate_exit(ArchExitReason::UnsupportedInstruction);
-        return false;
+        if (instruction.rd != Register::Zero) {
+          // One operand multiplication stores 128 bit result in RDX:RAX, take RDX away from the
+          // register cache.
+          register_cache.lock_platform_register(X64R::Rdx);
+
+          const auto [a, b, dest] = register_cache.lock_registers(
+            instruction.rs1, instruction.rs2, WO{instruction.rd});
+
+          as.mov(X64R::Rax, source_operand(a));
+          as.mov(X64R::Rbx, source_operand(b));
+
+          if (instruction_type == IT::Mulh) {
+            as.imul(X64R::Rbx);
+          } else {
+            as.mul(X64R::Rbx);
+          }
+
+          // Unsigned high half is too big by `b` if signed `a` is negative.
+          if (instruction_type == IT::Mulhsu) {
+            as.mov(X64R::Rax, source_operand(a));
+            as.sar(X64R::Rax, 63);
+            as.and_(X64R::Rax, X64R::Rbx);
+            as.sub(X64R::Rdx, X64R::Rax);
+          }
+
+          as.mov(dest, X64R::Rdx);
+
+          register_cache.unlock_registers(a, b);
+          register_cache.unlock_register_dirty(dest);
+
+          register_cache.unlock_platform_register(X64R::Rdx);
+        }
+
+        break;
       }
 
       case IT::Fence: {
+        // x64 only reorders stores with later loads, other orderings are always preserved.
+        const auto predecessors = (uint64_t(instruction.imm) >> 4) & 0xf;
+        const auto successors = uint64_t(instruction.imm) & 0xf;
+        if (is_multithreaded() && (predecessors & fence_writes) && (successors & fence_reads)) {
+          as.mfence();
+        }
+        break;
+      }
+
+      case IT::FenceI: {
+        // Blocks are invalidated when their code is written and the trace ends here.
+        break;
+      }
+
+      case IT::LrW:
+      case IT::LrD:
+      case IT::ScW:
+      case IT::ScD:
+      case IT::AmoswapW:
+      case IT::AmoaddW:
+      case IT::AmoxorW:
+      case IT::AmoandW:
+      case IT::AmoorW:
+      case IT::AmominW:
+      case IT::AmomaxW:
+      case IT::AmominuW:
+      case IT::AmomaxuW:
+      case IT::AmoswapD:
+      case IT::AmoaddD:
+      case IT::AmoxorD:
+      case IT::AmoandD:
+      case IT::AmoorD:
+      case IT::AmominD:
+      case IT::AmomaxD:
+      case IT::AmominuD:
+      case IT::AmomaxuD: {
+        generate_atomic_instruction(instruction);
+        break;
+      }
+
+      case IT::Flw:
+      case IT::Fld: {
+        generate_float_load(instruction);
+        break;
+      }
+
+      case IT::Fsw:
+      case IT::Fsd: {
+        generate_float_store(instruction);
+        break;
+      }
+
+      case IT::FmvXW:
+      case IT::FmvWX:
+      case IT::FmvXD:
+      case IT::FmvDX:
+      case IT::FsgnjD:
+      case IT::FsgnjnD:
+      case IT::FsgnjxD: {
+        generate_float_move(instruction);
         break;
       }
 
+      case IT::Csrrw:
+      case IT::Csrrs:
+      case IT::Csrrc:
+      case IT::Csrrwi:
+      case IT::Csrrsi:
+      case IT::Csrrci: {
+        // Floating point and vector CSR accesses are rare so they are left to the interpreter.
+        generate_exit(ArchExitReason::UnsupportedInstruction);
+        return false;
+      }
+
       case IT::Ecall: {
         generate_exit(ArchExitReason::Ecall);
         return false;
@@ -693,40 +2646,164 @@ struct CodeGenerator {
       }
 
       default:
-        fatal_error("unknown instruction {}", instruction);
+        if (Arithmetic::is_bit_manipulation(instruction_type)) {
+          generate_bit_manipulation(instruction);
+          break;
+        }
+        if (VectorArithmetic::is_vector_instruction(instruction_type)) {
+          generate_vector_instruction(instruction);
+          break;
+        }
+        if (!FloatArithmetic::is_float_operation(instruction_type)) {
+          fatal_error("unknown instruction {}", instruction_type);
+        }
+        generate_float_operation(instruction);
+        break;
     }
 
     return true;
   }
 
-  void generate_block(uint64_t block_pc) {
-    current_pc = block_pc;
+  // Exits the VM once the block becomes hot so it can be recompiled by the optimizing tier.
+  void generate_hot_counter_update() {
+    const auto hot_label = as.allocate_label();
 
-    while (true) {
-      uint32_t instruction_encoded;
-      if (!memory.read(current_pc, MemoryFlags::Execute, instruction_encoded)) {
-        generate_exit(ArchExitReason::InstructionFetchFault);
-        break;
+    load_relocated_value(RegisterAllocation::a_reg, jit::CodeBuffer::Relocation::Target::HotCounter,
+                         uint64_t(hot_counter));
+    as.sub(x64::Memory::base_disp(RegisterAllocation::a_reg, 0), 1);
+    as.jz(hot_label);
+
+    add_pending_exit(hot_label, ArchExitReason::BlockHot, false, current_pc);
+  }
+
+  bool generate_instruction(const jit::ir::Instruction& instruction) {
+    using WO = RegisterCache::WriteOnly;
+
+    switch (instruction.kind) {
+      case jit::ir::InstructionKind::Guest:
+        return generate_guest_instruction(instruction);
+
+      case jit::ir::InstructionKind::Constant: {
+        if (instruction.writes_rd()) {
+          const auto reg = register_cache.lock_register(WO{instruction.rd});
+          load_immediate(reg, instruction.imm);
+          register_cache.unlock_register_dirty(reg);
+        }
+        return true;
       }
 
-      Instruction instruction{instruction_encoded};
-      if (!generate_instruction(instruction)) {
-        break;
+      case jit::ir::InstructionKind::Move: {
+        if (instruction.writes_rd()) {
+          const auto [source, dest] =
+            register_cache.lock_registers(instruction.rs1, WO{instruction.rd});
+          if (dest != source) {
+            load_offseted_register(dest, source, 0);
+          }
+          register_cache.unlock_register(source);
+          register_cache.unlock_register_dirty(dest);
+        }
+        return true;
+      }
+
+      case jit::ir::InstructionKind::ZeroExtend: {
+        if (instruction.writes_rd()) {
+          const auto [source, dest] =
+            register_cache.lock_registers(instruction.rs1, WO{instruction.rd});
+          generate_zero_extend(dest, source, uint32_t(instruction.imm));
+          register_cache.unlock_register(source);
+          register_cache.unlock_register_dirty(dest);
+        }
+        return true;
       }
 
-      current_pc += 4;
+      case jit::ir::InstructionKind::SetAndBranch: {
+        const auto [a, b, dest] =
+          register_cache.lock_registers(instruction.rs1, instruction.rs2, WO{instruction.rd});
+        const auto is_unsigned =
+          instruction_any_of(instruction.type, InstructionType::Bltu, InstructionType::Bgeu);
+
+        // Flags of the comparison are reused by the branch.
+        as.xor_(RegisterAllocation::a_reg, RegisterAllocation::a_reg);
+        as.cmp(materialize_register(a, RegisterAllocation::c_reg), source_operand(b));
+        if (is_unsigned) {
+          as.setb(RegisterAllocation::a_reg);
+        } else {
+          as.setl(RegisterAllocation::a_reg);
+        }
+        as.mov(dest, RegisterAllocation::a_reg);
+
+        register_cache.unlock_registers(a, b);
+        register_cache.unlock_register_dirty(dest);
 
-      if (single_step) {
-        generate_exit(ArchExitReason::SingleStep);
-        break;
+        generate_branch_side_exit(instruction);
+
+        return true;
+      }
+
+      case jit::ir::InstructionKind::Nop:
+        return true;
+
+      default:
+        unreachable();
+    }
+  }
+
+  void generate_block(const jit::ir::Block& block) {
+    std::optional<x64::Label> loop_label;
+    if (!block.loop_guards.empty()) {
+      generate_loop_guards(block);
+
+      loop_label = as.allocate_label();
+      as.insert_label(*loop_label);
+    }
+
+    for (const auto& instruction : block.instructions) {
+      current_pc = instruction.pc;
+      next_pc = instruction.next_pc();
+
+      const auto continue_execution = generate_instruction(instruction);
+
+      register_cache.finish_instruction();
+
+      if (!continue_execution) {
+        return;
       }
     }
+
+    if (block.end_fetch_fault) {
+      generate_exit(ArchExitReason::InstructionFetchFault, block.end_pc);
+    } else if (loop_label && can_skip_loop_guards()) {
+      register_cache.flush_current_registers();
+
+      current_pc = block.end_pc;
+      generate_loop_back_edge(block, *loop_label);
+    } else {
+      generate_static_branch(block.end_pc, RegisterAllocation::a_reg);
+    }
   }
 
-  void generate_code(uint64_t pc) {
+  void generate_code(jit::Trace& trace,
+                     jit::ir::Block& block,
+                     const jit::TraceOptions& trace_options,
+                     uint64_t pc) {
     current_pc = pc;
 
-    generate_block(pc);
+    if (hot_counter) {
+      generate_hot_counter_update();
+    }
+
+    jit::build_trace(trace, memory, pc, trace_options);
+    jit::ir::build_block(block, trace);
+    jit::ir::fuse_instructions(block);
+    if (trace_options.optimize) {
+      jit::ir::optimize(block);
+    }
+    if (!memory.uses_byte_permissions()) {
+      jit::ir::combine_memory_checks(block);
+    }
+
+    generate_block(block);
+    generate_pending_branches();
     generate_pending_exits();
   }
 };
@@ -734,6 +2811,10 @@ struct CodeGenerator {
 std::span<const uint8_t> jit::x64::generate_block_code(CodegenContext& context,
                                                        const CodeBuffer& code_buffer,
                                                        const Memory& memory,
+                                                       const Abi& abi,
+                                                       const HostFeatures& host_features,
+                                                       const TraceOptions& trace_options,
+                                                       uint64_t* hot_counter,
                                                        bool single_step,
                                                        uint64_t pc) {
   context.prepare();
@@ -742,11 +2823,19 @@ std::span<const uint8_t> jit::x64::generate_block_code(CodegenContext& context,
     .as = context.assembler,
     .memory = memory,
     .code_buffer = code_buffer,
+    .abi = abi,
+    .host_features = host_features,
     .single_step = single_step,
+    .hot_counter = hot_counter,
     .pending_exits = context.pending_exits,
+    .pending_branches = context.pending_branches,
+    .link_sites = context.link_sites,
+    .inline_caches = context.inline_caches,
+    .fault_sites = context.fault_sites,
+    .relocations = context.relocations,
   };
 
-  code_generator.generate_code(pc);
+  code_generator.generate_code(context.trace, context.block, trace_options, pc);
 
   return code_generator.as.assembled_instructions();
 }
@@ -1,14 +1,21 @@
 #pragma once
 #include <vm/Memory.hpp>
 #include <vm/jit/CodeBuffer.hpp>
+#include <vm/jit/Trace.hpp>
 
+#include "Abi.hpp"
 #include "CodegenContext.hpp"
+#include "HostFeatures.hpp"
 
 namespace vm::jit::x64 {
 
 std::span<const uint8_t> generate_block_code(CodegenContext& context,
                                              const CodeBuffer& code_buffer,
                                              const Memory& memory,
+                                             const Abi& abi,
+                                             const HostFeatures& host_features,
+                                             const TraceOptions& trace_options,
+                                             uint64_t* hot_counter,
                                              bool single_step,
                                              uint64_t pc);
 
@@ -1,9 +1,16 @@
 #pragma once
 #include <asmlib_x64/Assembler.hpp>
 
+#include <vm/jit/CodeBuffer.hpp>
+#include <vm/jit/Trace.hpp>
+#include <vm/jit/ir/Block.hpp>
+
 #include "Exit.hpp"
+#include "RegisterCache.hpp"
 #include "Registers.hpp"
 
+#include <optional>
+
 namespace vm::jit::x64 {
 
 struct CodegenContext {
@@ -14,12 +21,40 @@ struct CodegenContext {
     ArchExitReason reason{};
     X64R pc_register{X64R::Rsp};
     uint64_t pc_value{};
+    RegisterCache::StateSnapshot snapshot;
+
+    // Code offset of the guest memory access which continues at this exit if it faults on
+    // a guard page.
+    std::optional<uint32_t> faulting_access_offset;
   };
   std::vector<Exit> pending_exits;
 
+  // Side exit of the trace which continues execution at `target_pc` in another block.
+  struct Branch {
+    asmlib::x64::Label label;
+    uint64_t target_pc{};
+    RegisterCache::StateSnapshot snapshot;
+  };
+  std::vector<Branch> pending_branches;
+
+  std::vector<CodeBuffer::LinkSite> link_sites;
+  std::vector<CodeBuffer::InlineCache> inline_caches;
+  std::vector<CodeBuffer::FaultSite> fault_sites;
+  std::vector<CodeBuffer::Relocation> relocations;
+
+  Trace trace;
+  ir::Block block;
+
   CodegenContext& prepare() {
     assembler.clear();
     pending_exits.clear();
+    pending_branches.clear();
+    link_sites.clear();
+    inline_caches.clear();
+    fault_sites.clear();
+    relocations.clear();
+    trace.clear();
+    block.clear();
 
     return *this;
   }
@@ -5,23 +5,47 @@
 #include <vm/jit/Executor.hpp>
 
 #include <memory>
+#include <span>
+#include <vector>
 
 #include "Abi.hpp"
 #include "CodegenContext.hpp"
+#include "HostFeatures.hpp"
 
 namespace vm::jit::x64 {
 
 class Executor : public jit::Executor {
-  std::shared_ptr<CodeBuffer> code_buffer;
-
+  Abi abi;
+  HostFeatures host_features;
   CodegenContext codegen_context;
+  std::vector<std::unique_ptr<CodegenContext>> compile_thread_contexts;
+  std::vector<std::unique_ptr<CodegenContext>> pretranslation_contexts;
 
   void* trampoline_fn = nullptr;
 
-  void* generate_code(const Memory& memory, uint64_t pc);
+  std::span<const uint8_t> generate_block(CodegenContext& context,
+                                          const Memory& memory,
+                                          uint64_t pc,
+                                          Tier tier);
+  CompiledBlock compile_block(CodegenContext& context, Memory& memory, uint64_t pc, Tier tier);
+  void* generate_code(Memory& memory, uint64_t pc, Tier tier);
+
+  uint32_t host_feature_mask() const override { return host_features.mask(); }
+
+  std::vector<std::unique_ptr<CodegenContext>>& context_pool(ContextPool pool);
+
+  void reserve_compile_contexts(ContextPool pool, size_t count) override;
+  CompiledBlock compile_in_background(ContextPool pool,
+                                      size_t thread_index,
+                                      Memory& memory,
+                                      uint64_t pc,
+                                      Tier tier) override;
 
  public:
-  explicit Executor(std::shared_ptr<CodeBuffer> code_buffer, const Abi& abi);
+  explicit Executor(std::shared_ptr<CodeBuffer> code_buffer,
+                    const Abi& abi,
+                    const TieringThresholds& tiering_thresholds);
+  ~Executor() override;
 
   ExitReason run(Memory& memory, Cpu& cpu) override;
 };
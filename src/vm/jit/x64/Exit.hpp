@@ -7,6 +7,8 @@ enum class ArchExitReason {
   OutOfBoundsPc,
   InstructionFetchFault,
   BlockNotGenerated,
+  InlineCacheMiss,
+  BlockHot,
   SingleStep,
   UndefinedInstruction,
   UnsupportedInstruction,
@@ -0,0 +1,48 @@
+#include "HostFeatures.hpp"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+using namespace vm::jit::x64;
+
+struct CpuidResult {
+  uint32_t eax{};
+  uint32_t ebx{};
+  uint32_t ecx{};
+  uint32_t edx{};
+};
+
+static CpuidResult cpuid(uint32_t leaf, uint32_t subleaf = 0) {
+  CpuidResult result;
+#ifdef _MSC_VER
+  int registers[4]{};
+  __cpuidex(registers, int(leaf), int(subleaf));
+  result = CpuidResult{uint32_t(registers[0]), uint32_t(registers[1]), uint32_t(registers[2]),
+                       uint32_t(registers[3])};
+#else
+  __cpuid_count(leaf, subleaf, result.eax, result.ebx, result.ecx, result.edx);
+#endif
+  return result;
+}
+
+HostFeatures HostFeatures::detect() {
+  HostFeatures features;
+
+  const auto max_leaf = cpuid(0).eax;
+  const auto max_extended_leaf = cpuid(0x8000'0000).eax;
+
+  if (max_leaf >= 1) {
+    features.popcnt = (cpuid(1).ecx & (1 << 23)) != 0;
+  }
+  if (max_leaf >= 7) {
+    features.bmi1 = (cpuid(7, 0).ebx & (1 << 3)) != 0;
+  }
+  if (max_extended_leaf >= 0x8000'0001) {
+    features.lzcnt = (cpuid(0x8000'0001).ecx & (1 << 5)) != 0;
+  }
+
+  return features;
+}
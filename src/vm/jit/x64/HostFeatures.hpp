@@ -0,0 +1,24 @@
+#pragma once
+#include <cstdint>
+
+namespace vm::jit::x64 {
+
+// Optional instruction set extensions of the host CPU which are used by the generated code.
+// Instructions that need a missing extension are computed by host calls instead.
+struct HostFeatures {
+  // `lzcnt` (ABM). Older CPUs decode it as `bsr` which gives different results.
+  bool lzcnt{};
+  // `tzcnt` (BMI1). Older CPUs decode it as `bsf` which gives different results.
+  bool bmi1{};
+  bool popcnt{};
+
+  // Identifies the features in the translation cache so code is never loaded on a host which
+  // can't run it.
+  uint32_t mask() const {
+    return uint32_t(lzcnt) | (uint32_t(bmi1) << 1) | (uint32_t(popcnt) << 2);
+  }
+
+  static HostFeatures detect();
+};
+
+}  // namespace vm::jit::x64
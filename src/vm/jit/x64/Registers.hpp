@@ -1,6 +1,8 @@
 #pragma once
 #include <asmlib_x64/Operand.hpp>
 
+#include <iterator>
+
 namespace vm::jit::x64 {
 
 using X64R = asmlib::x64::Register;
@@ -15,12 +17,22 @@ class RegisterAllocation {
 
   constexpr static auto trampoline_block = X64R::R11;
 
+  // Value of the stack pointer on JIT code entry. Guest calls push return address stack entries
+  // on the host stack and exits reset the stack pointer back to this value.
+  constexpr static auto stack_base = X64R::R11;
+
   constexpr static auto a_reg = X64R::Rax;
   constexpr static auto b_reg = X64R::Rbx;
   constexpr static auto c_reg = X64R::Rcx;
 
   constexpr static auto exit_reason = X64R::Rax;
   constexpr static auto exit_pc = X64R::Rbx;
+  constexpr static auto exit_data = X64R::Rcx;
+
+  constexpr static X64R cache[]{
+    X64R::Rdx, X64R::Rbp, X64R::R12, X64R::R13, X64R::R14, X64R::R15,
+  };
+  constexpr static size_t cache_size = std::size(cache);
 };
 
 }  // namespace vm::jit::x64
\ No newline at end of file
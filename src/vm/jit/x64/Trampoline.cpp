@@ -6,10 +6,9 @@
 using namespace vm::jit;
 using namespace vm::jit::x64;
 
-using asmlib::x64::Memory;
-
 void* x64::generate_trampoline(CodegenContext& context, CodeBuffer& code_buffer, const Abi& abi) {
   using RA = RegisterAllocation;
+  using asmlib::x64::Memory;
 
   auto& as = context.prepare().assembler;
 
@@ -38,7 +37,14 @@ void* x64::generate_trampoline(CodegenContext& context, CodeBuffer& code_buffer,
     as.push(RA::trampoline_block);
   }
 
-  as.call(Memory::base_disp(RA::trampoline_block, offsetof(TrampolineBlock, entrypoint)));
+  as.mov(RA::a_reg,
+         Memory::base_disp(RA::trampoline_block, offsetof(TrampolineBlock, entrypoint)));
+
+  // Stack pointer will be decremented by 8 after the call.
+  as.mov(RA::stack_base, X64R::Rsp);
+  as.sub(RA::stack_base, 8);
+
+  as.call(RA::a_reg);
 
   as.pop(RA::trampoline_block);
   if (needs_extra_push) {
@@ -48,6 +54,8 @@ void* x64::generate_trampoline(CodegenContext& context, CodeBuffer& code_buffer,
   as.mov(Memory::base_disp(RA::trampoline_block, offsetof(TrampolineBlock, exit_reason)),
          RA::exit_reason);
   as.mov(Memory::base_disp(RA::trampoline_block, offsetof(TrampolineBlock, exit_pc)), RA::exit_pc);
+  as.mov(Memory::base_disp(RA::trampoline_block, offsetof(TrampolineBlock, exit_data)),
+         RA::exit_data);
 
   for (const auto r : std::ranges::reverse_view(abi.callee_saved_regs)) {
     as.pop(r);
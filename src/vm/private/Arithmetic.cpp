@@ -0,0 +1,213 @@
+#include "Arithmetic.hpp"
+
+#include <base/Error.hpp>
+
+#include <bit>
+#include <limits>
+
+using namespace vm;
+
+using IT = InstructionType;
+
+static uint64_t signextend32(uint64_t value) {
+  return uint64_t(int64_t(int32_t(value)));
+}
+
+uint64_t Arithmetic::mulh(uint64_t a, uint64_t b) {
+  // Signed operands are interpreted as unsigned ones increased by 2^64 when negative.
+  auto result = mulhu(a, b);
+  if (int64_t(a) < 0) {
+    result -= b;
+  }
+  if (int64_t(b) < 0) {
+    result -= a;
+  }
+  return result;
+}
+
+uint64_t Arithmetic::mulhu(uint64_t a, uint64_t b) {
+  const auto a_lo = a & 0xffff'ffff;
+  const auto a_hi = a >> 32;
+  const auto b_lo = b & 0xffff'ffff;
+  const auto b_hi = b >> 32;
+
+  const auto lo_lo = a_lo * b_lo;
+  const auto lo_hi = a_lo * b_hi;
+  const auto hi_lo = a_hi * b_lo;
+  const auto hi_hi = a_hi * b_hi;
+
+  const auto middle = (lo_lo >> 32) + (lo_hi & 0xffff'ffff) + (hi_lo & 0xffff'ffff);
+
+  return hi_hi + (lo_hi >> 32) + (hi_lo >> 32) + (middle >> 32);
+}
+
+uint64_t Arithmetic::mulhsu(uint64_t a, uint64_t b) {
+  auto result = mulhu(a, b);
+  if (int64_t(a) < 0) {
+    result -= b;
+  }
+  return result;
+}
+
+uint64_t Arithmetic::div(uint64_t a, uint64_t b) {
+  if (b == 0) {
+    return std::numeric_limits<uint64_t>::max();
+  }
+  if (int64_t(a) == std::numeric_limits<int64_t>::min() && int64_t(b) == -1) {
+    return a;
+  }
+  return uint64_t(int64_t(a) / int64_t(b));
+}
+
+uint64_t Arithmetic::divu(uint64_t a, uint64_t b) {
+  if (b == 0) {
+    return std::numeric_limits<uint64_t>::max();
+  }
+  return a / b;
+}
+
+uint64_t Arithmetic::rem(uint64_t a, uint64_t b) {
+  if (b == 0) {
+    return a;
+  }
+  if (int64_t(a) == std::numeric_limits<int64_t>::min() && int64_t(b) == -1) {
+    return 0;
+  }
+  return uint64_t(int64_t(a) % int64_t(b));
+}
+
+uint64_t Arithmetic::remu(uint64_t a, uint64_t b) {
+  if (b == 0) {
+    return a;
+  }
+  return a % b;
+}
+
+uint64_t Arithmetic::divw(uint64_t a, uint64_t b) {
+  const auto a32 = int32_t(a);
+  const auto b32 = int32_t(b);
+
+  if (b32 == 0) {
+    return std::numeric_limits<uint64_t>::max();
+  }
+  if (a32 == std::numeric_limits<int32_t>::min() && b32 == -1) {
+    return signextend32(uint32_t(a32));
+  }
+  return signextend32(uint32_t(a32 / b32));
+}
+
+uint64_t Arithmetic::divuw(uint64_t a, uint64_t b) {
+  const auto a32 = uint32_t(a);
+  const auto b32 = uint32_t(b);
+
+  if (b32 == 0) {
+    return std::numeric_limits<uint64_t>::max();
+  }
+  return signextend32(a32 / b32);
+}
+
+uint64_t Arithmetic::remw(uint64_t a, uint64_t b) {
+  const auto a32 = int32_t(a);
+  const auto b32 = int32_t(b);
+
+  if (b32 == 0) {
+    return signextend32(uint32_t(a32));
+  }
+  if (a32 == std::numeric_limits<int32_t>::min() && b32 == -1) {
+    return 0;
+  }
+  return signextend32(uint32_t(a32 % b32));
+}
+
+uint64_t Arithmetic::remuw(uint64_t a, uint64_t b) {
+  const auto a32 = uint32_t(a);
+  const auto b32 = uint32_t(b);
+
+  if (b32 == 0) {
+    return signextend32(a32);
+  }
+  return signextend32(a32 % b32);
+}
+
+bool Arithmetic::is_bit_manipulation(InstructionType type) {
+  return uint32_t(type) >= uint32_t(IT::Sh1add) && uint32_t(type) <= uint32_t(IT::Rev8);
+}
+
+bool Arithmetic::reads_second_register(InstructionType type) {
+  return uint32_t(type) >= uint32_t(IT::Sh1add) && uint32_t(type) <= uint32_t(IT::Bset);
+}
+
+uint64_t Arithmetic::bit_manipulation(InstructionType type, uint64_t a, uint64_t b) {
+  const auto a32 = uint32_t(a);
+  const auto bit = uint64_t(1) << (b & 63);
+
+  switch (type) {
+      // clang-format off
+    case IT::Sh1add:   return (a << 1) + b;
+    case IT::Sh2add:   return (a << 2) + b;
+    case IT::Sh3add:   return (a << 3) + b;
+    case IT::AddUw:    return uint64_t(a32) + b;
+    case IT::Sh1addUw: return (uint64_t(a32) << 1) + b;
+    case IT::Sh2addUw: return (uint64_t(a32) << 2) + b;
+    case IT::Sh3addUw: return (uint64_t(a32) << 3) + b;
+    case IT::SlliUw:   return uint64_t(a32) << (b & 63);
+
+    case IT::Andn: return a & ~b;
+    case IT::Orn:  return a | ~b;
+    case IT::Xnor: return ~(a ^ b);
+    case IT::Min:  return int64_t(a) < int64_t(b) ? a : b;
+    case IT::Minu: return a < b ? a : b;
+    case IT::Max:  return int64_t(a) > int64_t(b) ? a : b;
+    case IT::Maxu: return a > b ? a : b;
+
+    case IT::Rol:   return std::rotl(a, int(b & 63));
+    case IT::Ror:   return std::rotr(a, int(b & 63));
+    case IT::Rori:  return std::rotr(a, int(b & 63));
+    case IT::Rolw:  return signextend32(std::rotl(a32, int(b & 31)));
+    case IT::Rorw:  return signextend32(std::rotr(a32, int(b & 31)));
+    case IT::Roriw: return signextend32(std::rotr(a32, int(b & 31)));
+
+    case IT::Bclr: case IT::Bclri: return a & ~bit;
+    case IT::Bset: case IT::Bseti: return a | bit;
+    case IT::Binv: case IT::Binvi: return a ^ bit;
+    case IT::Bext: case IT::Bexti: return (a >> (b & 63)) & 1;
+
+    case IT::Clz:   return std::countl_zero(a);
+    case IT::Clzw:  return std::countl_zero(a32);
+    case IT::Ctz:   return std::countr_zero(a);
+    case IT::Ctzw:  return std::countr_zero(a32);
+    case IT::Cpop:  return std::popcount(a);
+    case IT::Cpopw: return std::popcount(a32);
+    case IT::SextB: return uint64_t(int64_t(int8_t(a)));
+    case IT::SextH: return uint64_t(int64_t(int16_t(a)));
+    case IT::ZextH: return uint16_t(a);
+      // clang-format on
+
+    case IT::OrcB: {
+      uint64_t result = 0;
+      for (uint32_t i = 0; i < 64; i += 8) {
+        if (((a >> i) & 0xff) != 0) {
+          result |= uint64_t(0xff) << i;
+        }
+      }
+      return result;
+    }
+
+    case IT::Rev8: {
+      uint64_t result = 0;
+      for (uint32_t i = 0; i < 64; i += 8) {
+        result = (result << 8) | ((a >> i) & 0xff);
+      }
+      return result;
+    }
+
+    default:
+      unreachable();
+  }
+}
+
+uint64_t Arithmetic::bit_manipulation_raw(RegisterState* state,
+                                          uint64_t raw_instruction,
+                                          uint64_t rs1_value) {
+  return bit_manipulation(Instruction::from_raw(raw_instruction).type(), rs1_value, 0);
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdint>
+
+#include <vm/Instruction.hpp>
+#include <vm/RegisterState.hpp>
+
+namespace vm {
+
+// RV64M and Zba/Zbb/Zbs operations shared by the interpreter and the JIT constant folding.
+// Division by zero and signed division overflow don't trap and produce results defined by the
+// RISC-V spec.
+class Arithmetic {
+ public:
+  static uint64_t mulh(uint64_t a, uint64_t b);
+  static uint64_t mulhu(uint64_t a, uint64_t b);
+  static uint64_t mulhsu(uint64_t a, uint64_t b);
+
+  static uint64_t div(uint64_t a, uint64_t b);
+  static uint64_t divu(uint64_t a, uint64_t b);
+  static uint64_t rem(uint64_t a, uint64_t b);
+  static uint64_t remu(uint64_t a, uint64_t b);
+
+  static uint64_t divw(uint64_t a, uint64_t b);
+  static uint64_t divuw(uint64_t a, uint64_t b);
+  static uint64_t remw(uint64_t a, uint64_t b);
+  static uint64_t remuw(uint64_t a, uint64_t b);
+
+  static bool is_bit_manipulation(InstructionType type);
+  static bool reads_second_register(InstructionType type);
+
+  // `b` is the value of `rs2` or the immediate, it's ignored by unary operations.
+  static uint64_t bit_manipulation(InstructionType type, uint64_t a, uint64_t b);
+
+  // Called by the generated code for unary bit manipulation instructions which the host can't
+  // run, `raw_instruction` comes from `Instruction::raw()`.
+  static uint64_t bit_manipulation_raw(RegisterState* state,
+                                       uint64_t raw_instruction,
+                                       uint64_t rs1_value);
+};
+
+}  // namespace vm
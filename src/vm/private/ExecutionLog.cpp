@@ -16,5 +16,17 @@ void ExecutionLog::print_execution_step(const RegisterState& old_state,
     }
   }
 
+  for (size_t i = 0; i < 32; ++i) {
+    const auto reg = FloatRegister(i);
+
+    if (old_state.get(reg) != new_state.get(reg)) {
+      base::format_to(std::back_inserter(s), "{}:{:x} ", reg, new_state.get(reg));
+    }
+  }
+
+  if (old_state.fcsr() != new_state.fcsr()) {
+    base::format_to(std::back_inserter(s), "fcsr:{:x} ", new_state.fcsr());
+  }
+
   log_info("{:x} | {}", old_state.pc(), s);
 }
\ No newline at end of file
@@ -0,0 +1,569 @@
+#include "FloatArithmetic.hpp"
+
+#include <base/Error.hpp>
+
+#include <bit>
+#include <cfenv>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+
+using namespace vm;
+
+using IT = InstructionType;
+using RoundingMode = Instruction::RoundingMode;
+
+constexpr uint32_t flag_inexact = 1 << 0;
+constexpr uint32_t flag_underflow = 1 << 1;
+constexpr uint32_t flag_overflow = 1 << 2;
+constexpr uint32_t flag_divide_by_zero = 1 << 3;
+constexpr uint32_t flag_invalid = 1 << 4;
+
+constexpr uint32_t fflags_mask = 0b11111;
+constexpr uint32_t frm_shift = 5;
+
+constexpr uint32_t csr_fflags = 0x001;
+constexpr uint32_t csr_frm = 0x002;
+constexpr uint32_t csr_fcsr = 0x003;
+
+template <typename T>
+struct FloatBits;
+
+template <>
+struct FloatBits<float> {
+  using Type = uint32_t;
+  constexpr static Type canonical_nan = 0x7fc0'0000;
+  constexpr static Type quiet_bit = 0x0040'0000;
+};
+
+template <>
+struct FloatBits<double> {
+  using Type = uint64_t;
+  constexpr static Type canonical_nan = 0x7ff8'0000'0000'0000;
+  constexpr static Type quiet_bit = 0x0008'0000'0000'0000;
+};
+
+static uint64_t sign_extend_32(uint64_t value) {
+  return uint64_t(int64_t(int32_t(value)));
+}
+
+static bool between(InstructionType type, InstructionType first, InstructionType last) {
+  return uint32_t(type) >= uint32_t(first) && uint32_t(type) <= uint32_t(last);
+}
+
+// Single precision values which are not properly NaN-boxed are read as the canonical NaN.
+template <typename T>
+static T read(const RegisterState& state, FloatRegister reg) {
+  const auto value = state.get(reg);
+  if constexpr (std::is_same_v<T, float>) {
+    return std::bit_cast<float>((value >> 32) == 0xffff'ffff ? uint32_t(value)
+                                                              : FloatBits<float>::canonical_nan);
+  } else {
+    return std::bit_cast<double>(value);
+  }
+}
+
+template <typename T>
+static uint64_t to_register_bits(typename FloatBits<T>::Type bits) {
+  if constexpr (std::is_same_v<T, float>) {
+    return FloatArithmetic::box(bits);
+  } else {
+    return bits;
+  }
+}
+
+template <typename T>
+static uint64_t to_register(T value) {
+  return to_register_bits<T>(std::isnan(value) ? FloatBits<T>::canonical_nan
+                                               : std::bit_cast<typename FloatBits<T>::Type>(value));
+}
+
+template <typename T>
+static bool is_signaling_nan(T value) {
+  return std::isnan(value) &&
+         (std::bit_cast<typename FloatBits<T>::Type>(value) & FloatBits<T>::quiet_bit) == 0;
+}
+
+static void accrue_flags(RegisterState& state, uint32_t flags) {
+  state.set_fcsr(state.fcsr() | flags);
+}
+
+static RoundingMode resolve_rounding_mode(const RegisterState& state,
+                                          const Instruction& instruction) {
+  const auto mode = instruction.rounding_mode();
+  return mode == RoundingMode::Dynamic ? RoundingMode(state.fcsr() >> frm_shift) : mode;
+}
+
+// Host FPU doesn't support rounding to nearest with ties to max magnitude, ties to even is used
+// instead (it only differs for results exactly halfway between two representable values).
+static int host_rounding_mode(RoundingMode mode) {
+  switch (mode) {
+      // clang-format off
+    case RoundingMode::NearestEven:         return FE_TONEAREST;
+    case RoundingMode::TowardZero:          return FE_TOWARDZERO;
+    case RoundingMode::Down:                return FE_DOWNWARD;
+    case RoundingMode::Up:                  return FE_UPWARD;
+    case RoundingMode::NearestMaxMagnitude: return FE_TONEAREST;
+      // clang-format on
+
+    default:
+      unreachable();
+  }
+}
+
+static uint32_t host_exception_flags() {
+  const auto exceptions = std::fetestexcept(FE_ALL_EXCEPT);
+
+  uint32_t flags = 0;
+  if (exceptions & FE_INEXACT) {
+    flags |= flag_inexact;
+  }
+  if (exceptions & FE_UNDERFLOW) {
+    flags |= flag_underflow;
+  }
+  if (exceptions & FE_OVERFLOW) {
+    flags |= flag_overflow;
+  }
+  if (exceptions & FE_DIVBYZERO) {
+    flags |= flag_divide_by_zero;
+  }
+  if (exceptions & FE_INVALID) {
+    flags |= flag_invalid;
+  }
+
+  return flags;
+}
+
+// Volatile round trip keeps the compiler from moving the computation across the accesses to the
+// host floating point environment.
+template <typename T>
+static T barrier(T value) {
+  volatile T copy = value;
+  return copy;
+}
+
+// Runs the computation on the host FPU and accrues exceptions it raised. Host code always runs
+// with round to nearest so the rounding mode is only switched for other modes.
+template <typename Fn, typename... Args>
+static auto compute(RegisterState& state, RoundingMode mode, Fn&& operation, Args... args) {
+  const auto host_mode = host_rounding_mode(mode);
+
+  std::feclearexcept(FE_ALL_EXCEPT);
+  if (host_mode != FE_TONEAREST) {
+    std::fesetround(host_mode);
+  }
+
+  const auto result = barrier(operation(barrier(args)...));
+
+  if (host_mode != FE_TONEAREST) {
+    std::fesetround(FE_TONEAREST);
+  }
+  accrue_flags(state, host_exception_flags());
+
+  return result;
+}
+
+template <typename T>
+static T round_to_integer(T value, RoundingMode mode) {
+  switch (mode) {
+      // clang-format off
+    case RoundingMode::NearestEven:         return std::nearbyint(value);
+    case RoundingMode::TowardZero:          return std::trunc(value);
+    case RoundingMode::Down:                return std::floor(value);
+    case RoundingMode::Up:                  return std::ceil(value);
+    case RoundingMode::NearestMaxMagnitude: return std::round(value);
+      // clang-format on
+
+    default:
+      unreachable();
+  }
+}
+
+// Out of range values (including NaNs) saturate and raise the invalid exception.
+template <typename I, typename T>
+static I convert_to_integer(RegisterState& state, T value, RoundingMode mode) {
+  const auto upper_bound = std::ldexp(T(1), std::numeric_limits<I>::digits);
+  const auto lower_bound = std::is_signed_v<I> ? -upper_bound : T(0);
+
+  if (std::isnan(value)) {
+    accrue_flags(state, flag_invalid);
+    return std::numeric_limits<I>::max();
+  }
+
+  const auto rounded = round_to_integer(value, mode);
+  if (rounded >= upper_bound) {
+    accrue_flags(state, flag_invalid);
+    return std::numeric_limits<I>::max();
+  }
+  if (rounded < lower_bound) {
+    accrue_flags(state, flag_invalid);
+    return std::numeric_limits<I>::min();
+  }
+
+  if (rounded != value) {
+    accrue_flags(state, flag_inexact);
+  }
+
+  return I(rounded);
+}
+
+template <typename T>
+static T convert_from_integer(RegisterState& state,
+                              RoundingMode mode,
+                              InstructionType type,
+                              uint64_t value) {
+  switch (type) {
+    case IT::FcvtSW:
+      return compute(state, mode, [](int32_t v) { return T(v); }, int32_t(value));
+    case IT::FcvtSWu:
+      return compute(state, mode, [](uint32_t v) { return T(v); }, uint32_t(value));
+    case IT::FcvtSL:
+      return compute(state, mode, [](int64_t v) { return T(v); }, int64_t(value));
+    case IT::FcvtSLu:
+      return compute(state, mode, [](uint64_t v) { return T(v); }, value);
+
+    default:
+      unreachable();
+  }
+}
+
+// RISC-V minimum and maximum return the non-NaN operand and order -0.0 before +0.0.
+template <typename T>
+static T minimum_maximum(RegisterState& state, T a, T b, bool maximum) {
+  if (is_signaling_nan(a) || is_signaling_nan(b)) {
+    accrue_flags(state, flag_invalid);
+  }
+
+  if (std::isnan(a) || std::isnan(b)) {
+    return std::isnan(a) ? b : a;
+  }
+
+  if (a == b) {
+    return std::signbit(a) == maximum ? b : a;
+  }
+
+  return (a < b) == maximum ? b : a;
+}
+
+// Equality is a quiet comparison, ordered comparisons are signaling ones.
+template <typename T>
+static uint64_t compare(RegisterState& state, InstructionType type, T a, T b) {
+  const auto signaling = type != IT::FeqS;
+  if ((signaling && (std::isnan(a) || std::isnan(b))) || is_signaling_nan(a) ||
+      is_signaling_nan(b)) {
+    accrue_flags(state, flag_invalid);
+  }
+
+  switch (type) {
+      // clang-format off
+    case IT::FeqS: return a == b;
+    case IT::FltS: return a < b;
+    case IT::FleS: return a <= b;
+      // clang-format on
+
+    default:
+      unreachable();
+  }
+}
+
+template <typename T>
+static uint64_t classify(T value) {
+  const auto negative = std::signbit(value);
+
+  switch (std::fpclassify(value)) {
+    case FP_INFINITE:
+      return negative ? 1 << 0 : 1 << 7;
+    case FP_NORMAL:
+      return negative ? 1 << 1 : 1 << 6;
+    case FP_SUBNORMAL:
+      return negative ? 1 << 2 : 1 << 5;
+    case FP_ZERO:
+      return negative ? 1 << 3 : 1 << 4;
+    case FP_NAN:
+      return is_signaling_nan(value) ? 1 << 8 : 1 << 9;
+
+    default:
+      unreachable();
+  }
+}
+
+template <typename T>
+static typename FloatBits<T>::Type inject_sign(InstructionType type,
+                                               typename FloatBits<T>::Type a,
+                                               typename FloatBits<T>::Type b) {
+  using Bits = typename FloatBits<T>::Type;
+  constexpr auto sign = Bits(1) << (sizeof(Bits) * 8 - 1);
+
+  switch (type) {
+      // clang-format off
+    case IT::FsgnjS:  return (a & ~sign) | (b & sign);
+    case IT::FsgnjnS: return (a & ~sign) | (~b & sign);
+    case IT::FsgnjxS: return a ^ (b & sign);
+      // clang-format on
+
+    default:
+      unreachable();
+  }
+}
+
+// Fused multiply-add raises the invalid exception for infinity times zero even if the addend is a
+// quiet NaN.
+template <typename T>
+static T fused_multiply_add(RegisterState& state, RoundingMode mode, T a, T b, T c) {
+  if ((std::isinf(a) && b == T(0)) || (a == T(0) && std::isinf(b))) {
+    accrue_flags(state, flag_invalid);
+  }
+  return compute(state, mode, [](T x, T y, T z) { return std::fma(x, y, z); }, a, b, c);
+}
+
+// `type` is the single precision equivalent of the executed instruction.
+template <typename T>
+static uint64_t execute_typed(RegisterState& state,
+                              const Instruction& instruction,
+                              InstructionType type,
+                              uint64_t rs1_value) {
+  using Bits = typename FloatBits<T>::Type;
+
+  const auto mode = FloatArithmetic::uses_rounding_mode(type)
+                      ? resolve_rounding_mode(state, instruction)
+                      : RoundingMode::NearestEven;
+
+  const auto a = read<T>(state, instruction.frs1());
+  const auto b = read<T>(state, instruction.frs2());
+  const auto c = read<T>(state, instruction.frs3());
+
+  const auto set_result = [&](T value) { state.set(instruction.frd(), to_register(value)); };
+
+  switch (type) {
+      // clang-format off
+    case IT::FmaddS:  set_result(fused_multiply_add(state, mode, a, b, c)); break;
+    case IT::FmsubS:  set_result(fused_multiply_add(state, mode, a, b, -c)); break;
+    case IT::FnmsubS: set_result(fused_multiply_add(state, mode, -a, b, c)); break;
+    case IT::FnmaddS: set_result(fused_multiply_add(state, mode, -a, b, -c)); break;
+
+    case IT::FaddS: set_result(compute(state, mode, [](T x, T y) { return x + y; }, a, b)); break;
+    case IT::FsubS: set_result(compute(state, mode, [](T x, T y) { return x - y; }, a, b)); break;
+    case IT::FmulS: set_result(compute(state, mode, [](T x, T y) { return x * y; }, a, b)); break;
+    case IT::FdivS: set_result(compute(state, mode, [](T x, T y) { return x / y; }, a, b)); break;
+    case IT::FsqrtS: set_result(compute(state, mode, [](T x) { return std::sqrt(x); }, a)); break;
+
+    case IT::FminS: set_result(minimum_maximum(state, a, b, false)); break;
+    case IT::FmaxS: set_result(minimum_maximum(state, a, b, true)); break;
+
+    case IT::FcvtWS:  return sign_extend_32(convert_to_integer<int32_t>(state, a, mode));
+    case IT::FcvtWuS: return sign_extend_32(convert_to_integer<uint32_t>(state, a, mode));
+    case IT::FcvtLS:  return uint64_t(convert_to_integer<int64_t>(state, a, mode));
+    case IT::FcvtLuS: return convert_to_integer<uint64_t>(state, a, mode);
+
+    case IT::FeqS:    return compare(state, type, a, b);
+    case IT::FltS:    return compare(state, type, a, b);
+    case IT::FleS:    return compare(state, type, a, b);
+    case IT::FclassS: return classify(a);
+      // clang-format on
+
+    case IT::FcvtSW:
+    case IT::FcvtSWu:
+    case IT::FcvtSL:
+    case IT::FcvtSLu: {
+      set_result(convert_from_integer<T>(state, mode, type, rs1_value));
+      break;
+    }
+
+    case IT::FsgnjS:
+    case IT::FsgnjnS:
+    case IT::FsgnjxS: {
+      const auto result = inject_sign<T>(type, std::bit_cast<Bits>(a), std::bit_cast<Bits>(b));
+      state.set(instruction.frd(), to_register_bits<T>(result));
+      break;
+    }
+
+    // Moves don't unbox or canonicalize the value.
+    case IT::FmvXW: {
+      const auto value = state.get(instruction.frs1());
+      return std::is_same_v<T, float> ? sign_extend_32(value) : value;
+    }
+    case IT::FmvWX: {
+      state.set(instruction.frd(), to_register_bits<T>(Bits(rs1_value)));
+      break;
+    }
+
+    default:
+      unreachable();
+  }
+
+  return 0;
+}
+
+template <typename T>
+static uint64_t execute_element_typed(RegisterState& state,
+                                      InstructionType type,
+                                      uint64_t a_bits,
+                                      uint64_t b_bits,
+                                      uint64_t c_bits) {
+  using Bits = typename FloatBits<T>::Type;
+
+  const auto mode = RoundingMode(state.fcsr() >> frm_shift);
+
+  const auto a = std::bit_cast<T>(Bits(a_bits));
+  const auto b = std::bit_cast<T>(Bits(b_bits));
+  const auto c = std::bit_cast<T>(Bits(c_bits));
+
+  const auto result = [](T value) -> uint64_t {
+    return std::isnan(value) ? FloatBits<T>::canonical_nan : std::bit_cast<Bits>(value);
+  };
+
+  switch (type) {
+      // clang-format off
+    case IT::FmaddS:  return result(fused_multiply_add(state, mode, a, b, c));
+    case IT::FmsubS:  return result(fused_multiply_add(state, mode, a, b, -c));
+    case IT::FnmsubS: return result(fused_multiply_add(state, mode, -a, b, c));
+    case IT::FnmaddS: return result(fused_multiply_add(state, mode, -a, b, -c));
+
+    case IT::FaddS: return result(compute(state, mode, [](T x, T y) { return x + y; }, a, b));
+    case IT::FsubS: return result(compute(state, mode, [](T x, T y) { return x - y; }, a, b));
+    case IT::FmulS: return result(compute(state, mode, [](T x, T y) { return x * y; }, a, b));
+    case IT::FdivS: return result(compute(state, mode, [](T x, T y) { return x / y; }, a, b));
+
+    case IT::FminS: return result(minimum_maximum(state, a, b, false));
+    case IT::FmaxS: return result(minimum_maximum(state, a, b, true));
+
+    case IT::FeqS: return compare(state, type, a, b);
+    case IT::FltS: return compare(state, type, a, b);
+    case IT::FleS: return compare(state, type, a, b);
+      // clang-format on
+
+    case IT::FsgnjS:
+    case IT::FsgnjnS:
+    case IT::FsgnjxS:
+      return inject_sign<T>(type, Bits(a_bits), Bits(b_bits));
+
+    default:
+      unreachable();
+  }
+}
+
+InstructionType FloatArithmetic::single_precision_type(InstructionType type) {
+  if (!between(type, IT::FmaddD, IT::FclassD)) {
+    return type;
+  }
+  return InstructionType(uint32_t(type) - uint32_t(IT::FmaddD) + uint32_t(IT::FmaddS));
+}
+
+bool FloatArithmetic::is_float_operation(InstructionType type) {
+  return between(type, IT::FmaddS, IT::FcvtDS);
+}
+
+bool FloatArithmetic::reads_integer_register(InstructionType type) {
+  const auto single_type = single_precision_type(type);
+  return between(single_type, IT::FcvtSW, IT::FcvtSLu) || single_type == IT::FmvWX;
+}
+
+bool FloatArithmetic::writes_integer_register(InstructionType type) {
+  const auto single_type = single_precision_type(type);
+  return between(single_type, IT::FcvtWS, IT::FcvtLuS) || single_type == IT::FmvXW ||
+         between(single_type, IT::FeqS, IT::FclassS);
+}
+
+bool FloatArithmetic::uses_rounding_mode(InstructionType type) {
+  const auto single_type = single_precision_type(type);
+  return between(single_type, IT::FmaddS, IT::FsqrtS) ||
+         between(single_type, IT::FcvtWS, IT::FcvtSLu) || type == IT::FcvtSD ||
+         type == IT::FcvtDS;
+}
+
+bool FloatArithmetic::has_valid_rounding_mode(const RegisterState& state,
+                                              const Instruction& instruction) {
+  if (!uses_rounding_mode(instruction.type()) ||
+      instruction.rounding_mode() != RoundingMode::Dynamic) {
+    return true;
+  }
+  return (state.fcsr() >> frm_shift) <= uint32_t(RoundingMode::NearestMaxMagnitude);
+}
+
+uint64_t FloatArithmetic::execute(RegisterState& state,
+                                  const Instruction& instruction,
+                                  uint64_t rs1_value) {
+  const auto type = instruction.type();
+
+  switch (type) {
+    case IT::FcvtSD: {
+      const auto mode = resolve_rounding_mode(state, instruction);
+      const auto value = read<double>(state, instruction.frs1());
+      const auto result = compute(state, mode, [](double x) { return float(x); }, value);
+      state.set(instruction.frd(), to_register(result));
+      return 0;
+    }
+
+    case IT::FcvtDS: {
+      const auto mode = resolve_rounding_mode(state, instruction);
+      const auto value = read<float>(state, instruction.frs1());
+      const auto result = compute(state, mode, [](float x) { return double(x); }, value);
+      state.set(instruction.frd(), to_register(result));
+      return 0;
+    }
+
+    default:
+      break;
+  }
+
+  const auto single_type = single_precision_type(type);
+  if (single_type == type) {
+    return execute_typed<float>(state, instruction, single_type, rs1_value);
+  } else {
+    return execute_typed<double>(state, instruction, single_type, rs1_value);
+  }
+}
+
+uint64_t FloatArithmetic::execute_raw(RegisterState* state,
+                                      uint64_t raw_instruction,
+                                      uint64_t rs1_value) {
+  return execute(*state, Instruction::from_raw(raw_instruction), rs1_value);
+}
+
+uint64_t FloatArithmetic::execute_element(RegisterState& state,
+                                          InstructionType type,
+                                          bool double_precision,
+                                          uint64_t a,
+                                          uint64_t b,
+                                          uint64_t c) {
+  if (double_precision) {
+    return execute_element_typed<double>(state, type, a, b, c);
+  } else {
+    return execute_element_typed<float>(state, type, a, b, c);
+  }
+}
+
+bool FloatArithmetic::read_csr(const RegisterState& state, uint32_t csr, uint64_t& value) {
+  switch (csr) {
+      // clang-format off
+    case csr_fflags: value = state.fcsr() & fflags_mask; return true;
+    case csr_frm:    value = state.fcsr() >> frm_shift; return true;
+    case csr_fcsr:   value = state.fcsr(); return true;
+      // clang-format on
+
+    default:
+      return false;
+  }
+}
+
+bool FloatArithmetic::write_csr(RegisterState& state, uint32_t csr, uint64_t value) {
+  const auto fcsr = state.fcsr();
+
+  switch (csr) {
+    case csr_fflags: {
+      state.set_fcsr((fcsr & ~fflags_mask) | (uint32_t(value) & fflags_mask));
+      return true;
+    }
+    case csr_frm: {
+      state.set_fcsr((fcsr & fflags_mask) | ((uint32_t(value) & 0b111) << frm_shift));
+      return true;
+    }
+    case csr_fcsr: {
+      state.set_fcsr(uint32_t(value));
+      return true;
+    }
+
+    default:
+      return false;
+  }
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+
+#include <vm/Instruction.hpp>
+#include <vm/RegisterState.hpp>
+
+namespace vm {
+
+// RV64F and RV64D operations shared by the interpreter and the JIT. Computations run on the host
+// FPU with the guest rounding mode and raised exceptions are accrued in `fcsr`. NaN results are
+// canonicalized and single precision values are NaN-boxed as required by the RISC-V spec.
+class FloatArithmetic {
+ public:
+  // Single precision equivalent of a double precision instruction (both are laid out the same way
+  // in `InstructionType`).
+  static InstructionType single_precision_type(InstructionType type);
+
+  // Floating point computations (everything except loads, stores and CSR accesses).
+  static bool is_float_operation(InstructionType type);
+
+  static bool reads_integer_register(InstructionType type);
+  static bool writes_integer_register(InstructionType type);
+  static bool uses_rounding_mode(InstructionType type);
+
+  // Dynamic rounding mode is invalid if `frm` holds one of the reserved values.
+  static bool has_valid_rounding_mode(const RegisterState& state, const Instruction& instruction);
+
+  // `rs1_value` is the value of the integer source register and the result is the value of the
+  // integer destination register (if the instruction uses them). Rounding mode must be valid.
+  static uint64_t execute(RegisterState& state, const Instruction& instruction, uint64_t rs1_value);
+
+  // Called by the generated code, `raw_instruction` comes from `Instruction::raw()`.
+  static uint64_t execute_raw(RegisterState* state, uint64_t raw_instruction, uint64_t rs1_value);
+
+  // Element operation of a vector instruction. `type` is a single precision arithmetic, fused
+  // multiply-add, minimum/maximum, sign injection or comparison instruction. Operands and the
+  // result are raw element values (single precision values are not NaN-boxed). Rounding mode
+  // comes from `frm` and must be valid.
+  static uint64_t execute_element(RegisterState& state,
+                                  InstructionType type,
+                                  bool double_precision,
+                                  uint64_t a,
+                                  uint64_t b,
+                                  uint64_t c);
+
+  // Floating point CSRs (fflags, frm and fcsr). Return false for other CSRs.
+  static bool read_csr(const RegisterState& state, uint32_t csr, uint64_t& value);
+  static bool write_csr(RegisterState& state, uint32_t csr, uint64_t value);
+
+  static uint64_t box(uint32_t value) { return uint64_t(value) | 0xffff'ffff'0000'0000; }
+};
+
+}  // namespace vm
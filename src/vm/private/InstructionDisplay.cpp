@@ -1,4 +1,6 @@
 #include "InstructionDisplay.hpp"
+#include "FloatArithmetic.hpp"
+#include "VectorArithmetic.hpp"
 
 #include <base/Error.hpp>
 
@@ -63,6 +65,7 @@ std::string_view InstructionDisplay::instruction_name(InstructionType type) {
     CASE(Ebreak, "ebreak")
     CASE(Ecall, "ecall")
     CASE(Fence, "fence")
+    CASE(FenceI, "fence.i")
     CASE(Mul, "mul")
     CASE(Mulw, "mulw")
     CASE(Mulh, "mulh")
@@ -76,6 +79,146 @@ std::string_view InstructionDisplay::instruction_name(InstructionType type) {
     CASE(Remu, "remu")
     CASE(Remw, "remw")
     CASE(Remuw, "remuw")
+    CASE(LrW, "lr.w")
+    CASE(LrD, "lr.d")
+    CASE(ScW, "sc.w")
+    CASE(ScD, "sc.d")
+    CASE(AmoswapW, "amoswap.w")
+    CASE(AmoaddW, "amoadd.w")
+    CASE(AmoxorW, "amoxor.w")
+    CASE(AmoandW, "amoand.w")
+    CASE(AmoorW, "amoor.w")
+    CASE(AmominW, "amomin.w")
+    CASE(AmomaxW, "amomax.w")
+    CASE(AmominuW, "amominu.w")
+    CASE(AmomaxuW, "amomaxu.w")
+    CASE(AmoswapD, "amoswap.d")
+    CASE(AmoaddD, "amoadd.d")
+    CASE(AmoxorD, "amoxor.d")
+    CASE(AmoandD, "amoand.d")
+    CASE(AmoorD, "amoor.d")
+    CASE(AmominD, "amomin.d")
+    CASE(AmomaxD, "amomax.d")
+    CASE(AmominuD, "amominu.d")
+    CASE(AmomaxuD, "amomaxu.d")
+    CASE(Csrrw, "csrrw")
+    CASE(Csrrs, "csrrs")
+    CASE(Csrrc, "csrrc")
+    CASE(Csrrwi, "csrrwi")
+    CASE(Csrrsi, "csrrsi")
+    CASE(Csrrci, "csrrci")
+    CASE(Flw, "flw")
+    CASE(Fsw, "fsw")
+    CASE(Fld, "fld")
+    CASE(Fsd, "fsd")
+    CASE(FmaddS, "fmadd.s")
+    CASE(FmsubS, "fmsub.s")
+    CASE(FnmsubS, "fnmsub.s")
+    CASE(FnmaddS, "fnmadd.s")
+    CASE(FaddS, "fadd.s")
+    CASE(FsubS, "fsub.s")
+    CASE(FmulS, "fmul.s")
+    CASE(FdivS, "fdiv.s")
+    CASE(FsqrtS, "fsqrt.s")
+    CASE(FsgnjS, "fsgnj.s")
+    CASE(FsgnjnS, "fsgnjn.s")
+    CASE(FsgnjxS, "fsgnjx.s")
+    CASE(FminS, "fmin.s")
+    CASE(FmaxS, "fmax.s")
+    CASE(FcvtWS, "fcvt.w.s")
+    CASE(FcvtWuS, "fcvt.wu.s")
+    CASE(FcvtLS, "fcvt.l.s")
+    CASE(FcvtLuS, "fcvt.lu.s")
+    CASE(FcvtSW, "fcvt.s.w")
+    CASE(FcvtSWu, "fcvt.s.wu")
+    CASE(FcvtSL, "fcvt.s.l")
+    CASE(FcvtSLu, "fcvt.s.lu")
+    CASE(FmvXW, "fmv.x.w")
+    CASE(FmvWX, "fmv.w.x")
+    CASE(FeqS, "feq.s")
+    CASE(FltS, "flt.s")
+    CASE(FleS, "fle.s")
+    CASE(FclassS, "fclass.s")
+    CASE(FmaddD, "fmadd.d")
+    CASE(FmsubD, "fmsub.d")
+    CASE(FnmsubD, "fnmsub.d")
+    CASE(FnmaddD, "fnmadd.d")
+    CASE(FaddD, "fadd.d")
+    CASE(FsubD, "fsub.d")
+    CASE(FmulD, "fmul.d")
+    CASE(FdivD, "fdiv.d")
+    CASE(FsqrtD, "fsqrt.d")
+    CASE(FsgnjD, "fsgnj.d")
+    CASE(FsgnjnD, "fsgnjn.d")
+    CASE(FsgnjxD, "fsgnjx.d")
+    CASE(FminD, "fmin.d")
+    CASE(FmaxD, "fmax.d")
+    CASE(FcvtWD, "fcvt.w.d")
+    CASE(FcvtWuD, "fcvt.wu.d")
+    CASE(FcvtLD, "fcvt.l.d")
+    CASE(FcvtLuD, "fcvt.lu.d")
+    CASE(FcvtDW, "fcvt.d.w")
+    CASE(FcvtDWu, "fcvt.d.wu")
+    CASE(FcvtDL, "fcvt.d.l")
+    CASE(FcvtDLu, "fcvt.d.lu")
+    CASE(FmvXD, "fmv.x.d")
+    CASE(FmvDX, "fmv.d.x")
+    CASE(FeqD, "feq.d")
+    CASE(FltD, "flt.d")
+    CASE(FleD, "fle.d")
+    CASE(FclassD, "fclass.d")
+    CASE(FcvtSD, "fcvt.s.d")
+    CASE(FcvtDS, "fcvt.d.s")
+    CASE(Vsetvli, "vsetvli")
+    CASE(Vsetivli, "vsetivli")
+    CASE(Vsetvl, "vsetvl")
+    CASE(VectorLoad, "vload")
+    CASE(VectorStore, "vstore")
+    CASE(VectorLoadStrided, "vload.strided")
+    CASE(VectorStoreStrided, "vstore.strided")
+    CASE(VectorOperation, "vop")
+    CASE(VectorOperationScalar, "vop.scalar")
+    CASE(VectorMoveToScalar, "vop.to_scalar")
+    CASE(Sh1add, "sh1add")
+    CASE(Sh2add, "sh2add")
+    CASE(Sh3add, "sh3add")
+    CASE(AddUw, "add.uw")
+    CASE(Sh1addUw, "sh1add.uw")
+    CASE(Sh2addUw, "sh2add.uw")
+    CASE(Sh3addUw, "sh3add.uw")
+    CASE(Andn, "andn")
+    CASE(Orn, "orn")
+    CASE(Xnor, "xnor")
+    CASE(Min, "min")
+    CASE(Minu, "minu")
+    CASE(Max, "max")
+    CASE(Maxu, "maxu")
+    CASE(Rol, "rol")
+    CASE(Ror, "ror")
+    CASE(Rolw, "rolw")
+    CASE(Rorw, "rorw")
+    CASE(Bclr, "bclr")
+    CASE(Bext, "bext")
+    CASE(Binv, "binv")
+    CASE(Bset, "bset")
+    CASE(SlliUw, "slli.uw")
+    CASE(Rori, "rori")
+    CASE(Roriw, "roriw")
+    CASE(Bclri, "bclri")
+    CASE(Bexti, "bexti")
+    CASE(Binvi, "binvi")
+    CASE(Bseti, "bseti")
+    CASE(Clz, "clz")
+    CASE(Clzw, "clzw")
+    CASE(Ctz, "ctz")
+    CASE(Ctzw, "ctzw")
+    CASE(Cpop, "cpop")
+    CASE(Cpopw, "cpopw")
+    CASE(SextB, "sext.b")
+    CASE(SextH, "sext.h")
+    CASE(ZextH, "zext.h")
+    CASE(OrcB, "orc.b")
+    CASE(Rev8, "rev8")
 
 #undef CASE
 
@@ -131,6 +274,52 @@ std::string_view InstructionDisplay::register_name(Register reg) {
   }
 }
 
+std::string_view InstructionDisplay::register_name(FloatRegister reg) {
+  switch (reg) {
+#define CASE(type, name)    \
+  case FloatRegister::type: \
+    return name;
+
+    CASE(Ft0, "ft0")
+    CASE(Ft1, "ft1")
+    CASE(Ft2, "ft2")
+    CASE(Ft3, "ft3")
+    CASE(Ft4, "ft4")
+    CASE(Ft5, "ft5")
+    CASE(Ft6, "ft6")
+    CASE(Ft7, "ft7")
+    CASE(Fs0, "fs0")
+    CASE(Fs1, "fs1")
+    CASE(Fa0, "fa0")
+    CASE(Fa1, "fa1")
+    CASE(Fa2, "fa2")
+    CASE(Fa3, "fa3")
+    CASE(Fa4, "fa4")
+    CASE(Fa5, "fa5")
+    CASE(Fa6, "fa6")
+    CASE(Fa7, "fa7")
+    CASE(Fs2, "fs2")
+    CASE(Fs3, "fs3")
+    CASE(Fs4, "fs4")
+    CASE(Fs5, "fs5")
+    CASE(Fs6, "fs6")
+    CASE(Fs7, "fs7")
+    CASE(Fs8, "fs8")
+    CASE(Fs9, "fs9")
+    CASE(Fs10, "fs10")
+    CASE(Fs11, "fs11")
+    CASE(Ft8, "ft8")
+    CASE(Ft9, "ft9")
+    CASE(Ft10, "ft10")
+    CASE(Ft11, "ft11")
+
+#undef CASE
+
+    default:
+      unreachable();
+  }
+}
+
 static bool instruction_between(InstructionType type, InstructionType first, InstructionType last) {
   return uint32_t(type) >= uint32_t(first) && uint32_t(type) <= uint32_t(last);
 }
@@ -168,7 +357,8 @@ InstructionDisplay::Format InstructionDisplay::instruction_format(InstructionTyp
     return Format::RdRs1Rs2;
   }
 
-  if (instruction_between(type, InstructionType::Ebreak, InstructionType::Ecall)) {
+  if (instruction_between(type, InstructionType::Ebreak, InstructionType::Ecall) ||
+      type == InstructionType::FenceI) {
     return Format::Standalone;
   }
 
@@ -180,6 +370,86 @@ InstructionDisplay::Format InstructionDisplay::instruction_format(InstructionTyp
     return Format::RdRs1Rs2;
   }
 
+  if (type == InstructionType::LrW || type == InstructionType::LrD) {
+    return Format::LoadReserved;
+  }
+
+  if (instruction_between(type, InstructionType::ScW, InstructionType::AmomaxuD)) {
+    return Format::Atomic;
+  }
+
+  if (instruction_between(type, InstructionType::Csrrw, InstructionType::Csrrc)) {
+    return Format::Csr;
+  }
+
+  if (instruction_between(type, InstructionType::Csrrwi, InstructionType::Csrrci)) {
+    return Format::CsrImm;
+  }
+
+  if (type == InstructionType::Flw || type == InstructionType::Fld) {
+    return Format::FloatLoad;
+  }
+
+  if (type == InstructionType::Fsw || type == InstructionType::Fsd) {
+    return Format::FloatStore;
+  }
+
+  if (instruction_between(type, InstructionType::FmaddS, InstructionType::FclassD)) {
+    const auto base_type = FloatArithmetic::single_precision_type(type);
+
+    switch (base_type) {
+      case InstructionType::FsqrtS:
+        return Format::FrdFrs1;
+
+      case InstructionType::FcvtWS:
+      case InstructionType::FcvtWuS:
+      case InstructionType::FcvtLS:
+      case InstructionType::FcvtLuS:
+      case InstructionType::FmvXW:
+      case InstructionType::FclassS:
+        return Format::RdFrs1;
+
+      case InstructionType::FcvtSW:
+      case InstructionType::FcvtSWu:
+      case InstructionType::FcvtSL:
+      case InstructionType::FcvtSLu:
+      case InstructionType::FmvWX:
+        return Format::FrdRs1;
+
+      case InstructionType::FeqS:
+      case InstructionType::FltS:
+      case InstructionType::FleS:
+        return Format::RdFrs1Frs2;
+
+      default:
+        break;
+    }
+
+    return instruction_between(base_type, InstructionType::FmaddS, InstructionType::FnmaddS)
+             ? Format::FrdFrs1Frs2Frs3
+             : Format::FrdFrs1Frs2;
+  }
+
+  if (type == InstructionType::FcvtSD || type == InstructionType::FcvtDS) {
+    return Format::FrdFrs1;
+  }
+
+  if (VectorArithmetic::is_vector_instruction(type)) {
+    return Format::Vector;
+  }
+
+  if (instruction_between(type, InstructionType::Sh1add, InstructionType::Bset)) {
+    return Format::RdRs1Rs2;
+  }
+
+  if (instruction_between(type, InstructionType::SlliUw, InstructionType::Bseti)) {
+    return Format::RdRs1Imm;
+  }
+
+  if (instruction_between(type, InstructionType::Clz, InstructionType::Rev8)) {
+    return Format::RdRs1;
+  }
+
   unreachable();
 }
 
@@ -208,6 +478,17 @@ void InstructionDisplay::format_instruction(const Instruction& instruction,
       break;
     }
 
+    case Format::LoadReserved: {
+      base::format_to(inserter, "{} {}, ({})", name, instruction.rd(), instruction.rs1());
+      break;
+    }
+
+    case Format::Atomic: {
+      base::format_to(inserter, "{} {}, {}, ({})", name, instruction.rd(), instruction.rs2(),
+                      instruction.rs1());
+      break;
+    }
+
     case Format::RdImm: {
       base::format_to(inserter, "{} {}, {:#x}", name, instruction.rd(), instruction.imm());
       break;
@@ -225,12 +506,79 @@ void InstructionDisplay::format_instruction(const Instruction& instruction,
       break;
     }
 
+    case Format::RdRs1: {
+      base::format_to(inserter, "{} {}, {}", name, instruction.rd(), instruction.rs1());
+      break;
+    }
+
     case Format::RdRs1Rs2: {
       base::format_to(inserter, "{} {}, {}, {}", name, instruction.rd(), instruction.rs1(),
                       instruction.rs2());
       break;
     }
 
+    case Format::Csr: {
+      base::format_to(inserter, "{} {}, {:#x}, {}", name, instruction.rd(), instruction.csr(),
+                      instruction.rs1());
+      break;
+    }
+
+    case Format::CsrImm: {
+      base::format_to(inserter, "{} {}, {:#x}, {:#x}", name, instruction.rd(), instruction.csr(),
+                      instruction.csr_imm());
+      break;
+    }
+
+    case Format::FloatLoad: {
+      base::format_to(inserter, "{} {}, {:#x}({})", name, instruction.frd(), instruction.imm(),
+                      instruction.rs1());
+      break;
+    }
+
+    case Format::FloatStore: {
+      base::format_to(inserter, "{} {}, {:#x}({})", name, instruction.frs2(), instruction.imm(),
+                      instruction.rs1());
+      break;
+    }
+
+    case Format::FrdFrs1Frs2Frs3: {
+      base::format_to(inserter, "{} {}, {}, {}, {}", name, instruction.frd(), instruction.frs1(),
+                      instruction.frs2(), instruction.frs3());
+      break;
+    }
+
+    case Format::FrdFrs1Frs2: {
+      base::format_to(inserter, "{} {}, {}, {}", name, instruction.frd(), instruction.frs1(),
+                      instruction.frs2());
+      break;
+    }
+
+    case Format::FrdFrs1: {
+      base::format_to(inserter, "{} {}, {}", name, instruction.frd(), instruction.frs1());
+      break;
+    }
+
+    case Format::FrdRs1: {
+      base::format_to(inserter, "{} {}, {}", name, instruction.frd(), instruction.rs1());
+      break;
+    }
+
+    case Format::RdFrs1: {
+      base::format_to(inserter, "{} {}, {}", name, instruction.rd(), instruction.frs1());
+      break;
+    }
+
+    case Format::RdFrs1Frs2: {
+      base::format_to(inserter, "{} {}, {}, {}", name, instruction.rd(), instruction.frs1(),
+                      instruction.frs2());
+      break;
+    }
+
+    case Format::Vector: {
+      VectorArithmetic::format_instruction(instruction, formatted);
+      break;
+    }
+
     default:
       unreachable();
   }
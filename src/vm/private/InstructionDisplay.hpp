@@ -12,14 +12,35 @@ struct InstructionDisplay {
     Store,
     Load,
 
+    LoadReserved,
+    Atomic,
+
     RdImm,
+    RdRs1,
     RdRs1Imm,
     Rs1Rs2Imm,
     RdRs1Rs2,
+
+    Csr,
+    CsrImm,
+
+    FloatLoad,
+    FloatStore,
+
+    FrdFrs1Frs2Frs3,
+    FrdFrs1Frs2,
+    FrdFrs1,
+    FrdRs1,
+    RdFrs1,
+    RdFrs1Frs2,
+
+    // Formatted by `VectorArithmetic`, name depends on the encoded operation.
+    Vector,
   };
 
   static std::string_view instruction_name(InstructionType type);
   static std::string_view register_name(Register reg);
+  static std::string_view register_name(FloatRegister reg);
   static Format instruction_format(InstructionType type);
 
   static void format_instruction(const Instruction& instruction, std::string& formatted);
@@ -0,0 +1,1336 @@
+#include "VectorArithmetic.hpp"
+#include "Arithmetic.hpp"
+#include "FloatArithmetic.hpp"
+
+#include <vm/Memory.hpp>
+
+#include <base/Error.hpp>
+#include <base/Format.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <optional>
+#include <type_traits>
+
+using namespace vm;
+
+using IT = InstructionType;
+using Status = VectorArithmetic::Status;
+
+constexpr uint64_t vlenb = RegisterState::vector_register_size;
+
+constexpr uint32_t csr_vstart = 0x008;
+constexpr uint32_t csr_vl = 0xc20;
+constexpr uint32_t csr_vtype = 0xc21;
+constexpr uint32_t csr_vlenb = 0xc22;
+
+// Operand categories of OP-V instructions (selected by `funct3`).
+constexpr uint32_t opivv = 0b000;
+constexpr uint32_t opfvv = 0b001;
+constexpr uint32_t opmvv = 0b010;
+constexpr uint32_t opivi = 0b011;
+constexpr uint32_t opivx = 0b100;
+constexpr uint32_t opfvf = 0b101;
+constexpr uint32_t opmvx = 0b110;
+
+enum class Operation {
+  Add,
+  Sub,
+  Rsub,
+  Minu,
+  Min,
+  Maxu,
+  Max,
+  And,
+  Or,
+  Xor,
+  Sll,
+  Srl,
+  Sra,
+  Merge,
+  Move,
+  SlideUp,
+  SlideDown,
+  Mseq,
+  Msne,
+  Msltu,
+  Mslt,
+  Msleu,
+  Msle,
+  Msgtu,
+  Msgt,
+
+  Redsum,
+  Redand,
+  Redor,
+  Redxor,
+  Redminu,
+  Redmin,
+  Redmaxu,
+  Redmax,
+  Divu,
+  Div,
+  Remu,
+  Rem,
+  Mulhu,
+  Mul,
+  Mulhsu,
+  Mulh,
+  Madd,
+  Nmsub,
+  Macc,
+  Nmsac,
+  MoveToScalar,
+  MoveFromScalar,
+  Id,
+
+  Mandn,
+  Mand,
+  Mor,
+  Mxor,
+  Morn,
+  Mnand,
+  Mnor,
+  Mxnor,
+  Cpop,
+  First,
+
+  Fadd,
+  Fsub,
+  Frsub,
+  Fmul,
+  Fdiv,
+  Frdiv,
+  Fmin,
+  Fmax,
+  Fsgnj,
+  Fsgnjn,
+  Fsgnjx,
+  Fmacc,
+  Fnmacc,
+  Fmsac,
+  Fnmsac,
+  Fmadd,
+  Fnmadd,
+  Fmsub,
+  Fnmsub,
+  Fredusum,
+  Fredosum,
+  Fredmin,
+  Fredmax,
+  Mfeq,
+  Mfle,
+  Mflt,
+  Mfne,
+  Mfgt,
+  Mfge,
+  FmoveToScalar,
+  FmoveFromScalar,
+  Fmerge,
+  Fmove,
+};
+
+struct OperationInfo {
+  Operation operation{};
+  std::string_view name;
+
+  // Name doesn't include the operand suffix (like `.vv` or `.vx`).
+  bool suffixed = true;
+};
+
+struct Fields {
+  uint32_t vd{};
+  uint32_t vs1{};
+  uint32_t vs2{};
+  uint32_t funct3{};
+  uint32_t funct6{};
+  bool masked{};
+
+  explicit Fields(uint32_t encoding)
+      : vd((encoding >> 7) & 0b11111),
+        vs1((encoding >> 15) & 0b11111),
+        vs2((encoding >> 20) & 0b11111),
+        funct3((encoding >> 12) & 0b111),
+        funct6(encoding >> 26),
+        masked(((encoding >> 25) & 1) == 0) {}
+};
+
+struct Configuration {
+  // Element size in bytes.
+  uint32_t sew_log2{};
+  int32_t lmul_log2{};
+  uint64_t vlmax{};
+};
+
+static std::optional<Configuration> parse_vtype(uint64_t vtype) {
+  const auto vlmul = uint32_t(vtype & 0b111);
+  const auto vsew = uint32_t((vtype >> 3) & 0b111);
+
+  // Only `vta` and `vma` may be set besides these fields (which also excludes `vill`).
+  if ((vtype >> 8) != 0 || vlmul == 0b100 || vsew > 0b011) {
+    return std::nullopt;
+  }
+
+  const auto lmul_log2 = vlmul < 0b100 ? int32_t(vlmul) : int32_t(vlmul) - 8;
+
+  // Fractional LMUL requires SEW <= LMUL * ELEN.
+  if (int32_t(vsew) + 3 > lmul_log2 + 6) {
+    return std::nullopt;
+  }
+
+  // VLMAX = LMUL * VLEN / SEW.
+  return Configuration{
+    .sew_log2 = vsew,
+    .lmul_log2 = lmul_log2,
+    .vlmax = uint64_t(1) << (4 - int32_t(vsew) + lmul_log2),
+  };
+}
+
+// Register groups must be aligned to their size.
+static bool is_valid_group(uint32_t reg, int32_t emul_log2) {
+  return emul_log2 <= 0 || (reg & ((uint32_t(1) << emul_log2) - 1)) == 0;
+}
+
+static bool groups_overlap(uint32_t a, uint32_t b, int32_t emul_log2) {
+  const auto size = emul_log2 > 0 ? uint32_t(1) << emul_log2 : 1;
+  return a < b + size && b < a + size;
+}
+
+template <typename T>
+static T read_element(const RegisterState& state, uint32_t reg, uint64_t index) {
+  T value;
+  std::memcpy(&value, state.vector_register(reg) + index * sizeof(T), sizeof(T));
+  return value;
+}
+
+template <typename T>
+static void write_element(RegisterState& state, uint32_t reg, uint64_t index, T value) {
+  std::memcpy(state.vector_register(reg) + index * sizeof(T), &value, sizeof(T));
+}
+
+static bool read_mask(const RegisterState& state, uint32_t reg, uint64_t index) {
+  return (state.vector_register(reg)[index / 8] >> (index % 8)) & 1;
+}
+
+static void write_mask(RegisterState& state, uint32_t reg, uint64_t index, bool value) {
+  auto& byte = state.vector_register(reg)[index / 8];
+  const auto bit = uint8_t(1 << (index % 8));
+  byte = value ? (byte | bit) : (byte & ~bit);
+}
+
+static uint64_t sign_extend(uint64_t value, uint32_t bits) {
+  const auto shift = 64 - bits;
+  return uint64_t(int64_t(value << shift) >> shift);
+}
+
+template <typename Fn>
+static Status with_element_type(uint32_t sew_log2, Fn&& fn) {
+  switch (sew_log2) {
+      // clang-format off
+    case 0: return fn(uint8_t{});
+    case 1: return fn(uint16_t{});
+    case 2: return fn(uint32_t{});
+    case 3: return fn(uint64_t{});
+      // clang-format on
+
+    default:
+      unreachable();
+  }
+}
+
+static std::optional<OperationInfo> decode_operation(const Fields& f) {
+  using O = Operation;
+
+  const auto supported = [](bool valid, Operation operation, std::string_view name,
+                            bool suffixed = true) -> std::optional<OperationInfo> {
+    if (!valid) {
+      return std::nullopt;
+    }
+    return OperationInfo{.operation = operation, .name = name, .suffixed = suffixed};
+  };
+
+  const auto vv = f.funct3 == opivv || f.funct3 == opmvv || f.funct3 == opfvv;
+  const auto vx = f.funct3 == opivx || f.funct3 == opmvx;
+  const auto vi = f.funct3 == opivi;
+  const auto vf = f.funct3 == opfvf;
+
+  switch (f.funct3) {
+    case opivv:
+    case opivx:
+    case opivi: {
+      switch (f.funct6) {
+          // clang-format off
+        case 0b00'0000: return supported(true, O::Add, "vadd");
+        case 0b00'0010: return supported(!vi, O::Sub, "vsub");
+        case 0b00'0011: return supported(!vv, O::Rsub, "vrsub");
+        case 0b00'0100: return supported(!vi, O::Minu, "vminu");
+        case 0b00'0101: return supported(!vi, O::Min, "vmin");
+        case 0b00'0110: return supported(!vi, O::Maxu, "vmaxu");
+        case 0b00'0111: return supported(!vi, O::Max, "vmax");
+        case 0b00'1001: return supported(true, O::And, "vand");
+        case 0b00'1010: return supported(true, O::Or, "vor");
+        case 0b00'1011: return supported(true, O::Xor, "vxor");
+        case 0b00'1110: return supported(!vv, O::SlideUp, "vslideup");
+        case 0b00'1111: return supported(!vv, O::SlideDown, "vslidedown");
+        case 0b01'1000: return supported(true, O::Mseq, "vmseq");
+        case 0b01'1001: return supported(true, O::Msne, "vmsne");
+        case 0b01'1010: return supported(!vi, O::Msltu, "vmsltu");
+        case 0b01'1011: return supported(!vi, O::Mslt, "vmslt");
+        case 0b01'1100: return supported(true, O::Msleu, "vmsleu");
+        case 0b01'1101: return supported(true, O::Msle, "vmsle");
+        case 0b01'1110: return supported(!vv, O::Msgtu, "vmsgtu");
+        case 0b01'1111: return supported(!vv, O::Msgt, "vmsgt");
+        case 0b10'0101: return supported(true, O::Sll, "vsll");
+        case 0b10'1000: return supported(true, O::Srl, "vsrl");
+        case 0b10'1001: return supported(true, O::Sra, "vsra");
+          // clang-format on
+
+        case 0b01'0111: {
+          if (f.masked) {
+            return supported(true, O::Merge, "vmerge");
+          }
+          return supported(f.vs2 == 0, O::Move, "vmv.v");
+        }
+
+        default:
+          return std::nullopt;
+      }
+    }
+
+    case opmvv:
+    case opmvx: {
+      switch (f.funct6) {
+          // clang-format off
+        case 0b00'0000: return supported(vv, O::Redsum, "vredsum.vs", false);
+        case 0b00'0001: return supported(vv, O::Redand, "vredand.vs", false);
+        case 0b00'0010: return supported(vv, O::Redor, "vredor.vs", false);
+        case 0b00'0011: return supported(vv, O::Redxor, "vredxor.vs", false);
+        case 0b00'0100: return supported(vv, O::Redminu, "vredminu.vs", false);
+        case 0b00'0101: return supported(vv, O::Redmin, "vredmin.vs", false);
+        case 0b00'0110: return supported(vv, O::Redmaxu, "vredmaxu.vs", false);
+        case 0b00'0111: return supported(vv, O::Redmax, "vredmax.vs", false);
+        case 0b10'0000: return supported(true, O::Divu, "vdivu");
+        case 0b10'0001: return supported(true, O::Div, "vdiv");
+        case 0b10'0010: return supported(true, O::Remu, "vremu");
+        case 0b10'0011: return supported(true, O::Rem, "vrem");
+        case 0b10'0100: return supported(true, O::Mulhu, "vmulhu");
+        case 0b10'0101: return supported(true, O::Mul, "vmul");
+        case 0b10'0110: return supported(true, O::Mulhsu, "vmulhsu");
+        case 0b10'0111: return supported(true, O::Mulh, "vmulh");
+        case 0b10'1001: return supported(true, O::Madd, "vmadd");
+        case 0b10'1011: return supported(true, O::Nmsub, "vnmsub");
+        case 0b10'1101: return supported(true, O::Macc, "vmacc");
+        case 0b10'1111: return supported(true, O::Nmsac, "vnmsac");
+        case 0b01'1000: return supported(vv, O::Mandn, "vmandn.mm", false);
+        case 0b01'1001: return supported(vv, O::Mand, "vmand.mm", false);
+        case 0b01'1010: return supported(vv, O::Mor, "vmor.mm", false);
+        case 0b01'1011: return supported(vv, O::Mxor, "vmxor.mm", false);
+        case 0b01'1100: return supported(vv, O::Morn, "vmorn.mm", false);
+        case 0b01'1101: return supported(vv, O::Mnand, "vmnand.mm", false);
+        case 0b01'1110: return supported(vv, O::Mnor, "vmnor.mm", false);
+        case 0b01'1111: return supported(vv, O::Mxnor, "vmxnor.mm", false);
+          // clang-format on
+
+        // VWXUNARY0 and VRXUNARY0.
+        case 0b01'0000: {
+          if (vx) {
+            return supported(f.vs2 == 0, O::MoveFromScalar, "vmv.s.x", false);
+          }
+
+          switch (f.vs1) {
+              // clang-format off
+            case 0b00000: return supported(true, O::MoveToScalar, "vmv.x.s", false);
+            case 0b10000: return supported(true, O::Cpop, "vcpop.m", false);
+            case 0b10001: return supported(true, O::First, "vfirst.m", false);
+              // clang-format on
+
+            default:
+              return std::nullopt;
+          }
+        }
+
+        // VMUNARY0.
+        case 0b01'0100: {
+          return supported(vv && f.vs1 == 0b10001 && f.vs2 == 0, O::Id, "vid.v", false);
+        }
+
+        default:
+          return std::nullopt;
+      }
+    }
+
+    case opfvv:
+    case opfvf: {
+      switch (f.funct6) {
+          // clang-format off
+        case 0b00'0000: return supported(true, O::Fadd, "vfadd");
+        case 0b00'0010: return supported(true, O::Fsub, "vfsub");
+        case 0b10'0111: return supported(vf, O::Frsub, "vfrsub");
+        case 0b10'0100: return supported(true, O::Fmul, "vfmul");
+        case 0b10'0000: return supported(true, O::Fdiv, "vfdiv");
+        case 0b10'0001: return supported(vf, O::Frdiv, "vfrdiv");
+        case 0b00'0100: return supported(true, O::Fmin, "vfmin");
+        case 0b00'0110: return supported(true, O::Fmax, "vfmax");
+        case 0b00'1000: return supported(true, O::Fsgnj, "vfsgnj");
+        case 0b00'1001: return supported(true, O::Fsgnjn, "vfsgnjn");
+        case 0b00'1010: return supported(true, O::Fsgnjx, "vfsgnjx");
+        case 0b10'1100: return supported(true, O::Fmacc, "vfmacc");
+        case 0b10'1101: return supported(true, O::Fnmacc, "vfnmacc");
+        case 0b10'1110: return supported(true, O::Fmsac, "vfmsac");
+        case 0b10'1111: return supported(true, O::Fnmsac, "vfnmsac");
+        case 0b10'1000: return supported(true, O::Fmadd, "vfmadd");
+        case 0b10'1001: return supported(true, O::Fnmadd, "vfnmadd");
+        case 0b10'1010: return supported(true, O::Fmsub, "vfmsub");
+        case 0b10'1011: return supported(true, O::Fnmsub, "vfnmsub");
+        case 0b00'0001: return supported(vv, O::Fredusum, "vfredusum.vs", false);
+        case 0b00'0011: return supported(vv, O::Fredosum, "vfredosum.vs", false);
+        case 0b00'0101: return supported(vv, O::Fredmin, "vfredmin.vs", false);
+        case 0b00'0111: return supported(vv, O::Fredmax, "vfredmax.vs", false);
+        case 0b01'1000: return supported(true, O::Mfeq, "vmfeq");
+        case 0b01'1001: return supported(true, O::Mfle, "vmfle");
+        case 0b01'1011: return supported(true, O::Mflt, "vmflt");
+        case 0b01'1100: return supported(true, O::Mfne, "vmfne");
+        case 0b01'1101: return supported(vf, O::Mfgt, "vmfgt");
+        case 0b01'1111: return supported(vf, O::Mfge, "vmfge");
+          // clang-format on
+
+        // VWFUNARY0 and VRFUNARY0.
+        case 0b01'0000: {
+          if (vf) {
+            return supported(f.vs2 == 0, O::FmoveFromScalar, "vfmv.s.f", false);
+          }
+          return supported(f.vs1 == 0, O::FmoveToScalar, "vfmv.f.s", false);
+        }
+
+        case 0b01'0111: {
+          if (!vf) {
+            return std::nullopt;
+          }
+          if (f.masked) {
+            return supported(true, O::Fmerge, "vfmerge.vfm", false);
+          }
+          return supported(f.vs2 == 0, O::Fmove, "vfmv.v.f", false);
+        }
+
+        default:
+          return std::nullopt;
+      }
+    }
+
+    default:
+      return std::nullopt;
+  }
+}
+
+struct Context {
+  RegisterState& state;
+  Fields fields;
+  Configuration configuration;
+  uint64_t vl{};
+
+  bool active(uint64_t index) const { return !fields.masked || read_mask(state, 0, index); }
+
+  // Destination which is a vector register group cannot overlap the mask register.
+  bool valid_destination_group() const {
+    return is_valid_group(fields.vd, configuration.lmul_log2) && !(fields.masked && fields.vd == 0);
+  }
+};
+
+// Integer operations on `T` elements. Results of the element functions are truncated to `T`.
+template <typename T>
+static Status execute_integer(Context& c, Operation operation) {
+  using O = Operation;
+  using S = std::make_signed_t<T>;
+
+  constexpr auto shift_mask = uint32_t(sizeof(T) * 8 - 1);
+
+  auto& state = c.state;
+  const auto& f = c.fields;
+
+  // Shifts and slides take an unsigned immediate.
+  const auto unsigned_immediate = operation == O::Sll || operation == O::Srl ||
+                                  operation == O::Sra || operation == O::SlideUp ||
+                                  operation == O::SlideDown;
+
+  uint64_t scalar = 0;
+  if (f.funct3 == opivx) {
+    scalar = state.get(Register(f.vs1));
+  } else if (f.funct3 == opivi) {
+    scalar = unsigned_immediate ? f.vs1 : sign_extend(f.vs1, 5);
+  }
+
+  const auto operand = [&](uint64_t i) {
+    return f.funct3 == opivv ? read_element<T>(state, f.vs1, i) : T(scalar);
+  };
+
+  if (!is_valid_group(f.vs2, c.configuration.lmul_log2) ||
+      (f.funct3 == opivv && !is_valid_group(f.vs1, c.configuration.lmul_log2))) {
+    return Status::UndefinedInstruction;
+  }
+
+  const auto elementwise = [&](auto&& fn) {
+    if (!c.valid_destination_group()) {
+      return Status::UndefinedInstruction;
+    }
+    for (uint64_t i = 0; i < c.vl; ++i) {
+      if (c.active(i)) {
+        write_element<T>(state, f.vd, i, T(fn(read_element<T>(state, f.vs2, i), operand(i))));
+      }
+    }
+    return Status::Completed;
+  };
+
+  // Bits of the mask destination are written after reading the source elements they overlap.
+  const auto compare = [&](auto&& fn) {
+    for (uint64_t i = 0; i < c.vl; ++i) {
+      if (c.active(i)) {
+        write_mask(state, f.vd, i, fn(read_element<T>(state, f.vs2, i), operand(i)));
+      }
+    }
+    return Status::Completed;
+  };
+
+  switch (operation) {
+      // clang-format off
+    case O::Add:  return elementwise([](T a, T b) { return a + b; });
+    case O::Sub:  return elementwise([](T a, T b) { return a - b; });
+    case O::Rsub: return elementwise([](T a, T b) { return b - a; });
+    case O::Minu: return elementwise([](T a, T b) { return std::min(a, b); });
+    case O::Min:  return elementwise([](T a, T b) { return S(a) < S(b) ? a : b; });
+    case O::Maxu: return elementwise([](T a, T b) { return std::max(a, b); });
+    case O::Max:  return elementwise([](T a, T b) { return S(a) > S(b) ? a : b; });
+    case O::And:  return elementwise([](T a, T b) { return a & b; });
+    case O::Or:   return elementwise([](T a, T b) { return a | b; });
+    case O::Xor:  return elementwise([](T a, T b) { return a ^ b; });
+    case O::Sll:  return elementwise([](T a, T b) { return a << (b & shift_mask); });
+    case O::Srl:  return elementwise([](T a, T b) { return a >> (b & shift_mask); });
+    case O::Sra:  return elementwise([](T a, T b) { return S(a) >> (b & shift_mask); });
+
+    case O::Mseq:  return compare([](T a, T b) { return a == b; });
+    case O::Msne:  return compare([](T a, T b) { return a != b; });
+    case O::Msltu: return compare([](T a, T b) { return a < b; });
+    case O::Mslt:  return compare([](T a, T b) { return S(a) < S(b); });
+    case O::Msleu: return compare([](T a, T b) { return a <= b; });
+    case O::Msle:  return compare([](T a, T b) { return S(a) <= S(b); });
+    case O::Msgtu: return compare([](T a, T b) { return a > b; });
+    case O::Msgt:  return compare([](T a, T b) { return S(a) > S(b); });
+      // clang-format on
+
+    // Mask selects between the operands instead of disabling elements.
+    case O::Merge:
+    case O::Move: {
+      if (!is_valid_group(f.vd, c.configuration.lmul_log2) || (f.masked && f.vd == 0)) {
+        return Status::UndefinedInstruction;
+      }
+      for (uint64_t i = 0; i < c.vl; ++i) {
+        const auto use_operand = operation == O::Move || read_mask(state, 0, i);
+        const auto value = use_operand ? operand(i) : read_element<T>(state, f.vs2, i);
+        write_element<T>(state, f.vd, i, value);
+      }
+      return Status::Completed;
+    }
+
+    case O::SlideUp: {
+      if (!c.valid_destination_group() || groups_overlap(f.vd, f.vs2, c.configuration.lmul_log2)) {
+        return Status::UndefinedInstruction;
+      }
+      for (uint64_t i = std::min(scalar, c.vl); i < c.vl; ++i) {
+        if (c.active(i)) {
+          write_element<T>(state, f.vd, i, read_element<T>(state, f.vs2, i - scalar));
+        }
+      }
+      return Status::Completed;
+    }
+
+    // Source elements are read before they are overwritten so the groups can overlap.
+    case O::SlideDown: {
+      if (!c.valid_destination_group()) {
+        return Status::UndefinedInstruction;
+      }
+      const auto vlmax = c.configuration.vlmax;
+      for (uint64_t i = 0; i < c.vl; ++i) {
+        if (c.active(i)) {
+          const auto in_range = scalar < vlmax - i;
+          write_element<T>(state, f.vd, i,
+                           in_range ? read_element<T>(state, f.vs2, i + scalar) : T(0));
+        }
+      }
+      return Status::Completed;
+    }
+
+    default:
+      unreachable();
+  }
+}
+
+template <typename T>
+static uint64_t multiply_high(Operation operation, T a, T b) {
+  using S = std::make_signed_t<T>;
+  constexpr auto bits = sizeof(T) * 8;
+
+  if constexpr (sizeof(T) == sizeof(uint64_t)) {
+    switch (operation) {
+        // clang-format off
+      case Operation::Mulhu:  return Arithmetic::mulhu(a, b);
+      case Operation::Mulh:   return Arithmetic::mulh(a, b);
+      case Operation::Mulhsu: return Arithmetic::mulhsu(a, b);
+        // clang-format on
+
+      default:
+        unreachable();
+    }
+  } else {
+    switch (operation) {
+        // clang-format off
+      case Operation::Mulhu:  return (uint64_t(a) * uint64_t(b)) >> bits;
+      case Operation::Mulh:   return uint64_t(int64_t(S(a)) * int64_t(S(b))) >> bits;
+      case Operation::Mulhsu: return uint64_t(int64_t(S(a)) * int64_t(b)) >> bits;
+        // clang-format on
+
+      default:
+        unreachable();
+    }
+  }
+}
+
+// Multiplication, division, reductions and moves between scalar and vector registers.
+template <typename T>
+static Status execute_multiply(Context& c, Operation operation) {
+  using O = Operation;
+  using S = std::make_signed_t<T>;
+
+  constexpr auto bits = uint32_t(sizeof(T) * 8);
+
+  auto& state = c.state;
+  const auto& f = c.fields;
+  const auto lmul_log2 = c.configuration.lmul_log2;
+
+  const auto scalar = state.get(Register(f.vs1));
+  const auto operand = [&](uint64_t i) {
+    return f.funct3 == opmvv ? read_element<T>(state, f.vs1, i) : T(scalar);
+  };
+
+  const auto sign_extended = [](T value) { return uint64_t(int64_t(S(value))); };
+
+  // `fn` gets the `vs2` element, the `vs1`/`rs1` operand and the destination element.
+  const auto elementwise = [&](auto&& fn) {
+    if (!c.valid_destination_group() || !is_valid_group(f.vs2, lmul_log2) ||
+        (f.funct3 == opmvv && !is_valid_group(f.vs1, lmul_log2))) {
+      return Status::UndefinedInstruction;
+    }
+    for (uint64_t i = 0; i < c.vl; ++i) {
+      if (c.active(i)) {
+        const auto value =
+          fn(read_element<T>(state, f.vs2, i), operand(i), read_element<T>(state, f.vd, i));
+        write_element<T>(state, f.vd, i, T(value));
+      }
+    }
+    return Status::Completed;
+  };
+
+  // Result is written to the first element of `vd` and the first element of `vs1` is the
+  // initial value.
+  const auto reduce = [&](auto&& fn) {
+    if (!is_valid_group(f.vs2, lmul_log2)) {
+      return Status::UndefinedInstruction;
+    }
+    if (c.vl == 0) {
+      return Status::Completed;
+    }
+    auto accumulator = read_element<T>(state, f.vs1, 0);
+    for (uint64_t i = 0; i < c.vl; ++i) {
+      if (c.active(i)) {
+        accumulator = T(fn(accumulator, read_element<T>(state, f.vs2, i)));
+      }
+    }
+    write_element<T>(state, f.vd, 0, accumulator);
+    return Status::Completed;
+  };
+
+  switch (operation) {
+      // clang-format off
+    case O::Mul:  return elementwise([](T a, T b, T) { return uint64_t(a) * uint64_t(b); });
+    case O::Macc: return elementwise([](T a, T b, T d) { return uint64_t(a) * b + d; });
+    case O::Nmsac: return elementwise([](T a, T b, T d) { return d - uint64_t(a) * b; });
+    case O::Madd: return elementwise([](T a, T b, T d) { return uint64_t(d) * b + a; });
+    case O::Nmsub: return elementwise([](T a, T b, T d) { return a - uint64_t(d) * b; });
+
+    case O::Divu: return elementwise([](T a, T b, T) { return Arithmetic::divu(a, b); });
+    case O::Remu: return elementwise([](T a, T b, T) { return Arithmetic::remu(a, b); });
+    case O::Div: {
+      return elementwise(
+        [&](T a, T b, T) { return Arithmetic::div(sign_extended(a), sign_extended(b)); });
+    }
+    case O::Rem: {
+      return elementwise(
+        [&](T a, T b, T) { return Arithmetic::rem(sign_extended(a), sign_extended(b)); });
+    }
+
+    case O::Redsum:  return reduce([](T a, T b) { return a + b; });
+    case O::Redand:  return reduce([](T a, T b) { return a & b; });
+    case O::Redor:   return reduce([](T a, T b) { return a | b; });
+    case O::Redxor:  return reduce([](T a, T b) { return a ^ b; });
+    case O::Redminu: return reduce([](T a, T b) { return std::min(a, b); });
+    case O::Redmin:  return reduce([](T a, T b) { return S(a) < S(b) ? a : b; });
+    case O::Redmaxu: return reduce([](T a, T b) { return std::max(a, b); });
+    case O::Redmax:  return reduce([](T a, T b) { return S(a) > S(b) ? a : b; });
+      // clang-format on
+
+    case O::Mulhu:
+    case O::Mulh:
+    case O::Mulhsu: {
+      return elementwise([&](T a, T b, T) { return multiply_high<T>(operation, a, b); });
+    }
+
+    // Moves of the first element ignore the vector length (except writes when it's zero).
+    case O::MoveToScalar: {
+      if (f.masked) {
+        return Status::UndefinedInstruction;
+      }
+      state.set(Register(f.vd), sign_extend(read_element<T>(state, f.vs2, 0), bits));
+      return Status::Completed;
+    }
+    case O::MoveFromScalar: {
+      if (f.masked) {
+        return Status::UndefinedInstruction;
+      }
+      if (c.vl > 0) {
+        write_element<T>(state, f.vd, 0, T(scalar));
+      }
+      return Status::Completed;
+    }
+
+    case O::Id: {
+      if (!c.valid_destination_group()) {
+        return Status::UndefinedInstruction;
+      }
+      for (uint64_t i = 0; i < c.vl; ++i) {
+        if (c.active(i)) {
+          write_element<T>(state, f.vd, i, T(i));
+        }
+      }
+      return Status::Completed;
+    }
+
+    default:
+      unreachable();
+  }
+}
+
+// Mask operations don't depend on the element width.
+static Status execute_mask(Context& c, Operation operation) {
+  using O = Operation;
+
+  auto& state = c.state;
+  const auto& f = c.fields;
+
+  const auto logical = [&](auto&& fn) {
+    if (f.masked) {
+      return Status::UndefinedInstruction;
+    }
+    for (uint64_t i = 0; i < c.vl; ++i) {
+      write_mask(state, f.vd, i, fn(read_mask(state, f.vs2, i), read_mask(state, f.vs1, i)));
+    }
+    return Status::Completed;
+  };
+
+  switch (operation) {
+      // clang-format off
+    case O::Mandn: return logical([](bool a, bool b) { return a && !b; });
+    case O::Mand:  return logical([](bool a, bool b) { return a && b; });
+    case O::Mor:   return logical([](bool a, bool b) { return a || b; });
+    case O::Mxor:  return logical([](bool a, bool b) { return a != b; });
+    case O::Morn:  return logical([](bool a, bool b) { return a || !b; });
+    case O::Mnand: return logical([](bool a, bool b) { return !(a && b); });
+    case O::Mnor:  return logical([](bool a, bool b) { return !(a || b); });
+    case O::Mxnor: return logical([](bool a, bool b) { return a == b; });
+      // clang-format on
+
+    case O::Cpop: {
+      uint64_t count = 0;
+      for (uint64_t i = 0; i < c.vl; ++i) {
+        count += c.active(i) && read_mask(state, f.vs2, i);
+      }
+      state.set(Register(f.vd), count);
+      return Status::Completed;
+    }
+
+    case O::First: {
+      auto first = ~uint64_t(0);
+      for (uint64_t i = 0; i < c.vl; ++i) {
+        if (c.active(i) && read_mask(state, f.vs2, i)) {
+          first = i;
+          break;
+        }
+      }
+      state.set(Register(f.vd), first);
+      return Status::Completed;
+    }
+
+    default:
+      unreachable();
+  }
+}
+
+static bool is_rounded_float_operation(Operation operation) {
+  using O = Operation;
+
+  switch (operation) {
+    case O::Fadd:
+    case O::Fsub:
+    case O::Frsub:
+    case O::Fmul:
+    case O::Fdiv:
+    case O::Frdiv:
+    case O::Fmacc:
+    case O::Fnmacc:
+    case O::Fmsac:
+    case O::Fnmsac:
+    case O::Fmadd:
+    case O::Fnmadd:
+    case O::Fmsub:
+    case O::Fnmsub:
+    case O::Fredusum:
+    case O::Fredosum:
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+// Floating point operations on raw `T` elements (`uint32_t` for single precision and `uint64_t`
+// for double precision values). Element operations are done by `FloatArithmetic`.
+template <typename T>
+static Status execute_float(Context& c, Operation operation) {
+  using O = Operation;
+
+  constexpr auto double_precision = sizeof(T) == sizeof(uint64_t);
+
+  auto& state = c.state;
+  const auto& f = c.fields;
+  const auto lmul_log2 = c.configuration.lmul_log2;
+
+  // Single precision scalars which are not properly NaN-boxed are read as the canonical NaN.
+  auto scalar = T(state.get(FloatRegister(f.vs1)));
+  if (!double_precision && (state.get(FloatRegister(f.vs1)) >> 32) != 0xffff'ffff) {
+    scalar = T(0x7fc0'0000);
+  }
+
+  const auto operand = [&](uint64_t i) {
+    return f.funct3 == opfvv ? read_element<T>(state, f.vs1, i) : scalar;
+  };
+  const auto element = [&](InstructionType type, T a, T b, T c = 0) {
+    return T(FloatArithmetic::execute_element(state, type, double_precision, a, b, c));
+  };
+
+  if (!is_valid_group(f.vs2, lmul_log2) ||
+      (f.funct3 == opfvv && !is_valid_group(f.vs1, lmul_log2))) {
+    return Status::UndefinedInstruction;
+  }
+
+  // `fn` gets the `vs2` element, the `vs1`/`rs1` operand and the destination element.
+  const auto elementwise = [&](auto&& fn) {
+    if (!c.valid_destination_group()) {
+      return Status::UndefinedInstruction;
+    }
+    for (uint64_t i = 0; i < c.vl; ++i) {
+      if (c.active(i)) {
+        const auto value =
+          fn(read_element<T>(state, f.vs2, i), operand(i), read_element<T>(state, f.vd, i));
+        write_element<T>(state, f.vd, i, value);
+      }
+    }
+    return Status::Completed;
+  };
+
+  // `vfmacc` family multiplies `vs1` and `vs2`, `vfmadd` family multiplies `vs1` and `vd`.
+  const auto multiply_add = [&](InstructionType type, bool multiply_destination) {
+    return elementwise([&](T a, T b, T d) {
+      return multiply_destination ? element(type, b, d, a) : element(type, b, a, d);
+    });
+  };
+
+  const auto compare = [&](auto&& fn) {
+    for (uint64_t i = 0; i < c.vl; ++i) {
+      if (c.active(i)) {
+        write_mask(state, f.vd, i, fn(read_element<T>(state, f.vs2, i), operand(i)) != 0);
+      }
+    }
+    return Status::Completed;
+  };
+
+  // Unordered sums are done in order too.
+  const auto reduce = [&](InstructionType type) {
+    if (c.vl == 0) {
+      return Status::Completed;
+    }
+    auto accumulator = read_element<T>(state, f.vs1, 0);
+    for (uint64_t i = 0; i < c.vl; ++i) {
+      if (c.active(i)) {
+        accumulator = element(type, accumulator, read_element<T>(state, f.vs2, i));
+      }
+    }
+    write_element<T>(state, f.vd, 0, accumulator);
+    return Status::Completed;
+  };
+
+  switch (operation) {
+      // clang-format off
+    case O::Fadd:   return elementwise([&](T a, T b, T) { return element(IT::FaddS, a, b); });
+    case O::Fsub:   return elementwise([&](T a, T b, T) { return element(IT::FsubS, a, b); });
+    case O::Frsub:  return elementwise([&](T a, T b, T) { return element(IT::FsubS, b, a); });
+    case O::Fmul:   return elementwise([&](T a, T b, T) { return element(IT::FmulS, a, b); });
+    case O::Fdiv:   return elementwise([&](T a, T b, T) { return element(IT::FdivS, a, b); });
+    case O::Frdiv:  return elementwise([&](T a, T b, T) { return element(IT::FdivS, b, a); });
+    case O::Fmin:   return elementwise([&](T a, T b, T) { return element(IT::FminS, a, b); });
+    case O::Fmax:   return elementwise([&](T a, T b, T) { return element(IT::FmaxS, a, b); });
+    case O::Fsgnj:  return elementwise([&](T a, T b, T) { return element(IT::FsgnjS, a, b); });
+    case O::Fsgnjn: return elementwise([&](T a, T b, T) { return element(IT::FsgnjnS, a, b); });
+    case O::Fsgnjx: return elementwise([&](T a, T b, T) { return element(IT::FsgnjxS, a, b); });
+
+    case O::Fmacc:  return multiply_add(IT::FmaddS, false);
+    case O::Fnmacc: return multiply_add(IT::FnmaddS, false);
+    case O::Fmsac:  return multiply_add(IT::FmsubS, false);
+    case O::Fnmsac: return multiply_add(IT::FnmsubS, false);
+    case O::Fmadd:  return multiply_add(IT::FmaddS, true);
+    case O::Fnmadd: return multiply_add(IT::FnmaddS, true);
+    case O::Fmsub:  return multiply_add(IT::FmsubS, true);
+    case O::Fnmsub: return multiply_add(IT::FnmsubS, true);
+
+    case O::Mfeq: return compare([&](T a, T b) { return element(IT::FeqS, a, b); });
+    case O::Mfle: return compare([&](T a, T b) { return element(IT::FleS, a, b); });
+    case O::Mflt: return compare([&](T a, T b) { return element(IT::FltS, a, b); });
+    case O::Mfne: return compare([&](T a, T b) { return T(element(IT::FeqS, a, b) == 0); });
+    case O::Mfgt: return compare([&](T a, T b) { return element(IT::FltS, b, a); });
+    case O::Mfge: return compare([&](T a, T b) { return element(IT::FleS, b, a); });
+
+    case O::Fredusum: return reduce(IT::FaddS);
+    case O::Fredosum: return reduce(IT::FaddS);
+    case O::Fredmin:  return reduce(IT::FminS);
+    case O::Fredmax:  return reduce(IT::FmaxS);
+      // clang-format on
+
+    case O::FmoveToScalar: {
+      if (f.masked) {
+        return Status::UndefinedInstruction;
+      }
+      const auto value = read_element<T>(state, f.vs2, 0);
+      state.set(FloatRegister(f.vd), double_precision ? value : FloatArithmetic::box(value));
+      return Status::Completed;
+    }
+    case O::FmoveFromScalar: {
+      if (f.masked) {
+        return Status::UndefinedInstruction;
+      }
+      if (c.vl > 0) {
+        write_element<T>(state, f.vd, 0, scalar);
+      }
+      return Status::Completed;
+    }
+
+    // Mask selects between the operands instead of disabling elements.
+    case O::Fmerge:
+    case O::Fmove: {
+      if (!is_valid_group(f.vd, lmul_log2) || (f.masked && f.vd == 0)) {
+        return Status::UndefinedInstruction;
+      }
+      for (uint64_t i = 0; i < c.vl; ++i) {
+        const auto use_scalar = operation == O::Fmove || read_mask(state, 0, i);
+        write_element<T>(state, f.vd, i, use_scalar ? scalar : read_element<T>(state, f.vs2, i));
+      }
+      return Status::Completed;
+    }
+
+    default:
+      unreachable();
+  }
+}
+
+static Status execute_operation(RegisterState& state, uint32_t encoding) {
+  const Fields fields(encoding);
+
+  const auto info = decode_operation(fields);
+  const auto configuration = parse_vtype(state.vtype());
+  if (!info || !configuration) {
+    return Status::UndefinedInstruction;
+  }
+
+  Context context{
+    .state = state,
+    .fields = fields,
+    .configuration = *configuration,
+    .vl = state.vl(),
+  };
+
+  const auto operation = info->operation;
+
+  switch (fields.funct3) {
+    case opivv:
+    case opivx:
+    case opivi: {
+      return with_element_type(configuration->sew_log2, [&]<typename T>(T) {
+        return execute_integer<T>(context, operation);
+      });
+    }
+
+    case opmvv:
+    case opmvx: {
+      if (operation >= Operation::Mandn && operation <= Operation::First) {
+        return execute_mask(context, operation);
+      }
+      return with_element_type(configuration->sew_log2, [&]<typename T>(T) {
+        return execute_multiply<T>(context, operation);
+      });
+    }
+
+    case opfvv:
+    case opfvf: {
+      const auto frm = state.fcsr() >> 5;
+      if (is_rounded_float_operation(operation) &&
+          frm > uint32_t(Instruction::RoundingMode::NearestMaxMagnitude)) {
+        return Status::UndefinedInstruction;
+      }
+
+      switch (configuration->sew_log2) {
+          // clang-format off
+        case 2: return execute_float<uint32_t>(context, operation);
+        case 3: return execute_float<uint64_t>(context, operation);
+          // clang-format on
+
+        default:
+          return Status::UndefinedInstruction;
+      }
+    }
+
+    default:
+      unreachable();
+  }
+}
+
+static void set_configuration(RegisterState& state, const Instruction& instruction) {
+  const auto encoding = instruction.vector_encoding();
+
+  uint64_t vtype = 0;
+  uint64_t avl = 0;
+
+  switch (instruction.type()) {
+    case IT::Vsetvli:
+    case IT::Vsetvl: {
+      vtype = instruction.type() == IT::Vsetvli ? (encoding >> 20) & 0x7ff
+                                                 : state.get(instruction.rs2());
+
+      // `rs1` = zero requests the maximum vector length or keeps the current one if `rd` is also
+      // zero.
+      if (instruction.rs1() != Register::Zero) {
+        avl = state.get(instruction.rs1());
+      } else if (instruction.rd() != Register::Zero) {
+        avl = ~uint64_t(0);
+      } else {
+        avl = state.vl();
+      }
+      break;
+    }
+
+    case IT::Vsetivli: {
+      vtype = (encoding >> 20) & 0x3ff;
+      avl = uint64_t(instruction.rs1());
+      break;
+    }
+
+    default:
+      unreachable();
+  }
+
+  const auto vlmax = VectorArithmetic::max_vector_length(vtype);
+  if (vlmax == 0) {
+    state.set_vector_configuration(0, RegisterState::vtype_illegal);
+  } else {
+    state.set_vector_configuration(std::min(avl, vlmax), vtype);
+  }
+
+  state.set(instruction.rd(), state.vl());
+}
+
+static Status execute_memory(RegisterState& state,
+                             Memory& memory,
+                             const Instruction& instruction,
+                             uint64_t& faulty_address) {
+  const auto type = instruction.type();
+  const auto encoding = instruction.vector_encoding();
+
+  const auto load = type == IT::VectorLoad || type == IT::VectorLoadStrided;
+  const auto strided = type == IT::VectorLoadStrided || type == IT::VectorStoreStrided;
+
+  // Data register is `vd` for loads and `vs3` for stores (both are at the same position).
+  const auto vd = (encoding >> 7) & 0b11111;
+  const auto width = (encoding >> 12) & 0b111;
+  const auto lumop = (encoding >> 20) & 0b11111;
+  const auto masked = ((encoding >> 25) & 1) == 0;
+  const auto nf = encoding >> 29;
+
+  uint32_t eew_log2 = 0;
+  switch (width) {
+      // clang-format off
+    case 0b000: eew_log2 = 0; break;
+    case 0b101: eew_log2 = 1; break;
+    case 0b110: eew_log2 = 2; break;
+    case 0b111: eew_log2 = 3; break;
+      // clang-format on
+
+    default:
+      return Status::UndefinedInstruction;
+  }
+
+  const auto whole_register = !strided && lumop == 0b01000;
+  const auto mask = !strided && lumop == 0b01011;
+  const auto fault_only_first = !strided && lumop == 0b10000;
+
+  const auto size = uint64_t(1) << eew_log2;
+
+  auto stride = size;
+  uint64_t count = 0;
+
+  if (whole_register) {
+    // Whole register accesses don't depend on `vtype`.
+    const auto registers = nf + 1;
+    if (masked || vd % registers != 0) {
+      return Status::UndefinedInstruction;
+    }
+    count = registers * vlenb / size;
+  } else {
+    const auto configuration = parse_vtype(state.vtype());
+    if (!configuration) {
+      return Status::UndefinedInstruction;
+    }
+
+    if (mask) {
+      if (masked) {
+        return Status::UndefinedInstruction;
+      }
+      count = (state.vl() + 7) / 8;
+    } else {
+      const auto emul_log2 = configuration->lmul_log2 + int32_t(eew_log2) -
+                             int32_t(configuration->sew_log2);
+      if (emul_log2 < -3 || emul_log2 > 3 || !is_valid_group(vd, emul_log2) ||
+          (load && masked && vd == 0)) {
+        return Status::UndefinedInstruction;
+      }
+
+      count = state.vl();
+      if (strided) {
+        stride = state.get(instruction.rs2());
+      }
+    }
+  }
+
+  const auto base = state.get(instruction.rs1());
+  const auto flags = load ? MemoryFlags::Read : MemoryFlags::Write;
+
+  const auto active = [&](uint64_t i) { return !masked || read_mask(state, 0, i); };
+  const auto address = [&](uint64_t i) { return base + i * stride; };
+
+  // All elements are validated before accessing any of them so faulting instructions don't
+  // have side effects.
+  const auto contiguous = !masked && stride == size;
+  if (!contiguous || !memory.verify_permissions(base, count * size, flags)) {
+    for (uint64_t i = 0; i < count; ++i) {
+      if (active(i) && !memory.verify_permissions(address(i), size, flags)) {
+        if (fault_only_first && i > 0) {
+          state.set_vector_configuration(i, state.vtype());
+          count = i;
+          break;
+        }
+
+        faulty_address = address(i);
+        return load ? Status::MemoryReadFault : Status::MemoryWriteFault;
+      }
+    }
+  }
+
+  const auto data = state.vector_register(vd);
+
+  if (contiguous) {
+    if (load) {
+      memory.read(base, data, count * size);
+    } else {
+      memory.write(base, data, count * size);
+    }
+  } else {
+    for (uint64_t i = 0; i < count; ++i) {
+      if (active(i)) {
+        if (load) {
+          memory.read(address(i), data + i * size, size);
+        } else {
+          memory.write(address(i), data + i * size, size);
+        }
+      }
+    }
+  }
+
+  return Status::Completed;
+}
+
+bool VectorArithmetic::is_vector_instruction(InstructionType type) {
+  return uint32_t(type) >= uint32_t(IT::Vsetvli) &&
+         uint32_t(type) <= uint32_t(IT::VectorMoveToScalar);
+}
+
+uint64_t VectorArithmetic::max_vector_length(uint64_t vtype) {
+  const auto configuration = parse_vtype(vtype);
+  return configuration ? configuration->vlmax : 0;
+}
+
+Status VectorArithmetic::execute(RegisterState& state,
+                                 Memory& memory,
+                                 const Instruction& instruction,
+                                 uint64_t& faulty_address) {
+  switch (instruction.type()) {
+    case IT::Vsetvli:
+    case IT::Vsetivli:
+    case IT::Vsetvl: {
+      set_configuration(state, instruction);
+      return Status::Completed;
+    }
+
+    case IT::VectorLoad:
+    case IT::VectorStore:
+    case IT::VectorLoadStrided:
+    case IT::VectorStoreStrided:
+      return execute_memory(state, memory, instruction, faulty_address);
+
+    case IT::VectorOperation:
+    case IT::VectorOperationScalar:
+    case IT::VectorMoveToScalar:
+      return execute_operation(state, instruction.vector_encoding());
+
+    default:
+      unreachable();
+  }
+}
+
+uint64_t VectorArithmetic::execute_raw(RegisterState* state,
+                                       uint64_t raw_instruction,
+                                       Memory* memory) {
+  uint64_t faulty_address = 0;
+  return uint64_t(execute(*state, *memory, Instruction::from_raw(raw_instruction), faulty_address));
+}
+
+bool VectorArithmetic::read_csr(const RegisterState& state, uint32_t csr, uint64_t& value) {
+  switch (csr) {
+      // clang-format off
+    case csr_vstart: value = 0; return true;
+    case csr_vl:     value = state.vl(); return true;
+    case csr_vtype:  value = state.vtype(); return true;
+    case csr_vlenb:  value = vlenb; return true;
+      // clang-format on
+
+    default:
+      return false;
+  }
+}
+
+bool VectorArithmetic::write_csr(RegisterState& state, uint32_t csr, uint64_t value) {
+  // Instructions always start from the first element so `vstart` writes are ignored.
+  return csr == csr_vstart;
+}
+
+void VectorArithmetic::format_instruction(const Instruction& instruction,
+                                          std::string& formatted) {
+  const auto type = instruction.type();
+  const auto encoding = instruction.vector_encoding();
+  const Fields f(encoding);
+
+  auto inserter = std::back_inserter(formatted);
+
+  const auto mask_suffix = f.masked ? ", v0.t" : "";
+
+  switch (type) {
+    case IT::Vsetvli: {
+      base::format_to(inserter, "vsetvli {}, {}, {:#x}", instruction.rd(), instruction.rs1(),
+                      (encoding >> 20) & 0x7ff);
+      return;
+    }
+    case IT::Vsetivli: {
+      base::format_to(inserter, "vsetivli {}, {}, {:#x}", instruction.rd(), f.vs1,
+                      (encoding >> 20) & 0x3ff);
+      return;
+    }
+    case IT::Vsetvl: {
+      base::format_to(inserter, "vsetvl {}, {}, {}", instruction.rd(), instruction.rs1(),
+                      instruction.rs2());
+      return;
+    }
+
+    case IT::VectorLoad:
+    case IT::VectorStore:
+    case IT::VectorLoadStrided:
+    case IT::VectorStoreStrided: {
+      const auto load = type == IT::VectorLoad || type == IT::VectorLoadStrided;
+      const auto width = (encoding >> 12) & 0b111;
+      const auto eew = width == 0 ? 8 : (8 << (width - 4));
+      const auto prefix = load ? "vl" : "vs";
+
+      if (type == IT::VectorLoadStrided || type == IT::VectorStoreStrided) {
+        base::format_to(inserter, "{}se{}.v v{}, ({}), {}{}", prefix, eew, f.vd,
+                        instruction.rs1(), instruction.rs2(), mask_suffix);
+        return;
+      }
+
+      switch (f.vs2) {
+        case 0b01000: {
+          const auto registers = (encoding >> 29) + 1;
+          if (load) {
+            base::format_to(inserter, "vl{}re{}.v v{}, ({})", registers, eew, f.vd,
+                            instruction.rs1());
+          } else {
+            base::format_to(inserter, "vs{}r.v v{}, ({})", registers, f.vd, instruction.rs1());
+          }
+          return;
+        }
+        case 0b01011: {
+          base::format_to(inserter, "{}m.v v{}, ({})", prefix, f.vd, instruction.rs1());
+          return;
+        }
+        default: {
+          const auto suffix = f.vs2 == 0b10000 ? "ff" : "";
+          base::format_to(inserter, "{}e{}{}.v v{}, ({}){}", prefix, eew, suffix, f.vd,
+                          instruction.rs1(), mask_suffix);
+          return;
+        }
+      }
+    }
+
+    default:
+      break;
+  }
+
+  const auto info = decode_operation(f);
+  if (!info) {
+    base::format_to(inserter, "vector {:#010x}", encoding);
+    return;
+  }
+
+  if (type == IT::VectorMoveToScalar) {
+    base::format_to(inserter, "{} {}, v{}{}", info->name, instruction.rd(), f.vs2, mask_suffix);
+    return;
+  }
+
+  std::string_view suffix;
+  std::string operand;
+
+  switch (f.funct3) {
+      // clang-format off
+    case opivv: case opmvv: case opfvv: suffix = ".vv"; operand = base::format("v{}", f.vs1); break;
+    case opivx: case opmvx: suffix = ".vx"; operand = base::format("{}", instruction.rs1()); break;
+    case opivi: suffix = ".vi"; operand = base::format("{}", int64_t(sign_extend(f.vs1, 5))); break;
+    case opfvf: suffix = ".vf"; operand = base::format("{}", FloatRegister(f.vs1)); break;
+      // clang-format on
+
+    default:
+      unreachable();
+  }
+
+  base::format_to(inserter, "{}{} v{}, v{}, {}{}", info->name, info->suffixed ? suffix : "", f.vd,
+                  f.vs2, operand, mask_suffix);
+}
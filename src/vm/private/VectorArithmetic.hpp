@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+#include <vm/Instruction.hpp>
+#include <vm/RegisterState.hpp>
+
+namespace vm {
+
+class Memory;
+
+// Subset of the RVV 1.0 vector extension (VLEN = 128, ELEN = 64) shared by the interpreter and
+// the JIT. It covers configuration instructions, unit-stride, strided, mask and whole register
+// loads and stores, and common integer, mask and floating point operations and reductions.
+// Tail and inactive elements are always left undisturbed (which is allowed for the agnostic
+// policies) and `vstart` is always zero.
+class VectorArithmetic {
+ public:
+  enum class Status {
+    Completed,
+    UndefinedInstruction,
+    MemoryReadFault,
+    MemoryWriteFault,
+  };
+
+  static bool is_vector_instruction(InstructionType type);
+
+  // Maximum vector length for `vtype`, zero if the configuration is not supported.
+  static uint64_t max_vector_length(uint64_t vtype);
+
+  // Scalar operands are read from `state` and scalar results are written to it. Instructions
+  // which fault don't have any side effects so they can be executed again (fault-only-first
+  // loads shorten the vector length instead of faulting on elements other than the first one).
+  static Status execute(RegisterState& state,
+                        Memory& memory,
+                        const Instruction& instruction,
+                        uint64_t& faulty_address);
+
+  // Called by the generated code, `raw_instruction` comes from `Instruction::raw()` and the
+  // result is `Status`.
+  static uint64_t execute_raw(RegisterState* state, uint64_t raw_instruction, Memory* memory);
+
+  // Vector CSRs (vstart, vl, vtype and vlenb). Return false for other CSRs and for writes to the
+  // read-only ones.
+  static bool read_csr(const RegisterState& state, uint32_t csr, uint64_t& value);
+  static bool write_csr(RegisterState& state, uint32_t csr, uint64_t value);
+
+  static void format_instruction(const Instruction& instruction, std::string& formatted);
+};
+
+}  // namespace vm